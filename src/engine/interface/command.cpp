@@ -285,13 +285,168 @@ double ident::getnumber() const
     return ::getnumber(val, valtype);
 }
 
+/* string pool
+ *
+ * nearly every string valued tagval the interpreter makes is a short lived
+ * temporary: concatenated and formatted results, numbers forced to strings,
+ * copies of looked up values. Rather than deleting small strings in freearg()
+ * and allocating new ones for the next temporary, freed buffers are kept in
+ * free lists by size and handed back out by newpoolstring()
+ *
+ * pooled buffers are still allocated with new[], so a string may leave the
+ * interpreter (e.g. as an alias value) and be deleted anywhere as before. The
+ * real size of a freed buffer is not known, only that it holds its string, so
+ * it is filed under the largest size class no longer than its string
+ */
+static void clearstringpool();
+
+VARF(csstringpool, 0, 1, 1, if(!csstringpool) clearstringpool());
+
+namespace
+{
+    constexpr int exactstringclasses = 32, //one class for every size up to this
+                  maxpooledstrings = 64;   //per size class
+    constexpr int largestringclasses[] = {48, 64, 96, 128, 192, 256};
+    constexpr int numstringclasses = exactstringclasses + sizeof(largestringclasses)/sizeof(largestringclasses[0]),
+                  maxpooledsize = largestringclasses[sizeof(largestringclasses)/sizeof(largestringclasses[0]) - 1];
+
+    std::vector<char *> stringpool[numstringclasses];
+
+    struct
+    {
+        uint heapallocs, poolallocs, heapfrees, poolfrees;
+    } stringstats = {0, 0, 0, 0};
+
+    int stringclasssize(int c)
+    {
+        return c < exactstringclasses ? c + 1 : largestringclasses[c - exactstringclasses];
+    }
+
+    //smallest class holding buffers of at least size bytes
+    int stringclassabove(int size)
+    {
+        if(size <= exactstringclasses)
+        {
+            return size - 1;
+        }
+        int c = exactstringclasses;
+        while(stringclasssize(c) < size)
+        {
+            c++;
+        }
+        return c;
+    }
+
+    //largest class whose buffers are no longer than size bytes
+    int stringclassbelow(int size)
+    {
+        if(size <= exactstringclasses)
+        {
+            return size - 1;
+        }
+        int c = numstringclasses - 1;
+        while(stringclasssize(c) > size)
+        {
+            c--;
+        }
+        return c;
+    }
+}
+
+static void clearstringpool()
+{
+    for(std::vector<char *> &pool : stringpool)
+    {
+        for(char *s : pool)
+        {
+            delete[] s;
+        }
+        pool.clear();
+    }
+}
+
+//returns an empty string with room for len characters, in the manner of newstring(len)
+static char *newpoolstring(size_t len)
+{
+    int size = static_cast<int>(std::min(len, static_cast<size_t>(maxpooledsize))) + 1;
+    if(!csstringpool || size > maxpooledsize)
+    {
+        stringstats.heapallocs++;
+        char *s = new char[len + 1];
+        s[0] = '\0';
+        return s;
+    }
+    //a slightly larger buffer is better than going to the heap
+    int c = stringclassabove(size);
+    for(int last = std::min(c + 4, numstringclasses - 1); c <= last; ++c)
+    {
+        if(!stringpool[c].empty())
+        {
+            stringstats.poolallocs++;
+            char *s = stringpool[c].back();
+            stringpool[c].pop_back();
+            s[0] = '\0';
+            return s;
+        }
+    }
+    stringstats.heapallocs++;
+    char *s = new char[stringclasssize(stringclassabove(size))];
+    s[0] = '\0';
+    return s;
+}
+
+static char *newpoolstring(const char *str, size_t len)
+{
+    char *s = newpoolstring(len);
+    std::memcpy(s, str, len);
+    s[len] = '\0';
+    return s;
+}
+
+static char *newpoolstring(const char *str)
+{
+    return newpoolstring(str, std::strlen(str));
+}
+
+//deletes a string made by newpoolstring() or newstring(), or keeps it for reuse
+static void freepoolstring(char *s)
+{
+    if(csstringpool)
+    {
+        int size = static_cast<int>(std::strlen(s)) + 1;
+        if(size <= maxpooledsize)
+        {
+            std::vector<char *> &pool = stringpool[stringclassbelow(size)];
+            if(static_cast<int>(pool.size()) < maxpooledstrings)
+            {
+                stringstats.poolfrees++;
+                pool.push_back(s);
+                return;
+            }
+        }
+    }
+    stringstats.heapfrees++;
+    delete[] s;
+}
+
+//prints how the interpreter's temporary strings were allocated and freed since the last call
+static void csallocstats()
+{
+    uint allocs = stringstats.heapallocs + stringstats.poolallocs,
+         frees = stringstats.heapfrees + stringstats.poolfrees;
+    conoutf("csallocstats: %u strings allocated, %u (%.1f%%) from the heap; %u freed, %u (%.1f%%) to the heap",
+            allocs, stringstats.heapallocs, allocs ? 100.0f*stringstats.heapallocs/allocs : 0.0f,
+            frees, stringstats.heapfrees, frees ? 100.0f*stringstats.heapfrees/frees : 0.0f);
+    stringstats = {0, 0, 0, 0};
+}
+
 void freearg(tagval &v)
 {
     switch(v.type)
     {
         case Value_String:
         {
-            delete[] v.s;
+            freepoolstring(v.s);
             break;
         }
         case Value_Code:
@@ -400,7 +555,7 @@ static const char *forcestr(tagval &v)
         }
     }
     freearg(v);
-    v.setstr(newstring(s));
+    v.setstr(newpoolstring(s));
     return s;
 }
 
@@ -537,6 +692,363 @@ void clearoverrides()
 static bool initedidents = false;
 static vector<ident> *identinits = nullptr;
 
+/* hash of every ident as it was registered, in index order
+ *
+ * idents are never removed, so this identifies the state of the ident table
+ * that code was compiled against: its ident indices, and for builtins the
+ * flags and argument formats which decide how calls to them are compiled
+ */
+static uint identtablehash = 2166136261U;
+
+static uint hashstr(uint h, const char *s)
+{
+    for(const char *c = s; *c; c++)
+    {
+        h = (h^static_cast<uchar>(*c))*16777619U;
+    }
+    return h;
+}
+
+//the hash of an alias only depends on its name, so that loading can predict it
+static uint hashident(uint h, const char *name, int type)
+{
+    return (hashstr(h, name)^type)*16777619U;
+}
+
+static uint hashident(uint h, const ident &id)
+{
+    h = hashident(h, id.name, id.type);
+    if(id.type != Id_Alias)
+    {
+        h = (h^id.flags)*16777619U;
+    }
+    if(id.type == Id_Command && id.args)
+    {
+        h = hashstr(h, id.args);
+    }
+    return h;
+}
+
+/* ident lookup tables
+ *
+ * builtin commands and variables are looked up by name far more often than
+ * aliases: by the compiler for nearly every command word, and by dynamic lookups.
+ * Once registered they never change, so they are kept in a perfect hash built by
+ * hash and displace: names are hashed into buckets, and each bucket is given a
+ * displacement which sends all of its names to free slots. The table is not
+ * minimal; it keeps at least twice as many slots as names, so that displacements
+ * are quick to find and builtins registered later can usually be slotted in by
+ * moving only their own bucket. Finding a builtin takes one hash of the name and
+ * one comparison
+ *
+ * aliases are kept in an open addressed table keyed by the same hash, so a name
+ * which is not a builtin is looked up without hashing it again. Both tables are
+ * built on the first lookup and kept up to date by addident() from then on
+ *
+ * names held in bytecode (the strings pushed by Code_Macro, as for calls to
+ * aliases not yet defined when the code was compiled) are also looked up through
+ * a cache keyed by the address of the string, so that a call site which runs
+ * again finds its ident by a pointer comparison rather than by hashing; the
+ * name is still compared in case the code was freed and its memory reused
+ */
+VAR(csfastlookup, 0, 1, 1);
+
+namespace
+{
+    struct builtintable
+    {
+        std::vector<uint> displace;                //per bucket
+        std::vector<std::vector<ident *>> buckets; //the names hashed into each bucket
+        std::vector<ident *> slots;
+        uint bucketmask = 0,
+             slotmask = 0;
+        int numnames = 0;
+    } builtins;
+
+    struct aliastable
+    {
+        std::vector<ident *> slots;
+        uint slotmask = 0;
+        int numnames = 0;
+    } aliases;
+
+    bool identtablesbuilt = false;
+
+    struct identcacheentry
+    {
+        const char *name;
+        ident *id;
+    };
+    constexpr int identcachesize = 1024;
+    identcacheentry identcache[identcachesize] = {};
+
+    uint hashname(const char *s, int len)
+    {
+        uint h = 2166136261U;
+        for(int i = 0; i < len; ++i)
+        {
+            h = (h^static_cast<uchar>(s[i]))*16777619U;
+        }
+        return h;
+    }
+
+    uint hashname(const ident *id)
+    {
+        return hashname(id->name, std::strlen(id->name));
+    }
+
+    bool namematches(const ident *id, const char *s, int len)
+    {
+        return !std::strncmp(id->name, s, len) && !id->name[len];
+    }
+
+    //spreads the bits of a name's hash and a displacement over a slot index
+    uint slothash(uint h, uint displace)
+    {
+        h += displace*0x9E3779B9U;
+        h ^= h>>16;
+        h *= 0x85EBCA6BU;
+        h ^= h>>13;
+        h *= 0xC2B2AE35U;
+        h ^= h>>16;
+        return h;
+    }
+
+    //finds a displacement from d onwards sending all of bucket b's names to free slots, and fills them
+    bool placebucket(int b, uint d)
+    {
+        const std::vector<ident *> &bucket = builtins.buckets[b];
+        std::vector<uint> hashes,
+                          placed;
+        for(const ident *id : bucket)
+        {
+            hashes.push_back(hashname(id));
+        }
+        for(; d < 0x10000; d++)
+        {
+            placed.clear();
+            bool fits = true;
+            for(uint h : hashes)
+            {
+                uint slot = slothash(h, d)&builtins.slotmask;
+                if(builtins.slots[slot] || std::find(placed.begin(), placed.end(), slot) != placed.end())
+                {
+                    fits = false;
+                    break;
+                }
+                placed.push_back(slot);
+            }
+            if(fits)
+            {
+                builtins.displace[b] = d;
+                for(size_t i = 0; i < bucket.size(); ++i)
+                {
+                    builtins.slots[placed[i]] = bucket[i];
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool buildbuiltins(int numslots)
+    {
+        std::vector<ident *> names;
+        for(int i = 0; i < identmap.length(); ++i)
+        {
+            if(identmap[i]->type != Id_Alias)
+            {
+                names.push_back(identmap[i]);
+            }
+        }
+        int numbuckets = 1;
+        while(numbuckets*4 < static_cast<int>(names.size()))
+        {
+            numbuckets *= 2;
+        }
+        while(numslots < static_cast<int>(names.size())*2)
+        {
+            numslots *= 2;
+        }
+        builtins.buckets.assign(numbuckets, std::vector<ident *>());
+        for(ident *id : names)
+        {
+            builtins.buckets[hashname(id)&(numbuckets-1)].push_back(id);
+        }
+        //place the largest buckets first, while there is the most room
+        std::vector<int> order(numbuckets);
+        for(int i = 0; i < numbuckets; ++i)
+        {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [] (int a, int b) { return builtins.buckets[a].size() > builtins.buckets[b].size(); });
+        builtins.displace.assign(numbuckets, 0);
+        builtins.slots.assign(numslots, nullptr);
+        builtins.bucketmask = numbuckets-1;
+        builtins.slotmask = numslots-1;
+        builtins.numnames = names.size();
+        for(int b : order)
+        {
+            if(!placebucket(b, 0))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void rebuildbuiltins(int numslots)
+    {
+        while(!buildbuiltins(numslots))
+        {
+            numslots = builtins.slots.size()*2;
+        }
+    }
+
+    /* insertbuiltin: adds a builtin registered after the table was built
+     *
+     * only the new name's bucket is moved to a new displacement, unless the table
+     * is getting full or no displacement fits, in which case it is rebuilt larger
+     */
+    void insertbuiltin(ident *id)
+    {
+        if((builtins.numnames+1)*2 > static_cast<int>(builtins.slots.size()))
+        {
+            rebuildbuiltins(builtins.slots.size()*2);
+            return;
+        }
+        int b = hashname(id)&builtins.bucketmask;
+        std::vector<ident *> &bucket = builtins.buckets[b];
+        for(const ident *other : bucket)
+        {
+            builtins.slots[slothash(hashname(other), builtins.displace[b])&builtins.slotmask] = nullptr;
+        }
+        bucket.push_back(id);
+        builtins.numnames++;
+        if(!placebucket(b, builtins.displace[b]) && !placebucket(b, 0))
+        {
+            rebuildbuiltins(builtins.slots.size()*2);
+        }
+    }
+
+    void insertalias(ident *id)
+    {
+        if((aliases.numnames+1)*2 > static_cast<int>(aliases.slots.size()))
+        {
+            std::vector<ident *> old;
+            old.swap(aliases.slots);
+            aliases.slots.assign(old.size()*2, nullptr);
+            aliases.slotmask = aliases.slots.size()-1;
+            aliases.numnames = 0;
+            for(ident *a : old)
+            {
+                if(a)
+                {
+                    insertalias(a);
+                }
+            }
+        }
+        uint slot = hashname(id)&aliases.slotmask;
+        while(aliases.slots[slot])
+        {
+            slot = (slot+1)&aliases.slotmask;
+        }
+        aliases.slots[slot] = id;
+        aliases.numnames++;
+    }
+
+    void buildidenttables()
+    {
+        rebuildbuiltins(16);
+        aliases.slots.assign(256, nullptr);
+        aliases.slotmask = aliases.slots.size()-1;
+        aliases.numnames = 0;
+        for(int i = 0; i < identmap.length(); ++i)
+        {
+            if(identmap[i]->type == Id_Alias)
+            {
+                insertalias(identmap[i]);
+            }
+        }
+        identtablesbuilt = true;
+    }
+
+    //keeps the lookup tables up to date with an ident added to the idents hashtable
+    void updateidenttables(ident *id)
+    {
+        if(!identtablesbuilt)
+        {
+            return;
+        }
+        if(id->type == Id_Alias)
+        {
+            insertalias(id);
+        }
+        else
+        {
+            insertbuiltin(id);
+        }
+    }
+
+    ident *findbuiltin(uint h, const char *s, int len)
+    {
+        ident *id = builtins.slots[slothash(h, builtins.displace[h&builtins.bucketmask])&builtins.slotmask];
+        return id && namematches(id, s, len) ? id : nullptr;
+    }
+
+    ident *findalias(uint h, const char *s, int len)
+    {
+        for(uint slot = h&aliases.slotmask;; slot = (slot+1)&aliases.slotmask)
+        {
+            ident *id = aliases.slots[slot];
+            if(!id || namematches(id, s, len))
+            {
+                return id;
+            }
+        }
+    }
+}
+
+//finds the ident with the given name, or returns null if there is none
+template<class T>
+static ident *findident(const T &name)
+{
+    if(!csfastlookup || !initedidents)
+    {
+        return idents.access(name);
+    }
+    if(!identtablesbuilt)
+    {
+        buildidenttables();
+    }
+    const char *s = stringptr(name);
+    int len = stringlen(name);
+    uint h = hashname(s, len);
+    ident *id = findbuiltin(h, s, len);
+    return id ? id : findalias(h, s, len);
+}
+
+//findident() for names stored in bytecode, which stay at the same address between runs
+static ident *findcodeident(const char *name)
+{
+    if(!csfastlookup)
+    {
+        return idents.access(name);
+    }
+    identcacheentry &entry = identcache[(reinterpret_cast<size_t>(name)>>2)&(identcachesize-1)];
+    if(entry.name == name && !std::strcmp(entry.id->name, name))
+    {
+        return entry.id;
+    }
+    ident *id = findident(name);
+    if(id)
+    {
+        entry.name = name;
+        entry.id = id;
+    }
+    return id;
+}
+
 static ident *addident(const ident &id)
 {
     if(!initedidents)
@@ -550,7 +1062,10 @@ static ident *addident(const ident &id)
     }
     ident &def = idents.access(id.name, id);
     def.index = identmap.length();
-    return identmap.add(&def);
+    identtablehash = hashident(identtablehash, def);
+    identmap.add(&def);
+    updateidenttables(&def);
+    return &def;
 }
 
 ident *newident(const char *name, int flags = 0);
@@ -646,12 +1161,14 @@ static void dodebugalias()
     }
 }
 
-static int nodebug = 0;
+static int nodebug = 0,
+           numcodeerrors = 0; //errors reported by debugcode, so that compiling can tell whether it had any
 
 static void debugcode(const char *fmt, ...) PRINTFARGS(1, 2);
 
 static void debugcode(const char *fmt, ...)
 {
+    numcodeerrors++;
     if(nodebug)
     {
         return;
@@ -668,6 +1185,7 @@ static void debugcodeline(const char *p, const char *fmt, ...) PRINTFARGS(2, 3);
 
 static void debugcodeline(const char *p, const char *fmt, ...)
 {
+    numcodeerrors++;
     if(nodebug)
     {
         return;
@@ -699,7 +1217,7 @@ void poparg(ident &id)
     identstack *stack = id.stack;
     if(id.valtype == Value_String)
     {
-        delete[] id.val.s;
+        freepoolstring(id.val.s);
     }
     id.setval(*stack);
     cleancode(id);
@@ -789,7 +1307,7 @@ static bool checknumber(const stringslice &s)
 template<class T>
 static ident *newident(const T &name, int flags)
 {
-    ident *id = idents.access(name);
+    ident *id = findident(name);
     if(!id)
     {
         if(checknumber(name))
@@ -820,7 +1338,7 @@ static ident *forceident(tagval &v)
         case Value_String:
         {
             ident *id = newident(v.s, Idf_Unknown);
-            delete[] v.s;
+            freepoolstring(v.s);
             v.setident(id);
             return id;
         }
@@ -848,7 +1366,7 @@ ident *writeident(const char *name, int flags)
 
 static void resetvar(char *name)
 {
-    ident *id = idents.access(name);
+    ident *id = findident(name);
     if(!id)
     {
         return;
@@ -869,7 +1387,7 @@ void setarg(ident &id, tagval &v)
     {
         if(id.valtype == Value_String)
         {
-            delete[] id.val.s;
+            freepoolstring(id.val.s);
         }
         id.setval(v);
         cleancode(id);
@@ -885,7 +1403,7 @@ void setalias(ident &id, tagval &v)
 {
     if(id.valtype == Value_String)
     {
-        delete[] id.val.s;
+        freepoolstring(id.val.s);
     }
     id.setval(v);
     cleancode(id);
@@ -894,7 +1412,7 @@ void setalias(ident &id, tagval &v)
 
 static void setalias(const char *name, tagval &v)
 {
-    ident *id = idents.access(name);
+    ident *id = findident(name);
     if(id)
     {
         switch(id->type)
@@ -1009,7 +1527,7 @@ hashnameset<DefVar> defvars;
  */
 ident* getvar(int vartype, const char *name)
 {
-    ident *id = idents.access(name);
+    ident *id = findident(name);
     if(!id || id->type!=vartype)
     {
         return nullptr;
@@ -1199,17 +1717,17 @@ float getfvarmax(const char *name)
 
 bool identexists(const char *name)
 {
-    return idents.access(name) != nullptr;
+    return findident(name) != nullptr;
 }
 
 ident *getident(const char *name)
 {
-    return idents.access(name);
+    return findident(name);
 }
 
 void touchvar(const char *name)
 {
-    ident *id = idents.access(name);
+    ident *id = findident(name);
     if(id) switch(id->type)
     {
         case Id_Var:
@@ -1224,7 +1742,7 @@ void touchvar(const char *name)
 
 const char *getalias(const char *name)
 {
-    ident *i = idents.access(name);
+    ident *i = findident(name);
     return i && i->type==Id_Alias && (i->index >= Max_Args || aliasstack->usedargs&(1<<i->index)) ? i->getstr() : "";
 }
 
@@ -1643,7 +2161,7 @@ overflow:
     {
         len += std::max(prefix ? i : i-1, 0);
     }
-    char *buf = newstring(len + numlen);
+    char *buf = newpoolstring(len + numlen);
     int offset = 0,
         numoffset = 0;
     if(prefix)
@@ -1680,7 +2198,7 @@ overflow:
     if(i < n)
     {
         char *morebuf = conc(&v[i], n-i, space, buf, offset);
-        delete[] buf;
+        freepoolstring(buf);
         return morebuf;
     }
     return buf;
@@ -3167,7 +3685,7 @@ static void compilestatements(vector<uint> &code, const char *&p, int rettype, i
         }
         else
         {
-            ident *id = idents.access(idname);
+            ident *id = findident(idname);
             if(!id)
             {
                 if(!checknumber(idname))
@@ -3739,11 +4257,15 @@ static void compilestatements(vector<uint> &code, const char *&p, int rettype, i
     }
 }
 
+static void optimizecode(vector<uint> &code, int start);
+
 static void compilemain(vector<uint> &code, const char *p, int rettype = Value_Any)
 {
+    int start = code.length();
     code.add(Code_Start);
     compilestatements(code, p, Value_Any);
     code.add(Code_Exit|(rettype < Value_Any ? rettype<<Code_Ret : 0));
+    optimizecode(code, start);
 }
 
 uint *compilecode(const char *p)
@@ -3924,11 +4446,22 @@ static const uint *skipcode(const uint *code, tagval &result = noret)
             case Code_JumpFalse:
             case Code_JumpResultTrue:
             case Code_JumpResultFalse:
+            case Code_ConstArg|Ret_Integer:
+            case Code_ConstArg|Ret_Float:
             {
                 uint len = op>>8;
                 code += len;
                 continue;
             }
+            case Code_CompareJump|Ret_Null:
+            case Code_CompareJump|Ret_String:
+            case Code_CompareJump|Ret_Integer:
+            case Code_CompareJump|Ret_Float:
+            {
+                uint len = op>>12;
+                code += len;
+                continue;
+            }
             case Code_Enter:
             case Code_EnterResult:
             {
@@ -3955,22 +4488,407 @@ static const uint *skipcode(const uint *code, tagval &result = noret)
     }
 }
 
-static uint *copycode(const uint *src)
+/* bytecode optimiser
+ *
+ * optimizecode() rewrites sequences of compiled code in place, without changing
+ * its length, so that jump and block offsets stay valid; the words a
+ * superinstruction replaces are stepped over by it rather than removed. A
+ * sequence is only rewritten if no jump or block lands inside it
+ *
+ *  - a pure math command called only with constants, whose result is passed on
+ *    as an argument, is evaluated once here and becomes a Code_ConstArg
+ *  - an integer comparison against a constant which only decides a branch, as
+ *    in `if (< $i 10) [...]`, becomes a Code_CompareJump, which also takes in a
+ *    lookup of an alias or integer variable as its left operand; the right
+ *    operand may itself be a folded Code_ConstArg of any length
+ */
+VAR(csoptimize, 0, 1, 1);
+
+//where a Code_CompareJump gets its left operand, kept in its return type bits
+enum
 {
-    const uint *end = skipcode(src);
-    size_t len = end - src;
-    uint *dst = new uint[len + 1];
-    *dst++ = Code_Start;
-    std::memcpy(dst, src, len*sizeof(uint));
-    return dst;
-}
+    CompareJump_Stack  = Ret_Null,
+    CompareJump_Alias  = Ret_Integer,
+    CompareJump_IntVar = Ret_Float,
+};
 
-static void copyarg(tagval &dst, const tagval &src)
+enum
 {
-    switch(src.type)
+    Compare_Equal = 0,
+    Compare_NotEqual,
+    Compare_Less,
+    Compare_Greater,
+    Compare_LessEqual,
+    Compare_GreaterEqual,
+    Compare_NumKinds
+};
+
+static const char * const comparenames[Compare_NumKinds] = { "=", "!=", "<", ">", "<=", ">=" };
+
+//commands without side effects that take and return numbers; div and mod are left out as
+//they can trap at compile time on operands which might never be reached when running
+static const char * const foldablenames[] =
+{
+    "+", "*", "-", "=", "!=", "<", ">", "<=", ">=",
+    "^", "~", "&", "|", "^~", "&~", "|~", "<<", ">>",
+    "+f", "*f", "-f", "=f", "!=f", "<f", ">f", "<=f", ">=f",
+    "divf", "modf", "pow", "min", "max", "minf", "maxf"
+};
+
+static int comparekind(const ident *id)
+{
+    if(id->type != Id_Command)
     {
-        case Value_Integer:
-        case Value_Float:
+        return -1;
+    }
+    for(int i = 0; i < Compare_NumKinds; ++i)
+    {
+        if(!std::strcmp(id->name, comparenames[i]))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool compareints(int kind, int a, int b)
+{
+    switch(kind)
+    {
+        case Compare_Equal:
+        {
+            return a == b;
+        }
+        case Compare_NotEqual:
+        {
+            return a != b;
+        }
+        case Compare_Less:
+        {
+            return a < b;
+        }
+        case Compare_Greater:
+        {
+            return a > b;
+        }
+        case Compare_LessEqual:
+        {
+            return a <= b;
+        }
+        default:
+        {
+            return a >= b;
+        }
+    }
+}
+
+static bool foldable(const ident *id)
+{
+    if(id->type != Id_Command)
+    {
+        return false;
+    }
+    for(const char *name : foldablenames)
+    {
+        if(!std::strcmp(id->name, name))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+//number of words taken by the instruction at code, including any inline data
+static int codewords(const uint *code)
+{
+    uint op = *code;
+    switch(op&0xFF)
+    {
+        case Code_Macro:
+        case Code_Val|Ret_String:
+        {
+            return (op>>8)/sizeof(uint) + 2;
+        }
+        case Code_Val|Ret_Integer:
+        case Code_Val|Ret_Float:
+        {
+            return 2;
+        }
+        case Code_ConstArg|Ret_Integer:
+        case Code_ConstArg|Ret_Float:
+        {
+            return (op>>8) + 1;
+        }
+        case Code_CompareJump|Ret_Null:
+        case Code_CompareJump|Ret_String:
+        case Code_CompareJump|Ret_Integer:
+        case Code_CompareJump|Ret_Float:
+        {
+            return (op>>12) + 1;
+        }
+        default:
+        {
+            return 1;
+        }
+    }
+}
+
+//reads the instruction at code into v if it pushes a numeric constant
+static bool constantarg(const uint *code, tagval &v)
+{
+    uint op = *code;
+    switch(op&0xFF)
+    {
+        case Code_ValI|Ret_Integer:
+        {
+            v.setint(static_cast<int>(op)>>8);
+            return true;
+        }
+        case Code_ValI|Ret_Float:
+        {
+            v.setfloat(static_cast<float>(static_cast<int>(op)>>8));
+            return true;
+        }
+        case Code_Val|Ret_Integer:
+        case Code_ConstArg|Ret_Integer:
+        {
+            v.setint(static_cast<int>(code[1]));
+            return true;
+        }
+        case Code_Val|Ret_Float:
+        case Code_ConstArg|Ret_Float:
+        {
+            v.setfloat(*reinterpret_cast<const float *>(&code[1]));
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool hastarget(const std::vector<bool> &targets, int start, int end)
+{
+    for(int i = start+1; i <= end; ++i)
+    {
+        if(targets[i])
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* foldconstants: evaluates the command call at com, followed by the Code_ResultArg
+ * at com+1, if its arguments are the instructions before it in ops and all
+ * push constants
+ *
+ * returns the start of the rewritten sequence, or -1 if it was left alone
+ */
+static int foldconstants(vector<uint> &code, const std::vector<int> &ops, const std::vector<bool> &targets, int com)
+{
+    uint op = code[com];
+    int numargs = (op>>8)&0x1F,
+        numops = static_cast<int>(ops.size());
+    if(numargs > numops)
+    {
+        return -1;
+    }
+    ident *id = identmap[op>>13];
+    if(!foldable(id))
+    {
+        return -1;
+    }
+    int start = numargs ? ops[numops-numargs] : com;
+    if(hastarget(targets, start, com+1))
+    {
+        return -1;
+    }
+    tagval args[Max_Args];
+    for(int i = 0; i < numargs; ++i)
+    {
+        if(!constantarg(&code[ops[numops-numargs+i]], args[i]))
+        {
+            return -1;
+        }
+    }
+    tagval result,
+           *prevret = commandret;
+    result.setnull();
+    commandret = &result;
+    reinterpret_cast<comfunv>(id->fun)(args, numargs);
+    commandret = prevret;
+    forcearg(result, op&Code_RetMask);
+    forcearg(result, code[com+1]&Code_RetMask);
+    switch(result.type)
+    {
+        case Value_Integer:
+        {
+            code[start] = Code_ConstArg|Ret_Integer|((com+1-start)<<8);
+            code[start+1] = static_cast<uint>(result.i);
+            return start;
+        }
+        case Value_Float:
+        {
+            code[start] = Code_ConstArg|Ret_Float|((com+1-start)<<8);
+            std::memcpy(&code[start+1], &result.f, sizeof(uint));
+            return start;
+        }
+    }
+    freearg(result);
+    return -1;
+}
+
+/* fusecompare: turns the integer comparison against a constant whose result
+ * decides the jump at jump into a Code_CompareJump
+ *
+ * ops holds the instructions before the jump, ending with the comparison's
+ * operands, the comparison and its Code_ResultArg
+ *
+ * returns the start of the rewritten sequence, or -1 if it was left alone
+ */
+static int fusecompare(vector<uint> &code, const std::vector<int> &ops, const std::vector<bool> &targets, int jump)
+{
+    int numops = static_cast<int>(ops.size());
+    if(numops < 3)
+    {
+        return -1;
+    }
+    int right = ops[numops-3],
+        com = ops[numops-2];
+    uint op = code[com];
+    if((op&0x1F3F) != (Code_ComV|(2<<8)) || ops[numops-1] != com+1 || (code[com+1]&Code_OpMask) != Code_ResultArg)
+    {
+        return -1;
+    }
+    int kind = comparekind(identmap[op>>13]);
+    tagval val;
+    if(kind < 0 || !constantarg(&code[right], val) || val.type != Value_Integer)
+    {
+        return -1;
+    }
+    int start = right,
+        src = CompareJump_Stack;
+    uint srcident = 0;
+    if(numops >= 4)
+    {
+        int left = ops[numops-4];
+        uint leftop = code[left];
+        if(((leftop&0xFF) == (Code_Lookup|Ret_Integer) || (leftop&0xFF) == (Code_IntVar|Ret_Integer)) && !targets[right])
+        {
+            start = left;
+            src = (leftop&Code_OpMask) == Code_Lookup ? CompareJump_Alias : CompareJump_IntVar;
+            srcident = leftop>>8;
+        }
+    }
+    if(hastarget(targets, start, jump))
+    {
+        return -1;
+    }
+    //the length of the replaced words is kept in the top 20 bits
+    int len = jump - start;
+    if(len >= (1<<20))
+    {
+        return -1;
+    }
+    code[start] = Code_CompareJump|src|(kind<<8)|((code[jump]&Code_OpMask) == Code_JumpTrue ? 1<<11 : 0)|(len<<12);
+    code[start+1] = static_cast<uint>(val.i);
+    if(src != CompareJump_Stack)
+    {
+        code[start+2] = srcident;
+    }
+    return start;
+}
+
+static void optimizecode(vector<uint> &code, int start)
+{
+    if(!csoptimize)
+    {
+        return;
+    }
+    int end = code.length();
+    //everywhere a jump lands or a block is entered
+    std::vector<bool> targets(end+1, false);
+    for(int i = start; i < end; i += codewords(&code[i]))
+    {
+        uint op = code[i];
+        switch(op&0xFF)
+        {
+            case Code_Block:
+            {
+                targets[i+2] = true;
+            }
+            [[fallthrough]];
+            case Code_Jump:
+            case Code_JumpTrue:
+            case Code_JumpFalse:
+            case Code_JumpResultTrue:
+            case Code_JumpResultFalse:
+            {
+                targets[std::min(i+1 + static_cast<int>(op>>8), end)] = true;
+                break;
+            }
+        }
+    }
+    //start of each instruction seen so far, with fused sequences as one instruction
+    std::vector<int> ops;
+    for(int i = start; i < end; i += codewords(&code[i]))
+    {
+        uint op = code[i];
+        int fused = -1;
+        switch(op&Code_OpMask)
+        {
+            case Code_ResultArg:
+            {
+                if(!ops.empty() && ops.back() + 1 == i && (code[ops.back()]&Code_OpMask) == Code_ComV)
+                {
+                    int numargs = (code[ops.back()]>>8)&0x1F;
+                    ops.pop_back();
+                    fused = foldconstants(code, ops, targets, i-1);
+                    if(fused >= 0)
+                    {
+                        ops.resize(ops.size() - numargs);
+                    }
+                    else
+                    {
+                        ops.push_back(i-1);
+                    }
+                }
+                break;
+            }
+            case Code_JumpTrue:
+            case Code_JumpFalse:
+            {
+                fused = fusecompare(code, ops, targets, i);
+                while(fused >= 0 && !ops.empty() && ops.back() >= fused)
+                {
+                    ops.pop_back();
+                }
+                break;
+            }
+        }
+        if(fused >= 0)
+        {
+            i = fused;
+        }
+        ops.push_back(i);
+    }
+}
+
+static uint *copycode(const uint *src)
+{
+    const uint *end = skipcode(src);
+    size_t len = end - src;
+    uint *dst = new uint[len + 1];
+    *dst++ = Code_Start;
+    std::memcpy(dst, src, len*sizeof(uint));
+    return dst;
+}
+
+static void copyarg(tagval &dst, const tagval &src)
+{
+    switch(src.type)
+    {
+        case Value_Integer:
+        case Value_Float:
         case Value_Ident:
         {
             dst = src;
@@ -3980,7 +4898,7 @@ static void copyarg(tagval &dst, const tagval &src)
         case Value_Macro:
         case Value_CString:
         {
-            dst.setstr(newstring(src.s));
+            dst.setstr(newpoolstring(src.s));
             break;
         }
         case Value_Code:
@@ -4160,7 +5078,7 @@ static void callcommand(ident *id, tagval *args, int numargs, bool lookup = fals
                     {
                         break;
                     }
-                    args[i].setstr(newstring(""));
+                    args[i].setstr(newpoolstring(""));
                     fakeargs++;
                 }
                 else
@@ -4323,8 +5241,137 @@ cleanup:
 static constexpr int maxrundepth = 255; //limit for rundepth (nesting depth) var below
 static int rundepth = 0; //current rundepth
 
+/* opcode dispatch
+ *
+ * with CS_COMPUTED_GOTO every opcode handler in runcode() is also a label, and
+ * each handler jumps straight to the next one through a table of their
+ * addresses, so the branch predictor sees one indirect jump per handler
+ * rather than a single shared one at the top of the switch. Otherwise the
+ * labels and table are left out and handlers return to the switch
+ *
+ * every handler needs an entry in the table as well as its case label; an
+ * opcode missing from the table still runs, through the switch, but is
+ * reported the first time it is seen so that the table can be fixed
+ */
+#ifdef CS_COMPUTED_GOTO
+    #define OPCASE(op) case Code_##op: op_##op
+    #define RETCASE(op, ret) case Code_##op|Ret_##ret: op_##op##_##ret
+    #define NEXTOP { op = *code++; goto *dispatch[op&0xFF]; }
+
+    //compiled code only holds opcodes the switch handles, so any seen here lack a table entry
+    static void checkuntabledop(uint op)
+    {
+        static bool reported[256] = {};
+        if(!reported[op&0xFF])
+        {
+            reported[op&0xFF] = true;
+            conoutf(Console_Error, "cubescript opcode %u (return type %u) has no dispatch table entry", op&Code_OpMask, (op&Code_RetMask)>>Code_Ret);
+        }
+    }
+#else
+    #define OPCASE(op) case Code_##op
+    #define RETCASE(op, ret) case Code_##op|Ret_##ret
+    #define NEXTOP continue
+#endif
+
 static const uint *runcode(const uint *code, tagval &result)
 {
+#ifdef CS_COMPUTED_GOTO
+    static void *dispatch[256] = {};
+    if(!dispatch[Code_Start])
+    {
+        //opcodes without a table entry go through the switch, which skips those it has no case for
+        for(void *&target : dispatch)
+        {
+            target = &&untabledop;
+        }
+        #define OPTARGET(op) dispatch[Code_##op] = &&op_##op;
+        #define RETTARGET(op, ret) dispatch[Code_##op|Ret_##ret] = &&op_##op##_##ret;
+        OPTARGET(Start)
+        OPTARGET(Offset)
+        RETTARGET(Null, Null) RETTARGET(Null, String) RETTARGET(Null, Integer) RETTARGET(Null, Float)
+        RETTARGET(False, String) RETTARGET(False, Null) RETTARGET(False, Integer) RETTARGET(False, Float)
+        RETTARGET(True, String) RETTARGET(True, Null) RETTARGET(True, Integer) RETTARGET(True, Float)
+        RETTARGET(Not, String) RETTARGET(Not, Null) RETTARGET(Not, Integer) RETTARGET(Not, Float)
+        OPTARGET(Pop)
+        OPTARGET(Enter)
+        OPTARGET(EnterResult)
+        RETTARGET(Exit, String) RETTARGET(Exit, Integer) RETTARGET(Exit, Float) RETTARGET(Exit, Null)
+        RETTARGET(ResultArg, String) RETTARGET(ResultArg, Integer) RETTARGET(ResultArg, Float) RETTARGET(ResultArg, Null)
+        OPTARGET(Print)
+        OPTARGET(Local)
+        RETTARGET(DoArgs, Null) RETTARGET(DoArgs, String) RETTARGET(DoArgs, Integer) RETTARGET(DoArgs, Float)
+        RETTARGET(Do, Null) RETTARGET(Do, String) RETTARGET(Do, Integer) RETTARGET(Do, Float)
+        OPTARGET(Jump)
+        OPTARGET(JumpTrue)
+        OPTARGET(JumpFalse)
+        OPTARGET(JumpResultTrue)
+        OPTARGET(JumpResultFalse)
+        RETTARGET(ConstArg, Integer) RETTARGET(ConstArg, Float)
+        RETTARGET(CompareJump, Null) RETTARGET(CompareJump, String) RETTARGET(CompareJump, Integer) RETTARGET(CompareJump, Float)
+        OPTARGET(Macro)
+        RETTARGET(Val, String)
+        RETTARGET(ValI, String)
+        RETTARGET(Val, Null)
+        RETTARGET(ValI, Null)
+        RETTARGET(Val, Integer)
+        RETTARGET(ValI, Integer)
+        RETTARGET(Val, Float)
+        RETTARGET(ValI, Float)
+        RETTARGET(Dup, Null) RETTARGET(Dup, Integer) RETTARGET(Dup, Float) RETTARGET(Dup, String)
+        RETTARGET(Force, String) RETTARGET(Force, Integer) RETTARGET(Force, Float)
+        RETTARGET(Result, Null) RETTARGET(Result, String) RETTARGET(Result, Integer) RETTARGET(Result, Float)
+        RETTARGET(Empty, Null) RETTARGET(Empty, String) RETTARGET(Empty, Integer) RETTARGET(Empty, Float)
+        OPTARGET(Block)
+        OPTARGET(Compile)
+        OPTARGET(Cond)
+        OPTARGET(Ident)
+        OPTARGET(IdentArg)
+        OPTARGET(IdentU)
+        RETTARGET(LookupU, String)
+        RETTARGET(Lookup, String)
+        RETTARGET(LookupArg, String)
+        RETTARGET(LookupU, Integer)
+        RETTARGET(Lookup, Integer)
+        RETTARGET(LookupArg, Integer)
+        RETTARGET(LookupU, Float)
+        RETTARGET(Lookup, Float)
+        RETTARGET(LookupArg, Float)
+        RETTARGET(LookupU, Null)
+        RETTARGET(Lookup, Null)
+        RETTARGET(LookupArg, Null)
+        RETTARGET(LookupMU, String)
+        RETTARGET(LookupM, String)
+        RETTARGET(LookupMArg, String)
+        RETTARGET(LookupMU, Null)
+        RETTARGET(LookupM, Null)
+        RETTARGET(LookupMArg, Null)
+        RETTARGET(StrVar, String) RETTARGET(StrVar, Null) RETTARGET(StrVar, Integer) RETTARGET(StrVar, Float)
+        OPTARGET(StrVarM)
+        OPTARGET(StrVar1)
+        RETTARGET(IntVar, Integer) RETTARGET(IntVar, Null) RETTARGET(IntVar, String) RETTARGET(IntVar, Float)
+        OPTARGET(IntVar1)
+        OPTARGET(IntVar2)
+        OPTARGET(IntVar3)
+        RETTARGET(FloatVar, Float) RETTARGET(FloatVar, Null) RETTARGET(FloatVar, String) RETTARGET(FloatVar, Integer)
+        OPTARGET(FloatVar1)
+        RETTARGET(Com, Null) RETTARGET(Com, String) RETTARGET(Com, Float) RETTARGET(Com, Integer)
+        RETTARGET(ComD, Null) RETTARGET(ComD, String) RETTARGET(ComD, Float) RETTARGET(ComD, Integer)
+        RETTARGET(ComV, Null) RETTARGET(ComV, String) RETTARGET(ComV, Float) RETTARGET(ComV, Integer)
+        RETTARGET(ComC, Null) RETTARGET(ComC, String) RETTARGET(ComC, Float) RETTARGET(ComC, Integer)
+        RETTARGET(ConC, Null) RETTARGET(ConC, String) RETTARGET(ConC, Float) RETTARGET(ConC, Integer)
+        RETTARGET(ConCW, Null) RETTARGET(ConCW, String) RETTARGET(ConCW, Float) RETTARGET(ConCW, Integer)
+        RETTARGET(ConCM, Null) RETTARGET(ConCM, String) RETTARGET(ConCM, Float) RETTARGET(ConCM, Integer)
+        OPTARGET(Alias)
+        OPTARGET(AliasArg)
+        OPTARGET(AliasU)
+        RETTARGET(Call, Null) RETTARGET(Call, String) RETTARGET(Call, Float) RETTARGET(Call, Integer)
+        RETTARGET(CallArg, Null) RETTARGET(CallArg, String) RETTARGET(CallArg, Float) RETTARGET(CallArg, Integer)
+        RETTARGET(CallU, Null) RETTARGET(CallU, String) RETTARGET(CallU, Float) RETTARGET(CallU, Integer)
+        #undef OPTARGET
+        #undef RETTARGET
+    }
+#endif
     result.setnull();
     if(rundepth >= maxrundepth)
     {
@@ -4336,153 +5383,159 @@ static const uint *runcode(const uint *code, tagval &result)
     tagval args[Max_Args+Max_Results],
           *prevret = commandret;
     commandret = &result;
+    uint op;
     for(;;)
     {
-        uint op = *code++;
+        op = *code++;
+#ifdef CS_COMPUTED_GOTO
+        goto *dispatch[op&0xFF];
+    untabledop:
+        checkuntabledop(op);
+#endif
         switch(op&0xFF)
         {
-            case Code_Start:
-            case Code_Offset:
+            OPCASE(Start):
+            OPCASE(Offset):
             {
-                continue;
+                NEXTOP;
             }
             // For Code_Null cases, set results to null, empty, or 0 values.
-            case Code_Null|Ret_Null:
+            RETCASE(Null, Null):
             {
                 freearg(result);
                 result.setnull();
-                continue;
+                NEXTOP;
             }
-            case Code_Null|Ret_String:
+            RETCASE(Null, String):
             {
                 freearg(result);
-                result.setstr(newstring(""));
-                continue;
+                result.setstr(newpoolstring(""));
+                NEXTOP;
             }
-            case Code_Null|Ret_Integer:
+            RETCASE(Null, Integer):
             {
                 freearg(result);
                 result.setint(0);
-                continue;
+                NEXTOP;
             }
-            case Code_Null|Ret_Float:
+            RETCASE(Null, Float):
             {
                 freearg(result);
                 result.setfloat(0.0f);
-                continue;
+                NEXTOP;
             }
             // For Code_False cases, set results to 0 values.
-            case Code_False|Ret_String:
+            RETCASE(False, String):
             {
                 freearg(result);
-                result.setstr(newstring("0"));
-                continue;
+                result.setstr(newpoolstring("0"));
+                NEXTOP;
             }
-            case Code_False|Ret_Null: // Null case left empty intentionally.
-            case Code_False|Ret_Integer:
+            RETCASE(False, Null): // Null case left empty intentionally.
+            RETCASE(False, Integer):
             {
                 freearg(result);
                 result.setint(0);
-                continue;
+                NEXTOP;
             }
-            case Code_False|Ret_Float:
+            RETCASE(False, Float):
             {
                 freearg(result);
                 result.setfloat(0.0f);
-                continue;
+                NEXTOP;
             }
             // For Code_False cases, set results to 1 values.
-            case Code_True|Ret_String:
+            RETCASE(True, String):
             {
                 freearg(result);
-                result.setstr(newstring("1"));
-                continue;
+                result.setstr(newpoolstring("1"));
+                NEXTOP;
             }
-            case Code_True|Ret_Null: // Null case left empty intentionally.
-            case Code_True|Ret_Integer:
+            RETCASE(True, Null): // Null case left empty intentionally.
+            RETCASE(True, Integer):
             {
                 freearg(result);
                 result.setint(1);
-                continue;
+                NEXTOP;
             }
-            case Code_True|Ret_Float:
+            RETCASE(True, Float):
             {
                 freearg(result);
                 result.setfloat(1.0f);
-                continue;
+                NEXTOP;
             }
             // For Code_Not cases, negate values (flip 0's and 1's).
-            case Code_Not|Ret_String:
+            RETCASE(Not, String):
             {
                 freearg(result);
                 --numargs;
-                result.setstr(newstring(getbool(args[numargs]) ? "0" : "1"));
+                result.setstr(newpoolstring(getbool(args[numargs]) ? "0" : "1"));
                 freearg(args[numargs]);
-                continue;
+                NEXTOP;
             }
-            case Code_Not|Ret_Null: // Null case left empty intentionally.
-            case Code_Not|Ret_Integer:
+            RETCASE(Not, Null): // Null case left empty intentionally.
+            RETCASE(Not, Integer):
             {
                 freearg(result);
                 --numargs;
                 result.setint(getbool(args[numargs]) ? 0 : 1);
                 freearg(args[numargs]);
-                continue;
+                NEXTOP;
             }
-            case Code_Not|Ret_Float:
+            RETCASE(Not, Float):
             {
                 freearg(result);
                 --numargs;
                 result.setfloat(getbool(args[numargs]) ? 0.0f : 1.0f);
                 freearg(args[numargs]);
-                continue;
+                NEXTOP;
             }
-            case Code_Pop:
+            OPCASE(Pop):
             {
                 freearg(args[--numargs]);
-                continue;
+                NEXTOP;
             }
-            case Code_Enter:
+            OPCASE(Enter):
             {
                 code = runcode(code, args[numargs++]);
-                continue;
+                NEXTOP;
             }
-            case Code_EnterResult:
+            OPCASE(EnterResult):
             {
                 freearg(result);
                 code = runcode(code, result);
-                continue;
+                NEXTOP;
             }
-            case Code_Exit|Ret_String:
-            case Code_Exit|Ret_Integer:
-            case Code_Exit|Ret_Float:
+            RETCASE(Exit, String):
+            RETCASE(Exit, Integer):
+            RETCASE(Exit, Float):
             {
                 forcearg(result, op&Code_RetMask);
             }
             [[fallthrough]];
-            case Code_Exit|Ret_Null:
+            RETCASE(Exit, Null):
             {
                 goto exit;
             }
-            case Code_ResultArg|Ret_String:
-            case Code_ResultArg|Ret_Integer:
-            case Code_ResultArg|Ret_Float:
+            RETCASE(ResultArg, String):
+            RETCASE(ResultArg, Integer):
+            RETCASE(ResultArg, Float):
             {
                 forcearg(result, op&Code_RetMask);
             }
             [[fallthrough]];
-            case Code_ResultArg|Ret_Null:
+            RETCASE(ResultArg, Null):
             {
                 args[numargs++] = result;
                 result.setnull();
-                continue;
+                NEXTOP;
             }
-            case Code_Print:
+            OPCASE(Print):
             {
                 printvar(identmap[op>>8]);
-                continue;
+                NEXTOP;
             }
-            case Code_Local:
+            OPCASE(Local):
             {
                 freearg(result);
                 int numlocals = op>>8, offset = numargs-numlocals;
@@ -4498,10 +5551,10 @@ static const uint *runcode(const uint *code, tagval &result)
                 }
                 goto exit;
             }
-            case Code_DoArgs|Ret_Null:
-            case Code_DoArgs|Ret_String:
-            case Code_DoArgs|Ret_Integer:
-            case Code_DoArgs|Ret_Float:
+            RETCASE(DoArgs, Null):
+            RETCASE(DoArgs, String):
+            RETCASE(DoArgs, Integer):
+            RETCASE(DoArgs, Float):
             {
                 UNDOARGS
                 freearg(result);
@@ -4509,25 +5562,25 @@ static const uint *runcode(const uint *code, tagval &result)
                 freearg(args[numargs]);
                 forcearg(result, op&Code_RetMask);
                 REDOARGS
-                continue;
+                NEXTOP;
             }
-            case Code_Do|Ret_Null:
-            case Code_Do|Ret_String:
-            case Code_Do|Ret_Integer:
-            case Code_Do|Ret_Float:
+            RETCASE(Do, Null):
+            RETCASE(Do, String):
+            RETCASE(Do, Integer):
+            RETCASE(Do, Float):
                 freearg(result);
                 runcode(args[--numargs].code, result);
                 freearg(args[numargs]);
                 forcearg(result, op&Code_RetMask);
-                continue;
+                NEXTOP;
 
-            case Code_Jump:
+            OPCASE(Jump):
             {
                 uint len = op>>8;
                 code += len;
-                continue;
+                NEXTOP;
             }
-            case Code_JumpTrue:
+            OPCASE(JumpTrue):
             {
                 uint len = op>>8;
                 if(getbool(args[--numargs]))
@@ -4535,9 +5588,9 @@ static const uint *runcode(const uint *code, tagval &result)
                     code += len;
                 }
                 freearg(args[numargs]);
-                continue;
+                NEXTOP;
             }
-            case Code_JumpFalse:
+            OPCASE(JumpFalse):
             {
                 uint len = op>>8;
                 if(!getbool(args[--numargs]))
@@ -4545,9 +5598,9 @@ static const uint *runcode(const uint *code, tagval &result)
                     code += len;
                 }
                 freearg(args[numargs]);
-                continue;
+                NEXTOP;
             }
-            case Code_JumpResultTrue:
+            OPCASE(JumpResultTrue):
             {
                 uint len = op>>8;
                 freearg(result);
@@ -4565,9 +5618,9 @@ static const uint *runcode(const uint *code, tagval &result)
                 {
                     code += len;
                 }
-                continue;
+                NEXTOP;
             }
-            case Code_JumpResultFalse:
+            OPCASE(JumpResultFalse):
             {
                 uint len = op>>8;
                 freearg(result);
@@ -4585,136 +5638,191 @@ static const uint *runcode(const uint *code, tagval &result)
                 {
                     code += len;
                 }
-                continue;
+                NEXTOP;
             }
-            case Code_Macro:
+            RETCASE(ConstArg, Integer):
+            {
+                forcenull(result);
+                args[numargs++].setint(static_cast<int>(*code));
+                code += op>>8;
+                NEXTOP;
+            }
+            RETCASE(ConstArg, Float):
+            {
+                forcenull(result);
+                args[numargs++].setfloat(*reinterpret_cast<const float *>(code));
+                code += op>>8;
+                NEXTOP;
+            }
+            RETCASE(CompareJump, Null):
+            RETCASE(CompareJump, String):
+            RETCASE(CompareJump, Integer):
+            RETCASE(CompareJump, Float):
+            {
+                uint len = op>>12;
+                int val = static_cast<int>(code[0]),
+                    left;
+                switch(op&Code_RetMask)
+                {
+                    case CompareJump_Alias:
+                    {
+                        ident *id = identmap[code[1]];
+                        if(id->flags&Idf_Unknown)
+                        {
+                            debugcode("unknown alias lookup: %s", id->name);
+                        }
+                        left = id->getint();
+                        break;
+                    }
+                    case CompareJump_IntVar:
+                    {
+                        left = *identmap[code[1]]->storage.i;
+                        break;
+                    }
+                    default:
+                    {
+                        left = args[--numargs].i;
+                        break;
+                    }
+                }
+                bool cond = compareints((op>>8)&7, left, val);
+                uint jump = code[len-1];
+                code += len;
+                forcenull(result);
+                if(cond == (((op>>11)&1) != 0))
+                {
+                    code += jump>>8;
+                }
+                NEXTOP;
+            }
+            OPCASE(Macro):
             {
                 uint len = op>>8;
                 args[numargs++].setmacro(code);
                 code += len/sizeof(uint) + 1;
-                continue;
+                NEXTOP;
             }
-            case Code_Val|Ret_String:
+            RETCASE(Val, String):
             {
                 uint len = op>>8;
-                args[numargs++].setstr(newstring(reinterpret_cast<const char *>(code), len));
+                args[numargs++].setstr(newpoolstring(reinterpret_cast<const char *>(code), len));
                 code += len/sizeof(uint) + 1;
-                continue;
+                NEXTOP;
             }
-            case Code_ValI|Ret_String:
+            RETCASE(ValI, String):
             {
                 char s[4] = { static_cast<char>((op>>8)&0xFF), static_cast<char>((op>>16)&0xFF), static_cast<char>((op>>24)&0xFF), '\0' };
-                args[numargs++].setstr(newstring(s));
-                continue;
+                args[numargs++].setstr(newpoolstring(s));
+                NEXTOP;
             }
-            case Code_Val|Ret_Null:
-            case Code_ValI|Ret_Null:
+            RETCASE(Val, Null):
+            RETCASE(ValI, Null):
             {
                 args[numargs++].setnull();
-                continue;
+                NEXTOP;
             }
-            case Code_Val|Ret_Integer:
+            RETCASE(Val, Integer):
             {
                 args[numargs++].setint(static_cast<int>(*code++));
-                continue;
+                NEXTOP;
             }
-            case Code_ValI|Ret_Integer:
+            RETCASE(ValI, Integer):
             {
                 args[numargs++].setint(static_cast<int>(op)>>8);
-                continue;
+                NEXTOP;
             }
-            case Code_Val|Ret_Float:
+            RETCASE(Val, Float):
             {
                 args[numargs++].setfloat(*reinterpret_cast<const float *>(code++));
-                continue;
+                NEXTOP;
             }
-            case Code_ValI|Ret_Float:
+            RETCASE(ValI, Float):
             {
                 args[numargs++].setfloat(static_cast<float>(static_cast<int>(op)>>8));
-                continue;
+                NEXTOP;
             }
-            case Code_Dup|Ret_Null:
+            RETCASE(Dup, Null):
             {
                 args[numargs-1].getval(args[numargs]);
                 numargs++;
-                continue;
+                NEXTOP;
             }
-            case Code_Dup|Ret_Integer:
+            RETCASE(Dup, Integer):
             {
                 args[numargs].setint(args[numargs-1].getint());
                 numargs++;
-                continue;
+                NEXTOP;
             }
-            case Code_Dup|Ret_Float:
+            RETCASE(Dup, Float):
             {
                 args[numargs].setfloat(args[numargs-1].getfloat());
                 numargs++;
-                continue;
+                NEXTOP;
             }
-            case Code_Dup|Ret_String:
+            RETCASE(Dup, String):
             {
-                args[numargs].setstr(newstring(args[numargs-1].getstr()));
+                args[numargs].setstr(newpoolstring(args[numargs-1].getstr()));
                 numargs++;
-                continue;
+                NEXTOP;
             }
-            case Code_Force|Ret_String:
+            RETCASE(Force, String):
             {
                 forcestr(args[numargs-1]);
-                continue;
+                NEXTOP;
             }
-            case Code_Force|Ret_Integer:
+            RETCASE(Force, Integer):
             {
                 forceint(args[numargs-1]);
-                continue;
+                NEXTOP;
             }
-            case Code_Force|Ret_Float:
+            RETCASE(Force, Float):
             {
                 forcefloat(args[numargs-1]);
-                continue;
+                NEXTOP;
             }
-            case Code_Result|Ret_Null:
+            RETCASE(Result, Null):
             {
                 freearg(result);
                 result = args[--numargs];
-                continue;
+                NEXTOP;
             }
-            case Code_Result|Ret_String:
-            case Code_Result|Ret_Integer:
-            case Code_Result|Ret_Float:
+            RETCASE(Result, String):
+            RETCASE(Result, Integer):
+            RETCASE(Result, Float):
             {
                 freearg(result);
                 result = args[--numargs];
                 forcearg(result, op&Code_RetMask);
-                continue;
+                NEXTOP;
             }
-            case Code_Empty|Ret_Null:
+            RETCASE(Empty, Null):
             {
                 args[numargs++].setcode(emptyblock[Value_Null]+1);
                 break;
             }
-            case Code_Empty|Ret_String:
+            RETCASE(Empty, String):
             {
                 args[numargs++].setcode(emptyblock[Value_String]+1);
                 break;
             }
-            case Code_Empty|Ret_Integer:
+            RETCASE(Empty, Integer):
             {
                 args[numargs++].setcode(emptyblock[Value_Integer]+1);
                 break;
             }
-            case Code_Empty|Ret_Float:
+            RETCASE(Empty, Float):
             {
                 args[numargs++].setcode(emptyblock[Value_Float]+1);
                 break;
             }
-            case Code_Block:
+            OPCASE(Block):
             {
                 uint len = op>>8;
                 args[numargs++].setcode(code+1);
                 code += len;
-                continue;
+                NEXTOP;
             }
-            case Code_Compile:
+            OPCASE(Compile):
             {
                 tagval &arg = args[numargs-1];
                 vector<uint> buf;
@@ -4758,9 +5866,9 @@ static const uint *runcode(const uint *code, tagval &result)
                     }
                 }
                 arg.setcode(buf.disown()+1);
-                continue;
+                NEXTOP;
             }
-            case Code_Cond:
+            OPCASE(Cond):
             {
                 tagval &arg = args[numargs-1];
                 switch(arg.type)
@@ -4782,14 +5890,14 @@ static const uint *runcode(const uint *code, tagval &result)
                         }
                         break;
                 }
-                continue;
+                NEXTOP;
             }
-            case Code_Ident:
+            OPCASE(Ident):
             {
                 args[numargs++].setident(identmap[op>>8]);
-                continue;
+                NEXTOP;
             }
-            case Code_IdentArg:
+            OPCASE(IdentArg):
             {
                 ident *id = identmap[op>>8];
                 if(!(aliasstack->usedargs&(1<<id->index)))
@@ -4798,9 +5906,9 @@ static const uint *runcode(const uint *code, tagval &result)
                     aliasstack->usedargs |= 1<<id->index;
                 }
                 args[numargs++].setident(id);
-                continue;
+                NEXTOP;
             }
-            case Code_IdentU:
+            OPCASE(IdentU):
             {
                 tagval &arg = args[numargs-1];
                 ident *id = arg.type ==     Value_String
@@ -4813,17 +5921,17 @@ static const uint *runcode(const uint *code, tagval &result)
                 }
                 freearg(arg);
                 arg.setident(id);
-                continue;
+                NEXTOP;
             }
 
-            case Code_LookupU|Ret_String:
+            RETCASE(LookupU, String):
                 #define LOOKUPU(aval, sval, ival, fval, nval) { \
                     tagval &arg = args[numargs-1]; \
                     if(arg.type != Value_String && arg.type != Value_Macro && arg.type != Value_CString) \
                     { \
-                        continue; \
+                        NEXTOP; \
                     } \
-                    ident *id = idents.access(arg.s); \
+                    ident *id = arg.type == Value_Macro ? findcodeident(arg.s) : findident(arg.s); \
                     if(id) \
                     { \
                         switch(id->type) \
@@ -4838,28 +5946,28 @@ static const uint *runcode(const uint *code, tagval &result)
                                 if(id->index < Max_Args && !(aliasstack->usedargs&(1<<id->index))) \
                                 { \
                                     nval; \
-                                    continue; \
+                                    NEXTOP; \
                                 } \
                                 aval; \
-                                continue; \
+                                NEXTOP; \
                             } \
                             case Id_StringVar: \
                             { \
                                 freearg(arg); \
                                 sval; \
-                                continue; \
+                                NEXTOP; \
                             } \
                             case Id_Var: \
                             { \
                                 freearg(arg); \
                                 ival; \
-                                continue; \
+                                NEXTOP; \
                             } \
                             case Id_FloatVar: \
                             { \
                                 freearg(arg); \
                                 fval; \
-                                continue; \
+                                NEXTOP; \
                             } \
                             case Id_Command: \
                             { \
@@ -4870,27 +5978,27 @@ static const uint *runcode(const uint *code, tagval &result)
                                 callcommand(id, buf, 0, true); \
                                 forcearg(arg, op&Code_RetMask); \
                                 commandret = &result; \
-                                continue; \
+                                NEXTOP; \
                             } \
                             default: \
                             { \
                                 freearg(arg); \
                                 nval; \
-                                continue; \
+                                NEXTOP; \
                             } \
                         } \
                     } \
                     debugcode("unknown alias lookup: %s", arg.s); \
                     freearg(arg); \
                     nval; \
-                    continue; \
-                }
-                LOOKUPU(arg.setstr(newstring(id->getstr())),
-                        arg.setstr(newstring(*id->storage.s)),
-                        arg.setstr(newstring(intstr(*id->storage.i))),
-                        arg.setstr(newstring(floatstr(*id->storage.f))),
-                        arg.setstr(newstring("")));
-            case Code_Lookup|Ret_String:
+                    NEXTOP; \
+                }
+                LOOKUPU(arg.setstr(newpoolstring(id->getstr())),
+                        arg.setstr(newpoolstring(*id->storage.s)),
+                        arg.setstr(newpoolstring(intstr(*id->storage.i))),
+                        arg.setstr(newpoolstring(floatstr(*id->storage.f))),
+                        arg.setstr(newpoolstring("")));
+            RETCASE(Lookup, String):
                 #define LOOKUP(aval) { \
                     ident *id = identmap[op>>8]; \
                     if(id->flags&Idf_Unknown) \
@@ -4898,156 +6006,156 @@ static const uint *runcode(const uint *code, tagval &result)
                         debugcode("unknown alias lookup: %s", id->name); \
                     } \
                     aval; \
-                    continue; \
+                    NEXTOP; \
                 }
-                LOOKUP(args[numargs++].setstr(newstring(id->getstr())));
-            case Code_LookupArg|Ret_String:
+                LOOKUP(args[numargs++].setstr(newpoolstring(id->getstr())));
+            RETCASE(LookupArg, String):
                 #define LOOKUPARG(aval, nval) { \
                     ident *id = identmap[op>>8]; \
                     if(!(aliasstack->usedargs&(1<<id->index))) \
                     { \
                         nval; \
-                        continue; \
+                        NEXTOP; \
                     } \
                     aval; \
-                    continue; \
+                    NEXTOP; \
                 }
-                LOOKUPARG(args[numargs++].setstr(newstring(id->getstr())), args[numargs++].setstr(newstring("")));
-            case Code_LookupU|Ret_Integer:
+                LOOKUPARG(args[numargs++].setstr(newpoolstring(id->getstr())), args[numargs++].setstr(newpoolstring("")));
+            RETCASE(LookupU, Integer):
                 LOOKUPU(arg.setint(id->getint()),
                         arg.setint(parseint(*id->storage.s)),
                         arg.setint(*id->storage.i),
                         arg.setint(static_cast<int>(*id->storage.f)),
                         arg.setint(0));
-            case Code_Lookup|Ret_Integer:
+            RETCASE(Lookup, Integer):
                 LOOKUP(args[numargs++].setint(id->getint()));
-            case Code_LookupArg|Ret_Integer:
+            RETCASE(LookupArg, Integer):
                 LOOKUPARG(args[numargs++].setint(id->getint()), args[numargs++].setint(0));
-            case Code_LookupU|Ret_Float:
+            RETCASE(LookupU, Float):
                 LOOKUPU(arg.setfloat(id->getfloat()),
                         arg.setfloat(parsefloat(*id->storage.s)),
                         arg.setfloat(static_cast<float>(*id->storage.i)),
                         arg.setfloat(*id->storage.f),
                         arg.setfloat(0.0f));
-            case Code_Lookup|Ret_Float:
+            RETCASE(Lookup, Float):
                 LOOKUP(args[numargs++].setfloat(id->getfloat()));
-            case Code_LookupArg|Ret_Float:
+            RETCASE(LookupArg, Float):
                 LOOKUPARG(args[numargs++].setfloat(id->getfloat()), args[numargs++].setfloat(0.0f));
-            case Code_LookupU|Ret_Null:
+            RETCASE(LookupU, Null):
                 LOOKUPU(id->getval(arg),
-                        arg.setstr(newstring(*id->storage.s)),
+                        arg.setstr(newpoolstring(*id->storage.s)),
                         arg.setint(*id->storage.i),
                         arg.setfloat(*id->storage.f),
                         arg.setnull());
-            case Code_Lookup|Ret_Null:
+            RETCASE(Lookup, Null):
                 LOOKUP(id->getval(args[numargs++]));
-            case Code_LookupArg|Ret_Null:
+            RETCASE(LookupArg, Null):
                 LOOKUPARG(id->getval(args[numargs++]), args[numargs++].setnull());
-            case Code_LookupMU|Ret_String:
+            RETCASE(LookupMU, String):
                 LOOKUPU(id->getcstr(arg),
                         arg.setcstr(*id->storage.s),
-                        arg.setstr(newstring(intstr(*id->storage.i))),
-                        arg.setstr(newstring(floatstr(*id->storage.f))),
+                        arg.setstr(newpoolstring(intstr(*id->storage.i))),
+                        arg.setstr(newpoolstring(floatstr(*id->storage.f))),
                         arg.setcstr(""));
-            case Code_LookupM|Ret_String:
+            RETCASE(LookupM, String):
                 LOOKUP(id->getcstr(args[numargs++]));
-            case Code_LookupMArg|Ret_String:
+            RETCASE(LookupMArg, String):
                 LOOKUPARG(id->getcstr(args[numargs++]), args[numargs++].setcstr(""));
-            case Code_LookupMU|Ret_Null:
+            RETCASE(LookupMU, Null):
                 LOOKUPU(id->getcval(arg),
                         arg.setcstr(*id->storage.s),
                         arg.setint(*id->storage.i),
                         arg.setfloat(*id->storage.f),
                         arg.setnull());
-            case Code_LookupM|Ret_Null:
+            RETCASE(LookupM, Null):
                 LOOKUP(id->getcval(args[numargs++]));
-            case Code_LookupMArg|Ret_Null:
+            RETCASE(LookupMArg, Null):
                 LOOKUPARG(id->getcval(args[numargs++]), args[numargs++].setnull());
 
-            case Code_StrVar|Ret_String:
-            case Code_StrVar|Ret_Null:
+            RETCASE(StrVar, String):
+            RETCASE(StrVar, Null):
             {
-                args[numargs++].setstr(newstring(*identmap[op>>8]->storage.s));
-                continue;
+                args[numargs++].setstr(newpoolstring(*identmap[op>>8]->storage.s));
+                NEXTOP;
             }
-            case Code_StrVar|Ret_Integer:
+            RETCASE(StrVar, Integer):
             {
                 args[numargs++].setint(parseint(*identmap[op>>8]->storage.s));
-                continue;
+                NEXTOP;
             }
-            case Code_StrVar|Ret_Float:
+            RETCASE(StrVar, Float):
             {
                 args[numargs++].setfloat(parsefloat(*identmap[op>>8]->storage.s));
-                continue;
+                NEXTOP;
             }
-            case Code_StrVarM:
+            OPCASE(StrVarM):
             {
                 args[numargs++].setcstr(*identmap[op>>8]->storage.s);
-                continue;
+                NEXTOP;
             }
-            case Code_StrVar1:
+            OPCASE(StrVar1):
             {
                 setsvarchecked(identmap[op>>8], args[--numargs].s); freearg(args[numargs]);
-                continue;
+                NEXTOP;
             }
-            case Code_IntVar|Ret_Integer:
-            case Code_IntVar|Ret_Null:
+            RETCASE(IntVar, Integer):
+            RETCASE(IntVar, Null):
             {
                 args[numargs++].setint(*identmap[op>>8]->storage.i);
-                continue;
+                NEXTOP;
             }
-            case Code_IntVar|Ret_String:
+            RETCASE(IntVar, String):
             {
-                args[numargs++].setstr(newstring(intstr(*identmap[op>>8]->storage.i)));
-                continue;
+                args[numargs++].setstr(newpoolstring(intstr(*identmap[op>>8]->storage.i)));
+                NEXTOP;
             }
-            case Code_IntVar|Ret_Float:
+            RETCASE(IntVar, Float):
             {
                 args[numargs++].setfloat(static_cast<float>(*identmap[op>>8]->storage.i));
-                continue;
+                NEXTOP;
             }
-            case Code_IntVar1:
+            OPCASE(IntVar1):
             {
                 setvarchecked(identmap[op>>8], args[--numargs].i);
-                continue;
+                NEXTOP;
             }
-            case Code_IntVar2:
+            OPCASE(IntVar2):
             {
                 numargs -= 2;
                 setvarchecked(identmap[op>>8], (args[numargs].i<<16)|(args[numargs+1].i<<8));
-                continue;
+                NEXTOP;
             }
-            case Code_IntVar3:
+            OPCASE(IntVar3):
             {
                 numargs -= 3;
                 setvarchecked(identmap[op>>8], (args[numargs].i<<16)|(args[numargs+1].i<<8)|args[numargs+2].i);
-                continue;
+                NEXTOP;
             }
-            case Code_FloatVar|Ret_Float:
-            case Code_FloatVar|Ret_Null:
+            RETCASE(FloatVar, Float):
+            RETCASE(FloatVar, Null):
             {
                 args[numargs++].setfloat(*identmap[op>>8]->storage.f);
-                continue;
+                NEXTOP;
             }
-            case Code_FloatVar|Ret_String:
+            RETCASE(FloatVar, String):
             {
-                args[numargs++].setstr(newstring(floatstr(*identmap[op>>8]->storage.f)));
-                continue;
+                args[numargs++].setstr(newpoolstring(floatstr(*identmap[op>>8]->storage.f)));
+                NEXTOP;
             }
-            case Code_FloatVar|Ret_Integer:
+            RETCASE(FloatVar, Integer):
             {
                 args[numargs++].setint(static_cast<int>(*identmap[op>>8]->storage.f));
-                continue;
+                NEXTOP;
             }
-            case Code_FloatVar1:
+            OPCASE(FloatVar1):
             {
                 setfvarchecked(identmap[op>>8], args[--numargs].f);
-                continue;
+                NEXTOP;
             }
-            case Code_Com|Ret_Null:
-            case Code_Com|Ret_String:
-            case Code_Com|Ret_Float:
-            case Code_Com|Ret_Integer:
+            RETCASE(Com, Null):
+            RETCASE(Com, String):
+            RETCASE(Com, Float):
+            RETCASE(Com, Integer):
             {
                 ident *id = identmap[op>>8];
                 int offset = numargs-id->numargs;
@@ -5055,12 +6163,12 @@ static const uint *runcode(const uint *code, tagval &result)
                 callcom(id, args, id->numargs, offset);
                 forcearg(result, op&Code_RetMask);
                 freeargs(args, numargs, offset);
-                continue;
+                NEXTOP;
             }
-            case Code_ComD|Ret_Null:
-            case Code_ComD|Ret_String:
-            case Code_ComD|Ret_Float:
-            case Code_ComD|Ret_Integer:
+            RETCASE(ComD, Null):
+            RETCASE(ComD, String):
+            RETCASE(ComD, Float):
+            RETCASE(ComD, Integer):
             {
                 ident *id = identmap[op>>8];
                 int offset = numargs-(id->numargs-1);
@@ -5068,13 +6176,13 @@ static const uint *runcode(const uint *code, tagval &result)
                 callcom(id, args, id->numargs, offset);
                 forcearg(result, op&Code_RetMask);
                 freeargs(args, numargs, offset);
-                continue;
+                NEXTOP;
             }
 
-            case Code_ComV|Ret_Null:
-            case Code_ComV|Ret_String:
-            case Code_ComV|Ret_Float:
-            case Code_ComV|Ret_Integer:
+            RETCASE(ComV, Null):
+            RETCASE(ComV, String):
+            RETCASE(ComV, Float):
+            RETCASE(ComV, Integer):
             {
                 ident *id = identmap[op>>13];
                 int callargs = (op>>8)&0x1F,
@@ -5083,12 +6191,12 @@ static const uint *runcode(const uint *code, tagval &result)
                 reinterpret_cast<comfunv>(id->fun)(&args[offset], callargs);
                 forcearg(result, op&Code_RetMask);
                 freeargs(args, numargs, offset);
-                continue;
+                NEXTOP;
             }
-            case Code_ComC|Ret_Null:
-            case Code_ComC|Ret_String:
-            case Code_ComC|Ret_Float:
-            case Code_ComC|Ret_Integer:
+            RETCASE(ComC, Null):
+            RETCASE(ComC, String):
+            RETCASE(ComC, Float):
+            RETCASE(ComC, Integer):
             {
                 ident *id = identmap[op>>13];
                 int callargs = (op>>8)&0x1F,
@@ -5101,16 +6209,16 @@ static const uint *runcode(const uint *code, tagval &result)
                 }
                 forcearg(result, op&Code_RetMask);
                 freeargs(args, numargs, offset);
-                continue;
+                NEXTOP;
             }
-            case Code_ConC|Ret_Null:
-            case Code_ConC|Ret_String:
-            case Code_ConC|Ret_Float:
-            case Code_ConC|Ret_Integer:
-            case Code_ConCW|Ret_Null:
-            case Code_ConCW|Ret_String:
-            case Code_ConCW|Ret_Float:
-            case Code_ConCW|Ret_Integer:
+            RETCASE(ConC, Null):
+            RETCASE(ConC, String):
+            RETCASE(ConC, Float):
+            RETCASE(ConC, Integer):
+            RETCASE(ConCW, Null):
+            RETCASE(ConCW, String):
+            RETCASE(ConCW, Float):
+            RETCASE(ConCW, Integer):
             {
                 int numconc = op>>8;
                 char *s = conc(&args[numargs-numconc], numconc, (op&Code_OpMask)==Code_ConC);
@@ -5118,48 +6226,48 @@ static const uint *runcode(const uint *code, tagval &result)
                 args[numargs].setstr(s);
                 forcearg(args[numargs], op&Code_RetMask);
                 numargs++;
-                continue;
+                NEXTOP;
             }
 
-            case Code_ConCM|Ret_Null:
-            case Code_ConCM|Ret_String:
-            case Code_ConCM|Ret_Float:
-            case Code_ConCM|Ret_Integer:
+            RETCASE(ConCM, Null):
+            RETCASE(ConCM, String):
+            RETCASE(ConCM, Float):
+            RETCASE(ConCM, Integer):
             {
                 int numconc = op>>8;
                 char *s = conc(&args[numargs-numconc], numconc, false);
                 freeargs(args, numargs, numargs-numconc);
                 result.setstr(s);
                 forcearg(result, op&Code_RetMask);
-                continue;
+                NEXTOP;
             }
-            case Code_Alias:
+            OPCASE(Alias):
             {
                 setalias(*identmap[op>>8], args[--numargs]);
-                continue;
+                NEXTOP;
             }
-            case Code_AliasArg:
+            OPCASE(AliasArg):
             {
                 setarg(*identmap[op>>8], args[--numargs]);
-                continue;
+                NEXTOP;
             }
-            case Code_AliasU:
+            OPCASE(AliasU):
             {
                 numargs -= 2;
                 setalias(args[numargs].getstr(), args[numargs+1]);
                 freearg(args[numargs]);
-                continue;
+                NEXTOP;
             }
             #define SKIPARGS(offset) offset
-            case Code_Call|Ret_Null:
-            case Code_Call|Ret_String:
-            case Code_Call|Ret_Float:
-            case Code_Call|Ret_Integer:
+            RETCASE(Call, Null):
+            RETCASE(Call, String):
+            RETCASE(Call, Float):
+            RETCASE(Call, Integer):
             {
                 #define FORCERESULT { \
                     freeargs(args, numargs, SKIPARGS(offset)); \
                     forcearg(result, op&Code_RetMask); \
-                    continue; \
+                    NEXTOP; \
                 }
                 //==================================================== CALLALIAS
                 #define CALLALIAS { \
@@ -5215,12 +6323,12 @@ static const uint *runcode(const uint *code, tagval &result)
                     FORCERESULT;
                 }
                 CALLALIAS;
-                continue;
+                NEXTOP;
             }
-            case Code_CallArg|Ret_Null:
-            case Code_CallArg|Ret_String:
-            case Code_CallArg|Ret_Float:
-            case Code_CallArg|Ret_Integer:
+            RETCASE(CallArg, Null):
+            RETCASE(CallArg, String):
+            RETCASE(CallArg, Float):
+            RETCASE(CallArg, Integer):
             {
                 forcenull(result);
                 ident *id = identmap[op>>13];
@@ -5231,15 +6339,15 @@ static const uint *runcode(const uint *code, tagval &result)
                     FORCERESULT;
                 }
                 CALLALIAS;
-                continue;
+                NEXTOP;
             }
             #undef SKIPARGS
 //==============================================================================
             #define SKIPARGS(offset) offset-1
-            case Code_CallU|Ret_Null:
-            case Code_CallU|Ret_String:
-            case Code_CallU|Ret_Float:
-            case Code_CallU|Ret_Integer:
+            RETCASE(CallU, Null):
+            RETCASE(CallU, String):
+            RETCASE(CallU, Float):
+            RETCASE(CallU, Integer):
             {
                 int callargs = op>>8,
                     offset = numargs-callargs;
@@ -5254,9 +6362,9 @@ static const uint *runcode(const uint *code, tagval &result)
                     {
                         freearg(args[numargs]);
                     }
-                    continue;
+                    NEXTOP;
                 }
-                ident *id = idents.access(idarg.s);
+                ident *id = idarg.type == Value_Macro ? findcodeident(idarg.s) : findident(idarg.s);
                 if(!id)
                 {
                 noid:
@@ -5285,7 +6393,7 @@ static const uint *runcode(const uint *code, tagval &result)
                         callcommand(id, &args[offset], callargs);
                         forcearg(result, op&Code_RetMask);
                         numargs = offset - 1;
-                        continue;
+                        NEXTOP;
                     }
                     case Id_Local:
                     {
@@ -5345,7 +6453,7 @@ static const uint *runcode(const uint *code, tagval &result)
                         }
                         freearg(idarg);
                         CALLALIAS;
-                        continue;
+                        NEXTOP;
                 }
             }
             #undef SKIPARGS
@@ -5357,6 +6465,10 @@ exit:
     return code;
 }
 
+#undef OPCASE
+#undef RETCASE
+#undef NEXTOP
+
 void executeret(const uint *code, tagval &result)
 {
     runcode(code, result);
@@ -5504,6 +6616,357 @@ int execute(const char *p)
     return i;
 }
 
+/* bytecode cache
+ *
+ * the top level code of every file run by execfile() is written out to
+ * cache/cubescript/ after being compiled, along with hashes of the source and
+ * of the ident table it was compiled against, which covers the argument
+ * formats and flags of the builtins as well. Compiling adds an alias for every
+ * unknown name it meets, so the names of those are stored too, and are added
+ * again in the same order when the code is loaded to give them the indices the
+ * code refers to. Cached code is only used when the source, the optimiser
+ * setting, the ident table before loading and the ident table after adding those
+ * aliases all match; files which had compile errors are not cached, so that
+ * their errors are reported every time they are run
+ */
+static constexpr uint codecachemagic = 0x43534243, // "CBSC"
+                      codecacheversion = 4;
+
+VARP(cscache, 0, 1, 1);
+
+static int codecachehits = 0,
+           codecachemisses = 0;
+static double codecacheloadtime = 0,
+              codecachecompiletime = 0;
+
+static std::uint64_t hashsource(const char *p, size_t len)
+{
+    std::uint64_t h = 14695981039346656037ULL;
+    for(size_t i = 0; i < len; ++i)
+    {
+        h = (h^static_cast<uchar>(p[i]))*1099511628211ULL;
+    }
+    return h;
+}
+
+static void codecachename(const char *file, string &name)
+{
+    uint h = 2166136261U;
+    for(const char *c = file; *c; c++)
+    {
+        h = (h^static_cast<uchar>(*c))*16777619U;
+    }
+    formatstring(name, "cache/cubescript/%08x.csc", h);
+    path(name);
+}
+
+//bytes left to read in f, so that lengths read from it can be checked against them
+static size_t remainingbytes(stream *f)
+{
+    stream::offset size = f->size(),
+                   pos = f->tell();
+    return pos >= 0 && size > pos ? size - pos : 0;
+}
+
+static bool readcodecache(stream *f, const char *file, const char *p, size_t len, vector<uint> &code)
+{
+    if(f->get<uint>() != codecachemagic || f->get<uint>() != codecacheversion || f->get<int>() != csoptimize)
+    {
+        return false;
+    }
+    string cachedfile;
+    uint filelen = f->get<uint>();
+    if(filelen >= sizeof(cachedfile) || f->read(cachedfile, filelen) != filelen)
+    {
+        return false;
+    }
+    cachedfile[filelen] = '\0';
+    if(std::strcmp(cachedfile, file) || f->get<std::uint64_t>() != len || f->get<std::uint64_t>() != hashsource(p, len))
+    {
+        return false;
+    }
+    uint prehash = f->get<uint>(),
+         precount = f->get<uint>(),
+         posthash = f->get<uint>(),
+         numnewidents = f->get<uint>();
+    if(prehash != identtablehash || precount != static_cast<uint>(identmap.length()))
+    {
+        return false;
+    }
+    vector<char *> names;
+    vector<int> flags;
+    bool ok = numnewidents <= remainingbytes(f)/(2*sizeof(uint));
+    //the hash the ident table will have once the recorded names are added as aliases
+    uint newhash = identtablehash;
+    for(uint i = 0; ok && i < numnewidents; ++i)
+    {
+        uint namelen = f->get<uint>();
+        if(!namelen || namelen > 0x10000)
+        {
+            ok = false;
+            break;
+        }
+        char *name = new char[namelen+1];
+        names.add(name);
+        flags.add(f->get<int>());
+        if(f->read(name, namelen) != namelen)
+        {
+            ok = false;
+            break;
+        }
+        name[namelen] = '\0';
+        newhash = hashident(newhash, name, Id_Alias);
+    }
+    uint codelen = ok ? f->get<uint>() : 0;
+    //nothing is registered until the whole entry has been read and checked
+    if(ok && newhash == posthash && codelen > 1 && codelen <= remainingbytes(f)/sizeof(uint))
+    {
+        code.setsize(0);
+        code.reserve(codelen);
+        ok = f->read(code.getbuf(), codelen*sizeof(uint)) == codelen*sizeof(uint);
+        if(ok)
+        {
+            code.advance(codelen);
+            ok = (code[0]&Code_OpMask) == Code_Start;
+        }
+        if(ok)
+        {
+            for(int i = 0; i < names.length(); ++i)
+            {
+                newident(names[i], flags[i]);
+            }
+            ok = identtablehash == posthash;
+        }
+    }
+    else
+    {
+        ok = false;
+    }
+    names.deletearrays();
+    return ok;
+}
+
+static bool loadcodecache(const char *file, const char *p, vector<uint> &code)
+{
+    string name;
+    codecachename(file, name);
+    stream *f = openrawfile(name, "rb");
+    if(!f)
+    {
+        return false;
+    }
+    bool loaded = readcodecache(f, file, p, std::strlen(p), code);
+    delete f;
+    return loaded;
+}
+
+static void savecodecache(const char *file, const char *p, uint prehash, int precount, const vector<uint> &code)
+{
+    string name;
+    codecachename(file, name);
+    stream *f = openrawfile(name, "wb");
+    if(!f)
+    {
+        return;
+    }
+    size_t len = std::strlen(p);
+    uint filelen = std::strlen(file);
+    f->put<uint>(codecachemagic);
+    f->put<uint>(codecacheversion);
+    f->put<int>(csoptimize);
+    f->put<uint>(filelen);
+    f->write(file, filelen);
+    f->put<std::uint64_t>(len);
+    f->put<std::uint64_t>(hashsource(p, len));
+    f->put<uint>(prehash);
+    f->put<uint>(precount);
+    f->put<uint>(identtablehash);
+    f->put<uint>(identmap.length() - precount);
+    for(int i = precount; i < identmap.length(); ++i)
+    {
+        const ident &id = *identmap[i];
+        uint namelen = std::strlen(id.name);
+        f->put<uint>(namelen);
+        f->put<int>(id.flags);
+        f->write(id.name, namelen);
+    }
+    f->put<uint>(code.length());
+    f->write(code.getbuf(), code.length()*sizeof(uint));
+    delete f;
+}
+
+/* executefile: runs the contents p of the file named file, as execute() does
+ *
+ * the file's compiled code is taken from the bytecode cache when it is still
+ * valid there, and written to it otherwise
+ */
+int executefile(const char *file, const char *p)
+{
+    vector<uint> code;
+    double start = getpreciseclockmillis();
+    if(cscache && loadcodecache(file, p, code))
+    {
+        codecachehits++;
+        codecacheloadtime += getpreciseclockmillis() - start;
+    }
+    else
+    {
+        uint prehash = identtablehash;
+        int precount = identmap.length(),
+            preerrors = numcodeerrors;
+        code.setsize(0);
+        code.reserve(64);
+        compilemain(code, p, Value_Integer);
+        if(cscache && numcodeerrors == preerrors)
+        {
+            savecodecache(file, p, prehash, precount, code);
+        }
+        codecachemisses++;
+        codecachecompiletime += getpreciseclockmillis() - start;
+    }
+    tagval result;
+    runcode(code.getbuf()+1, result);
+    if(static_cast<int>(code[0]) >= 0x100)
+    {
+        code.disown();
+    }
+    int i = result.getint();
+    freearg(result);
+    return i;
+}
+
+//prints how many files were run from the bytecode cache and the time spent getting their code
+static void cscachestats()
+{
+    conoutf("cscachestats: %d files loaded from cache in %.2f ms, %d compiled in %.2f ms",
+            codecachehits, codecacheloadtime, codecachemisses, codecachecompiletime);
+}
+
+/* csbench: runs a set of script microbenchmarks, each for num iterations, with
+ * the bytecode optimiser off and then on
+ *
+ * reports the iterations run per second, whether both runs gave the same result
+ * and how many strings per iteration the optimised run took from the heap
+ */
+static void csbench(int *num)
+{
+    struct benchscript
+    {
+        const char *name, *setup, *body;
+    };
+    static const benchscript scripts[] =
+    {
+        {
+            "loops",
+            "csbench_x = 0",
+            "loop csbench_i %d [if (< $csbench_i (* 1000 8)) [csbench_x = (+ $csbench_x (* 2 3))] [csbench_x = (- $csbench_x 1)]]; result $csbench_x"
+        },
+        {
+            "loopconcat",
+            "",
+            "loopconcat csbench_i %d [result (+ $csbench_i (<< 1 4))]"
+        },
+        {
+            "ui",
+            "csbench_label = [format \"%1: %2\" $arg1 (+ $arg2 1)]; "
+            "csbench_row = [if (>= $arg1 5) [csbench_label high $arg1] [csbench_label low (* $arg1 (- 10 8))]]",
+            "loopconcat csbench_i %d [csbench_row (mod $csbench_i 10)]"
+        }
+    };
+    int iterations = *num > 0 ? *num : 100000,
+        oldoptimize = csoptimize;
+    for(const benchscript &b : scripts)
+    {
+        double times[2];
+        tagval results[2];
+        uint heapallocs = 0;
+        for(int optimize = 0; optimize < 2; ++optimize)
+        {
+            csoptimize = optimize;
+            execute(b.setup); //reassigning the aliases drops their code compiled with the old setting
+            string body;
+            formatstring(body, b.body, iterations);
+            uint *code = compilecode(body);
+            uint oldheapallocs = stringstats.heapallocs;
+            double start = getpreciseclockmillis();
+            executeret(code, results[optimize]);
+            times[optimize] = getpreciseclockmillis() - start;
+            heapallocs = stringstats.heapallocs - oldheapallocs;
+            freecode(code);
+        }
+        conoutf("csbench: %s: %.2f K iterations/s unoptimised, %.2f K iterations/s optimised, %s, %.2f heap strings/iteration", b.name,
+                times[0] > 0 ? iterations/times[0] : 0,
+                times[1] > 0 ? iterations/times[1] : 0,
+                std::strcmp(results[0].getstr(), results[1].getstr()) ? "mismatch" : "identical",
+                static_cast<float>(heapallocs)/iterations);
+        freearg(results[0]);
+        freearg(results[1]);
+    }
+    csoptimize = oldoptimize;
+}
+
+/* identbench: times num lookups of every ident's name through the idents
+ * hashtable and through findident(), then runs an alias heavy script num times
+ * with the fast lookups off and on
+ *
+ * the script calls aliases which are only defined after it is compiled, so
+ * each call looks its alias up by name from the bytecode
+ */
+static void identbench(int *num)
+{
+    int iterations = *num > 0 ? *num : 100,
+        oldfastlookup = csfastlookup;
+    vector<char *> names;
+    for(int i = 0; i < identmap.length(); ++i)
+    {
+        names.add(newstring(identmap[i]->name));
+    }
+    int found[2] = {0, 0};
+    double times[2];
+    for(int fast = 0; fast < 2; ++fast)
+    {
+        csfastlookup = fast;
+        findident(names[0]); //builds the lookup tables outside of the timing
+        double start = getpreciseclockmillis();
+        for(int i = 0; i < iterations; ++i)
+        {
+            for(int j = 0; j < names.length(); ++j)
+            {
+                if(findident(names[j]))
+                {
+                    found[fast]++;
+                }
+            }
+        }
+        times[fast] = getpreciseclockmillis() - start;
+    }
+    conoutf("identbench: %d names, %.2f M lookups/s hashtable, %.2f M lookups/s perfect hash, %s", names.length(),
+            times[0] > 0 ? found[0]/(times[0]*1000) : 0,
+            times[1] > 0 ? found[1]/(times[1]*1000) : 0,
+            found[0] == found[1] ? "identical" : "mismatch");
+    names.deletearrays();
+
+    string body;
+    formatstring(body, "loop identbench_i %d [identbench_outer $identbench_i]; result $identbench_sum", iterations*100);
+    uint *code = compilecode(body);
+    for(int fast = 0; fast < 2; ++fast)
+    {
+        csfastlookup = fast;
+        execute("identbench_sum = 0; "
+                "identbench_inner = [identbench_sum = (+ $identbench_sum $arg1)]; "
+                "identbench_outer = [identbench_inner $arg1; identbench_inner 1; if (getalias identbench_sum) [identbench_inner 0]]");
+        double start = getpreciseclockmillis();
+        tagval result;
+        executeret(code, result);
+        times[fast] = getpreciseclockmillis() - start;
+        conoutf("identbench: alias calls, fast lookups %s: %.2f K iterations/s, result %s",
+                fast ? "on" : "off", times[fast] > 0 ? iterations*100/times[fast] : 0, result.getstr());
+        freearg(result);
+    }
+    freecode(code);
+    csfastlookup = oldfastlookup;
+}
+
 int execute(ident *id, tagval *args, int numargs, bool lookup)
 {
     tagval result;
@@ -5515,7 +6978,7 @@ int execute(ident *id, tagval *args, int numargs, bool lookup)
 
 int execident(const char *name, int noid, bool lookup)
 {
-    ident *id = idents.access(name);
+    ident *id = findident(name);
     return id ? execute(id, nullptr, 0, lookup) : noid;
 }
 
@@ -5541,12 +7004,12 @@ void initcscmds()
 {
     addcommand("local", static_cast<identfun>(nullptr), nullptr, Id_Local);
 
-    addcommand("defvar", reinterpret_cast<identfun>(+[] (char *name, int *min, int *cur, int *max, char *onchange) { { if(idents.access(name)) { debugcode("cannot redefine %s as a variable", name); return; } name = newstring(name); DefVar &def = defvars[name]; def.name = name; def.onchange = onchange[0] ? compilecode(onchange) : nullptr; def.i = variable(name, *min, *cur, *max, &def.i, def.onchange ? DefVar::changed : nullptr, 0); }; }), "siiis", Id_Command);
-    addcommand("defvarp", reinterpret_cast<identfun>(+[] (char *name, int *min, int *cur, int *max, char *onchange) { { if(idents.access(name)) { debugcode("cannot redefine %s as a variable", name); return; } name = newstring(name); DefVar &def = defvars[name]; def.name = name; def.onchange = onchange[0] ? compilecode(onchange) : nullptr; def.i = variable(name, *min, *cur, *max, &def.i, def.onchange ? DefVar::changed : nullptr, Idf_Persist); }; }), "siiis", Id_Command);
-    addcommand("deffvar", reinterpret_cast<identfun>(+[] (char *name, float *min, float *cur, float *max, char *onchange) { { if(idents.access(name)) { debugcode("cannot redefine %s as a variable", name); return; } name = newstring(name); DefVar &def = defvars[name]; def.name = name; def.onchange = onchange[0] ? compilecode(onchange) : nullptr; def.f = fvariable(name, *min, *cur, *max, &def.f, def.onchange ? DefVar::changed : nullptr, 0); }; }), "sfffs", Id_Command);
-    addcommand("deffvarp", reinterpret_cast<identfun>(+[] (char *name, float *min, float *cur, float *max, char *onchange) { { if(idents.access(name)) { debugcode("cannot redefine %s as a variable", name); return; } name = newstring(name); DefVar &def = defvars[name]; def.name = name; def.onchange = onchange[0] ? compilecode(onchange) : nullptr; def.f = fvariable(name, *min, *cur, *max, &def.f, def.onchange ? DefVar::changed : nullptr, Idf_Persist); }; }), "sfffs", Id_Command);
-    addcommand("defsvar", reinterpret_cast<identfun>(+[] (char *name, char *cur, char *onchange) { { if(idents.access(name)) { debugcode("cannot redefine %s as a variable", name); return; } name = newstring(name); DefVar &def = defvars[name]; def.name = name; def.onchange = onchange[0] ? compilecode(onchange) : nullptr; def.s = svariable(name, cur, &def.s, def.onchange ? DefVar::changed : nullptr, 0); }; }), "sss", Id_Command);
-    addcommand("defsvarp", reinterpret_cast<identfun>(+[] (char *name, char *cur, char *onchange) { { if(idents.access(name)) { debugcode("cannot redefine %s as a variable", name); return; } name = newstring(name); DefVar &def = defvars[name]; def.name = name; def.onchange = onchange[0] ? compilecode(onchange) : nullptr; def.s = svariable(name, cur, &def.s, def.onchange ? DefVar::changed : nullptr, Idf_Persist); }; }), "sss", Id_Command);
+    addcommand("defvar", reinterpret_cast<identfun>(+[] (char *name, int *min, int *cur, int *max, char *onchange) { { if(findident(name)) { debugcode("cannot redefine %s as a variable", name); return; } name = newstring(name); DefVar &def = defvars[name]; def.name = name; def.onchange = onchange[0] ? compilecode(onchange) : nullptr; def.i = variable(name, *min, *cur, *max, &def.i, def.onchange ? DefVar::changed : nullptr, 0); }; }), "siiis", Id_Command);
+    addcommand("defvarp", reinterpret_cast<identfun>(+[] (char *name, int *min, int *cur, int *max, char *onchange) { { if(findident(name)) { debugcode("cannot redefine %s as a variable", name); return; } name = newstring(name); DefVar &def = defvars[name]; def.name = name; def.onchange = onchange[0] ? compilecode(onchange) : nullptr; def.i = variable(name, *min, *cur, *max, &def.i, def.onchange ? DefVar::changed : nullptr, Idf_Persist); }; }), "siiis", Id_Command);
+    addcommand("deffvar", reinterpret_cast<identfun>(+[] (char *name, float *min, float *cur, float *max, char *onchange) { { if(findident(name)) { debugcode("cannot redefine %s as a variable", name); return; } name = newstring(name); DefVar &def = defvars[name]; def.name = name; def.onchange = onchange[0] ? compilecode(onchange) : nullptr; def.f = fvariable(name, *min, *cur, *max, &def.f, def.onchange ? DefVar::changed : nullptr, 0); }; }), "sfffs", Id_Command);
+    addcommand("deffvarp", reinterpret_cast<identfun>(+[] (char *name, float *min, float *cur, float *max, char *onchange) { { if(findident(name)) { debugcode("cannot redefine %s as a variable", name); return; } name = newstring(name); DefVar &def = defvars[name]; def.name = name; def.onchange = onchange[0] ? compilecode(onchange) : nullptr; def.f = fvariable(name, *min, *cur, *max, &def.f, def.onchange ? DefVar::changed : nullptr, Idf_Persist); }; }), "sfffs", Id_Command);
+    addcommand("defsvar", reinterpret_cast<identfun>(+[] (char *name, char *cur, char *onchange) { { if(findident(name)) { debugcode("cannot redefine %s as a variable", name); return; } name = newstring(name); DefVar &def = defvars[name]; def.name = name; def.onchange = onchange[0] ? compilecode(onchange) : nullptr; def.s = svariable(name, cur, &def.s, def.onchange ? DefVar::changed : nullptr, 0); }; }), "sss", Id_Command);
+    addcommand("defsvarp", reinterpret_cast<identfun>(+[] (char *name, char *cur, char *onchange) { { if(findident(name)) { debugcode("cannot redefine %s as a variable", name); return; } name = newstring(name); DefVar &def = defvars[name]; def.name = name; def.onchange = onchange[0] ? compilecode(onchange) : nullptr; def.s = svariable(name, cur, &def.s, def.onchange ? DefVar::changed : nullptr, Idf_Persist); }; }), "sss", Id_Command);
     addcommand("getvarmin", reinterpret_cast<identfun>(+[] (char *s) { intret(getvarmin(s)); }), "s", Id_Command);
     addcommand("getfvarmin", reinterpret_cast<identfun>(+[] (char *s) { floatret(getfvarmin(s)); }), "s", Id_Command);
     addcommand("getfvarmax", reinterpret_cast<identfun>(+[] (char *s) { floatret(getfvarmax(s)); }), "s", Id_Command);
@@ -5557,4 +7020,8 @@ void initcscmds()
     addcommand("push", reinterpret_cast<identfun>(pushcmd), "rTe", Id_Command);
     addcommand("alias", reinterpret_cast<identfun>(+[] (const char *name, tagval *v){ setalias(name, *v); v->type = Value_Null;}), "sT", Id_Command);
     addcommand("resetvar", reinterpret_cast<identfun>(resetvar), "s", Id_Command);
+    addcommand("cscachestats", reinterpret_cast<identfun>(cscachestats), "", Id_Command);
+    addcommand("csbench", reinterpret_cast<identfun>(csbench), "i", Id_Command);
+    addcommand("csallocstats", reinterpret_cast<identfun>(csallocstats), "", Id_Command);
+    addcommand("identbench", reinterpret_cast<identfun>(identbench), "i", Id_Command);
 }
@@ -156,6 +156,15 @@ int getclockmillis()
     return std::max(millis, totalmillis);
 }
 
+/* getpreciseclockmillis: returns a high resolution wall clock time in milliseconds
+ *
+ * not tied to the game clock; intended for timing engine work such as benchmarks
+ */
+double getpreciseclockmillis()
+{
+    return static_cast<double>(SDL_GetPerformanceCounter())*1000/SDL_GetPerformanceFrequency();
+}
+
 //identification info about engine
 std::string enginestr()
 {
@@ -28,6 +28,7 @@ extern bool initwarning(const char *desc, int level = Init_Reset, int type = Cha
 extern float loadprogress;
 
 extern int getclockmillis();
+extern double getpreciseclockmillis();
 
 
 #endif
@@ -75,6 +75,8 @@ enum
     Code_JumpFalse,
     Code_JumpResultTrue,  //60
     Code_JumpResultFalse,
+    Code_ConstArg,        //superinstructions added by optimizecode()
+    Code_CompareJump,
 
     Code_OpMask = 0x3F,
     Code_Ret = 6,
@@ -87,6 +89,12 @@ enum
     Ret_Float   = Value_Float<<Code_Ret,
 };
 
+//runcode() dispatches opcodes with computed goto when built with CS_THREADED_DISPATCH
+//by a compiler which supports it, and through a portable switch otherwise
+#if defined(CS_THREADED_DISPATCH) && defined(__GNUC__)
+    #define CS_COMPUTED_GOTO
+#endif
+
 #define PARSEFLOAT(name, type) \
     inline type parse##name(const char *s) \
     { \
@@ -283,6 +291,7 @@ extern char *executestr(ident *id, tagval *args, int numargs, bool lookup = fals
 extern uint *compilecode(const char *p);
 extern void freecode(uint *p);
 extern int execute(ident *id, tagval *args, int numargs, bool lookup = false);
+extern int executefile(const char *file, const char *p);
 extern bool executebool(ident *id, tagval *args, int numargs, bool lookup = false);
 extern void alias(const char *name, const char *action);
 extern void explodelist(const char *s, vector<char *> &elems, int limit = -1);
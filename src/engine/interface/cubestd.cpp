@@ -42,7 +42,7 @@ bool execfile(const char *cfgfile, bool msg)
                *oldsourcestr  = sourcestr;
     sourcefile = cfgfile;
     sourcestr = buf;
-    execute(buf);
+    executefile(cfgfile, buf);
     sourcefile = oldsourcefile;
     sourcestr = oldsourcestr;
     delete[] buf;
@@ -4535,6 +4535,32 @@ namespace UI
         }
     }
 
+    /* uibuildbench: rebuilds the shown user interfaces numbuilds times, as update()
+     * does once a frame, and reports the average time taken by a rebuild
+     */
+    void uibuildbench(int *numbuilds)
+    {
+        int num = *numbuilds > 0 ? *numbuilds : 100,
+            numwindows = static_cast<int>(world->children.size());
+        if(!numwindows)
+        {
+            conoutf(Console_Error, "uibuildbench: no user interfaces are shown");
+            return;
+        }
+#ifdef CS_COMPUTED_GOTO
+        const char *dispatch = "computed goto";
+#else
+        const char *dispatch = "switch";
+#endif
+        double start = getpreciseclockmillis();
+        for(int i = 0; i < num; ++i)
+        {
+            world->build();
+        }
+        double elapsed = getpreciseclockmillis() - start;
+        conoutf("uibuildbench: %d windows, %.3f ms per rebuild (%s dispatch)", numwindows, elapsed/num, dispatch);
+    }
+
     void inituicmds()
     {
 
@@ -4701,6 +4727,7 @@ namespace UI
 
         addcommand("uicontextscale", reinterpret_cast<identfun>(uicontextscalecmd), "", Id_Command);
         addcommand("newui", reinterpret_cast<identfun>(newui), "ssss", Id_Command);
+        addcommand("uibuildbench", reinterpret_cast<identfun>(uibuildbench), "i", Id_Command);
         addcommand("uiallowinput", reinterpret_cast<identfun>(uiallowinput), "b", Id_Command);
         addcommand("uieschide", reinterpret_cast<identfun>(uieschide), "b", Id_Command);
     }
@@ -24,6 +24,7 @@ class ImageData
         void scaleimage(int w, int h);
         void texmad(const vec &mul, const vec &add);
         void texpremul();
+        void replace(ImageData &d);
 
         bool texturedata(const char *tname, bool msg = true, int *compress = nullptr, int *wrap = nullptr, const char *tdir = nullptr, int ttype = 0);
         bool texturedata(Slot &slot, Slot::Tex &tex, bool msg = true, int *compress = nullptr, int *wrap = nullptr);
@@ -36,7 +37,6 @@ class ImageData
         int calcsize() const;
         void disown();
         void cleanup();
-        void replace(ImageData &d);
         void wraptex(SDL_Surface *s);
 
         void texreorient(bool flipx, bool flipy, bool swapxy, int type = 0);
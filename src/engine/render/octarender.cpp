@@ -4,6 +4,8 @@
 #include "../../shared/glemu.h"
 #include "../../shared/glexts.h"
 
+#include <unordered_set>
+
 #include "grass.h"
 #include "octarender.h"
 #include "rendergl.h"
@@ -14,11 +16,14 @@
 #include "shaderparam.h"
 #include "texture.h"
 
+#include "interface/console.h"
+#include "interface/control.h"
 #include "interface/menus.h"
 
 #include "world/entities.h"
 #include "world/light.h"
 #include "world/material.h"
+#include "world/octacompact.h"
 #include "world/octaworld.h"
 #include "world/physics.h"
 #include "world/world.h"
@@ -428,6 +433,7 @@ namespace
          sortval() {}
     };
 
+    //vacollect: the geometry of one vertex array as it is being collected; setupdata() copies it into the vbo buffers
     class vacollect : public verthash
     {
         public:
@@ -443,6 +449,11 @@ namespace
             vector<ushort> skyindices;
             hashtable<sortkey, sortval> indices;
 
+            vacollect()
+            {
+                clear();
+            }
+
             void clear()
             {
                 clearverts();
@@ -659,10 +670,6 @@ namespace
                 {
                     va->mapmodels.put(mapmodels.getbuf(), mapmodels.length());
                 }
-                if(decals.length())
-                {
-                    va->decals.put(decals.getbuf(), decals.length());
-                }
             }
 
             bool emptyva()
@@ -893,7 +900,7 @@ namespace
                 });
                 decaltexs.sort(decalkey::sort);
             }
-    } vc;
+    };
 
     int recalcprogress = 0;
 
@@ -924,7 +931,7 @@ namespace
 
     //index array must be >= numverts long
     //verts array must be >= Face_MaxVerts + 1 and >= numverts long
-    void addtris(VSlot &vslot, int orient, const sortkey &key, vertex *verts, const int *index, int numverts, int tj)
+    void addtris(vacollect &vc, VSlot &vslot, int orient, const sortkey &key, vertex *verts, const int *index, int numverts, int tj)
     {
         int &total = key.tex == Default_Sky ? vc.skytris : vc.worldtris,
              edge  = orient*(Face_MaxVerts+1);
@@ -1098,7 +1105,7 @@ namespace
     //verts: information about grass texs' face, array of vertices, must be >= face+3 long
     //numv: number of grass vertices
     //texture: index for the grass texture to use
-    void addgrasstri(int face, vertex *verts, int numv, ushort texture)
+    void addgrasstri(vacollect &vc, int face, vertex *verts, int numv, ushort texture)
     {
         grasstri &g = vc.grasstris.add();
         int i1, i2, i3, i4;
@@ -1253,7 +1260,7 @@ namespace
         return vec(-yaw.y*pitch.x, yaw.x*pitch.x, pitch.y);
     }
 
-    void addcubeverts(VSlot &vslot, int orient, vec *pos, ushort texture, vertinfo *vinfo, int numverts, int tj = -1, int grassy = 0, bool alpha = false, int layer = BlendLayer_Top)
+    void addcubeverts(vacollect &vc, VSlot &vslot, int orient, vec *pos, ushort texture, vertinfo *vinfo, int numverts, int tj = -1, int grassy = 0, bool alpha = false, int layer = BlendLayer_Top)
     {
         vec4<float> sgen, tgen;
         calctexgen(vslot, orient, sgen, tgen);
@@ -1329,7 +1336,7 @@ namespace
             }
         }
         sortkey key(texture, vslot.scroll.iszero() ? Orient_Any : orient, layer&BlendLayer_Bottom ? layer : BlendLayer_Top, alpha ? (vslot.refractscale > 0 ? Alpha_Refract : (vslot.alphaback ? Alpha_Back : Alpha_Front)) : Alpha_None);
-        addtris(vslot, orient, key, verts, index, numverts, tj);
+        addtris(vc, vslot, orient, key, verts, index, numverts, tj);
         if(grassy)
         {
             for(int i = 0; i < numverts-2; i += 2)
@@ -1345,17 +1352,17 @@ namespace
                 }
                 if(grassy > 1 && faces==3)
                 {
-                    addgrasstri(i, verts, 4, texture);
+                    addgrasstri(vc, i, verts, 4, texture);
                 }
                 else
                 {
                     if(faces&1)
                     {
-                        addgrasstri(i, verts, 3, texture);
+                        addgrasstri(vc, i, verts, 3, texture);
                     }
                     if(faces&2)
                     {
-                        addgrasstri(i+1, verts, 3, texture);
+                        addgrasstri(vc, i+1, verts, 3, texture);
                     }
                 }
             }
@@ -1569,7 +1576,7 @@ namespace
         --neighbordepth;
     }
 
-    void gencubeverts(cube &c, const ivec &co, int size)
+    void gencubeverts(vacollect &vc, cube &c, const ivec &co, int size)
     {
         if(!(c.visible&0xC0))
         {
@@ -1637,18 +1644,18 @@ namespace
                     grassy = vslot.slot->grass && i!=Orient_Bottom ? (vis!=3 || convex ? 1 : 2) : 0;
                 if(!c.ext)
                 {
-                    addcubeverts(vslot, i, pos, c.texture[i], nullptr, numverts, hastj, grassy, (c.material&Mat_Alpha)!=0);
+                    addcubeverts(vc, vslot, i, pos, c.texture[i], nullptr, numverts, hastj, grassy, (c.material&Mat_Alpha)!=0);
                 }
                 else
                 {
                     const surfaceinfo &surf = c.ext->surfaces[i];
                     if(!surf.numverts || surf.numverts&BlendLayer_Top)
                     {
-                        addcubeverts(vslot, i, pos, c.texture[i], verts, numverts, hastj, grassy, (c.material&Mat_Alpha)!=0, surf.numverts&BlendLayer_Blend);
+                        addcubeverts(vc, vslot, i, pos, c.texture[i], verts, numverts, hastj, grassy, (c.material&Mat_Alpha)!=0, surf.numverts&BlendLayer_Blend);
                     }
                     if(surf.numverts&BlendLayer_Bottom)
                     {
-                        addcubeverts(vslot, i, pos, 0, verts, numverts, hastj, 0, false, surf.numverts&BlendLayer_Top ? BlendLayer_Bottom : BlendLayer_Top);
+                        addcubeverts(vc, vslot, i, pos, 0, verts, numverts, hastj, 0, false, surf.numverts&BlendLayer_Top ? BlendLayer_Bottom : BlendLayer_Top);
                     }
                 }
             }
@@ -1657,7 +1664,8 @@ namespace
 
     ////////// Vertex Arrays //////////////
 
-    vtxarray *newva(const ivec &o, int size)
+    //creates the va for the collected geometry; the vbo data is filled in by finishva()
+    vtxarray *newva(const vacollect &vc, const ivec &o, int size)
     {
         auto *va = new vtxarray;
         va->parent = nullptr;
@@ -1670,29 +1678,10 @@ namespace
         va->bbmax = va->alphamax = va->refractmax = va->skymax = ivec(-1, -1, -1);
         va->hasmerges = 0;
         va->mergelevel = -1;
-
-        vc.setupdata(va);
-
-        if(va->alphafronttris || va->alphabacktris || va->refracttris)
+        if(vc.decals.length())
         {
-            va->alphamin = ivec(vec(vc.alphamin).mul(8)).shr(3);
-            va->alphamax = ivec(vec(vc.alphamax).mul(8)).add(7).shr(3);
+            va->decals.put(vc.decals.getbuf(), vc.decals.length());
         }
-        if(va->refracttris)
-        {
-            va->refractmin = ivec(vec(vc.refractmin).mul(8)).shr(3);
-            va->refractmax = ivec(vec(vc.refractmax).mul(8)).add(7).shr(3);
-        }
-        if(va->sky && vc.skymax.x >= 0)
-        {
-            va->skymin = ivec(vec(vc.skymin).mul(8)).shr(3);
-            va->skymax = ivec(vec(vc.skymax).mul(8)).add(7).shr(3);
-        }
-
-        wverts += va->verts;
-        wtris  += va->tris + va->alphabacktris + va->alphafronttris + va->refracttris + va->decaltris;
-        allocva++;
-        valist.add(va);
         return va;
     }
 
@@ -1705,11 +1694,27 @@ namespace
     };
 
     const int maxmergelevel = 12;
-    int vahasmerges = 0,
-        vamergemax = 0;
-    vector<mergedface> vamerges[maxmergelevel+1];
 
-    int genmergedfaces(cube &c, const ivec &co, int size, int minlevel = -1)
+    //vabuilder: the state of one traversal which builds vertex arrays
+    struct vabuilder
+    {
+        vacollect *vc;
+        vector<mergedface> vamerges[maxmergelevel+1];
+        int vahasmerges,
+            vamergemax,
+            entdepth;
+        octaentities *entstack[32];
+        vector<vtxarray *> varoot;
+
+        vabuilder() : vc(new vacollect), vahasmerges(0), vamergemax(0), entdepth(-1) {}
+
+        ~vabuilder()
+        {
+            delete vc;
+        }
+    };
+
+    int genmergedfaces(vabuilder &b, cube &c, const ivec &co, int size, int minlevel = -1)
     {
         if(!c.ext || c.isempty())
         {
@@ -1727,7 +1732,7 @@ namespace
                 {
                     if(minlevel < 0)
                     {
-                        vahasmerges |= Merge_Part;
+                        b.vahasmerges |= Merge_Part;
                     }
                     continue;
                 }
@@ -1753,26 +1758,26 @@ namespace
                     }
                     if(surf.numverts&BlendLayer_Top)
                     {
-                        vamerges[level].add(mf);
+                        b.vamerges[level].add(mf);
                     }
                     if(surf.numverts&BlendLayer_Bottom)
                     {
                         mf.numverts &= ~BlendLayer_Blend;
                         mf.numverts |= surf.numverts&BlendLayer_Top ? BlendLayer_Bottom : BlendLayer_Top;
-                        vamerges[level].add(mf);
+                        b.vamerges[level].add(mf);
                     }
                 }
             }
         }
         if(maxlevel >= 0)
         {
-            vamergemax = std::max(vamergemax, maxlevel);
-            vahasmerges |= Merge_Origin;
+            b.vamergemax = std::max(b.vamergemax, maxlevel);
+            b.vahasmerges |= Merge_Origin;
         }
         return maxlevel;
     }
 
-    int findmergedfaces(cube &c, const ivec &co, int size, int csi, int minlevel)
+    int findmergedfaces(vabuilder &b, cube &c, const ivec &co, int size, int csi, int minlevel)
     {
         if(c.ext && c.ext->va && !(c.ext->va->hasmerges&Merge_Origin))
         {
@@ -1784,14 +1789,14 @@ namespace
             for(int i = 0; i < 8; ++i)
             {
                 ivec o(i, co, size/2);
-                int level = findmergedfaces(c.children[i], o, size/2, csi-1, minlevel);
+                int level = findmergedfaces(b, c.children[i], o, size/2, csi-1, minlevel);
                 maxlevel = std::max(maxlevel, level);
             }
             return maxlevel;
         }
         else if(c.ext && c.merged)
         {
-            return genmergedfaces(c, co, size, minlevel);
+            return genmergedfaces(b, c, co, size, minlevel);
         }
         else
         {
@@ -1799,9 +1804,9 @@ namespace
         }
     }
 
-    void addmergedverts(int level, const ivec &o)
+    void addmergedverts(vabuilder &b, int level, const ivec &o)
     {
-        vector<mergedface> &mfl = vamerges[level];
+        vector<mergedface> &mfl = b.vamerges[level];
         if(mfl.empty())
         {
             return;
@@ -1819,14 +1824,14 @@ namespace
             }
             VSlot &vslot = lookupvslot(mf.tex, true);
             int grassy = vslot.slot->grass && mf.orient!=Orient_Bottom && mf.numverts&BlendLayer_Top ? 2 : 0;
-            addcubeverts(vslot, mf.orient, pos, mf.tex, mf.verts, numverts, mf.tjoints, grassy, (mf.mat&Mat_Alpha)!=0, mf.numverts&BlendLayer_Blend);
-            vahasmerges |= Merge_Use;
+            addcubeverts(*b.vc, vslot, mf.orient, pos, mf.tex, mf.verts, numverts, mf.tjoints, grassy, (mf.mat&Mat_Alpha)!=0, mf.numverts&BlendLayer_Blend);
+            b.vahasmerges |= Merge_Use;
         }
         mfl.setsize(0);
     }
 
     //recursively finds and adds decals to vacollect object vc
-    void finddecals(vtxarray *va)
+    void finddecals(vacollect &vc, vtxarray *va)
     {
         if(va->hasmerges&(Merge_Origin|Merge_Part))
         {
@@ -1836,17 +1841,18 @@ namespace
             }
             for(int i = 0; i < va->children.length(); i++)
             {
-                finddecals(va->children[i]);
+                finddecals(vc, va->children[i]);
             }
         }
     }
 
-    void rendercube(cube &c, const ivec &co, int size, int csi, int &maxlevel) // creates vertices and indices ready to be put into a va
+    void rendercube(vabuilder &b, cube &c, const ivec &co, int size, int csi, int &maxlevel) // creates vertices and indices ready to be put into a va
     {
+        vacollect &vc = *b.vc;
         if(c.ext && c.ext->va)
         {
             maxlevel = std::max(maxlevel, c.ext->va->mergelevel);
-            finddecals(c.ext->va);
+            finddecals(vc, c.ext->va);
             return; // don't re-render
         }
 
@@ -1858,7 +1864,7 @@ namespace
             {
                 ivec o(i, co, size/2);
                 int level = -1;
-                rendercube(c.children[i], o, size/2, csi-1, level);
+                rendercube(b, c.children[i], o, size/2, csi-1, level);
                 if(level >= csi)
                 {
                     c.escaped |= 1<<i;
@@ -1867,9 +1873,9 @@ namespace
             }
             --neighbordepth;
 
-            if(csi <= maxmergelevel && vamerges[csi].length())
+            if(csi <= maxmergelevel && b.vamerges[csi].length())
             {
-                addmergedverts(csi, co);
+                addmergedverts(b, csi, co);
             }
             if(c.ext && c.ext->ents)
             {
@@ -1887,10 +1893,10 @@ namespace
 
         if(!(c.isempty()))
         {
-            gencubeverts(c, co, size);
+            gencubeverts(vc, c, co, size);
             if(c.merged)
             {
-                maxlevel = std::max(maxlevel, genmergedfaces(c, co, size));
+                maxlevel = std::max(maxlevel, genmergedfaces(b, c, co, size));
             }
         }
         if(c.material != Mat_Air)
@@ -1909,13 +1915,13 @@ namespace
             }
         }
 
-        if(csi <= maxmergelevel && vamerges[csi].length())
+        if(csi <= maxmergelevel && b.vamerges[csi].length())
         {
-            addmergedverts(csi, co);
+            addmergedverts(b, csi, co);
         }
     }
 
-    void calcgeombb(const ivec &co, int size, ivec &bbmin, ivec &bbmax)
+    void calcgeombb(const vacollect &vc, const ivec &co, int size, ivec &bbmin, ivec &bbmax)
     {
         vec vmin(co),
             vmax = vmin;
@@ -1932,42 +1938,69 @@ namespace
         bbmax = ivec(vmax.mul(8)).add(7).shr(3);
     }
 
-    int entdepth = -1;
-    octaentities *entstack[32];
+    //copies the collected geometry of a va into the vbos
+    void finishva(vacollect &vc, vtxarray *va, const ivec &co, int size)
+    {
+        vc.setupdata(va);
 
-    void setva(cube &c, const ivec &co, int size, int csi)
+        if(va->alphafronttris || va->alphabacktris || va->refracttris)
+        {
+            va->alphamin = ivec(vec(vc.alphamin).mul(8)).shr(3);
+            va->alphamax = ivec(vec(vc.alphamax).mul(8)).add(7).shr(3);
+        }
+        if(va->refracttris)
+        {
+            va->refractmin = ivec(vec(vc.refractmin).mul(8)).shr(3);
+            va->refractmax = ivec(vec(vc.refractmax).mul(8)).add(7).shr(3);
+        }
+        if(va->sky && vc.skymax.x >= 0)
+        {
+            va->skymin = ivec(vec(vc.skymin).mul(8)).shr(3);
+            va->skymax = ivec(vec(vc.skymax).mul(8)).add(7).shr(3);
+        }
+
+        wverts += va->verts;
+        wtris  += va->tris + va->alphabacktris + va->alphafronttris + va->refracttris + va->decaltris;
+        allocva++;
+        valist.add(va);
+
+        calcgeombb(vc, co, size, va->geommin, va->geommax);
+        calcmatbb(va, co, size, vc.matsurfs);
+    }
+
+    void setva(vabuilder &b, cube &c, const ivec &co, int size, int csi)
     {
+        vacollect &vc = *b.vc;
         int vamergeoffset[maxmergelevel+1];
         for(int i = 0; i < maxmergelevel+1; ++i)
         {
-            vamergeoffset[i] = vamerges[i].length();
+            vamergeoffset[i] = b.vamerges[i].length();
         }
         vc.origin = co;
         vc.size = size;
-        for(int i = 0; i < entdepth+1; ++i)
+        for(int i = 0; i < b.entdepth+1; ++i)
         {
-            octaentities *oe = entstack[i];
+            octaentities *oe = b.entstack[i];
             if(oe->decals.length())
             {
                 vc.extdecals.add(oe);
             }
         }
         int maxlevel = -1;
-        rendercube(c, co, size, csi, maxlevel);
+        rendercube(b, c, co, size, csi, maxlevel);
         if(size == std::min(0x1000, worldsize/2) || !vc.emptyva())
         {
-            vtxarray *va = newva(co, size);
+            vtxarray *va = newva(vc, co, size);
             ext(c).va = va;
-            calcgeombb(co, size, va->geommin, va->geommax);
-            calcmatbb(va, co, size, vc.matsurfs);
-            va->hasmerges = vahasmerges;
-            va->mergelevel = vamergemax;
+            va->hasmerges = b.vahasmerges;
+            va->mergelevel = b.vamergemax;
+            finishva(vc, va, co, size);
         }
         else
         {
             for(int i = 0; i < maxmergelevel+1; ++i)
             {
-                vamerges[i].setsize(vamergeoffset[i]);
+                b.vamerges[i].setsize(vamergeoffset[i]);
             }
         }
         vc.clear();
@@ -2019,83 +2052,206 @@ namespace
     VARF(vafacemin, 0, 96, 256*256, rootworld.allchanged());
     VARF(vacubesize, 32, 128, 0x1000, rootworld.allchanged()); //note that performance drops off at low values -> large numbers of VAs
 
-    //updates the va that contains the cube c
-    int updateva(cube *c, const ivec &co, int size, int csi)
+    /* dirty cells
+     *
+     * the world is split into cells of dirtycellsize, and every cell with any
+     * geometry gets a va of its own (or has all of it in vas below), so that the
+     * vas above a cell never hold geometry from inside it
+     *
+     * edits mark the cells they touch as dirty and retire the vas covering them.
+     * Retired vas larger than a cell only hold geometry of cubes larger than a
+     * cell, so they are rebuilt by the first octarender after the edit and then
+     * destroyed. The retired vas inside a cell keep being drawn, with the cell's
+     * current mapmodels, until the cell is released for rebuilding; cells are
+     * released oldest first, as many per frame as varebuildbudget allows. Until
+     * a cell is released, updateva keeps the vas still attached inside it and
+     * builds nothing else there
+     */
+    struct dirtycell
+    {
+        ivec o;
+        double queued;
+    };
+
+    std::vector<dirtycell> dirtycells,      //waiting to be rebuilt, oldest first
+                           releasedcells;   //released, rebuilt by the next octarender
+    std::unordered_set<uint64_t> dirtykeys; //the cells in dirtycells
+    std::vector<vtxarray *> retiredvas;
+    int dirtycellsize = 0,
+        rebuiltcells = 0,
+        framecells = 0,     //cells rebuilt this frame
+        batchcells = 0,     //cells rebuilt since the queue was last empty
+        batchframes = 0,    //frames those were rebuilt over
+        lastbatchcells = 0,
+        lastbatchframes = 0;
+    double lastrebuildlatency = 0,
+           maxrebuildlatency = 0,
+           totalrebuildlatency = 0;
+
+    uint64_t dirtykey(const ivec &o)
     {
-        int ccount = 0,
-            cmergemax  = vamergemax,
-            chasmerges = vahasmerges;
-        neighborstack[++neighbordepth] = c;
-        for(int i = 0; i < 8; ++i)                                  // counting number of semi-solid/solid children cubes
+        return static_cast<uint64_t>(o.x/dirtycellsize) | static_cast<uint64_t>(o.y/dirtycellsize)<<21 | static_cast<uint64_t>(o.z/dirtycellsize)<<42;
+    }
+
+    //picks the cell size for the current world; only while no cells are queued, as it keys them
+    void resetdirtycellsize()
+    {
+        if(!dirtycells.empty() || !releasedcells.empty())
+        {
+            return;
+        }
+        dirtycellsize = std::min(0x1000, worldsize/2);
+        while(dirtycellsize/2 >= 2*vacubesize)
+        {
+            dirtycellsize /= 2;
+        }
+    }
+
+    //whether any dirty cell which has not been released yet overlaps the cube at o
+    bool vadirty(const ivec &o, int size)
+    {
+        if(dirtycells.empty())
         {
-            int count = 0,
-                childpos = varoot.length();
-            ivec o(i, co, size);                                    //translate cube vector to world vector
-            vamergemax = 0;
-            vahasmerges = 0;
-            if(c[i].ext && c[i].ext->va)
+            return false;
+        }
+        if(size <= dirtycellsize)
+        {
+            return dirtykeys.count(dirtykey(ivec(o).mask(~(dirtycellsize-1)))) > 0;
+        }
+        uint64_t span = size/dirtycellsize;
+        if(dirtycells.size() < span*span*span)
+        {
+            for(const dirtycell &d : dirtycells)
             {
-                varoot.add(c[i].ext->va);
-                if(c[i].ext->va->hasmerges&Merge_Origin)
+                if(d.o.x >= o.x && d.o.y >= o.y && d.o.z >= o.z && d.o.x < o.x+size && d.o.y < o.y+size && d.o.z < o.z+size)
                 {
-                    findmergedfaces(c[i], o, size, csi, csi);
+                    return true;
                 }
             }
-            else
+            return false;
+        }
+        for(int x = o.x; x < o.x+size; x += dirtycellsize)
+        {
+            for(int y = o.y; y < o.y+size; y += dirtycellsize)
             {
-                if(c[i].children)
+                for(int z = o.z; z < o.z+size; z += dirtycellsize)
                 {
-                    if(c[i].ext && c[i].ext->ents)
+                    if(dirtykeys.count(dirtykey(ivec(x, y, z))))
                     {
-                        entstack[++entdepth] = c[i].ext->ents;
-                    }
-                    count += updateva(c[i].children, o, size/2, csi-1);
-                    if(c[i].ext && c[i].ext->ents)
-                    {
-                        --entdepth;
+                        return true;
                     }
                 }
-                else
+            }
+        }
+        return false;
+    }
+
+    int updateva(vabuilder &b, cube *c, const ivec &co, int size, int csi);
+
+    //keeps the vas of a dirty cell which were not retired in the va tree, as roots
+    void addfrozenvas(vabuilder &b, const cube &c)
+    {
+        if(c.ext && c.ext->va)
+        {
+            b.varoot.add(c.ext->va);
+        }
+        else if(c.children)
+        {
+            for(int i = 0; i < 8; ++i)
+            {
+                addfrozenvas(b, c.children[i]);
+            }
+        }
+    }
+
+    //updates child i of the cube family c, adding its face count and merges into the accumulators of updateva
+    void updatechild(vabuilder &b, cube *c, int i, const ivec &co, int size, int csi, int &ccount, int &cmergemax, int &chasmerges)
+    {
+        int count = 0,
+            childpos = b.varoot.length();
+        ivec o(i, co, size);                                        //translate cube vector to world vector
+        b.vamergemax = 0;
+        b.vahasmerges = 0;
+        if(size == dirtycellsize && vadirty(o, size))
+        {
+            addfrozenvas(b, c[i]); //the rest is left to the retired vas until the cell is released
+            return;
+        }
+        if(c[i].ext && c[i].ext->va)
+        {
+            b.varoot.add(c[i].ext->va);
+            if(c[i].ext->va->hasmerges&Merge_Origin)
+            {
+                findmergedfaces(b, c[i], o, size, csi, csi);
+            }
+        }
+        else
+        {
+            if(c[i].children)
+            {
+                if(c[i].ext && c[i].ext->ents)
+                {
+                    b.entstack[++b.entdepth] = c[i].ext->ents;
+                }
+                count += updateva(b, c[i].children, o, size/2, csi-1);
+                if(c[i].ext && c[i].ext->ents)
                 {
-                    count += setcubevisibility(c[i], o, size);
+                    --b.entdepth;
                 }
-                int tcount = count + (csi <= maxmergelevel ? vamerges[csi].length() : 0);
-                if(tcount > vafacemax || (tcount >= vafacemin && size >= vacubesize) || size == std::min(0x1000, worldsize/2))
+            }
+            else
+            {
+                count += setcubevisibility(c[i], o, size);
+            }
+            int tcount = count + (csi <= maxmergelevel ? b.vamerges[csi].length() : 0);
+            if(tcount > vafacemax || (tcount >= vafacemin && size >= vacubesize) || size == dirtycellsize || size == std::min(0x1000, worldsize/2))
+            {
+                setva(b, c[i], o, size, csi);
+                if(c[i].ext && c[i].ext->va)
                 {
-                    setva(c[i], o, size, csi);
-                    if(c[i].ext && c[i].ext->va)
+                    while(b.varoot.length() > childpos)
                     {
-                        while(varoot.length() > childpos)
-                        {
-                            vtxarray *child = varoot.pop();
-                            c[i].ext->va->children.add(child);
-                            child->parent = c[i].ext->va;
-                        }
-                        varoot.add(c[i].ext->va);
-                        if(vamergemax > size)
-                        {
-                            cmergemax = std::max(cmergemax, vamergemax);
-                            chasmerges |= vahasmerges&~Merge_Use;
-                        }
-                        continue;
+                        vtxarray *child = b.varoot.pop();
+                        c[i].ext->va->children.add(child);
+                        child->parent = c[i].ext->va;
                     }
-                    else
+                    b.varoot.add(c[i].ext->va);
+                    if(b.vamergemax > size)
                     {
-                        count = 0;
+                        cmergemax = std::max(cmergemax, b.vamergemax);
+                        chasmerges |= b.vahasmerges&~Merge_Use;
                     }
+                    return;
+                }
+                else
+                {
+                    count = 0;
                 }
             }
-            if(csi+1 <= maxmergelevel && vamerges[csi].length())
-            {
-                vamerges[csi+1].move(vamerges[csi]);
-            }
-            cmergemax = std::max(cmergemax, vamergemax);
-            chasmerges |= vahasmerges;
-            ccount += count;
+        }
+        if(csi+1 <= maxmergelevel && b.vamerges[csi].length())
+        {
+            b.vamerges[csi+1].move(b.vamerges[csi]);
+        }
+        cmergemax = std::max(cmergemax, b.vamergemax);
+        chasmerges |= b.vahasmerges;
+        ccount += count;
+    }
+
+    //updates the va that contains the cube c
+    int updateva(vabuilder &b, cube *c, const ivec &co, int size, int csi)
+    {
+        int ccount = 0,
+            cmergemax  = b.vamergemax,
+            chasmerges = b.vahasmerges;
+        neighborstack[++neighbordepth] = c;
+        for(int i = 0; i < 8; ++i)                                  // counting number of semi-solid/solid children cubes
+        {
+            updatechild(b, c, i, co, size, csi, ccount, cmergemax, chasmerges);
         }
         --neighbordepth;
-        vamergemax = cmergemax;
-        vahasmerges = chasmerges;
+        b.vamergemax = cmergemax;
+        b.vahasmerges = chasmerges;
 
         return ccount;
     }
@@ -2130,6 +2286,29 @@ namespace
         }
     }
 
+    //flags the vslots of every face the vertex arrays will be built from
+    void gathervslots(const cube *c, const ivec &o, int size, std::vector<uchar> &used)
+    {
+        for(int i = 0; i < 8; ++i)
+        {
+            ivec co(i, o, size);
+            if(c[i].children)
+            {
+                gathervslots(c[i].children, co, size>>1, used);
+            }
+            else if(!(c[i].isempty()))
+            {
+                for(int j = 0; j < 6; ++j)
+                {
+                    if(visibletris(c[i], j, co, size))
+                    {
+                        used[c[i].texture[j]] = 1;
+                    }
+                }
+            }
+        }
+    }
+
     void precachetextures()
     {
         std::vector<int> texs;
@@ -2385,6 +2564,220 @@ void clearvas(cube *c)
     }
 }
 
+/* retireva: detaches a va from the va tree's rebuild, leaving it to be drawn
+ * until the area it covers has been rebuilt
+ *
+ * the caller is expected to clear the owning cube's va pointer; the va's
+ * mapmodel and decal lists are dropped, as the octaentities they point to are
+ * freed along with the cube's entities. The mapmodel list is filled in again
+ * by refreshretiredvas once the entities are back in the octree
+ */
+void retireva(vtxarray *va)
+{
+    va->mapmodels.setsize(0);
+    va->decals.setsize(0);
+    retiredvas.push_back(va);
+}
+
+/* queuevarebuild: marks the cells overlapping the box bbmin-bbmax as dirty
+ *
+ * to be called after the vas in the box have been retired; every child of a
+ * retired va becomes a root, so that the ones still attached to their cubes are
+ * not drawn both by their retired parent and by the parent built to replace it,
+ * and so that retired vas can be destroyed in any order
+ */
+void queuevarebuild(const ivec &bbmin, const ivec &bbmax)
+{
+    for(vtxarray *va : retiredvas)
+    {
+        for(int i = 0; i < va->children.length(); i++)
+        {
+            vtxarray *child = va->children[i];
+            child->parent = nullptr;
+            varoot.add(child);
+        }
+        va->children.setsize(0);
+    }
+    resetdirtycellsize();
+    ivec cmin = ivec(bbmin).max(0).mask(~(dirtycellsize-1)),
+         cmax = ivec(bbmax).min(worldsize-1);
+    double now = getpreciseclockmillis();
+    for(int x = cmin.x; x <= cmax.x; x += dirtycellsize)
+    {
+        for(int y = cmin.y; y <= cmax.y; y += dirtycellsize)
+        {
+            for(int z = cmin.z; z <= cmax.z; z += dirtycellsize)
+            {
+                ivec o(x, y, z);
+                if(dirtykeys.insert(dirtykey(o)).second)
+                {
+                    dirtycells.push_back({o, now});
+                }
+            }
+        }
+    }
+}
+
+/* releasevarebuild: lets the next octarender rebuild the numcells oldest dirty
+ * cells, returning how many were released
+ */
+int releasevarebuild(int numcells)
+{
+    int num = std::clamp(numcells, 0, static_cast<int>(dirtycells.size()));
+    for(int i = 0; i < num; ++i)
+    {
+        releasedcells.push_back(dirtycells[i]);
+        dirtykeys.erase(dirtykey(dirtycells[i].o));
+    }
+    dirtycells.erase(dirtycells.begin(), dirtycells.begin() + num);
+    return num;
+}
+
+/* finishvarebuild: to be called after octarender has rebuilt the released cells
+ *
+ * destroys the retired vas which have been replaced: those larger than a cell,
+ * which octarender always rebuilds, and those whose cell is no longer dirty.
+ * Also updates the rebuild latency counters
+ */
+void finishvarebuild()
+{
+    double now = getpreciseclockmillis();
+    for(const dirtycell &d : releasedcells)
+    {
+        lastrebuildlatency = now - d.queued;
+        maxrebuildlatency = std::max(maxrebuildlatency, lastrebuildlatency);
+        totalrebuildlatency += lastrebuildlatency;
+        rebuiltcells++;
+        framecells++;
+    }
+    releasedcells.clear();
+    for(uint i = 0; i < retiredvas.size();)
+    {
+        vtxarray *va = retiredvas[i];
+        if(va->size <= dirtycellsize && vadirty(va->o, va->size))
+        {
+            i++;
+            continue;
+        }
+        retiredvas.erase(retiredvas.begin() + i);
+        destroyva(va);
+    }
+}
+
+/* endvarebuildframe: to be called once a frame after the rebuild passes
+ *
+ * counts the frames the current batch of edits has been rebuilt over, for vaqueuestats
+ */
+void endvarebuildframe()
+{
+    if(framecells)
+    {
+        batchcells += framecells;
+        batchframes++;
+        framecells = 0;
+    }
+    if(dirtycells.empty() && batchcells)
+    {
+        lastbatchcells = batchcells;
+        lastbatchframes = batchframes;
+        batchcells = batchframes = 0;
+    }
+}
+
+//adds the octaentities with mapmodels below c to va, stopping at cubes which have a va of their own or are covered by another retired va
+static void findretiredmapmodels(vtxarray *va, const cube *c, const std::unordered_set<const cube *> &retiredcubes)
+{
+    for(int i = 0; i < 8; ++i)
+    {
+        if(retiredcubes.count(&c[i]))
+        {
+            continue;
+        }
+        if(c[i].ext)
+        {
+            if(c[i].ext->va)
+            {
+                continue;
+            }
+            if(c[i].ext->ents && c[i].ext->ents->mapmodels.length())
+            {
+                va->mapmodels.add(c[i].ext->ents);
+            }
+        }
+        if(c[i].children)
+        {
+            findretiredmapmodels(va, c[i].children, retiredcubes);
+        }
+    }
+}
+
+/* refreshretiredvas: points the mapmodel lists of the retired vas inside dirty
+ * cells at the octaentities now in their area
+ *
+ * to be called after the entities have been put back into the octree; the
+ * cube of each retired va has no va of its own any more, so its area is walked
+ * down to the vas still attached below it, or to the area of another retired va
+ */
+void refreshretiredvas()
+{
+    std::unordered_set<const cube *> retiredcubes;
+    std::vector<const cube *> cubes(retiredvas.size(), nullptr);
+    for(uint i = 0; i < retiredvas.size(); ++i)
+    {
+        vtxarray *va = retiredvas[i];
+        va->mapmodels.setsize(0);
+        //larger ones are replaced by the next octarender, before they are drawn again
+        if(va->size > dirtycellsize)
+        {
+            continue;
+        }
+        ivec ro;
+        int rsize;
+        const cube &c = rootworld.lookupcube(va->o, -va->size, ro, rsize);
+        if(rsize == va->size && ro == va->o)
+        {
+            cubes[i] = &c;
+            retiredcubes.insert(&c);
+        }
+    }
+    for(uint i = 0; i < retiredvas.size(); ++i)
+    {
+        const cube *c = cubes[i];
+        if(!c)
+        {
+            continue;
+        }
+        if(c->ext && c->ext->ents && c->ext->ents->mapmodels.length())
+        {
+            retiredvas[i]->mapmodels.add(c->ext->ents);
+        }
+        if(c->children)
+        {
+            findretiredmapmodels(retiredvas[i], c->children, retiredcubes);
+        }
+    }
+}
+
+int pendingvarebuild()
+{
+    return dirtycells.size();
+}
+
+//drops all pending rebuilds along with the retired vas, for when every va is about to be rebuilt
+void clearvarebuild()
+{
+    std::stable_sort(retiredvas.begin(), retiredvas.end(), [](const vtxarray *x, const vtxarray *y) { return x->size < y->size; });
+    for(vtxarray *va : retiredvas)
+    {
+        destroyva(va);
+    }
+    retiredvas.clear();
+    dirtycells.clear();
+    releasedcells.clear();
+    dirtykeys.clear();
+    framecells = batchcells = batchframes = 0;
+}
+
 void updatevabb(vtxarray *va, bool force)
 {
     if(!force && va->bbmin.x >= 0)
@@ -2466,8 +2859,18 @@ void cubeworld::octarender()                               // creates va s for a
         csi++;
     }
     recalcprogress = 0;
+    resetdirtycellsize();
     varoot.setsize(0);
-    updateva(worldroot, ivec(0, 0, 0), worldsize/2, csi-1);
+    vabuilder builder;
+    updateva(builder, worldroot, ivec(0, 0, 0), worldsize/2, csi-1);
+    varoot.move(builder.varoot);
+    for(vtxarray *va : retiredvas)
+    {
+        if(!va->parent)
+        {
+            varoot.add(va);
+        }
+    }
     flushvbo();
     explicitsky = 0;
     for(int i = 0; i < valist.length(); i++)
@@ -2488,6 +2891,7 @@ void cubeworld::allchanged(bool load)
     {
         initlights();
     }
+    clearvarebuild();
     clearvas(worldroot);
     resetqueries();
     resetclipplanes();
@@ -2497,6 +2901,20 @@ void cubeworld::allchanged(bool load)
     {
         findtjoints();
     }
+    if(load)
+    {
+        std::vector<uchar> used(0x10000, 0);
+        gathervslots(worldroot, ivec(0, 0, 0), worldsize>>1, used);
+        std::vector<int> texs;
+        for(uint i = 0; i < used.size(); ++i)
+        {
+            if(used[i])
+            {
+                texs.push_back(i);
+            }
+        }
+        loadvslots(texs);
+    }
     octarender();
     if(load)
     {
@@ -2510,9 +2928,21 @@ void cubeworld::allchanged(bool load)
         genshadowmeshes();
         seedparticles();
     }
+    buildcompactocta();
+}
+
+//prints the state of the incremental va rebuild queue
+void vaqueuestats()
+{
+    conoutf("vaqueuestats: %d cells pending, %d stale vas, rebuild latency %.2f ms last, %.2f ms avg, %.2f ms max over %d cells",
+            static_cast<int>(dirtycells.size()), static_cast<int>(retiredvas.size()),
+            lastrebuildlatency, rebuiltcells ? totalrebuildlatency/rebuiltcells : 0, maxrebuildlatency, rebuiltcells);
+    conoutf("vaqueuestats: last batch of edits rebuilt %d cells over %d frames, current batch %d cells over %d frames so far",
+            lastbatchcells, lastbatchframes, batchcells, batchframes);
 }
 
 void initoctarendercmds()
 {
     addcommand("recalc", reinterpret_cast<identfun>(+[](){rootworld.allchanged(true);}), "", Id_Command);
+    addcommand("vaqueuestats", reinterpret_cast<identfun>(vaqueuestats), "", Id_Command);
 }
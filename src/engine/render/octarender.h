@@ -104,6 +104,14 @@ extern void reduceslope(ivec &n);
 extern void findtjoints();
 extern void clearvas(cube *c);
 extern void destroyva(vtxarray *va, bool reparent = true);
+extern void retireva(vtxarray *va);
+extern void queuevarebuild(const ivec &bbmin, const ivec &bbmax);
+extern int releasevarebuild(int numcells);
+extern void finishvarebuild();
+extern void endvarebuildframe();
+extern void refreshretiredvas();
+extern int pendingvarebuild();
+extern void clearvarebuild();
 extern void updatevabb(vtxarray *va, bool force = false);
 extern void updatevabbs(bool force = false);
 
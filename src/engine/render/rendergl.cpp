@@ -36,6 +36,7 @@
 #include "world/octaworld.h"
 #include "world/raycube.h"
 #include "world/world.h"
+#include "world/worldio.h"
 
 #include "interface/console.h"
 #include "interface/control.h"
@@ -1910,6 +1911,7 @@ void gl_setupframe(bool force)
 void gl_drawframe(int crosshairindex, void (*gamefxn)(), void (*hudfxn)(), void (*editfxn)(), void (*hud2d)())
 {
     synctimers();
+    checkmapsave(); //report a background map save as soon as it finishes
     xtravertsva = xtraverts = glde = gbatches = vtris = vverts = 0;
     flipqueries();
     aspect = forceaspect ? forceaspect : hudw/static_cast<float>(hudh);
@@ -11,6 +11,7 @@
 #include "../../shared/glemu.h"
 #include "../../shared/glexts.h"
 #include "../../shared/stream.h"
+#include "../../shared/threads.h"
 
 #include "aa.h"
 #include "csm.h"
@@ -51,12 +52,18 @@ model *loadingmodel = nullptr;
 
 #include "model/hitzone.h"
 
+/* loadmapmodel: returns mapmodel n, loading it if it has not been yet
+ *
+ * inside worker tasks this only looks the model up, since loading touches GL
+ * and the model registry; such callers must resolve the models they need
+ * on the main thread beforehand
+ */
 model *loadmapmodel(int n)
 {
     if(static_cast<int>(mapmodels.size()) > n)
     {
         model *m = mapmodels[n].m;
-        return m ? m : loadmodel(nullptr, n);
+        return m || inworkertask() ? m : loadmodel(nullptr, n);
     }
     return nullptr;
 }
@@ -1512,4 +1519,6 @@ void initrendermodelcmds()
     addcommand("nummapmodels", reinterpret_cast<identfun>(nummapmodels), "", Id_Command);
     addcommand("clearmodel", reinterpret_cast<identfun>(clearmodel), "s", Id_Command);
     addcommand("findanims", reinterpret_cast<identfun>(findanimscmd), "s", Id_Command);
+    addcommand("bihbench", reinterpret_cast<identfun>(bihbench), "", Id_Command);
+    addcommand("mmraybench", reinterpret_cast<identfun>(mmraybench), "i", Id_Command);
 }
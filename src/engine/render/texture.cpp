@@ -4,6 +4,10 @@
 #include "../../shared/geomexts.h"
 #include "../../shared/glexts.h"
 #include "../../shared/stream.h"
+#include "../../shared/threads.h"
+
+#include <string>
+#include <unordered_map>
 
 #include "SDL_image.h"
 
@@ -2261,34 +2265,63 @@ int Slot::cancombine(int type) const
     }
 }
 
-void Slot::load(int index, Slot::Tex &t)
+//returns the texture which is combined into the given slot texture, if any
+static Slot::Tex *findcombine(Slot &slot, int index)
 {
-    vector<char> key;
-    addname(key, *this, t, false, shouldpremul(t.type) ? "<premul>" : nullptr);
-    Slot::Tex *combine = nullptr;
-    for(int i = 0; i < sts.length(); i++)
+    for(int i = 0; i < slot.sts.length(); i++)
     {
-        Slot::Tex &c = sts[i];
+        Slot::Tex &c = slot.sts[i];
         if(c.combined == index)
         {
-            combine = &c;
-            addname(key, *this, c, true);
-            break;
+            return &c;
         }
     }
+    return nullptr;
+}
+
+//builds the name a slot texture is stored under in the texture table
+static void slottexkey(vector<char> &key, Slot &slot, int index, Slot::Tex &t)
+{
+    addname(key, slot, t, false, slot.shouldpremul(t.type) ? "<premul>" : nullptr);
+    Slot::Tex *combine = findcombine(slot, index);
+    if(combine)
+    {
+        addname(key, slot, *combine, true);
+    }
     key.add('\0');
-    t.t = textures.access(key.getbuf());
-    if(t.t)
+}
+
+//marks which textures in a slot get packed into the spare channels of another
+static void linkcombines(Slot &slot)
+{
+    for(int i = 0; i < slot.sts.length(); i++)
     {
-        return;
+        Slot::Tex &t = slot.sts[i];
+        if(t.combined >= 0)
+        {
+            continue;
+        }
+        int combine = slot.cancombine(t.type);
+        if(combine >= 0 && (combine = slot.findtextype(1<<combine)) >= 0)
+        {
+            Slot::Tex &c = slot.sts[combine];
+            c.combined = i;
+        }
     }
-    int compress = 0,
-        wrap = 0;
-    ImageData ts;
-    if(!ts.texturedata(*this, t, true, &compress, &wrap))
+}
+
+/* prepareslottex: decodes and preprocesses the image for one texture of a slot
+ *
+ * this is everything Slot::load does short of creating the GL texture, and only
+ * touches the image data, so it is safe to run from the worker pool
+ */
+static bool prepareslottex(Slot &slot, int index, Slot::Tex &t, ImageData &ts, int &compress, int &wrap, bool msg)
+{
+    compress = 0;
+    wrap = 0;
+    if(!ts.texturedata(slot, t, msg, &compress, &wrap))
     {
-        t.t = notexture;
-        return;
+        return false;
     }
     if(!ts.compressed)
     {
@@ -2305,10 +2338,12 @@ void Slot::load(int index, Slot::Tex &t)
             case Tex_Glow:
             case Tex_Diffuse:
             case Tex_Normal:
+            {
+                Slot::Tex *combine = findcombine(slot, index);
                 if(combine)
                 {
                     ImageData cs;
-                    if(cs.texturedata(*this, *combine))
+                    if(cs.texturedata(slot, *combine, msg))
                     {
                         if(cs.w!=ts.w || cs.h!=ts.h)
                         {
@@ -2339,18 +2374,72 @@ void Slot::load(int index, Slot::Tex &t)
                     ts.swizzleimage();
                 }
                 break;
+            }
         }
     }
-    if(!ts.compressed && shouldpremul(t.type))
+    if(!ts.compressed && slot.shouldpremul(t.type))
     {
         ts.texpremul();
     }
+    return true;
+}
+
+/* slot texture pipeline
+ *
+ * when a map is loaded, the images of every slot the world uses are decoded and
+ * preprocessed on the worker pool before the vertex arrays are built; Slot::load
+ * then picks up the prepared image and only has to do the GL upload, which stays
+ * on the main thread
+ */
+VARP(texturepipeline, 0, 1, 1);
+
+namespace
+{
+    struct preparedtex
+    {
+        ImageData image;
+        int compress = 0,
+            wrap = 0;
+        bool valid = false;
+    };
+
+    //prepared images waiting to be uploaded, keyed by their texture name
+    std::unordered_map<std::string, preparedtex> preparedtexs;
+}
+
+void Slot::load(int index, Slot::Tex &t)
+{
+    vector<char> key;
+    slottexkey(key, *this, index, t);
+    t.t = textures.access(key.getbuf());
+    if(t.t)
+    {
+        return;
+    }
+    int compress = 0,
+        wrap = 0;
+    ImageData ts;
+    auto itr = preparedtexs.find(key.getbuf());
+    if(itr != preparedtexs.end() && itr->second.valid)
+    {
+        ts.replace(itr->second.image);
+        compress = itr->second.compress;
+        wrap = itr->second.wrap;
+        preparedtexs.erase(itr);
+    }
+    //failed images are decoded again here so that their errors get reported
+    else if(!prepareslottex(*this, index, t, ts, compress, wrap, true))
+    {
+        t.t = notexture;
+        return;
+    }
     t.t = newtexture(nullptr, key.getbuf(), ts, wrap, true, true, true, compress);
 }
 
 void Slot::load()
 {
     linkslotshader(*this);
+    linkcombines(*this);
     for(int i = 0; i < sts.length(); i++)
     {
         Slot::Tex &t = sts[i];
@@ -2358,30 +2447,95 @@ void Slot::load()
         {
             continue;
         }
-        int combine = cancombine(t.type);
-        if(combine >= 0 && (combine = findtextype(1<<combine)) >= 0)
+        switch(t.type)
         {
-            Slot::Tex &c = sts[combine];
-            c.combined = i;
+            default:
+            {
+                load(i, t);
+                break;
+            }
         }
     }
-    for(int i = 0; i < sts.length(); i++)
+    loaded = true;
+}
+
+/* loadvslots: loads the slots used by the given vslots
+ *
+ * with the texture pipeline enabled, the slots' images are first prepared in
+ * parallel, leaving only the uploads to be done serially by Slot::load; slots
+ * are taken in batches of about texturepipelinebatch images, so that only one
+ * batch of decoded images is held in memory at a time
+ */
+VARP(texturepipelinebatch, 1, 64, 1024);
+
+void loadvslots(const std::vector<int> &vslotindices)
+{
+    double start = getpreciseclockmillis();
+    std::vector<Slot *> toload;
+    for(int index : vslotindices)
     {
-        Slot::Tex &t = sts[i];
-        if(t.combined >= 0)
+        Slot *s = lookupvslot(index, false).slot;
+        if(!s->loaded && std::find(toload.begin(), toload.end(), s) == toload.end())
         {
-            continue;
+            toload.push_back(s);
         }
-        switch(t.type)
+    }
+    if(toload.empty())
+    {
+        return;
+    }
+    struct texjob
+    {
+        Slot *slot;
+        int index;
+        preparedtex *prepared;
+    };
+    std::vector<texjob> jobs;
+    int numprepared = 0;
+    for(size_t batchstart = 0; batchstart < toload.size();)
+    {
+        size_t batchend = batchstart;
+        jobs.clear();
+        do
         {
-            default:
+            Slot *s = toload[batchend++];
+            if(!texturepipeline)
             {
-                load(i, t);
-                break;
+                continue;
+            }
+            linkcombines(*s);
+            for(int i = 0; i < s->sts.length(); i++)
+            {
+                Slot::Tex &t = s->sts[i];
+                if(t.combined >= 0)
+                {
+                    continue;
+                }
+                vector<char> key;
+                slottexkey(key, *s, i, t);
+                if(textures.access(key.getbuf()) || preparedtexs.count(key.getbuf()))
+                {
+                    continue;
+                }
+                jobs.push_back({s, i, &preparedtexs[key.getbuf()]});
             }
+        } while(batchend < toload.size() && static_cast<int>(jobs.size()) < texturepipelinebatch);
+        parallelfor(static_cast<int>(jobs.size()), [&jobs](int i)
+        {
+            texjob &job = jobs[i];
+            preparedtex &p = *job.prepared;
+            p.valid = prepareslottex(*job.slot, job.index, job.slot->sts[job.index], p.image, p.compress, p.wrap, false);
+        });
+        numprepared += jobs.size();
+        for(; batchstart < batchend; ++batchstart)
+        {
+            renderprogress(static_cast<float>(batchstart)/toload.size(), "loading texture slots...");
+            toload[batchstart]->load();
         }
+        preparedtexs.clear();
     }
-    loaded = true;
+    conoutf(Console_Debug, "loaded %d texture slots (%d images prepared on %d threads) in %.1f ms",
+            static_cast<int>(toload.size()), numprepared, texturepipeline ? numworkerthreads() : 1, getpreciseclockmillis() - start);
 }
 
 // end of Slot
@@ -20,6 +20,7 @@ extern void compactvslots(cube *c, int n = 8);
 extern void compactvslot(int &index);
 extern void compactvslot(VSlot &vs);
 extern void reloadtextures();
+extern void loadvslots(const std::vector<int> &vslotindices);
 extern void cleanuptextures();
 extern bool settexture(const char *name, int clamp = 0);
 
@@ -7,11 +7,16 @@
 #include "../libprimis-headers/cube.h"
 #include "../../shared/geomexts.h"
 #include "../../shared/glexts.h"
+#include "../../shared/threads.h"
 
 #include "entities.h"
 #include "physics.h"
 #include "raycube.h"
 
+#include "interface/console.h"
+#include "interface/control.h"
+
+#include "render/rendergl.h"
 #include "render/rendermodel.h"
 #include "render/shaderparam.h"
 #include "render/stain.h"
@@ -21,8 +26,17 @@
 
 #include "model/model.h"
 
+//packet traversal uses SSE where available, and plain arrays of floats otherwise
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+    #define BIH_SSE
+#endif
+
 constexpr float maxcollidedistance = -1e9f;
 
+//smallest subtree, in triangles, which is worth handing to another thread while building
+constexpr int bihtasksize = 1024;
+
 int BIH::node::axis() const
 {
     return child[0]>>14;
@@ -244,10 +258,56 @@ bool BIH::traverse(const mesh &m, const vec &o, const vec &ray, const vec &invra
     }
 }
 
+//sets tmin and tmax to the interval along the ray over which it is inside the mesh's bounding box
+static void raymeshbounds(const BIH::mesh &m, const vec &o, const vec &invray, float &tmin, float &tmax)
+{
+    float t1 = (m.bbmin.x - o.x)*invray.x,
+          t2 = (m.bbmax.x - o.x)*invray.x;
+    if(invray.x > 0)
+    {
+        tmin = t1;
+        tmax = t2;
+    }
+    else
+    {
+        tmin = t2;
+        tmax = t1;
+    }
+    t1 = (m.bbmin.y - o.y)*invray.y;
+    t2 = (m.bbmax.y - o.y)*invray.y;
+    if(invray.y > 0)
+    {
+        tmin = std::max(tmin, t1);
+        tmax = std::min(tmax, t2);
+    }
+    else
+    {
+        tmin = std::max(tmin, t2);
+        tmax = std::min(tmax, t1);
+    }
+    t1 = (m.bbmin.z - o.z)*invray.z;
+    t2 = (m.bbmax.z - o.z)*invray.z;
+    if(invray.z > 0)
+    {
+        tmin = std::max(tmin, t1);
+        tmax = std::min(tmax, t2);
+    }
+    else
+    {
+        tmin = std::max(tmin, t2);
+        tmax = std::min(tmax, t1);
+    }
+}
+
+//if components are zero, set component to large value: 1e16, else invert
+static vec invertray(const vec &ray)
+{
+    return vec(ray.x ? 1/ray.x : 1e16f, ray.y ? 1/ray.y : 1e16f, ray.z ? 1/ray.z : 1e16f);
+}
+
 bool BIH::traverse(const vec &o, const vec &ray, float maxdist, float &dist, int mode)
 {
-    //if components are zero, set component to large value: 1e16, else invert
-    vec invray(ray.x ? 1/ray.x : 1e16f, ray.y ? 1/ray.y : 1e16f, ray.z ? 1/ray.z : 1e16f);
+    vec invray = invertray(ray);
     for(int i = 0; i < nummeshes; ++i)
     {
         mesh &m = meshes[i];
@@ -255,53 +315,355 @@ bool BIH::traverse(const vec &o, const vec &ray, float maxdist, float &dist, int
         {
             continue;
         }
-        float t1 = (m.bbmin.x - o.x)*invray.x,
-              t2 = (m.bbmax.x - o.x)*invray.x,
-              tmin, tmax;
-        if(invray.x > 0)
+        float tmin, tmax;
+        raymeshbounds(m, o, invray, tmin, tmax);
+        tmax = std::min(tmax, maxdist);
+        if(tmin < tmax && traverse(m, o, ray, invray, maxdist, dist, mode, m.nodes, tmin, tmax))
         {
-            tmin = t1;
-            tmax = t2;
+            return true;
         }
-        else
+    }
+    return false;
+}
+
+/* ray packets
+ *
+ * a packet carries up to four rays whose directions have the same signs, so that
+ * they visit the children of every node in the same order. Each node's split
+ * planes are tested against all rays of the packet at once, and the rays which
+ * need a child are tracked as a bitmask. Every ray is only tested against the
+ * triangles the single ray traversal would test, in the same order, and stops
+ * at the same first hit, so packets return exactly the scalar hit distances.
+ */
+namespace
+{
+    constexpr int packetsize = 4;
+
+#ifdef BIH_SSE
+    typedef __m128 float4;
+
+    inline float4 loadfloat4(const float *f) { return _mm_loadu_ps(f); }
+    inline float4 splatfloat4(float f) { return _mm_set1_ps(f); }
+    inline float4 subfloat4(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+    inline float4 mulfloat4(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+    //operands swapped so that results match std::max and std::min exactly
+    inline float4 maxfloat4(float4 a, float4 b) { return _mm_max_ps(b, a); }
+    inline float4 minfloat4(float4 a, float4 b) { return _mm_min_ps(b, a); }
+    inline int lessequalmask(float4 a, float4 b) { return _mm_movemask_ps(_mm_cmple_ps(a, b)); }
+    inline int lessmask(float4 a, float4 b) { return _mm_movemask_ps(_mm_cmplt_ps(a, b)); }
+#else
+    struct float4
+    {
+        float v[packetsize];
+    };
+
+    inline float4 loadfloat4(const float *f)
+    {
+        float4 r;
+        std::memcpy(r.v, f, sizeof(r.v));
+        return r;
+    }
+
+    inline float4 splatfloat4(float f)
+    {
+        return {{f, f, f, f}};
+    }
+
+    inline float4 subfloat4(float4 a, float4 b)
+    {
+        return {{a.v[0]-b.v[0], a.v[1]-b.v[1], a.v[2]-b.v[2], a.v[3]-b.v[3]}};
+    }
+
+    inline float4 mulfloat4(float4 a, float4 b)
+    {
+        return {{a.v[0]*b.v[0], a.v[1]*b.v[1], a.v[2]*b.v[2], a.v[3]*b.v[3]}};
+    }
+
+    inline float4 maxfloat4(float4 a, float4 b)
+    {
+        return {{std::max(a.v[0], b.v[0]), std::max(a.v[1], b.v[1]), std::max(a.v[2], b.v[2]), std::max(a.v[3], b.v[3])}};
+    }
+
+    inline float4 minfloat4(float4 a, float4 b)
+    {
+        return {{std::min(a.v[0], b.v[0]), std::min(a.v[1], b.v[1]), std::min(a.v[2], b.v[2]), std::min(a.v[3], b.v[3])}};
+    }
+
+    inline int lessequalmask(float4 a, float4 b)
+    {
+        int mask = 0;
+        for(int i = 0; i < packetsize; ++i)
         {
-            tmin = t2;
-            tmax = t1;
+            mask |= (a.v[i] <= b.v[i] ? 1 : 0)<<i;
         }
-        t1 = (m.bbmin.y - o.y)*invray.y;
-        t2 = (m.bbmax.y - o.y)*invray.y;
-        if(invray.y > 0)
+        return mask;
+    }
+
+    inline int lessmask(float4 a, float4 b)
+    {
+        int mask = 0;
+        for(int i = 0; i < packetsize; ++i)
         {
-            tmin = std::max(tmin, t1);
-            tmax = std::min(tmax, t2);
+            mask |= (a.v[i] < b.v[i] ? 1 : 0)<<i;
         }
-        else
+        return mask;
+    }
+#endif
+
+    struct raypacket
+    {
+        float4 o[3], invray[3];
+        vec mo[packetsize], mray[packetsize]; //rays transformed into mesh space, for triangle tests
+        ivec order;
+        float maxdist;
+        int mode;
+        int hitmask;
+        float dist[packetsize];
+        vec surface[packetsize];
+    };
+
+    struct packetstate
+    {
+        BIH::node *node;
+        float4 tmin, tmax;
+        int mask;
+    };
+
+    //tests the triangle against every ray in mask, recording the first hit of each
+    void packettriintersect(BIH &bih, const BIH::mesh &m, int tidx, raypacket &p, int mask)
+    {
+        for(int i = 0; i < packetsize; ++i)
         {
-            tmin = std::max(tmin, t2);
-            tmax = std::min(tmax, t1);
+            if(mask&(1<<i) && bih.triintersect(m, tidx, p.mo[i], p.mray[i], p.maxdist, p.dist[i], p.mode))
+            {
+                p.hitmask |= 1<<i;
+                if(!(p.mode&Ray_Shadow))
+                {
+                    p.surface[i] = hitsurface;
+                }
+            }
         }
-        t1 = (m.bbmin.z - o.z)*invray.z;
-        t2 = (m.bbmax.z - o.z)*invray.z;
-        if(invray.z > 0)
+    }
+
+    //packet form of BIH::traverse(), see that function for the handling of each case
+    void traversepacket(BIH &bih, const BIH::mesh &m, raypacket &p, BIH::node *curnode, float4 tmin, float4 tmax, int mask)
+    {
+        packetstate stack[128];
+        int stacksize = 0;
+        for(;;)
         {
-            tmin = std::max(tmin, t1);
-            tmax = std::min(tmax, t2);
+            mask &= ~p.hitmask;
+            if(mask)
+            {
+                int axis = curnode->axis();
+                int nearidx = p.order[axis],
+                    faridx = nearidx^1;
+                float4 nearsplit = mulfloat4(subfloat4(splatfloat4(curnode->split[nearidx]), p.o[axis]), p.invray[axis]),
+                       farsplit = mulfloat4(subfloat4(splatfloat4(curnode->split[faridx]), p.o[axis]), p.invray[axis]);
+                //rays whose interval passes through the near child, and through the far child
+                int nearmask = mask & ~lessequalmask(nearsplit, tmin),
+                    farmask = mask & lessmask(farsplit, tmax);
+                if(curnode->isleaf(nearidx))
+                {
+                    packettriintersect(bih, m, curnode->childindex(nearidx), p, nearmask);
+                    farmask &= ~p.hitmask;
+                    if(farmask)
+                    {
+                        if(!curnode->isleaf(faridx))
+                        {
+                            curnode += curnode->childindex(faridx);
+                            tmin = maxfloat4(tmin, farsplit);
+                            mask = farmask;
+                            continue;
+                        }
+                        packettriintersect(bih, m, curnode->childindex(faridx), p, farmask);
+                    }
+                }
+                else
+                {
+                    if(farmask)
+                    {
+                        if(!curnode->isleaf(faridx))
+                        {
+                            if(!nearmask)
+                            {
+                                curnode += curnode->childindex(faridx);
+                                tmin = maxfloat4(tmin, farsplit);
+                                mask = farmask;
+                                continue;
+                            }
+                            if(stacksize < static_cast<int>(sizeof(stack)/sizeof(stack[0])))
+                            {
+                                packetstate &save = stack[stacksize++];
+                                save.node = curnode + curnode->childindex(faridx);
+                                save.tmin = maxfloat4(tmin, farsplit);
+                                save.tmax = tmax;
+                                save.mask = farmask;
+                            }
+                            else
+                            {
+                                traversepacket(bih, m, p, curnode + curnode->childindex(nearidx), tmin, minfloat4(tmax, nearsplit), nearmask);
+                                curnode += curnode->childindex(faridx);
+                                tmin = maxfloat4(tmin, farsplit);
+                                mask = farmask;
+                                continue;
+                            }
+                        }
+                        else
+                        {
+                            packettriintersect(bih, m, curnode->childindex(faridx), p, farmask);
+                            nearmask &= ~p.hitmask;
+                        }
+                    }
+                    if(nearmask)
+                    {
+                        curnode += curnode->childindex(nearidx);
+                        tmax = minfloat4(tmax, nearsplit);
+                        mask = nearmask;
+                        continue;
+                    }
+                }
+            }
+            if(stacksize <= 0)
+            {
+                return;
+            }
+            packetstate &restore = stack[--stacksize];
+            curnode = restore.node;
+            tmin = restore.tmin;
+            tmax = restore.tmax;
+            mask = restore.mask;
         }
-        else
+    }
+}
+
+/* traverse: batched form of traverse(), for many rays against this hierarchy
+ *
+ * rays are grouped into packets of four consecutive rays; groups whose directions
+ * do not share signs fall back to single ray traversal. dist[i] is set to the hit
+ * distance of ray i, or -1 if it missed. If surfaces is not null, the hit surface
+ * normal of each ray is written to it (unless mode is Ray_Shadow). Returns the
+ * number of rays which hit.
+ */
+int BIH::traverse(int numrays, const vec *o, const vec *ray, float maxdist, float *dist, int mode, vec *surfaces)
+{
+    int numhits = 0;
+    for(int base = 0; base < numrays; base += packetsize)
+    {
+        int lanes = std::min(numrays - base, packetsize);
+        ivec order(ray[base].x>0 ? 0 : 1, ray[base].y>0 ? 0 : 1, ray[base].z>0 ? 0 : 1);
+        bool coherent = true;
+        for(int i = 1; i < lanes; ++i)
         {
-            tmin = std::max(tmin, t2);
-            tmax = std::min(tmax, t1);
+            const vec &r = ray[base+i];
+            if(ivec(r.x>0 ? 0 : 1, r.y>0 ? 0 : 1, r.z>0 ? 0 : 1) != order)
+            {
+                coherent = false;
+                break;
+            }
         }
-        tmax = std::min(tmax, maxdist);
-        if(tmin < tmax && traverse(m, o, ray, invray, maxdist, dist, mode, m.nodes, tmin, tmax))
+        if(!coherent || lanes == 1)
         {
-            return true;
+            for(int i = base; i < base + lanes; ++i)
+            {
+                if(traverse(o[i], ray[i], maxdist, dist[i], mode))
+                {
+                    ++numhits;
+                    if(surfaces && !(mode&Ray_Shadow))
+                    {
+                        surfaces[i] = hitsurface;
+                    }
+                }
+                else
+                {
+                    dist[i] = -1;
+                }
+            }
+            continue;
+        }
+        raypacket p;
+        p.order = order;
+        p.maxdist = maxdist;
+        p.mode = mode;
+        p.hitmask = 0;
+        //unused lanes repeat the first ray so that they carry valid numbers, and are masked off
+        vec invray[packetsize];
+        float lo[3][packetsize], linv[3][packetsize];
+        for(int i = 0; i < packetsize; ++i)
+        {
+            int r = base + (i < lanes ? i : 0);
+            invray[i] = invertray(ray[r]);
+            for(int k = 0; k < 3; ++k)
+            {
+                lo[k][i] = o[r][k];
+                linv[k][i] = invray[i][k];
+            }
+        }
+        for(int k = 0; k < 3; ++k)
+        {
+            p.o[k] = loadfloat4(lo[k]);
+            p.invray[k] = loadfloat4(linv[k]);
+        }
+        for(int j = 0; j < nummeshes; ++j)
+        {
+            mesh &m = meshes[j];
+            if(!(m.flags&Mesh_Render) || (!(mode&Ray_Shadow) && m.flags&Mesh_NoClip))
+            {
+                continue;
+            }
+            float tmin[packetsize] = {0, 0, 0, 0},
+                  tmax[packetsize] = {0, 0, 0, 0};
+            int mask = 0;
+            for(int i = 0; i < lanes; ++i)
+            {
+                if(p.hitmask&(1<<i))
+                {
+                    continue;
+                }
+                const vec &ro = o[base+i];
+                raymeshbounds(m, ro, invray[i], tmin[i], tmax[i]);
+                tmax[i] = std::min(tmax[i], maxdist);
+                if(tmin[i] < tmax[i])
+                {
+                    mask |= 1<<i;
+                    p.mo[i] = m.invxform.transform(ro);
+                    p.mray[i] = m.invxformnorm.transform(ray[base+i]);
+                }
+            }
+            if(!mask)
+            {
+                continue;
+            }
+            traversepacket(*this, m, p, m.nodes, loadfloat4(tmin), loadfloat4(tmax), mask);
+        }
+        for(int i = 0; i < lanes; ++i)
+        {
+            if(p.hitmask&(1<<i))
+            {
+                ++numhits;
+                dist[base+i] = p.dist[i];
+                if(surfaces && !(mode&Ray_Shadow))
+                {
+                    surfaces[base+i] = p.surface[i];
+                }
+            }
+            else
+            {
+                dist[base+i] = -1;
+            }
         }
     }
-    return false;
+    return numhits;
 }
 
-void BIH::build(mesh &m, ushort *indices, int numindices, const ivec &vmin, const ivec &vmax)
+/* build: builds the subtree over the given triangle indices
+ *
+ * a subtree over n triangles always takes n-1 nodes, so the nodes of both children
+ * of a node are known before either is built: the left subtree starts immediately
+ * after its parent, and the right one after the left subtree. Large right subtrees
+ * are therefore handed to the worker pool without changing the resulting tree.
+ */
+void BIH::build(mesh &m, ushort *indices, int numindices, const ivec &vmin, const ivec &vmax, int offset, taskgroup &tasks)
 {
     int axis = 2;
     for(int k = 0; k < 2; ++k)
@@ -376,29 +738,41 @@ void BIH::build(mesh &m, ushort *indices, int numindices, const ivec &vmin, cons
         }
     }
 
-    int offset = m.numnodes++;
     node &curnode = m.nodes[offset];
     curnode.split[0] = static_cast<short>(splitleft);
     curnode.split[1] = static_cast<short>(splitright);
 
-    if(left==1)
+    //left subtree takes left-1 nodes (none if it is a leaf), so the right subtree is always left nodes away
+    int rightnumindices = numindices-right;
+    if(rightnumindices==1)
     {
-        curnode.child[0] = (axis<<14) | indices[0];
+        curnode.child[1] = (1<<15) | (left==1 ? 1<<14 : 0) | indices[right];
     }
     else
     {
-        curnode.child[0] = (axis<<14) | (m.numnodes - offset);
-        build(m, indices, left, leftmin, leftmax);
+        curnode.child[1] = (left==1 ? 1<<14 : 0) | left;
+        ushort *rightindices = &indices[right];
+        if(rightnumindices >= bihtasksize && left >= bihtasksize)
+        {
+            tasks.run([this, &m, rightindices, rightnumindices, rightmin, rightmax, offset, left, &tasks]()
+            {
+                build(m, rightindices, rightnumindices, rightmin, rightmax, offset + left, tasks);
+            });
+        }
+        else
+        {
+            build(m, rightindices, rightnumindices, rightmin, rightmax, offset + left, tasks);
+        }
     }
 
-    if(numindices-right==1)
+    if(left==1)
     {
-        curnode.child[1] = (1<<15) | (left==1 ? 1<<14 : 0) | indices[right];
+        curnode.child[0] = (axis<<14) | indices[0];
     }
     else
     {
-        curnode.child[1] = (left==1 ? 1<<14 : 0) | (m.numnodes - offset);
-        build(m, &indices[right], numindices-right, rightmin, rightmax);
+        curnode.child[0] = (axis<<14) | 1;
+        build(m, indices, left, leftmin, leftmax, offset + 1, tasks);
     }
 }
 
@@ -422,74 +796,99 @@ BIH::BIH(std::vector<mesh> &buildmeshes)
     meshes = new mesh[nummeshes];
     std::memcpy(meshes, buildmeshes.data(), sizeof(mesh)*buildmeshes.size());
     tribbs = new tribb[numtris];
-    tribb *dsttri = tribbs;
+    nodes = new node[numtris];
+    ushort *indices = new ushort[numtris];
+    //each mesh gets its own slice of the tribb, node and index arrays, so meshes can be built independently
+    int trioffset = 0,
+        nodeoffset = 0;
     for(int i = 0; i < nummeshes; ++i)
     {
         mesh &m = meshes[i];
-        m.scale = m.xform.a.magnitude();
-        m.invscale = 1/m.scale;
-        m.xformnorm = matrix3(m.xform);
-        m.xformnorm.normalize();
-        m.invxform.invert(m.xform);
-        m.invxformnorm = matrix3(m.invxform);
-        m.invxformnorm.normalize();
-        m.tribbs = dsttri;
-        const tri *srctri = m.tris;
-        vec mmin(1e16f, 1e16f, 1e16f), mmax(-1e16f, -1e16f, -1e16f);
-        for(int j = 0; j < m.numtris; ++j)
-        {
-            vec s0 = m.getpos(srctri->vert[0]),
-                s1 = m.getpos(srctri->vert[1]),
-                s2 = m.getpos(srctri->vert[2]),
-                v0 = m.xform.transform(s0),
-                v1 = m.xform.transform(s1),
-                v2 = m.xform.transform(s2),
-                vmin = vec(v0).min(v1).min(v2),
-                vmax = vec(v0).max(v1).max(v2);
-            mmin.min(vmin);
-            mmax.max(vmax);
-            ivec imin = ivec::floor(vmin),
-                 imax = ivec::ceil(vmax);
-            dsttri->center = static_cast<svec>(static_cast<ivec>(imin).add(imax).div(2));
-            dsttri->radius = static_cast<svec>(static_cast<ivec>(imax).sub(imin).add(1).div(2));
-            ++srctri;
-            ++dsttri;
-        }
-        for(int k = 0; k < 3; ++k)
+        m.tribbs = &tribbs[trioffset];
+        m.nodes = &nodes[nodeoffset];
+        m.numnodes = m.numtris - 1;
+        trioffset += m.numtris;
+        nodeoffset += m.numnodes;
+    }
+    numnodes = nodeoffset;
+
+    taskgroup tasks;
+    trioffset = 0;
+    for(int i = 0; i < nummeshes; ++i)
+    {
+        mesh &m = meshes[i];
+        ushort *meshindices = &indices[trioffset];
+        trioffset += m.numtris;
+        tasks.run([this, &m, meshindices, &tasks]()
         {
-            if(std::fabs(mmax[k] - mmin[k]) < 0.125f)
-            {
-                float mid = (mmin[k] + mmax[k]) / 2;
-                mmin[k] = mid - 0.0625f;
-                mmax[k] = mid + 0.0625f;
-            }
-        }
-        m.bbmin = mmin;
-        m.bbmax = mmax;
-        bbmin.min(mmin);
-        bbmax.max(mmax);
+            buildmesh(m, meshindices, tasks);
+        });
     }
+    tasks.wait();
+    delete[] indices;
 
+    for(int i = 0; i < nummeshes; ++i)
+    {
+        bbmin.min(meshes[i].bbmin);
+        bbmax.max(meshes[i].bbmax);
+    }
     center = vec(bbmin).add(bbmax).mul(0.5f);
     radius = vec(bbmax).sub(bbmin).mul(0.5f).magnitude();
     entradius = std::max(bbmin.squaredlen(), bbmax.squaredlen());
+}
 
-    nodes = new node[numtris];
-    node *curnode = nodes;
-    ushort *indices = new ushort[numtris];
-    for(int i = 0; i < nummeshes; ++i)
+/* buildmesh: sets up the transforms and triangle bounds of a mesh and builds its tree
+ *
+ * only touches the mesh's own slices of the shared arrays, so may run on any thread
+ */
+void BIH::buildmesh(mesh &m, ushort *indices, taskgroup &tasks)
+{
+    m.scale = m.xform.a.magnitude();
+    m.invscale = 1/m.scale;
+    m.xformnorm = matrix3(m.xform);
+    m.xformnorm.normalize();
+    m.invxform.invert(m.xform);
+    m.invxformnorm = matrix3(m.invxform);
+    m.invxformnorm.normalize();
+    tribb *dsttri = m.tribbs;
+    const tri *srctri = m.tris;
+    vec mmin(1e16f, 1e16f, 1e16f), mmax(-1e16f, -1e16f, -1e16f);
+    for(int j = 0; j < m.numtris; ++j)
+    {
+        vec s0 = m.getpos(srctri->vert[0]),
+            s1 = m.getpos(srctri->vert[1]),
+            s2 = m.getpos(srctri->vert[2]),
+            v0 = m.xform.transform(s0),
+            v1 = m.xform.transform(s1),
+            v2 = m.xform.transform(s2),
+            vmin = vec(v0).min(v1).min(v2),
+            vmax = vec(v0).max(v1).max(v2);
+        mmin.min(vmin);
+        mmax.max(vmax);
+        ivec imin = ivec::floor(vmin),
+             imax = ivec::ceil(vmax);
+        dsttri->center = static_cast<svec>(static_cast<ivec>(imin).add(imax).div(2));
+        dsttri->radius = static_cast<svec>(static_cast<ivec>(imax).sub(imin).add(1).div(2));
+        ++srctri;
+        ++dsttri;
+    }
+    for(int k = 0; k < 3; ++k)
     {
-        mesh &m = meshes[i];
-        m.nodes = curnode;
-        for(int j = 0; j < m.numtris; ++j)
+        if(std::fabs(mmax[k] - mmin[k]) < 0.125f)
         {
-            indices[j] = j;
+            float mid = (mmin[k] + mmax[k]) / 2;
+            mmin[k] = mid - 0.0625f;
+            mmax[k] = mid + 0.0625f;
         }
-        build(m, indices, m.numtris, ivec::floor(m.bbmin), ivec::ceil(m.bbmax));
-        curnode += m.numnodes;
     }
-    delete[] indices;
-    numnodes = static_cast<int>(curnode - nodes);
+    m.bbmin = mmin;
+    m.bbmax = mmax;
+
+    for(int j = 0; j < m.numtris; ++j)
+    {
+        indices[j] = j;
+    }
+    build(m, indices, m.numtris, ivec::floor(m.bbmin), ivec::ceil(m.bbmax), 0, tasks);
 }
 
 BIH::~BIH()
@@ -499,32 +898,68 @@ BIH::~BIH()
     delete[] tribbs;
 }
 
-bool mmintersect(const extentity &e, const vec &o, const vec &ray, float maxdist, int mode, float &dist)
+//returns copies of the meshes this hierarchy was built from, suitable for building it again
+std::vector<BIH::mesh> BIH::getbuildmeshes() const
+{
+    return std::vector<mesh>(meshes, meshes + nummeshes);
+}
+
+//returns true if both hierarchies have the same bounds, nodes and triangle bounds, bit for bit
+bool BIH::identical(const BIH &b) const
+{
+    if(nummeshes != b.nummeshes || numnodes != b.numnodes || numtris != b.numtris)
+    {
+        return false;
+    }
+    for(int i = 0; i < nummeshes; ++i)
+    {
+        const mesh &m = meshes[i],
+                   &bm = b.meshes[i];
+        if(m.numnodes != bm.numnodes || m.nodes - nodes != bm.nodes - b.nodes || m.bbmin != bm.bbmin || m.bbmax != bm.bbmax)
+        {
+            return false;
+        }
+    }
+    return !std::memcmp(nodes, b.nodes, numnodes*sizeof(node)) && !std::memcmp(tribbs, b.tribbs, numtris*sizeof(tribb));
+}
+
+//returns the BIH of e's mapmodel, or null if rays of this mode do not intersect it
+static BIH *mmintersectbih(const extentity &e, int mode)
 {
     model *m = loadmapmodel(e.attr1);
     if(!m)
     {
-        return false;
+        return nullptr;
     }
     if(mode&Ray_Shadow)
     {
         if(!m->shadow || e.flags&EntFlag_NoShadow)
         {
-            return false;
+            return nullptr;
         }
     }
     else if((mode&Ray_Ents)!=Ray_Ents && (!m->collide || e.flags&EntFlag_NoCollide))
     {
-        return false;
+        return nullptr;
     }
-    if(!m->bih && !m->setBIH())
+    //worker tasks only use BIHs built beforehand, as setBIH() is not thread safe
+    if(!m->bih && (inworkertask() || !m->setBIH()))
     {
-        return false;
+        return nullptr;
     }
-    float scale = e.attr5 ? 100.0f/e.attr5 : 1.0f;
-    vec mo = static_cast<vec>(o).sub(e.o).mul(scale), mray(ray);
+    return m->bih;
+}
+
+/* mmtransformray: transforms the ray into the model space of e
+ *
+ * returns false if the ray cannot come within the bounding sphere of the model
+ */
+static bool mmtransformray(const extentity &e, const BIH *bih, float scale, const vec &o, const vec &ray, vec &mo, vec &mray)
+{
+    mo = static_cast<vec>(o).sub(e.o).mul(scale);
+    mray = ray;
     float v = mo.dot(mray),
-          inside = m->bih->entradius - mo.squaredlen();
+          inside = bih->entradius - mo.squaredlen();
     if((inside < 0 && v > 0) || inside + v*v < 0)
     {
         return false;
@@ -551,30 +986,117 @@ bool mmintersect(const extentity &e, const vec &o, const vec &ray, float maxdist
         mo.rotate_around_y(rot);
         mray.rotate_around_y(rot);
     }
-    if(m->bih->traverse(mo, mray, maxdist ? maxdist*scale : 1e16f, dist, mode))
+    return true;
+}
+
+//rotates a hit surface normal from the model space of e back to world space
+static void mmrotatesurface(const extentity &e, vec &surface)
+{
+    int yaw   = e.attr2,
+        pitch = e.attr3,
+        roll  = e.attr4;
+    if(roll != 0)
+    {
+        surface.rotate_around_y(sincosmod360(-roll));
+    }
+    if(pitch != 0)
+    {
+        surface.rotate_around_x(sincosmod360(pitch));
+    }
+    if(yaw != 0)
+    {
+        surface.rotate_around_z(sincosmod360(yaw));
+    }
+}
+
+bool mmintersect(const extentity &e, const vec &o, const vec &ray, float maxdist, int mode, float &dist)
+{
+    BIH *bih = mmintersectbih(e, mode);
+    if(!bih)
+    {
+        return false;
+    }
+    float scale = e.attr5 ? 100.0f/e.attr5 : 1.0f;
+    vec mo, mray;
+    if(!mmtransformray(e, bih, scale, o, ray, mo, mray))
+    {
+        return false;
+    }
+    if(bih->traverse(mo, mray, maxdist ? maxdist*scale : 1e16f, dist, mode))
     {
         dist /= scale;
         if(!(mode&Ray_Shadow))
         {
-            //reorientation
-            if(roll != 0)
-            {
-                hitsurface.rotate_around_y(sincosmod360(-roll));
-            }
-            if(pitch != 0)
-            {
-                hitsurface.rotate_around_x(sincosmod360(pitch));
-            }
-            if(yaw != 0)
-            {
-                hitsurface.rotate_around_z(sincosmod360(yaw));
-            }
+            mmrotatesurface(e, hitsurface);
         }
         return true;
     }
     return false;
 }
 
+/* mmintersect: batched form of mmintersect, for many rays against one mapmodel entity
+ *
+ * gives the same distances as calling mmintersect for each ray in turn. dist[i]
+ * is set to the hit distance of ray i, or -1 if it missed; if surfaces is not
+ * null, the world space hit surface normal of each hit is written to it. Returns
+ * the number of rays which hit.
+ */
+int mmintersect(const extentity &e, int numrays, const vec *o, const vec *ray, float maxdist, int mode, float *dist, vec *surfaces)
+{
+    for(int i = 0; i < numrays; ++i)
+    {
+        dist[i] = -1;
+    }
+    BIH *bih = mmintersectbih(e, mode);
+    if(!bih)
+    {
+        return 0;
+    }
+    float scale = e.attr5 ? 100.0f/e.attr5 : 1.0f;
+    //only rays which reach the model's bounding sphere are traced, packed together to keep packets full
+    std::vector<vec> mo, mray, msurfaces;
+    std::vector<float> mdist;
+    std::vector<int> rayindices;
+    mo.reserve(numrays);
+    mray.reserve(numrays);
+    rayindices.reserve(numrays);
+    for(int i = 0; i < numrays; ++i)
+    {
+        vec to, tray;
+        if(mmtransformray(e, bih, scale, o[i], ray[i], to, tray))
+        {
+            mo.push_back(to);
+            mray.push_back(tray);
+            rayindices.push_back(i);
+        }
+    }
+    if(rayindices.empty())
+    {
+        return 0;
+    }
+    mdist.resize(rayindices.size());
+    if(surfaces)
+    {
+        msurfaces.resize(rayindices.size());
+    }
+    int numhits = bih->traverse(rayindices.size(), mo.data(), mray.data(), maxdist ? maxdist*scale : 1e16f, mdist.data(), mode, surfaces ? msurfaces.data() : nullptr);
+    for(uint i = 0; i < rayindices.size(); ++i)
+    {
+        if(mdist[i] < 0)
+        {
+            continue;
+        }
+        int r = rayindices[i];
+        dist[r] = mdist[i] / scale;
+        if(surfaces && !(mode&Ray_Shadow))
+        {
+            surfaces[r] = msurfaces[i];
+            mmrotatesurface(e, surfaces[r]);
+        }
+    }
+    return numhits;
+}
+
 static float segmentdistance(const vec &d1, const vec &d2, const vec &r)
 {
     float a = d1.squaredlen(),
@@ -832,7 +1354,7 @@ static bool playercollidecheck(physent *d, float pdist, vec dir, vec n, vec radi
 }
 
 template<>
-void BIH::tricollide<Collide_Ellipse>(const mesh &m, int tidx, physent *d, const vec &dir, float cutoff, const vec &, const vec &radius, const matrix4x3 &orient, float &dist, const ivec &bo, const ivec &br)
+void BIH::tricollide<Collide_Ellipse>(CollisionContext &ctx, const mesh &m, int tidx, physent *d, const vec &dir, float cutoff, const vec &, const vec &radius, const matrix4x3 &orient, float &dist, const ivec &bo, const ivec &br)
 {
     if(m.tribbs[tidx].outside(bo, br))
     {
@@ -854,7 +1376,7 @@ void BIH::tricollide<Collide_Ellipse>(const mesh &m, int tidx, physent *d, const
     {
         return;
     }
-    collideinside = true;
+    ctx.inside = true;
     n = orient.transformnormal(n).mul(m.invscale);
     if(!dir.iszero())
     {
@@ -869,11 +1391,11 @@ void BIH::tricollide<Collide_Ellipse>(const mesh &m, int tidx, physent *d, const
         }
     }
     dist = pdist;
-    collidewall = n;
+    ctx.wall = n;
 }
 
 template<>
-void BIH::tricollide<Collide_OrientedBoundingBox>(const mesh &m, int tidx, physent *d, const vec &dir, float cutoff, const vec &, const vec &radius, const matrix4x3 &orient, float &dist, const ivec &bo, const ivec &br)
+void BIH::tricollide<Collide_OrientedBoundingBox>(CollisionContext &ctx, const mesh &m, int tidx, physent *d, const vec &dir, float cutoff, const vec &, const vec &radius, const matrix4x3 &orient, float &dist, const ivec &bo, const ivec &br)
 {
     if(m.tribbs[tidx].outside(bo, br))
     {
@@ -900,7 +1422,7 @@ void BIH::tricollide<Collide_OrientedBoundingBox>(const mesh &m, int tidx, physe
     {
         return;
     }
-    collideinside = true;
+    ctx.inside = true;
     if(!dir.iszero())
     {
         if(n.dot(dir) >= -cutoff*dir.magnitude())
@@ -913,11 +1435,11 @@ void BIH::tricollide<Collide_OrientedBoundingBox>(const mesh &m, int tidx, physe
         }
     }
     dist = pdist;
-    collidewall = n;
+    ctx.wall = n;
 }
 
 template<int C>
-void BIH::collide(const mesh &m, physent *d, const vec &dir, float cutoff, const vec &center, const vec &radius, const matrix4x3 &orient, float &dist, node *curnode, const ivec &bo, const ivec &br)
+void BIH::collide(CollisionContext &ctx, const mesh &m, physent *d, const vec &dir, float cutoff, const vec &center, const vec &radius, const matrix4x3 &orient, float &dist, node *curnode, const ivec &bo, const ivec &br)
 {
     node *stack[128];
     int stacksize = 0;
@@ -942,13 +1464,13 @@ void BIH::collide(const mesh &m, physent *d, const vec &dir, float cutoff, const
                 }
                 else
                 {
-                    tricollide<C>(m, curnode->childindex(faridx), d, dir, cutoff, center, radius, orient, dist, bo, br);
+                    tricollide<C>(ctx, m, curnode->childindex(faridx), d, dir, cutoff, center, radius, orient, dist, bo, br);
                 }
             }
         }
         else if(curnode->isleaf(nearidx))
         {
-            tricollide<C>(m, curnode->childindex(nearidx), d, dir, cutoff, center, radius, orient, dist, bo, br);
+            tricollide<C>(ctx, m, curnode->childindex(nearidx), d, dir, cutoff, center, radius, orient, dist, bo, br);
             if(farsplit <= 0)
             {
                 if(!curnode->isleaf(faridx))
@@ -958,7 +1480,7 @@ void BIH::collide(const mesh &m, physent *d, const vec &dir, float cutoff, const
                 }
                 else
                 {
-                    tricollide<C>(m, curnode->childindex(faridx), d, dir, cutoff, center, radius, orient, dist, bo, br);
+                    tricollide<C>(ctx, m, curnode->childindex(faridx), d, dir, cutoff, center, radius, orient, dist, bo, br);
                 }
             }
         }
@@ -974,14 +1496,14 @@ void BIH::collide(const mesh &m, physent *d, const vec &dir, float cutoff, const
                     }
                     else
                     {
-                        collide<C>(m, d, dir, cutoff, center, radius, orient, dist, &nodes[curnode->childindex(nearidx)], bo, br);
+                        collide<C>(ctx, m, d, dir, cutoff, center, radius, orient, dist, &nodes[curnode->childindex(nearidx)], bo, br);
                         curnode += curnode->childindex(faridx);
                         continue;
                     }
                 }
                 else
                 {
-                    tricollide<C>(m, curnode->childindex(faridx), d, dir, cutoff, center, radius, orient, dist, bo, br);
+                    tricollide<C>(ctx, m, curnode->childindex(faridx), d, dir, cutoff, center, radius, orient, dist, bo, br);
                 }
             }
             curnode += curnode->childindex(nearidx);
@@ -995,7 +1517,7 @@ void BIH::collide(const mesh &m, physent *d, const vec &dir, float cutoff, const
     }
 }
 
-bool BIH::ellipsecollide(physent *d, const vec &dir, float cutoff, const vec &o, int yaw, int pitch, int roll, float scale)
+bool BIH::ellipsecollide(CollisionContext &ctx, physent *d, const vec &dir, float cutoff, const vec &o, int yaw, int pitch, int roll, float scale)
 {
     if(!numnodes)
     {
@@ -1046,12 +1568,12 @@ bool BIH::ellipsecollide(physent *d, const vec &dir, float cutoff, const vec &o,
         }
         matrix4x3 morient;
         morient.mul(orient, m.xform);
-        collide<Collide_Ellipse>(m, d, dir, cutoff, m.invxform.transform(bo), radius, morient, dist, m.nodes, icenter, iradius);
+        collide<Collide_Ellipse>(ctx, m, d, dir, cutoff, m.invxform.transform(bo), radius, morient, dist, m.nodes, icenter, iradius);
     }
     return dist > maxcollidedistance;
 }
 
-bool BIH::boxcollide(physent *d, const vec &dir, float cutoff, const vec &o, int yaw, int pitch, int roll, float scale)
+bool BIH::boxcollide(CollisionContext &ctx, physent *d, const vec &dir, float cutoff, const vec &o, int yaw, int pitch, int roll, float scale)
 {
     if(!numnodes)
     {
@@ -1106,11 +1628,11 @@ bool BIH::boxcollide(physent *d, const vec &dir, float cutoff, const vec &o, int
         }
         matrix4x3 morient;
         morient.mul(dorient, dcenter, m.xform);
-        collide<Collide_OrientedBoundingBox>(m, d, ddir, cutoff, center, radius, morient, dist, m.nodes, icenter, iradius);
+        collide<Collide_OrientedBoundingBox>(ctx, m, d, ddir, cutoff, center, radius, morient, dist, m.nodes, icenter, iradius);
     }
     if(dist > maxcollidedistance)
     {
-        collidewall = drot.transposedtransform(collidewall);
+        ctx.wall = drot.transposedtransform(ctx.wall);
         return true;
     }
     return false;
@@ -1262,3 +1784,141 @@ void BIH::genstaintris(stainrenderer *s, const vec &staincenter, float stainradi
     }
 }
 
+
+/* bihbench: rebuilds the BIH of every loaded mapmodel with 1, 2, 4 and 8 worker
+ * threads, reporting the time taken for each and whether the rebuilt hierarchies
+ * match the ones built with a single thread
+ */
+void bihbench()
+{
+    std::vector<std::vector<BIH::mesh>> buildmeshes;
+    for(const mapmodelinfo &mmi : mapmodels)
+    {
+        if(mmi.m && mmi.m->bih)
+        {
+            buildmeshes.push_back(mmi.m->bih->getbuildmeshes());
+        }
+    }
+    if(buildmeshes.empty())
+    {
+        conoutf(Console_Error, "no mapmodel BIHs to benchmark");
+        return;
+    }
+    int oldthreads = workerthreads;
+    std::vector<BIH *> reference;
+    for(int threads = 1; threads <= 8; threads *= 2)
+    {
+        setworkerthreads(threads);
+        std::vector<BIH *> built;
+        double start = getpreciseclockmillis();
+        for(std::vector<BIH::mesh> &meshes : buildmeshes)
+        {
+            built.push_back(new BIH(meshes));
+        }
+        double elapsed = getpreciseclockmillis() - start;
+        bool identical = true;
+        if(reference.empty())
+        {
+            reference = built;
+        }
+        else
+        {
+            for(uint i = 0; i < built.size(); ++i)
+            {
+                identical = identical && built[i]->identical(*reference[i]);
+                delete built[i];
+            }
+        }
+        conoutf("bihbench: %d models, %d threads: %.2f ms%s", static_cast<int>(buildmeshes.size()), threads, elapsed, identical ? "" : " (mismatch)");
+    }
+    for(BIH *b : reference)
+    {
+        delete b;
+    }
+    setworkerthreads(oldthreads);
+}
+
+/* mmraybench: fires a fan of coherent rays from the camera at every mapmodel in
+ * the map, first one at a time and then through the batched mmintersect, and
+ * reports the throughput of each and whether their hit distances agree
+ */
+void mmraybench(int *fansize)
+{
+    int side = std::clamp(*fansize > 0 ? *fansize : 32, 1, 256),
+        numrays = side*side;
+    const vector<extentity *> &ents = entities::getents();
+    std::vector<int> mapmodelents;
+    for(int i = 0; i < ents.length(); i++)
+    {
+        if(ents[i]->type == EngineEnt_Mapmodel)
+        {
+            mapmodelents.push_back(i);
+        }
+    }
+    if(mapmodelents.empty())
+    {
+        conoutf(Console_Error, "no mapmodels to benchmark");
+        return;
+    }
+    const vec &o = camera1->o;
+    std::vector<vec> origins(numrays, o),
+                     rays(numrays);
+    std::vector<float> scalardist(numrays),
+                       batchdist(numrays);
+    double scalartime = 0,
+           batchtime = 0;
+    int mismatches = 0,
+        hits = 0;
+    for(int idx : mapmodelents)
+    {
+        const extentity &e = *ents[idx];
+        vec dir = vec(e.o).sub(o);
+        float dist = dir.magnitude();
+        if(dist <= 0)
+        {
+            continue;
+        }
+        dir.div(dist);
+        //spread the fan over roughly a 16 unit square around the entity's origin
+        vec right = vec(dir.y, -dir.x, 0),
+            up;
+        if(right.iszero())
+        {
+            right = vec(1, 0, 0);
+        }
+        right.normalize();
+        up.cross(right, dir);
+        for(int y = 0; y < side; ++y)
+        {
+            for(int x = 0; x < side; ++x)
+            {
+                float dx = 16.0f*(x + 0.5f)/side - 8.0f,
+                      dy = 16.0f*(y + 0.5f)/side - 8.0f;
+                rays[y*side + x] = vec(e.o).add(vec(right).mul(dx)).add(vec(up).mul(dy)).sub(o).normalize();
+            }
+        }
+        double start = getpreciseclockmillis();
+        for(int i = 0; i < numrays; ++i)
+        {
+            if(!mmintersect(e, origins[i], rays[i], 0, Ray_Poly, scalardist[i]))
+            {
+                scalardist[i] = -1;
+            }
+        }
+        scalartime += getpreciseclockmillis() - start;
+        start = getpreciseclockmillis();
+        hits += mmintersect(e, numrays, origins.data(), rays.data(), 0, Ray_Poly, batchdist.data());
+        batchtime += getpreciseclockmillis() - start;
+        for(int i = 0; i < numrays; ++i)
+        {
+            if(scalardist[i] != batchdist[i])
+            {
+                mismatches++;
+            }
+        }
+    }
+    double totalrays = static_cast<double>(numrays)*mapmodelents.size();
+    conoutf("mmraybench: %.0f rays, %d hits", totalrays, hits);
+    conoutf("mmraybench: single: %.2f ms (%.2f Mrays/s)", scalartime, scalartime > 0 ? totalrays/(scalartime*1000) : 0);
+    conoutf("mmraybench: batched: %.2f ms (%.2f Mrays/s), %d mismatches", batchtime, batchtime > 0 ? totalrays/(batchtime*1000) : 0, mismatches);
+}
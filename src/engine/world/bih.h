@@ -1,4 +1,6 @@
 class stainrenderer;
+class taskgroup;
+struct CollisionContext;
 
 class BIH
 {
@@ -43,7 +45,7 @@ class BIH
             node *nodes;
             int numnodes;
             const tri *tris;
-            const tribb *tribbs;
+            tribb *tribbs;
             int numtris;
             const uchar *pos, *tc;
             int posstride, tcstride;
@@ -64,11 +66,14 @@ class BIH
         float entradius;
 
         bool traverse(const vec &o, const vec &ray, float maxdist, float &dist, int mode);
+        int traverse(int numrays, const vec *o, const vec *ray, float maxdist, float *dist, int mode, vec *surfaces = nullptr);
         bool triintersect(const mesh &m, int tidx, const vec &mo, const vec &mray, float maxdist, float &dist, int mode);
-        bool boxcollide(physent *d, const vec &dir, float cutoff, const vec &o, int yaw, int pitch, int roll, float scale = 1);
-        bool ellipsecollide(physent *d, const vec &dir, float cutoff, const vec &o, int yaw, int pitch, int roll, float scale = 1);
+        bool boxcollide(CollisionContext &ctx, physent *d, const vec &dir, float cutoff, const vec &o, int yaw, int pitch, int roll, float scale = 1);
+        bool ellipsecollide(CollisionContext &ctx, physent *d, const vec &dir, float cutoff, const vec &o, int yaw, int pitch, int roll, float scale = 1);
         void genstaintris(stainrenderer *s, const vec &staincenter, float stainradius, const vec &o, int yaw, int pitch, int roll, float scale = 1);
         void preload();
+        std::vector<mesh> getbuildmeshes() const;
+        bool identical(const BIH &b) const;
 
     private:
         mesh *meshes;
@@ -81,15 +86,19 @@ class BIH
         float radius;
 
         template<int C>
-        void collide(const mesh &m, physent *d, const vec &dir, float cutoff, const vec &center, const vec &radius, const matrix4x3 &orient, float &dist, node *curnode, const ivec &bo, const ivec &br);
+        void collide(CollisionContext &ctx, const mesh &m, physent *d, const vec &dir, float cutoff, const vec &center, const vec &radius, const matrix4x3 &orient, float &dist, node *curnode, const ivec &bo, const ivec &br);
         template<int C>
-        void tricollide(const mesh &m, int tidx, physent *d, const vec &dir, float cutoff, const vec &center, const vec &radius, const matrix4x3 &orient, float &dist, const ivec &bo, const ivec &br);
+        void tricollide(CollisionContext &ctx, const mesh &m, int tidx, physent *d, const vec &dir, float cutoff, const vec &center, const vec &radius, const matrix4x3 &orient, float &dist, const ivec &bo, const ivec &br);
 
-        void build(mesh &m, ushort *indices, int numindices, const ivec &vmin, const ivec &vmax);
+        void buildmesh(mesh &m, ushort *indices, taskgroup &tasks);
+        void build(mesh &m, ushort *indices, int numindices, const ivec &vmin, const ivec &vmax, int offset, taskgroup &tasks);
         bool traverse(const mesh &m, const vec &o, const vec &ray, const vec &invray, float maxdist, float &dist, int mode, node *curnode, float tmin, float tmax);
         void genstaintris(stainrenderer *s, const mesh &m, const vec &center, float radius, const matrix4x3 &orient, node *curnode, const ivec &bo, const ivec &br);
         void genstaintris(stainrenderer *s, const mesh &m, int tidx, const vec &center, float radius, const matrix4x3 &orient, const ivec &bo, const ivec &br);
 };
 
 extern bool mmintersect(const extentity &e, const vec &o, const vec &ray, float maxdist, int mode, float &dist);
+extern int mmintersect(const extentity &e, int numrays, const vec *o, const vec *ray, float maxdist, int mode, float *dist, vec *surfaces = nullptr);
+extern void bihbench();
+extern void mmraybench(int *fansize);
 
@@ -9,6 +9,7 @@
 #include "../libprimis-headers/cube.h"
 #include "../../shared/geomexts.h"
 #include "../../shared/glexts.h"
+#include "../../shared/threads.h"
 
 #include "light.h"
 #include "octaworld.h"
@@ -16,6 +17,7 @@
 #include "world.h"
 
 #include "interface/console.h"
+#include "interface/control.h"
 #include "interface/input.h"
 
 #include "render/radiancehints.h"
@@ -430,7 +432,13 @@ void clearlightcache(int id)
     }
 }
 
-static uint lightprogress = 0;
+//number of cube families processed by the current calclight, shared by all worker threads
+static std::atomic<uint> lightprogress(0);
+static double lightsurfacetime = 0;
+static std::vector<uchar> *lightsnapshot = nullptr; //when set, calclight saves the computed surfaces here
+
+//subtrees this many levels below the root (or shallower) are lit as separate tasks
+static constexpr int lighttaskdepth = 2;
 
 static void calcsurfaces(cube &c, const ivec &co, int size, int usefacemask, int preview = 0)
 {
@@ -613,16 +621,34 @@ static void calcsurfaces(cube &c, const ivec &co, int size, int usefacemask, int
     }
 }
 
-static void calcsurfaces(cube *c, const ivec &co, int size)
+/* calcsurfaces: computes the lit surfaces of every cube in the octree node c
+ *
+ * each cube's surfaces depend only on its own geometry, its neighbors' shapes,
+ * and the normal groups, none of which are modified here, so separate subtrees
+ * are handed out to the worker pool; the result is identical regardless of the
+ * number of threads used
+ */
+static void calcsurfaces(cube *c, const ivec &co, int size, taskgroup &tasks, int depth = 0)
 {
-    lightprogress++;
+    lightprogress.fetch_add(1, std::memory_order_relaxed);
 
     for(int i = 0; i < 8; ++i)
     {
         ivec o(i, co, size);
         if(c[i].children)
         {
-            calcsurfaces(c[i].children, o, size >> 1);
+            if(depth < lighttaskdepth)
+            {
+                cube *children = c[i].children;
+                tasks.run([children, o, size, &tasks, depth]()
+                {
+                    calcsurfaces(children, o, size >> 1, tasks, depth + 1);
+                });
+            }
+            else
+            {
+                calcsurfaces(c[i].children, o, size >> 1, tasks, depth + 1);
+            }
         }
         else if(!(c[i].isempty()))
         {
@@ -649,17 +675,79 @@ static void calcsurfaces(cube *c, const ivec &co, int size)
     }
 }
 
+//appends the surfaces and lit verts of every cube to out, for comparing lighting results
+static void savesurfaces(const cube *c, std::vector<uchar> &out)
+{
+    for(int i = 0; i < 8; ++i)
+    {
+        if(c[i].children)
+        {
+            savesurfaces(c[i].children, out);
+        }
+        else if(c[i].ext)
+        {
+            const uchar *surfs = reinterpret_cast<const uchar *>(c[i].ext->surfaces);
+            out.insert(out.end(), surfs, surfs + sizeof(c[i].ext->surfaces));
+            int numverts = 0;
+            for(int j = 0; j < 6; ++j)
+            {
+                numverts += c[i].ext->surfaces[j].totalverts();
+            }
+            const uchar *verts = reinterpret_cast<const uchar *>(c[i].ext->verts());
+            out.insert(out.end(), verts, verts + numverts*sizeof(vertinfo));
+        }
+    }
+}
+
 void cubeworld::calclight()
 {
     remip();
     clearsurfaces(worldroot);
     lightprogress = 0;
     calcnormals(filltjoints > 0);
-    calcsurfaces(worldroot, ivec(0, 0, 0), worldsize >> 1);
+    double start = getpreciseclockmillis();
+    {
+        taskgroup tasks;
+        calcsurfaces(worldroot, ivec(0, 0, 0), worldsize >> 1, tasks);
+        tasks.wait();
+    }
+    lightsurfacetime = getpreciseclockmillis() - start;
+    if(lightsnapshot)
+    {
+        savesurfaces(worldroot, *lightsnapshot);
+    }
     clearnormals();
     allchanged();
 }
 
+/* calclightbench: relights the map with 1, 2, 4 and 8 threads
+ *
+ * reports the time spent computing surfaces for each thread count, and whether
+ * the result differs from the single threaded one
+ */
+void calclightbench()
+{
+    int oldthreads = workerthreads;
+    std::vector<uchar> reference,
+                       surfaces;
+    double basetime = 0;
+    for(int threads = 1; threads <= 8; threads *= 2)
+    {
+        setworkerthreads(threads);
+        std::vector<uchar> &out = threads == 1 ? reference : surfaces;
+        out.clear();
+        lightsnapshot = &out;
+        rootworld.calclight();
+        lightsnapshot = nullptr;
+        if(threads == 1)
+        {
+            basetime = lightsurfacetime;
+        }
+        conoutf("calclightbench: %d threads: %.2f ms (%.2fx), %u cube families, %s", threads, lightsurfacetime, lightsurfacetime > 0 ? basetime/lightsurfacetime : 0, lightprogress.load(), out == reference ? "identical" : "mismatch");
+    }
+    setworkerthreads(oldthreads);
+}
+
 VAR(fullbright, 0, 0, 1);           //toggles rendering at fullbrightlevel light
 VAR(fullbrightlevel, 0, 160, 255);  //grayscale shade for lighting when at fullbright
 
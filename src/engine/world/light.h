@@ -14,6 +14,7 @@ extern int fullbright, fullbrightlevel;
 extern void clearlights();
 extern void initlights();
 extern void clearlightcache(int id = -1);
+extern void calclightbench();
 extern void brightencube(cube &c);
 extern void setsurfaces(cube &c, const surfaceinfo *surfs, const vertinfo *verts, int numverts);
 extern void setsurface(cube &c, int orient, const surfaceinfo &surf, const vertinfo *verts, int numverts);
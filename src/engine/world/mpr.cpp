@@ -13,6 +13,12 @@
 
 #include "mpr.h"
 
+//the first step of batched searches uses SSE where available, and plain floats otherwise
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+    #define MPR_SSE
+#endif
+
 namespace mpr
 {
 
@@ -134,6 +140,11 @@ namespace mpr
     float EntOBB::bottom() const { return ent->o.z - ent->eyeheight; }
     float EntOBB::top()    const { return ent->o.z + ent->aboveeye; }
 
+    const matrix3 &EntOBB::getorient() const
+    {
+        return orient;
+    }
+
     //EntFuzzy
 
     float EntFuzzy::left()   const { return ent->o.x - ent->radius; }
@@ -339,4 +350,494 @@ namespace mpr
         }
         return orient.transposedtransform(p).add(o);
     }
+
+    //ModelBatch
+
+    ModelBatch::ModelBatch(bool ellipse) : ellipse(ellipse)
+    {
+    }
+
+    void ModelBatch::clear()
+    {
+        for(std::vector<float> *v : {&ox, &oy, &oz, &rx, &ry, &rz, &ax, &ay, &az, &bx, &by, &bz, &cx, &cy, &cz})
+        {
+            v->clear();
+        }
+    }
+
+    void ModelBatch::add(const Model &m)
+    {
+        ox.push_back(m.o.x);
+        oy.push_back(m.o.y);
+        oz.push_back(m.o.z);
+        rx.push_back(m.radius.x);
+        ry.push_back(m.radius.y);
+        rz.push_back(m.radius.z);
+        ax.push_back(m.orient.a.x);
+        ay.push_back(m.orient.a.y);
+        az.push_back(m.orient.a.z);
+        bx.push_back(m.orient.b.x);
+        by.push_back(m.orient.b.y);
+        bz.push_back(m.orient.b.z);
+        cx.push_back(m.orient.c.x);
+        cy.push_back(m.orient.c.y);
+        cz.push_back(m.orient.c.z);
+    }
+
+    int ModelBatch::size() const
+    {
+        return static_cast<int>(ox.size());
+    }
+
+    bool ModelBatch::hit(int i) const
+    {
+        return hits[i] != 0;
+    }
+
+    vec ModelBatch::contactpoint(int i) const
+    {
+        return contactpoints[i];
+    }
+
+    //the support point of model i in direction n, computed as ModelOBB/ModelEllipse::supportpoint do
+    template<bool isellipse>
+    inline void ModelBatch::modelsupport(int i, float nx, float ny, float nz, float &px, float &py, float &pz) const
+    {
+        float lx = ax[i]*nx + bx[i]*ny + cx[i]*nz,
+              ly = ay[i]*nx + by[i]*ny + cy[i]*nz,
+              lz = az[i]*nx + bz[i]*ny + cz[i]*nz,
+              sx, sy,
+              sz = lz > 0 ? rz[i] : -rz[i];
+        if(isellipse)
+        {
+            bool round = lx || ly;
+            float r = round ? std::sqrt(lx*lx + ly*ly) : 1;
+            sx = round ? lx*rx[i]/r : 0;
+            sy = round ? ly*ry[i]/r : 0;
+        }
+        else
+        {
+            sx = lx > 0 ? rx[i] : -rx[i];
+            sy = ly > 0 ? ry[i] : -ry[i];
+        }
+        px = ax[i]*sx + ay[i]*sy + az[i]*sz + ox[i];
+        py = bx[i]*sx + by[i]*sy + bz[i]*sz + oy[i];
+        pz = cx[i]*sx + cy[i]*sy + cz[i]*sz + oz[i];
+    }
+
+    vec ModelBatch::modelsupport(int i, const vec &n) const
+    {
+        vec p;
+        if(ellipse)
+        {
+            modelsupport<true>(i, n.x, n.y, n.z, p.x, p.y, p.z);
+        }
+        else
+        {
+            modelsupport<false>(i, n.x, n.y, n.z, p.x, p.y, p.z);
+        }
+        return p;
+    }
+
+    //an oriented box entity's support function, unpacked so the batch can evaluate it without going through vecs
+    struct BatchEnt
+    {
+        float ax, ay, az, bx, by, bz, cx, cy, cz,
+              xradius, yradius, aboveeye, eyeheight,
+              ox, oy, oz;
+
+        BatchEnt(const EntOBB &ent)
+        {
+            const matrix3 &m = ent.getorient();
+            ax = m.a.x; ay = m.a.y; az = m.a.z;
+            bx = m.b.x; by = m.b.y; bz = m.b.z;
+            cx = m.c.x; cy = m.c.y; cz = m.c.z;
+            xradius = ent.ent->xradius;
+            yradius = ent.ent->yradius;
+            aboveeye = ent.ent->aboveeye;
+            eyeheight = ent.ent->eyeheight;
+            ox = ent.ent->o.x;
+            oy = ent.ent->o.y;
+            oz = ent.ent->o.z;
+        }
+
+        //computed as EntOBB::supportpoint does
+        void supportpoint(float nx, float ny, float nz, float &px, float &py, float &pz) const
+        {
+            float lx = ax*nx + bx*ny + cx*nz,
+                  ly = ay*nx + by*ny + cy*nz,
+                  lz = az*nx + bz*ny + cz*nz,
+                  sx = lx > 0 ? xradius : -xradius,
+                  sy = ly > 0 ? yradius : -yradius,
+                  sz = lz > 0 ? aboveeye : -eyeheight;
+            px = ax*sx + ay*sy + az*sz + ox;
+            py = bx*sx + by*sy + bz*sz + oy;
+            pz = cx*sx + cy*sy + cz*sz + oz;
+        }
+    };
+
+#ifdef MPR_SSE
+    namespace
+    {
+        typedef __m128 float4;
+
+        inline float4 loadfloat4(const float *f) { return _mm_loadu_ps(f); }
+        inline void storefloat4(float *f, float4 a) { _mm_storeu_ps(f, a); }
+        inline float4 splatfloat4(float f) { return _mm_set1_ps(f); }
+        inline float4 addfloat4(float4 a, float4 b) { return _mm_add_ps(a, b); }
+        inline float4 subfloat4(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+        inline float4 mulfloat4(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+        inline float4 divfloat4(float4 a, float4 b) { return _mm_div_ps(a, b); }
+        inline float4 sqrtfloat4(float4 a) { return _mm_sqrt_ps(a); }
+        inline float4 positivemask(float4 a) { return _mm_cmpgt_ps(a, _mm_setzero_ps()); }
+        inline float4 nonzeromask(float4 a) { return _mm_cmpneq_ps(a, _mm_setzero_ps()); }
+        inline float4 ormask(float4 a, float4 b) { return _mm_or_ps(a, b); }
+        //picks a where mask is set, and b elsewhere
+        inline float4 selectfloat4(float4 mask, float4 a, float4 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+
+        //(x*mx + y*my) + z*mz, the order matrix3::transform and vec::dot sum in
+        inline float4 sumfloat4(float4 x, float4 mx, float4 y, float4 my, float4 z, float4 mz)
+        {
+            return addfloat4(addfloat4(mulfloat4(x, mx), mulfloat4(y, my)), mulfloat4(z, mz));
+        }
+    }
+#endif
+
+    /* firststep: finds, for every model, how far the origin lies inside the
+     * support plane of the first step of its search (with v0 = model center -
+     * entity center, and n = -v0), four models at a time where SSE is available
+     */
+    template<bool isellipse>
+    void ModelBatch::firststep(const vec &entcenter, const BatchEnt &entfn)
+    {
+        const BatchEnt e = entfn;
+        const float ecx = entcenter.x,
+                    ecy = entcenter.y,
+                    ecz = entcenter.z;
+        int num = size(),
+            i = 0;
+#ifdef MPR_SSE
+        float4 eax = splatfloat4(e.ax), eay = splatfloat4(e.ay), eaz = splatfloat4(e.az),
+               ebx = splatfloat4(e.bx), eby = splatfloat4(e.by), ebz = splatfloat4(e.bz),
+               ecxs = splatfloat4(e.cx), ecys = splatfloat4(e.cy), eczs = splatfloat4(e.cz),
+               xradius = splatfloat4(e.xradius), negxradius = splatfloat4(-e.xradius),
+               yradius = splatfloat4(e.yradius), negyradius = splatfloat4(-e.yradius),
+               aboveeye = splatfloat4(e.aboveeye), negeyeheight = splatfloat4(-e.eyeheight),
+               eox = splatfloat4(e.ox), eoy = splatfloat4(e.oy), eoz = splatfloat4(e.oz),
+               zero = _mm_setzero_ps(),
+               one = splatfloat4(1),
+               negone = splatfloat4(-1);
+        for(; i + 4 <= num; i += 4)
+        {
+            float4 v0x = subfloat4(loadfloat4(&ox[i]), splatfloat4(ecx)),
+                   v0y = subfloat4(loadfloat4(&oy[i]), splatfloat4(ecy)),
+                   v0z = subfloat4(loadfloat4(&oz[i]), splatfloat4(ecz));
+            v0z = selectfloat4(ormask(ormask(nonzeromask(v0x), nonzeromask(v0y)), nonzeromask(v0z)), v0z, splatfloat4(1e-5f));
+            float4 nx = mulfloat4(v0x, negone),
+                   ny = mulfloat4(v0y, negone),
+                   nz = mulfloat4(v0z, negone),
+                   //entity support point in direction v0
+                   elx = sumfloat4(eax, v0x, ebx, v0y, ecxs, v0z),
+                   ely = sumfloat4(eay, v0x, eby, v0y, ecys, v0z),
+                   elz = sumfloat4(eaz, v0x, ebz, v0y, eczs, v0z),
+                   esx = selectfloat4(positivemask(elx), xradius, negxradius),
+                   esy = selectfloat4(positivemask(ely), yradius, negyradius),
+                   esz = selectfloat4(positivemask(elz), aboveeye, negeyeheight),
+                   ex = addfloat4(sumfloat4(eax, esx, eay, esy, eaz, esz), eox),
+                   ey = addfloat4(sumfloat4(ebx, esx, eby, esy, ebz, esz), eoy),
+                   ez = addfloat4(sumfloat4(ecxs, esx, ecys, esy, eczs, esz), eoz),
+                   //model support point in direction n
+                   mdlax = loadfloat4(&ax[i]), mdlay = loadfloat4(&ay[i]), mdlaz = loadfloat4(&az[i]),
+                   mdlbx = loadfloat4(&bx[i]), mdlby = loadfloat4(&by[i]), mdlbz = loadfloat4(&bz[i]),
+                   mdlcx = loadfloat4(&cx[i]), mdlcy = loadfloat4(&cy[i]), mdlcz = loadfloat4(&cz[i]),
+                   mdlrx = loadfloat4(&rx[i]), mdlry = loadfloat4(&ry[i]), mdlrz = loadfloat4(&rz[i]),
+                   lx = sumfloat4(mdlax, nx, mdlbx, ny, mdlcx, nz),
+                   ly = sumfloat4(mdlay, nx, mdlby, ny, mdlcy, nz),
+                   lz = sumfloat4(mdlaz, nx, mdlbz, ny, mdlcz, nz),
+                   sz = selectfloat4(positivemask(lz), mdlrz, mulfloat4(mdlrz, negone)),
+                   sx, sy;
+            if(isellipse)
+            {
+                float4 round = ormask(nonzeromask(lx), nonzeromask(ly)),
+                       r = selectfloat4(round, sqrtfloat4(addfloat4(mulfloat4(lx, lx), mulfloat4(ly, ly))), one);
+                sx = selectfloat4(round, divfloat4(mulfloat4(lx, mdlrx), r), zero);
+                sy = selectfloat4(round, divfloat4(mulfloat4(ly, mdlry), r), zero);
+            }
+            else
+            {
+                sx = selectfloat4(positivemask(lx), mdlrx, mulfloat4(mdlrx, negone));
+                sy = selectfloat4(positivemask(ly), mdlry, mulfloat4(mdlry, negone));
+            }
+            float4 mx = addfloat4(sumfloat4(mdlax, sx, mdlay, sy, mdlaz, sz), loadfloat4(&ox[i])),
+                   my = addfloat4(sumfloat4(mdlbx, sx, mdlby, sy, mdlbz, sz), loadfloat4(&oy[i])),
+                   mz = addfloat4(sumfloat4(mdlcx, sx, mdlcy, sy, mdlcz, sz), loadfloat4(&oz[i]));
+            storefloat4(&firstdist[i], sumfloat4(subfloat4(mx, ex), nx, subfloat4(my, ey), ny, subfloat4(mz, ez), nz));
+        }
+#endif
+        for(; i < num; ++i)
+        {
+            float v0x = ox[i] - ecx,
+                  v0y = oy[i] - ecy,
+                  v0z = oz[i] - ecz;
+            if(!v0x && !v0y && !v0z)
+            {
+                v0z = 1e-5f;
+            }
+            float nx = -v0x,
+                  ny = -v0y,
+                  nz = -v0z,
+                  ex, ey, ez, mx, my, mz;
+            e.supportpoint(v0x, v0y, v0z, ex, ey, ez);
+            modelsupport<isellipse>(i, nx, ny, nz, mx, my, mz);
+            firstdist[i] = (mx - ex)*nx + (my - ey)*ny + (mz - ez)*nz;
+        }
+    }
+
+    /* collide: tests ent against every model in the batch
+     *
+     * afterwards hit(i) is whether ent touches model i, and contactpoint(i) the
+     * contact point on that model if so
+     */
+    void ModelBatch::collide(const EntOBB &ent)
+    {
+        int num = size();
+        firstdist.resize(num);
+        lanes.resize(num);
+        hits.assign(num, 0);
+        contactpoints.resize(num);
+        vec entcenter = ent.center();
+        BatchEnt entfn(ent);
+        if(ellipse)
+        {
+            firststep<true>(entcenter, entfn);
+        }
+        else
+        {
+            firststep<false>(entcenter, entfn);
+        }
+        active.clear();
+        for(int i = 0; i < num; ++i)
+        {
+            if(firstdist[i] <= 0)
+            {
+                continue;
+            }
+            BatchLane &l = lanes[i];
+            l.v02 = vec(ox[i], oy[i], oz[i]);
+            l.v0 = vec(l.v02).sub(entcenter);
+            if(l.v0.iszero())
+            {
+                l.v0 = vec(0, 0, 1e-5f);
+            }
+            l.n = vec(l.v0).neg();
+            l.stage = BatchLane::Stage_Support1;
+            l.iter = 0;
+            l.hit = false;
+            contactpoints[i] = l.v02;
+            vec es;
+            entfn.supportpoint(l.v0.x, l.v0.y, l.v0.z, es.x, es.y, es.z);
+            advance(i, es, modelsupport(i, l.n));
+            if(l.stage != BatchLane::Stage_Done)
+            {
+                active.push_back(i);
+            }
+        }
+        //the remaining searches take one support point per round
+        while(!active.empty())
+        {
+            int remaining = 0;
+            for(int i : active)
+            {
+                const vec &n = lanes[i].n;
+                vec es;
+                entfn.supportpoint(-n.x, -n.y, -n.z, es.x, es.y, es.z);
+                advance(i, es, modelsupport(i, n));
+                if(lanes[i].stage != BatchLane::Stage_Done)
+                {
+                    active[remaining++] = i;
+                }
+            }
+            active.resize(remaining);
+        }
+    }
+
+    void ModelBatch::finish(int i, bool collided)
+    {
+        lanes[i].stage = BatchLane::Stage_Done;
+        hits[i] = collided ? 1 : 0;
+    }
+
+    //phase two of the search: computes the portal's normal and records the contact once the origin is inside it
+    void ModelBatch::refine(int i)
+    {
+        BatchLane &l = lanes[i];
+        l.n.cross(l.v1, l.v2, l.v3);
+        if(l.n.iszero())
+        {
+            finish(i, true);
+            return;
+        }
+        l.n.normalize();
+        if(l.n.dot(l.v1) >= 0 && !l.hit)
+        {
+            float b0 = l.v3.scalartriple(l.v1, l.v2),
+                  b1 = l.v0.scalartriple(l.v3, l.v2),
+                  b2 = l.v3.scalartriple(l.v0, l.v1),
+                  b3 = l.v0.scalartriple(l.v2, l.v1),
+                  sum = b0 + b1 + b2 + b3;
+            if(sum <= 0)
+            {
+                b0 = 0;
+                b1 = l.n.scalartriple(l.v2, l.v3);
+                b2 = l.n.scalartriple(l.v3, l.v1);
+                b3 = l.n.scalartriple(l.v1, l.v2);
+                sum = b1 + b2 + b3;
+            }
+            contactpoints[i] = (vec(l.v02).mul(b0).add(vec(l.v12).mul(b1)).add(vec(l.v22).mul(b2)).add(vec(l.v32).mul(b3))).mul(1.0f/sum);
+            l.hit = true;
+        }
+        l.stage = BatchLane::Stage_Refine;
+    }
+
+    /* advance: takes model i's search one step, given the support points of the
+     * entity and the model in the current search direction
+     *
+     * follows collide(p1, p2, contactnormal, contactpoint1, contactpoint2) in mpr.h
+     * step for step
+     */
+    void ModelBatch::advance(int i, const vec &entsupport, const vec &mdlsupport)
+    {
+        BatchLane &l = lanes[i];
+        vec v = vec(mdlsupport).sub(entsupport);
+        switch(l.stage)
+        {
+            case BatchLane::Stage_Support1:
+            {
+                l.v1 = v;
+                l.v11 = entsupport;
+                l.v12 = mdlsupport;
+                if(l.v1.dot(l.n) <= 0)
+                {
+                    finish(i, false);
+                    return;
+                }
+                l.n.cross(l.v1, l.v0);
+                if(l.n.iszero())
+                {
+                    contactpoints[i] = l.v12;
+                    finish(i, true);
+                    return;
+                }
+                l.stage = BatchLane::Stage_Support2;
+                return;
+            }
+            case BatchLane::Stage_Support2:
+            {
+                l.v2 = v;
+                l.v21 = entsupport;
+                l.v22 = mdlsupport;
+                if(l.v2.dot(l.n) <= 0)
+                {
+                    finish(i, false);
+                    return;
+                }
+                l.n.cross(l.v0, l.v1, l.v2);
+                if(l.n.dot(l.v0) > 0)
+                {
+                    std::swap(l.v1, l.v2);
+                    std::swap(l.v11, l.v21);
+                    std::swap(l.v12, l.v22);
+                    l.n.neg();
+                }
+                l.iter = 0;
+                l.stage = BatchLane::Stage_Portal;
+                return;
+            }
+            case BatchLane::Stage_Portal:
+            {
+                l.v3 = v;
+                l.v31 = entsupport;
+                l.v32 = mdlsupport;
+                if(l.v3.dot(l.n) <= 0)
+                {
+                    finish(i, false);
+                    return;
+                }
+                vec v3xv0;
+                v3xv0.cross(l.v3, l.v0);
+                if(l.v1.dot(v3xv0) < 0)
+                {
+                    l.v2 = l.v3;
+                    l.v21 = l.v31;
+                    l.v22 = l.v32;
+                    l.n.cross(l.v0, l.v1, l.v3);
+                }
+                else if(l.v2.dot(v3xv0) > 0)
+                {
+                    l.v1 = l.v3;
+                    l.v11 = l.v31;
+                    l.v12 = l.v32;
+                    l.n.cross(l.v0, l.v3, l.v2);
+                }
+                else
+                {
+                    l.iter = 0;
+                    refine(i);
+                    return;
+                }
+                if(++l.iter >= 100)
+                {
+                    finish(i, false);
+                }
+                return;
+            }
+            case BatchLane::Stage_Refine:
+            {
+                if(v.dot(l.n) <= 0 || vec(v).sub(l.v3).dot(l.n) <= boundarytolerance || l.iter > 100)
+                {
+                    finish(i, l.hit);
+                    return;
+                }
+                vec v4xv0;
+                v4xv0.cross(v, l.v0);
+                if(l.v1.dot(v4xv0) > 0)
+                {
+                    if(l.v2.dot(v4xv0) > 0)
+                    {
+                        l.v1 = v;
+                        l.v11 = entsupport;
+                        l.v12 = mdlsupport;
+                    }
+                    else
+                    {
+                        l.v3 = v;
+                        l.v31 = entsupport;
+                        l.v32 = mdlsupport;
+                    }
+                }
+                else
+                {
+                    if(l.v3.dot(v4xv0) > 0)
+                    {
+                        l.v2 = v;
+                        l.v21 = entsupport;
+                        l.v22 = mdlsupport;
+                    }
+                    else
+                    {
+                        l.v1 = v;
+                        l.v11 = entsupport;
+                        l.v12 = mdlsupport;
+                    }
+                }
+                l.iter++;
+                refine(i);
+                return;
+            }
+            default:
+            {
+                return;
+            }
+        }
+    }
 }
@@ -52,6 +52,8 @@ namespace mpr
             float front()  const;
             float bottom() const;
             float top()    const;
+
+            const matrix3 &getorient() const;
         private:
             matrix3 orient;
             float supportcoord(const vec &p) const;
@@ -123,6 +125,69 @@ namespace mpr
         vec supportpoint(const vec &n) const;
     };
 
+    //the state of one model's portal search within a ModelBatch
+    struct BatchLane
+    {
+        enum
+        {
+            Stage_Done = 0,
+            Stage_Support1,
+            Stage_Support2,
+            Stage_Portal,
+            Stage_Refine
+        };
+
+        vec v0, v02, v1, v11, v12, v2, v21, v22, v3, v31, v32, n;
+        int stage, iter;
+        bool hit;
+    };
+
+    struct BatchEnt;
+
+    /* ModelBatch: a set of mapmodel volumes of one shape, stored by component
+     *
+     * collide() tests an oriented box entity against every model in the batch
+     * at once. The first step of the portal search, which rejects most models
+     * near the entity, runs as one pass over the whole batch, four models at a
+     * time where SSE is available; the searches for the models which survive
+     * it then advance together, one support point per round
+     *
+     * each model's search makes the same steps as collide(entity, model) with a
+     * contact point, and computes its support points with the same operations
+     * as ModelOBB/ModelEllipse::supportpoint
+     */
+    class ModelBatch
+    {
+        public:
+            ModelBatch(bool ellipse);
+
+            void clear();
+            void add(const Model &m);
+            int size() const;
+
+            void collide(const EntOBB &ent);
+            bool hit(int i) const;
+            vec contactpoint(int i) const;
+        private:
+            bool ellipse;
+            std::vector<float> ox, oy, oz, rx, ry, rz,
+                               ax, ay, az, bx, by, bz, cx, cy, cz;
+            std::vector<float> firstdist; //how far the origin lies inside each search's first support plane
+            std::vector<BatchLane> lanes;
+            std::vector<int> active;
+            std::vector<uchar> hits;
+            std::vector<vec> contactpoints;
+
+            template<bool isellipse>
+            void modelsupport(int i, float nx, float ny, float nz, float &px, float &py, float &pz) const;
+            vec modelsupport(int i, const vec &n) const;
+            template<bool isellipse>
+            void firststep(const vec &entcenter, const BatchEnt &entfn);
+            void advance(int i, const vec &entsupport, const vec &mdlsupport);
+            void finish(int i, bool collided);
+            void refine(int i);
+    };
+
     //templates
     const float boundarytolerance = 1e-3f;
 
@@ -0,0 +1,175 @@
+/* octacompact.cpp: breadth first copy of the octree for queries
+ *
+ * raycasts, collision and material lookups descend the octree far more often
+ * than it changes outside of edit mode; walking the cubes themselves chases a
+ * pointer to a separately allocated family at every level and pulls in whole
+ * cubes for nodes whose only role is to be stepped through. The compact octree
+ * keeps eight byte nodes in one array instead, and is only used while it
+ * matches the world exactly
+ */
+#include "../libprimis-headers/cube.h"
+#include "../../shared/geomexts.h"
+#include "../../shared/threads.h"
+
+#include "octacompact.h"
+#include "octaedit.h"
+#include "octaworld.h"
+#include "physics.h"
+#include "raycube.h"
+
+#include "interface/console.h"
+#include "interface/control.h"
+
+VAR(usecompactocta, 0, 1, 1);
+
+static compactoctree compactworld = {{}, {}, nullptr, 0};
+
+//returns the compact octree if it is up to date and may be used, otherwise null
+const compactoctree *getcompactocta()
+{
+    if(!usecompactocta || editmode || compactworld.nodes.empty() || compactworld.root != worldroot || compactworld.scale != worldscale)
+    {
+        return nullptr;
+    }
+    return &compactworld;
+}
+
+static void addcompactfamily(cube *c)
+{
+    for(int i = 0; i < 8; ++i)
+    {
+        uchar flags = 0;
+        if(c[i].isempty())
+        {
+            flags |= CompactNode_Empty;
+        }
+        if(c[i].issolid())
+        {
+            flags |= CompactNode_Solid;
+        }
+        if(c[i].ext && c[i].ext->ents)
+        {
+            flags |= CompactNode_Ents;
+        }
+        compactworld.nodes.push_back({-1, c[i].material, flags});
+        compactworld.cubes.push_back(&c[i]);
+    }
+}
+
+/* buildcompactocta: rebuilds the compact octree from the current world
+ *
+ * families are appended in the order their parents were added, so the nodes
+ * array is itself the queue of a breadth first walk of the octree
+ */
+void buildcompactocta()
+{
+    clearcompactocta();
+    if(!worldroot)
+    {
+        return;
+    }
+    compactworld.nodes.reserve(8*allocnodes);
+    compactworld.cubes.reserve(8*allocnodes);
+    addcompactfamily(worldroot);
+    for(size_t i = 0; i < compactworld.nodes.size(); ++i)
+    {
+        cube *c = compactworld.cubes[i];
+        if(c->children)
+        {
+            compactworld.nodes[i].children = compactworld.nodes.size();
+            addcompactfamily(c->children);
+        }
+    }
+    compactworld.root = worldroot;
+    compactworld.scale = worldscale;
+}
+
+//drops the compact octree; must be called before the world's cubes are changed or freed
+void clearcompactocta()
+{
+    compactworld.nodes.clear();
+    compactworld.cubes.clear();
+    compactworld.root = nullptr;
+}
+
+/* compactoctabench: times material lookups, raycasts and collision tests at
+ * numqueries random points, walking the cubes and then the compact octree
+ *
+ * reports the throughput of each and how many results differ between the two
+ */
+void compactoctabench(int *numqueries)
+{
+    if(editmode)
+    {
+        conoutf(Console_Error, "compactoctabench: not available in edit mode");
+        return;
+    }
+    int num = std::clamp(*numqueries > 0 ? *numqueries : 1<<20, 1, 1<<24),
+        numcollides = std::max(num/16, 1);
+    double start = getpreciseclockmillis();
+    buildcompactocta();
+    double buildtime = getpreciseclockmillis() - start;
+    conoutf("compactoctabench: %d nodes, %.2f MB, built in %.2f ms", static_cast<int>(compactworld.nodes.size()),
+            compactworld.nodes.size()*(sizeof(compactnode) + sizeof(cube *))/(1024.0f*1024.0f), buildtime);
+    std::vector<vec> points(num),
+                     rays(num);
+    for(int i = 0; i < num; ++i)
+    {
+        points[i] = vec(randomint(worldsize), randomint(worldsize), randomint(worldsize)).add(0.5f);
+        //spiral of directions evenly covering the sphere
+        float z = 1 - (2*i + 1)/static_cast<float>(num),
+              r = std::sqrt(std::max(1 - z*z, 0.0f)),
+              angle = i*2.39996323f;
+        rays[i] = vec(r*std::cos(angle), r*std::sin(angle), z);
+    }
+    std::vector<int> materials[2];
+    std::vector<float> dists[2];
+    std::vector<uchar> collisions[2];
+    physent d = player ? *static_cast<physent *>(player) : physent();
+    int oldcompact = usecompactocta;
+    for(int compact = 0; compact < 2; ++compact)
+    {
+        usecompactocta = compact;
+        materials[compact].resize(num);
+        dists[compact].resize(num);
+        collisions[compact].resize(numcollides);
+        start = getpreciseclockmillis();
+        for(int i = 0; i < num; ++i)
+        {
+            materials[compact][i] = rootworld.lookupmaterial(points[i]);
+        }
+        double materialtime = getpreciseclockmillis() - start;
+        start = getpreciseclockmillis();
+        raycubes(num, points.data(), rays.data(), dists[compact].data(), 0, Ray_ClipMat);
+        double raytime = getpreciseclockmillis() - start;
+        start = getpreciseclockmillis();
+        for(int i = 0; i < numcollides; ++i)
+        {
+            d.o = points[i];
+            collisions[compact][i] = collide(&d, vec(0, 0, 0), 0, false) ? 1 : 0;
+        }
+        double collidetime = getpreciseclockmillis() - start;
+        conoutf("compactoctabench: %s: %.2f M material lookups/s, %.2f Mrays/s (%d threads), %.2f K collisions/s",
+                compact ? "compact" : "cubes",
+                materialtime > 0 ? num/(materialtime*1000) : 0,
+                raytime > 0 ? num/(raytime*1000) : 0, numworkerthreads(),
+                collidetime > 0 ? numcollides/collidetime : 0);
+    }
+    usecompactocta = oldcompact;
+    int mismatches = 0;
+    for(int i = 0; i < num; ++i)
+    {
+        if(materials[0][i] != materials[1][i] || dists[0][i] != dists[1][i])
+        {
+            mismatches++;
+        }
+    }
+    for(int i = 0; i < numcollides; ++i)
+    {
+        if(collisions[0][i] != collisions[1][i])
+        {
+            mismatches++;
+        }
+    }
+    conoutf("compactoctabench: %d mismatches", mismatches);
+}
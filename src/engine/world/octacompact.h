@@ -0,0 +1,45 @@
+#ifndef OCTACOMPACT_H_
+#define OCTACOMPACT_H_
+
+/* compact octree
+ *
+ * a read-only copy of the octree's structure laid out breadth first, so that
+ * the eight children of a node are contiguous and the upper levels of the tree
+ * sit together at the start of the array. Nodes hold only what traversal needs;
+ * the cube each node was built from is kept in a parallel array, for the leaf
+ * tests which need its full geometry
+ *
+ * built by allchanged() and dropped as soon as the world is edited; queries walk
+ * the cubes themselves while it is missing, and always in edit mode
+ */
+
+enum CompactNodeFlags
+{
+    CompactNode_Empty = 1<<0,
+    CompactNode_Solid = 1<<1,
+    CompactNode_Ents  = 1<<2, //cube has octaentities attached
+};
+
+struct compactnode
+{
+    int children;    //index of the first of this node's eight children, or -1 for a leaf
+    ushort material;
+    uchar flags;
+};
+
+struct compactoctree
+{
+    std::vector<compactnode> nodes; //the world root's children are nodes 0-7
+    std::vector<cube *> cubes;      //the cube each node was built from
+    const cube *root;
+    int scale;
+};
+
+extern int usecompactocta;
+
+extern const compactoctree *getcompactocta();
+extern void buildcompactocta();
+extern void clearcompactocta();
+extern void compactoctabench(int *numqueries);
+
+#endif
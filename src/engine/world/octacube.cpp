@@ -7,6 +7,7 @@
 
 #include "../libprimis-headers/cube.h"
 #include "../../shared/geomexts.h"
+#include "../../shared/threads.h"
 
 #include "light.h"
 #include "octaworld.h"
@@ -14,6 +15,7 @@
 #include "world.h"
 
 #include "interface/console.h"
+#include "interface/control.h"
 
 #include "render/octarender.h"
 #include "render/renderwindow.h"
@@ -75,7 +77,7 @@ void cube::freecubeext(cube &c)
 {
     if(c.ext)
     {
-        delete[] reinterpret_cast<uchar *>(c.ext);
+        deletecubeext(c.ext);
         c.ext = nullptr;
     }
 }
@@ -114,9 +116,8 @@ void cube::discardchildren(bool fixtex, int depth)
                 faces[0] = facesolid;
             }
         }
-        delete[] children;
+        freecubes(children);
         children = nullptr;
-        allocnodes--;
     }
 }
 
@@ -639,8 +640,13 @@ void cube::mergepolys(int orient, const ivec &n, int offset, std::vector<poly> &
         addmerges(orient, n, offset, polys);
         return;
     }
-    hashset<plink> links(polys.size() <= 32 ? 128 : 1024);
-    std::vector<plink *> queue;
+    //link and queue storage is kept per thread and reused across calls, so
+    //merging many small groups does not reallocate it for every group
+    static thread_local hashset<plink> smalllinks(128),
+                                       largelinks(1024);
+    static thread_local std::vector<plink *> queue,
+                                             nextqueue;
+    hashset<plink> &links = polys.size() <= 32 ? smalllinks : largelinks;
     for(uint i = 0; i < polys.size(); i++)
     {
         poly &p = polys[i];
@@ -662,7 +668,6 @@ void cube::mergepolys(int orient, const ivec &n, int offset, std::vector<poly> &
             prev = j;
         }
     }
-    std::vector<plink *> nextqueue;
     while(queue.size())
     {
         for(uint i = 0; i < queue.size(); i++)
@@ -677,11 +682,38 @@ void cube::mergepolys(int orient, const ivec &n, int offset, std::vector<poly> &
         queue.insert(queue.end(), nextqueue.begin(), nextqueue.end());
         nextqueue.clear();
     }
+    links.clear();
     addmerges(orient, n, offset, polys);
 }
 
 static int genmergeprogress = 0;
 
+VAR(threadedmerges, 0, 1, 1); //merge subtrees on the worker pool
+
+//copy of a thread's neighbor stack, so a subtree can be merged on another thread
+struct mergestack
+{
+    int depth;
+    const cube *stack[32];
+
+    void save()
+    {
+        depth = neighbordepth;
+        std::memcpy(stack, neighborstack, sizeof(stack));
+    }
+
+    void restore() const
+    {
+        neighbordepth = depth;
+        std::memcpy(neighborstack, stack, sizeof(stack));
+    }
+};
+
+//set on the thread running calcmerges while it gathers subtrees for the worker pool
+static thread_local std::vector<std::function<void()>> *mergetasks = nullptr;
+//set while a thread merges a gathered subtree, so its polys go into its own table
+static thread_local bool mergeworker = false;
+
 bool htcmp(const cube::cfkey &x, const cube::cfkey &y)
 {
     return x.orient == y.orient && x.tex == y.tex && x.n == y.n && x.offset == y.offset && x.material==y.material;
@@ -695,6 +727,8 @@ uint hthash(const cube::cfkey &k)
 //recursively goes through children of cube passed and attempts to merge faces together
 void cube::genmerges(cube * root, const ivec &o, int size)
 {
+    static thread_local hashtable<cfkey, cfpolys> workerpolys;
+    hashtable<cfkey, cfpolys> &polys = mergeworker ? workerpolys : cpolys;
     neighborstack[++neighbordepth] = this;
     for(int i = 0; i < 8; ++i)
     {
@@ -702,6 +736,30 @@ void cube::genmerges(cube * root, const ivec &o, int size)
         int vis;
         if(this[i].children)
         {
+            //polys below a cube at the flush size only ever merge with each other and
+            //only touch cubes inside it, so the whole subtree can go to another thread
+            if(mergetasks && size <= 1<<maxmerge && (size == 1<<maxmerge || this == root))
+            {
+                mergestack stack;
+                stack.save();
+                cube *c = &this[i];
+                mergetasks->push_back([this, c, root, co, size, stack]()
+                {
+                    mergestack old;
+                    old.save();
+                    stack.restore();
+                    mergeworker = true;
+                    c->children->genmerges(root, co, size>>1);
+                    ENUMERATE_KT(workerpolys, cfkey, key, cfpolys, val,
+                    {
+                        mergepolys(key.orient, key.n, key.offset, val.polys);
+                    });
+                    workerpolys.clear();
+                    mergeworker = false;
+                    old.restore();
+                });
+                continue;
+            }
             this[i].children->genmerges(root, co, size>>1);
         }
         else if(!(this[i].isempty()))
@@ -719,7 +777,7 @@ void cube::genmerges(cube * root, const ivec &o, int size)
                             k.orient = j;
                             k.tex = this[i].texture[j];
                             k.material = this[i].material&Mat_Alpha;
-                            cpolys[k].polys.push_back(p);
+                            polys[k].polys.push_back(p);
                             continue;
                         }
                     }
@@ -735,20 +793,140 @@ void cube::genmerges(cube * root, const ivec &o, int size)
                 }
             }
         }
-        if((size == 1<<maxmerge || this == root) && cpolys.numelems)
+        if((size == 1<<maxmerge || this == root) && polys.numelems)
         {
-            ENUMERATE_KT(cpolys, cfkey, key, cfpolys, val,
+            ENUMERATE_KT(polys, cfkey, key, cfpolys, val,
             {
                 mergepolys(key.orient, key.n, key.offset, val.polys);
             });
-            cpolys.clear();
+            polys.clear();
         }
     }
     --neighbordepth;
 }
 
+/* calcmerges: merges coplanar faces across the whole world
+ *
+ * with threadedmerges set, the tree is walked once on the calling thread to
+ * gather the subtrees at the flush size, which are then merged on the worker
+ * pool; each subtree only writes to its own cubes and other subtrees only read
+ * their geometry, so the result is the same as the serial pass
+ */
 void cube::calcmerges(cube * root)
 {
     genmergeprogress = 0;
+    if(!threadedmerges)
+    {
+        genmerges(root);
+        return;
+    }
+    std::vector<std::function<void()>> tasks;
+    mergetasks = &tasks;
     genmerges(root);
+    mergetasks = nullptr;
+    taskgroup group;
+    for(const std::function<void()> &task : tasks)
+    {
+        group.run(task);
+    }
+    group.wait();
+}
+
+//appends the merge state of every leaf cube below c, for comparing merge passes
+static void savemerges(const cube *c, std::vector<int> &out)
+{
+    for(int i = 0; i < 8; ++i)
+    {
+        if(c[i].children)
+        {
+            savemerges(c[i].children, out);
+            continue;
+        }
+        out.push_back(c[i].merged);
+        if(!c[i].ext)
+        {
+            continue;
+        }
+        for(int j = 0; j < 6; ++j)
+        {
+            if(!(c[i].merged&(1<<j)))
+            {
+                continue;
+            }
+            const surfaceinfo &surf = c[i].ext->surfaces[j];
+            int numverts = surf.numverts&Face_MaxVerts;
+            out.push_back(numverts);
+            const vertinfo *verts = c[i].ext->verts() + surf.verts;
+            for(int k = 0; k < numverts; ++k)
+            {
+                ivec v = verts[k].getxyz();
+                out.push_back(v.x);
+                out.push_back(v.y);
+                out.push_back(v.z);
+            }
+        }
+    }
+}
+
+//clears every merged face below c, as if no merge pass had run
+static void resetmerges(cube *c)
+{
+    for(int i = 0; i < 8; ++i)
+    {
+        if(c[i].children)
+        {
+            resetmerges(c[i].children);
+            continue;
+        }
+        if(c[i].ext)
+        {
+            for(int j = 0; j < 6; ++j)
+            {
+                if(c[i].merged&(1<<j))
+                {
+                    c[i].ext->surfaces[j] = topsurface;
+                }
+            }
+        }
+        c[i].merged = 0;
+    }
+}
+
+/* calcmergesbench: merges the map's faces serially, then threaded with 1, 2, 4
+ * and 8 threads
+ *
+ * every pass starts from unmerged faces; reports the time taken by each pass
+ * and whether its merges match the serial one
+ */
+void calcmergesbench()
+{
+    int oldthreads = workerthreads,
+        oldthreaded = threadedmerges;
+    std::vector<int> reference,
+                     merges;
+    double basetime = 0;
+    for(int threads = 0; threads <= 8; threads = threads ? threads*2 : 1)
+    {
+        threadedmerges = threads ? 1 : 0;
+        if(threads)
+        {
+            setworkerthreads(threads);
+        }
+        resetmerges(worldroot);
+        double start = getpreciseclockmillis();
+        worldroot->calcmerges(worldroot);
+        double elapsed = getpreciseclockmillis() - start;
+        std::vector<int> &out = threads ? merges : reference;
+        out.clear();
+        savemerges(worldroot, out);
+        if(!threads)
+        {
+            basetime = elapsed;
+            conoutf("calcmergesbench: serial: %.2f ms", elapsed);
+            continue;
+        }
+        conoutf("calcmergesbench: %d threads: %.2f ms (%.2fx), %s", threads, elapsed, elapsed > 0 ? basetime/elapsed : 0, out == reference ? "identical" : "mismatch");
+    }
+    threadedmerges = oldthreaded;
+    setworkerthreads(oldthreads);
 }
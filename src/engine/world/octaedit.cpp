@@ -17,6 +17,7 @@
 #include "../../shared/stream.h"
 
 #include "light.h"
+#include "octacompact.h"
 #include "octaedit.h"
 #include "octaworld.h"
 #include "physics.h"
@@ -389,10 +390,10 @@ static void readychanges(const ivec &bbmin, const ivec &bbmax, cube *c, const iv
         ivec o(i, cor, size);
         if(c[i].ext)
         {
-            if(c[i].ext->va)             // removes va s so that octarender will recreate
+            if(c[i].ext->va)             // retires va s so that octarender will recreate them, they are drawn until then
             {
                 int hasmerges = c[i].ext->va->hasmerges;
-                destroyva(c[i].ext->va);
+                retireva(c[i].ext->va);
                 c[i].ext->va = nullptr;
                 if(hasmerges)
                 {
@@ -422,27 +423,58 @@ static void readychanges(const ivec &bbmin, const ivec &bbmax, cube *c, const iv
     }
 }
 
+VARP(varebuildbudget, 0, 8, 1000); //ms per frame spent rebuilding vas after edits, 0 rebuilds all of them at once
+
+/* commitchanges: rebuilds the vas of changed parts of the world
+ *
+ * dirty cells are rebuilt oldest first until varebuildbudget ms have passed;
+ * the remaining ones are left for later calls, and their old vas are drawn in
+ * the meantime. Each pass releases as many cells as the previous pass suggests
+ * will fit in what is left of the budget, so that a large edit is not rebuilt
+ * with one octarender per cell. force rebuilds everything that is pending
+ */
 void cubeworld::commitchanges(bool force)
 {
     if(!force && !haschanged)
     {
         return;
     }
-    haschanged = false;
-    int oldlen = valist.length();
     resetclipplanes();
     entitiesinoctanodes();
+    refreshretiredvas();
     inbetweenframes = false;
-    octarender();
+    bool all = force || !varebuildbudget;
+    int numcells = 1;
+    double start = getpreciseclockmillis();
+    for(;;)
+    {
+        double passstart = getpreciseclockmillis();
+        int released = releasevarebuild(all ? pendingvarebuild() : numcells);
+        int oldlen = valist.length();
+        octarender();
+        setupmaterials(oldlen);
+        finishvarebuild();
+        double now = getpreciseclockmillis(),
+               left = varebuildbudget - (now - start);
+        if(!pendingvarebuild() || left <= 0)
+        {
+            break;
+        }
+        double percell = (now - passstart)/std::max(released, 1);
+        numcells = percell > 0 ? std::clamp(static_cast<int>(left/percell), 1, pendingvarebuild()) : pendingvarebuild();
+    }
+    endvarebuildframe();
     inbetweenframes = true;
-    setupmaterials(oldlen);
+    haschanged = pendingvarebuild() > 0;
     clearshadowcache();
     updatevabbs();
 }
 
 void cubeworld::changed(const ivec &bbmin, const ivec &bbmax, bool commit)
 {
+    clearcompactocta();
     readychanges(bbmin, bbmax, worldroot, ivec(0, 0, 0), worldsize/2);
+    queuevarebuild(bbmin, bbmax);
     haschanged = true;
 
     if(commit)
@@ -457,7 +489,11 @@ void cubeworld::changed(const block3 &sel, bool commit)
     {
         return;
     }
-    readychanges(ivec(sel.o).sub(1), ivec(sel.s).mul(sel.grid).add(sel.o).add(1), worldroot, ivec(0, 0, 0), worldsize/2);
+    ivec bbmin = ivec(sel.o).sub(1),
+         bbmax = ivec(sel.s).mul(sel.grid).add(sel.o).add(1);
+    clearcompactocta();
+    readychanges(bbmin, bbmax, worldroot, ivec(0, 0, 0), worldsize/2);
+    queuevarebuild(bbmin, bbmax);
     haschanged = true;
     if(commit)
     {
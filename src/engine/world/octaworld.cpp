@@ -14,9 +14,14 @@
 #include "../libprimis-headers/cube.h"
 #include "../../shared/geomexts.h"
 
+#include <memory>
+#include <mutex>
+
 #include "light.h"
+#include "octacompact.h"
 #include "octacube.h"
 #include "octaworld.h"
+#include "physics.h"
 #include "raycube.h"
 #include "world.h"
 
@@ -25,7 +30,7 @@
 #include "render/octarender.h"
 #include "render/renderwindow.h"
 
-int allocnodes = 0;
+std::atomic<int> allocnodes(0);
 
 const uchar faceedgesidx[6][4] = // ordered edges surrounding each orient
 {//0..1 = row edges, 2..3 = column edges
@@ -41,9 +46,227 @@ cubeworld rootworld;
 
 void calcmerges();
 
+/* cube pool
+ *
+ * cube families and cubeexts are blocks carved out of 64KiB slabs, with one
+ * list of slabs per block size, rather than separate heap allocations. Slabs
+ * are aligned to their own size, so the slab owning a block is found by masking
+ * the block's address. Slabs whose blocks have all been freed are kept for reuse
+ * until trimcubepool() hands them back, which is done once the world has been
+ * freed on map reset
+ *
+ * maps are decoded and lit on worker threads, so each block size has its own lock
+ */
+namespace
+{
+    constexpr size_t cubeslabsize = 1<<16;
+
+    struct alignas(16) cubeslab
+    {
+        cubeslab *prev, *next; //neighbors in the pool's list of slabs with free blocks
+        void *freeblocks;      //blocks freed back to this slab
+        size_t bump;           //offset of the first block never handed out
+        int used,
+            capacity;
+    };
+
+    struct cubepool
+    {
+        std::mutex lock;
+        cubeslab *avail = nullptr;
+        int numslabs = 0,
+            used = 0,
+            peak = 0;
+
+        void link(cubeslab *s)
+        {
+            s->prev = nullptr;
+            s->next = avail;
+            if(avail)
+            {
+                avail->prev = s;
+            }
+            avail = s;
+        }
+
+        void unlink(cubeslab *s)
+        {
+            if(s->prev)
+            {
+                s->prev->next = s->next;
+            }
+            else
+            {
+                avail = s->next;
+            }
+            if(s->next)
+            {
+                s->next->prev = s->prev;
+            }
+        }
+
+        void *alloc(size_t size)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            cubeslab *s = avail;
+            if(!s)
+            {
+                s = new(operator new(cubeslabsize, std::align_val_t(cubeslabsize))) cubeslab;
+                s->freeblocks = nullptr;
+                s->bump = sizeof(cubeslab);
+                s->used = 0;
+                s->capacity = (cubeslabsize - sizeof(cubeslab))/size;
+                link(s);
+                numslabs++;
+            }
+            void *block;
+            if(s->freeblocks)
+            {
+                block = s->freeblocks;
+                s->freeblocks = *static_cast<void **>(block);
+            }
+            else
+            {
+                block = reinterpret_cast<uchar *>(s) + s->bump;
+                s->bump += size;
+            }
+            if(++s->used == s->capacity)
+            {
+                unlink(s);
+            }
+            peak = std::max(peak, ++used);
+            return block;
+        }
+
+        void free(void *block)
+        {
+            cubeslab *s = reinterpret_cast<cubeslab *>(reinterpret_cast<uintptr_t>(block) & ~(cubeslabsize-1));
+            std::lock_guard<std::mutex> guard(lock);
+            *static_cast<void **>(block) = s->freeblocks;
+            s->freeblocks = block;
+            if(s->used-- == s->capacity)
+            {
+                link(s);
+            }
+            used--;
+        }
+
+        //returns every slab with no blocks in use to the heap
+        void trim()
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            for(cubeslab *s = avail, *next; s; s = next)
+            {
+                next = s->next;
+                if(!s->used)
+                {
+                    unlink(s);
+                    operator delete(s, std::align_val_t(cubeslabsize));
+                    numslabs--;
+                }
+            }
+        }
+    };
+
+    //verts reserved by each size of cubeext block, up to the most a uchar maxverts can hold
+    constexpr int extpoolverts[] = {0, 4, 8, 12, 16, 24, 32, 48, 64, 96, 128, 192, 255};
+    constexpr int numextpools = sizeof(extpoolverts)/sizeof(extpoolverts[0]);
+
+    cubepool familypool,
+             extpools[numextpools];
+    bool cubepoolenabled = true;
+
+    size_t poolblocksize(size_t size)
+    {
+        return (size + 15) & ~static_cast<size_t>(15);
+    }
+
+    size_t familyblocksize()
+    {
+        return poolblocksize(8*sizeof(cube));
+    }
+
+    int extpool(int maxverts)
+    {
+        int i = 0;
+        while(extpoolverts[i] < maxverts)
+        {
+            i++;
+        }
+        return i;
+    }
+
+    size_t extblocksize(int pool)
+    {
+        return poolblocksize(sizeof(cubeext) + extpoolverts[pool]*sizeof(vertinfo));
+    }
+}
+
+/* setcubepool: switches between pooled and plain heap allocation of cubes
+ *
+ * blocks must be freed the way they were allocated, so this may only be
+ * switched while no cubes or cubeexts allocated since the last switch are alive
+ */
+void setcubepool(bool on)
+{
+    cubepoolenabled = on;
+}
+
+//returns empty slabs to the heap; called after the world has been freed
+void trimcubepool()
+{
+    familypool.trim();
+    for(cubepool &pool : extpools)
+    {
+        pool.trim();
+    }
+}
+
+//frees a cubeext allocated by growcubeext or newcubeext
+void deletecubeext(cubeext *ext)
+{
+    if(!cubepoolenabled)
+    {
+        operator delete(ext);
+        return;
+    }
+    extpools[extpool(ext->maxverts)].free(ext);
+}
+
+//prints the blocks in use and memory held by the cube pool
+void cubepoolstats()
+{
+    conoutf("cubepoolstats: families: %d in use (%d peak), %d slabs, %.2f MB in use of %.2f MB",
+            familypool.used, familypool.peak, familypool.numslabs,
+            familypool.used*familyblocksize()/(1024.0f*1024.0f), familypool.numslabs*cubeslabsize/(1024.0f*1024.0f));
+    int used = 0,
+        peak = 0,
+        numslabs = 0;
+    size_t usedbytes = 0;
+    for(int i = 0; i < numextpools; ++i)
+    {
+        used += extpools[i].used;
+        peak += extpools[i].peak;
+        numslabs += extpools[i].numslabs;
+        usedbytes += extpools[i].used*extblocksize(i);
+    }
+    conoutf("cubepoolstats: cubeexts: %d in use (%d peak), %d slabs, %.2f MB in use of %.2f MB",
+            used, peak, numslabs, usedbytes/(1024.0f*1024.0f), numslabs*cubeslabsize/(1024.0f*1024.0f));
+}
+
 cubeext *growcubeext(cubeext *old, int maxverts)
 {
-    cubeext *ext = reinterpret_cast<cubeext *>(new uchar[sizeof(cubeext) + maxverts*sizeof(vertinfo)]);
+    maxverts = std::min(maxverts, 255); //stored in a uchar
+    cubeext *ext;
+    if(cubepoolenabled)
+    {
+        int pool = extpool(maxverts);
+        ext = static_cast<cubeext *>(extpools[pool].alloc(extblocksize(pool)));
+    }
+    else
+    {
+        ext = static_cast<cubeext *>(operator new(sizeof(cubeext) + maxverts*sizeof(vertinfo)));
+    }
     if(old)
     {
         ext->va = old->va;
@@ -70,7 +293,7 @@ void setcubeext(cube &c, cubeext *ext)
     c.ext = ext;
     if(old)
     {
-        delete[] reinterpret_cast<uchar *>(old);
+        deletecubeext(old);
     }
 }
 
@@ -99,7 +322,8 @@ cubeext *newcubeext(cube &c, int maxverts, bool init)
 
 cube *newcubes(uint face, int mat)
 {
-    cube *c = new cube[8];
+    cube *c = static_cast<cube *>(cubepoolenabled ? familypool.alloc(familyblocksize()) : operator new(8*sizeof(cube)));
+    std::uninitialized_default_construct_n(c, 8);
     for(int i = 0; i < 8; ++i)
     {
         c->children = nullptr;
@@ -141,7 +365,21 @@ void freeocta(cube *c)
     {
         c[i].discardchildren();
     }
-    delete[] c;
+    freecubes(c);
+}
+
+//frees a family allocated by newcubes, without touching its children
+void freecubes(cube *c)
+{
+    std::destroy_n(c, 8);
+    if(cubepoolenabled)
+    {
+        familypool.free(c);
+    }
+    else
+    {
+        operator delete(c);
+    }
     allocnodes--;
 }
 
@@ -278,6 +516,17 @@ int cubeworld::lookupmaterial(const vec &v)
         return Mat_Air;
     }
     int scale = worldscale-1;
+    const compactoctree *compact = getcompactocta();
+    if(compact)
+    {
+        int n = OCTA_STEP(o.x, o.y, o.z, scale);
+        while(compact->nodes[n].children >= 0)
+        {
+            scale--;
+            n = compact->nodes[n].children + OCTA_STEP(o.x, o.y, o.z, scale);
+        }
+        return compact->nodes[n].material;
+    }
     cube *c = &worldroot[OCTA_STEP(o.x, o.y, o.z, scale)];
     while(c->children)
     {
@@ -287,8 +536,9 @@ int cubeworld::lookupmaterial(const vec &v)
     return c->material;
 }
 
-const cube *neighborstack[32];
-int neighbordepth = -1;
+//per thread, so that faces can be merged on worker threads
+thread_local const cube *neighborstack[32];
+thread_local int neighbordepth = -1;
 
 const cube &cubeworld::neighborcube(int orient, const ivec &co, int size, ivec &ro, int &rsize)
 {
@@ -748,6 +998,7 @@ static bool remip(cube &c, const ivec &co, int size)
 
 void cubeworld::remip()
 {
+    clearcompactocta();
     remipprogress = 1;
     remiptotal = allocnodes;
     for(int i = 0; i < 8; ++i)
@@ -1833,4 +2084,13 @@ void invalidatemerges(cube &c)
 void initoctaworldcmds()
 {
     addcommand("printcube", reinterpret_cast<identfun>(printcube), "", Id_Command);
+    addcommand("raycubebench", reinterpret_cast<identfun>(raycubebench), "i", Id_Command);
+    addcommand("calclightbench", reinterpret_cast<identfun>(calclightbench), "", Id_Command);
+    addcommand("dynentbench", reinterpret_cast<identfun>(dynentbench), "", Id_Command);
+    addcommand("movedynentsbench", reinterpret_cast<identfun>(movedynentsbench), "i", Id_Command);
+    addcommand("clipplanebench", reinterpret_cast<identfun>(clipplanebench), "", Id_Command);
+    addcommand("mapmodelbench", reinterpret_cast<identfun>(mapmodelbench), "i", Id_Command);
+    addcommand("calcmergesbench", reinterpret_cast<identfun>(calcmergesbench), "", Id_Command);
+    addcommand("cubepoolstats", reinterpret_cast<identfun>(cubepoolstats), "", Id_Command);
+    addcommand("compactoctabench", reinterpret_cast<identfun>(compactoctabench), "i", Id_Command);
 }
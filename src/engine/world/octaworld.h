@@ -1,6 +1,8 @@
 #ifndef OCTAWORLD_H_
 #define OCTAWORLD_H_
 
+#include <atomic>
+
 #define OPPOSITE(orient)   ((orient)^1)
 
 enum BlendMapLayers
@@ -88,6 +90,20 @@ struct clipplanes
     int version;
 };
 
+/* clipplanecache: caches the clip planes of recently visited cubes
+ *
+ * entries are keyed on the cube they belong to and stay valid until the world's
+ * clip planes are reset. The world keeps one cache shared by the main thread;
+ * code which queries the world from other threads must give each its own.
+ */
+struct clipplanecache
+{
+    static constexpr int maxclipplanes = 1024;
+    clipplanes planes[maxclipplanes];
+
+    clipplanes &getclipbounds(const cube &c, const ivec &o, int size, int offset);
+};
+
 struct surfaceinfo
 {
     uchar verts, numverts;
@@ -185,7 +201,8 @@ extern int wtris, wverts,
            glde, gbatches,
            rplanes;
 
-extern int allocnodes, allocva;
+extern std::atomic<int> allocnodes; //atomic as maps are decoded on worker threads
+extern int allocva;
 
 enum
 {
@@ -199,14 +216,18 @@ extern cube *newcubes(uint face = faceempty, int mat = Mat_Air);
 extern cubeext *growcubeext(cubeext *ext, int maxverts);
 extern void setcubeext(cube &c, cubeext *ext);
 extern cubeext *newcubeext(cube &c, int maxverts = 0, bool init = true);
+extern void deletecubeext(cubeext *ext);
 extern void getcubevector(cube &c, int d, int x, int y, int z, ivec &p);
 extern void setcubevector(cube &c, int d, int x, int y, int z, const ivec &p);
 extern int familysize(const cube &c);
 extern void freeocta(cube *c);
+extern void freecubes(cube *c);
+extern void setcubepool(bool on);
+extern void trimcubepool();
 extern void validatec(cube *c, int size = 0);
 
-extern const cube *neighborstack[32];
-extern int neighbordepth;
+extern thread_local const cube *neighborstack[32];
+extern thread_local int neighbordepth;
 extern int getmippedtexture(const cube &p, int orient);
 extern void forcemip(cube &c, bool fixtex = true);
 extern bool subdividecube(cube &c, bool fullcheck=true, bool brighten=true);
@@ -226,6 +247,7 @@ extern int visibleorient(const cube &c, int orient);
 extern void genfaceverts(const cube &c, int orient, ivec v[4]);
 extern int calcmergedsize(int orient, const ivec &co, int size, const vertinfo *verts, int numverts);
 extern void invalidatemerges(cube &c);
+extern void calcmergesbench();
 extern void remip();
 
 inline cubeext &ext(cube &c)
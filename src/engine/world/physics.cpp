@@ -5,32 +5,42 @@
  */
 #include "../libprimis-headers/cube.h"
 #include "../../shared/geomexts.h"
+#include "../../shared/threads.h"
+
+#include <memory>
+#include <unordered_map>
 
 #include "bih.h"
 #include "entities.h"
 #include "mpr.h"
+#include "octacompact.h"
 #include "octaworld.h"
 #include "physics.h"
 #include "raycube.h"
 #include "world.h"
 
 #include "interface/console.h"
+#include "interface/control.h"
 
 #include "model/model.h"
 
 #include "render/rendermodel.h"
 
+//clip plane support points are batched with SSE where available, and plain arrays of floats otherwise
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+    #define PHYSICS_SSE
+#endif
+
 int numdynents; //updated by engine, visible through iengine.h
 vector<dynent *> dynents;
 
 static constexpr int maxclipoffset = 4;
-static constexpr int maxclipplanes = 1024;
-static clipplanes clipcache[maxclipplanes];
 static int clipcacheversion = -maxclipoffset;
 
-clipplanes &cubeworld::getclipbounds(const cube &c, const ivec &o, int size, int offset)
+clipplanes &clipplanecache::getclipbounds(const cube &c, const ivec &o, int size, int offset)
 {
-    clipplanes &p = clipcache[static_cast<int>(&c - worldroot) & (maxclipplanes-1)];
+    clipplanes &p = planes[static_cast<int>(&c - worldroot) & (maxclipplanes-1)];
     if(p.owner != &c || p.version != clipcacheversion+offset)
     {
         p.owner = &c;
@@ -40,10 +50,38 @@ clipplanes &cubeworld::getclipbounds(const cube &c, const ivec &o, int size, int
     return p;
 }
 
-static clipplanes &getclipbounds(const cube &c, const ivec &o, int size, physent &d)
+CollisionContext::CollisionContext() : inside(0), player(nullptr), wall(0, 0, 0), clipcache(new clipplanecache()), broadphase(nullptr),
+    mmboxes(new mpr::ModelBatch(false)), mmellipses(new mpr::ModelBatch(true))
+{
+}
+
+CollisionContext::~CollisionContext()
+{
+    delete clipcache;
+    delete mmboxes;
+    delete mmellipses;
+}
+
+clipplanes &CollisionContext::getclipbounds(const cube &c, const ivec &o, int size, int offset)
+{
+    return clipcache->getclipbounds(c, o, size, offset);
+}
+
+//the context used by the engine's own (main thread) collision queries
+static CollisionContext maincollision;
+
+//contexts kept between movedynents() calls so their clip plane caches stay warm, one per task
+static std::vector<std::unique_ptr<CollisionContext>> movecollisions;
+
+clipplanes &cubeworld::getclipbounds(const cube &c, const ivec &o, int size, int offset)
+{
+    return maincollision.getclipbounds(c, o, size, offset);
+}
+
+static clipplanes &getclipbounds(CollisionContext &ctx, const cube &c, const ivec &o, int size, physent &d)
 {
     int offset = !(c.visible&0x80) || d.type==physent::PhysEnt_Player ? 0 : 1;
-    return rootworld.getclipbounds(c, o, size, offset);
+    return ctx.getclipbounds(c, o, size, offset);
 }
 
 static int forceclipplanes(const cube &c, const ivec &o, int size, clipplanes &p)
@@ -67,19 +105,18 @@ void cubeworld::resetclipplanes()
     clipcacheversion += maxclipoffset;
     if(!clipcacheversion)
     {
-        memset(clipcache, 0, sizeof(clipcache));
+        memset(maincollision.clipcache->planes, 0, sizeof(maincollision.clipcache->planes));
+        for(std::unique_ptr<CollisionContext> &ctx : movecollisions)
+        {
+            memset(ctx->clipcache->planes, 0, sizeof(ctx->clipcache->planes));
+        }
         clipcacheversion = maxclipoffset;
     }
 }
 
 /////////////////////////  entity collision  ///////////////////////////////////////////////
 
-// info about collisions
-int collideinside; // whether an internal collision happened
-physent *collideplayer; // whether the collection hit a player
-vec collidewall; // just the normal vectors.
-
-bool ellipseboxcollide(physent *d, const vec &dir, const vec &origin, const vec &center, float yaw, float xr, float yr, float hi, float lo)
+bool ellipseboxcollide(CollisionContext &ctx, physent *d, const vec &dir, const vec &origin, const vec &center, float yaw, float xr, float yr, float hi, float lo)
 {
     float below = (origin.z+center.z-lo) - (d->o.z+d->aboveeye),
           above = (d->o.z-d->eyeheight) - (origin.z+center.z+hi);
@@ -107,15 +144,15 @@ bool ellipseboxcollide(physent *d, const vec &dir, const vec &origin, const vec
             {
                 if(dir.iszero() || sx*ydir.x < -1e-6f)
                 {
-                    collidewall = vec(sx, 0, 0);
-                    collidewall.rotate_around_z(yaw/RAD);
+                    ctx.wall = vec(sx, 0, 0);
+                    ctx.wall.rotate_around_z(yaw/RAD);
                     return true;
                 }
             }
             else if(dir.iszero() || sy*ydir.y < -1e-6f)
             {
-                collidewall = vec(0, sy, 0);
-                collidewall.rotate_around_z(yaw/RAD);
+                ctx.wall = vec(0, sy, 0);
+                ctx.wall.rotate_around_z(yaw/RAD);
                 return true;
             }
         }
@@ -123,21 +160,21 @@ bool ellipseboxcollide(physent *d, const vec &dir, const vec &origin, const vec
         {
             if(dir.iszero() || (dir.z > 0 && (d->type!=physent::PhysEnt_Player || below >= d->zmargin-(d->eyeheight+d->aboveeye)/4.0f)))
             {
-                collidewall = vec(0, 0, -1);
+                ctx.wall = vec(0, 0, -1);
                 return true;
             }
         }
         else if(dir.iszero() || (dir.z < 0 && (d->type!=physent::PhysEnt_Player || above >= d->zmargin-(d->eyeheight+d->aboveeye)/3.0f)))
         {
-            collidewall = vec(0, 0, 1);
+            ctx.wall = vec(0, 0, 1);
             return true;
         }
-        collideinside++;
+        ctx.inside++;
     }
     return false;
 }
 
-bool ellipsecollide(physent *d, const vec &dir, const vec &o, const vec &center, float yaw, float xr, float yr, float hi, float lo)
+bool ellipsecollide(CollisionContext &ctx, physent *d, const vec &dir, const vec &o, const vec &center, float yaw, float xr, float yr, float hi, float lo)
 {
     float below = (o.z+center.z-lo) - (d->o.z+d->aboveeye),
           above = (d->o.z-d->eyeheight) - (o.z+center.z+hi);
@@ -162,55 +199,27 @@ bool ellipsecollide(physent *d, const vec &dir, const vec &o, const vec &center,
     {
         if(dist > (d->o.z < yo.z ? below : above) && (dir.iszero() || x*dir.x + y*dir.y > 0))
         {
-            collidewall = vec(-x, -y, 0).rescale(1);
+            ctx.wall = vec(-x, -y, 0).rescale(1);
             return true;
         }
         if(d->o.z < yo.z)
         {
             if(dir.iszero() || (dir.z > 0 && (d->type!=physent::PhysEnt_Player || below >= d->zmargin-(d->eyeheight+d->aboveeye)/4.0f)))
             {
-                collidewall = vec(0, 0, -1);
+                ctx.wall = vec(0, 0, -1);
                 return true;
             }
         }
         else if(dir.iszero() || (dir.z < 0 && (d->type!=physent::PhysEnt_Player || above >= d->zmargin-(d->eyeheight+d->aboveeye)/3.0f)))
         {
-            collidewall = vec(0, 0, 1);
+            ctx.wall = vec(0, 0, 1);
             return true;
         }
-        collideinside++;
+        ctx.inside++;
     }
     return false;
 }
 
-static constexpr int dynentcachesize = 1024;
-
-static uint dynentframe = 0;
-
-static struct dynentcacheentry
-{
-    int x, y;
-    uint frame;
-    vector<physent *> dynents;
-} dynentcache[dynentcachesize];
-
-//resets the dynentcache[] array entries
-void cleardynentcache()
-{
-    dynentframe++;
-    if(!dynentframe || dynentframe == 1)
-    {
-        for(int i = 0; i < dynentcachesize; ++i)
-        {
-            dynentcache[i].frame = 0;
-        }
-    }
-    if(!dynentframe)
-    {
-        dynentframe = 1;
-    }
-}
-
 //returns the dynent at location i in the dynents vector
 dynent *iterdynents(int i)
 {
@@ -221,61 +230,361 @@ dynent *iterdynents(int i)
     return nullptr;
 }
 
+/* dynentgrid: uniform grid broadphase for dynents
+ *
+ * the world's xy plane is split into square cells, and each entity is filed in
+ * every cell its bounding square overlaps. Entities are kept in slots, with
+ * their positions and cell ranges held in flat arrays; moving an entity only
+ * touches the cells it leaves or enters, and an entity staying within its
+ * cells costs nothing but the comparison of its cell range. Queries reject
+ * most candidates from the flat arrays alone, before reading the entity
+ *
+ * the grid is only modified from the main thread, so collision queries on other
+ * threads may read it freely between updates
+ */
+class dynentgrid
+{
+    public:
+        //sets the cell size and world size, refiling every entity if they changed
+        void setsize(int shift, int size)
+        {
+            int newdim = std::max(size>>shift, 1);
+            if(shift == cellshift && newdim == dim && size == gridsize)
+            {
+                return;
+            }
+            cellshift = shift;
+            dim = newdim;
+            gridsize = size;
+            cells.assign(dim*dim, std::vector<int>());
+            for(uint i = 0; i < ents.size(); ++i)
+            {
+                calcrange(xs[i], ys[i], radii[i], x1s[i], y1s[i], x2s[i], y2s[i]);
+                addtocells(i);
+            }
+        }
+
+        /* update: files an entity under its current position, adding it to the grid if needed
+         *
+         * a margin widens the area the entity is filed under, so that it can be
+         * moved that far without being refiled
+         */
+        int update(physent *d, float margin = 0)
+        {
+            ushort x1, y1, x2, y2;
+            calcrange(d->o.x, d->o.y, d->radius + margin, x1, y1, x2, y2);
+            auto itr = slots.find(d);
+            if(itr == slots.end())
+            {
+                int slot = ents.size();
+                slots[d] = slot;
+                ents.push_back(d);
+                xs.push_back(d->o.x);
+                ys.push_back(d->o.y);
+                radii.push_back(d->radius + margin);
+                x1s.push_back(x1);
+                y1s.push_back(y1);
+                x2s.push_back(x2);
+                y2s.push_back(y2);
+                marks.push_back(syncmark);
+                addtocells(slot);
+                return slot;
+            }
+            int slot = itr->second;
+            xs[slot] = d->o.x;
+            ys[slot] = d->o.y;
+            radii[slot] = d->radius + margin;
+            if(x1 != x1s[slot] || y1 != y1s[slot] || x2 != x2s[slot] || y2 != y2s[slot])
+            {
+                removefromcells(slot);
+                x1s[slot] = x1;
+                y1s[slot] = y1;
+                x2s[slot] = x2;
+                y2s[slot] = y2;
+                addtocells(slot);
+            }
+            return slot;
+        }
+
+        //brings the grid in line with the given entities, dropping any no longer listed
+        void sync(const std::vector<physent *> &list)
+        {
+            syncmark++;
+            for(physent *d : list)
+            {
+                marks[update(d)] = syncmark;
+            }
+            for(int i = ents.size(); --i >= 0;)
+            {
+                if(marks[i] != syncmark)
+                {
+                    remove(i);
+                }
+            }
+        }
+
+        void clear()
+        {
+            for(std::vector<int> &c : cells)
+            {
+                c.clear();
+            }
+            slots.clear();
+            ents.clear();
+            xs.clear();
+            ys.clear();
+            radii.clear();
+            x1s.clear();
+            y1s.clear();
+            x2s.clear();
+            y2s.clear();
+            marks.clear();
+        }
+
+        //cell range covered by a bounding square, clamped to the world
+        void calcrange(float x, float y, float radius, ushort &x1, ushort &y1, ushort &x2, ushort &y2) const
+        {
+            x1 = std::clamp(static_cast<int>(x-radius), 0, gridsize-1)>>cellshift;
+            y1 = std::clamp(static_cast<int>(y-radius), 0, gridsize-1)>>cellshift;
+            x2 = std::clamp(static_cast<int>(x+radius), 0, gridsize-1)>>cellshift;
+            y2 = std::clamp(static_cast<int>(y+radius), 0, gridsize-1)>>cellshift;
+        }
+
+        /* reject: whether a slot's entity is out of reach of a square at x, y
+         *
+         * tests the area the entity was filed under, so it is only a quick
+         * conservative check; entities it passes still need an exact test
+         */
+        bool reject(int slot, float x, float y, float radius) const
+        {
+            float r = radius + radii[slot];
+            return std::fabs(xs[slot] - x) > r || std::fabs(ys[slot] - y) > r;
+        }
+
+        const std::vector<int> &cell(int x, int y) const
+        {
+            return cells[y*dim + x];
+        }
+
+        physent *ent(int slot) const
+        {
+            return ents[slot];
+        }
+
+        int numents() const
+        {
+            return ents.size();
+        }
+
+        int shift() const
+        {
+            return cellshift;
+        }
+
+    private:
+        int cellshift = 0,
+            dim = 0,
+            gridsize = 0;
+        uint syncmark = 0;
+        std::vector<std::vector<int>> cells;
+        std::unordered_map<const physent *, int> slots;
+        //per slot data
+        std::vector<physent *> ents;
+        std::vector<float> xs, ys, radii; //radii include the margin the entity was filed with
+        std::vector<ushort> x1s, y1s, x2s, y2s;
+        std::vector<uint> marks;
+
+        void addtocells(int slot)
+        {
+            for(int y = y1s[slot]; y <= y2s[slot]; ++y)
+            {
+                for(int x = x1s[slot]; x <= x2s[slot]; ++x)
+                {
+                    cells[y*dim + x].push_back(slot);
+                }
+            }
+        }
+
+        void removefromcells(int slot)
+        {
+            for(int y = y1s[slot]; y <= y2s[slot]; ++y)
+            {
+                for(int x = x1s[slot]; x <= x2s[slot]; ++x)
+                {
+                    std::vector<int> &c = cells[y*dim + x];
+                    c.erase(std::find(c.begin(), c.end(), slot));
+                }
+            }
+        }
+
+        //removes a slot, moving the last slot into its place
+        void remove(int slot)
+        {
+            removefromcells(slot);
+            slots.erase(ents[slot]);
+            int last = ents.size() - 1;
+            if(slot != last)
+            {
+                for(int y = y1s[last]; y <= y2s[last]; ++y)
+                {
+                    for(int x = x1s[last]; x <= x2s[last]; ++x)
+                    {
+                        std::vector<int> &c = cells[y*dim + x];
+                        *std::find(c.begin(), c.end(), last) = slot;
+                    }
+                }
+                ents[slot] = ents[last];
+                xs[slot] = xs[last];
+                ys[slot] = ys[last];
+                radii[slot] = radii[last];
+                x1s[slot] = x1s[last];
+                y1s[slot] = y1s[last];
+                x2s[slot] = x2s[last];
+                y2s[slot] = y2s[last];
+                marks[slot] = marks[last];
+                slots[ents[slot]] = slot;
+            }
+            ents.pop_back();
+            xs.pop_back();
+            ys.pop_back();
+            radii.pop_back();
+            x1s.pop_back();
+            y1s.pop_back();
+            x2s.pop_back();
+            y2s.pop_back();
+            marks.pop_back();
+        }
+};
+
+static dynentgrid dynentbroadphase;
+
 VARF(dynentsize, 4, 7, 12, cleardynentcache());
 
-static int dynenthash(int x, int y)
+//cells are at least 2^dynentsize units across, and the grid is at most 256 cells wide
+static int dynentcellshift(int size)
 {
-    return (((((x)^(y))<<5) + (((x)^(y))>>5)) & (dynentcachesize - 1));
+    int shift = dynentsize;
+    while((size>>shift) > 256)
+    {
+        shift++;
+    }
+    return shift;
 }
 
-const vector<physent *> &checkdynentcache(int x, int y)
+/* cleardynentcache: refiles the dynents in the broadphase grid
+ *
+ * called once per frame; only entities whose cell range changed since they
+ * were last filed are moved, and entities no longer in the dynents list are
+ * dropped from the grid
+ */
+void cleardynentcache()
 {
-    dynentcacheentry &dec = dynentcache[dynenthash(x, y)];
-    if(dec.x == x && dec.y == y && dec.frame == dynentframe)
-    {
-        return dec.dynents;
-    }
-    dec.x = x;
-    dec.y = y;
-    dec.frame = dynentframe;
-    dec.dynents.shrink(0);
-    int numdyns = numdynents,
-        dsize = 1<<dynentsize,
-        dx = x<<dynentsize,
-        dy = y<<dynentsize;
-    for(int i = 0; i < numdyns; ++i)
+    static std::vector<physent *> list;
+    list.clear();
+    for(int i = 0; i < numdynents; ++i)
     {
-        dynent *d = iterdynents(i);
-        if(d->o.x+d->radius <= dx || d->o.x-d->radius >= dx+dsize ||
-           d->o.y+d->radius <= dy || d->o.y-d->radius >= dy+dsize)
-        {
-            continue;
-        }
-        dec.dynents.add(d);
+        list.push_back(iterdynents(i));
     }
-    return dec.dynents;
+    dynentbroadphase.setsize(dynentcellshift(worldsize), worldsize);
+    dynentbroadphase.sync(list);
 }
 
-//============================================================== LOOPDYNENTCACHE
-#define LOOPDYNENTCACHE(curx, cury, o, radius) \
-    for(int curx = std::max(static_cast<int>(o.x-radius), 0)>>dynentsize, endx = std::min(static_cast<int>(o.x+radius), worldsize-1)>>dynentsize; curx <= endx; curx++) \
-        for(int cury = std::max(static_cast<int>(o.y-radius), 0)>>dynentsize, endy = std::min(static_cast<int>(o.y+radius), worldsize-1)>>dynentsize; cury <= endy; cury++)
 
+//refiles one entity in the broadphase grid after it moved
 void updatedynentcache(physent *d)
 {
-    LOOPDYNENTCACHE(x, y, d->o, d->radius)
+    dynentbroadphase.setsize(dynentcellshift(worldsize), worldsize);
+    dynentbroadphase.update(d);
+}
+
+/* dynentbench: times the dynent broadphase with 64, 256 and 1024 entities
+ *
+ * each frame every entity takes a small random step and is refiled in a grid,
+ * then the grid is used to find the entities near each one; the same search
+ * done by checking every entity against every other is timed for comparison
+ */
+void dynentbench()
+{
+    constexpr int frames = 100;
+    int size = worldsize ? worldsize : 1024;
+    for(int num = 64; num <= 1024; num *= 4)
     {
-        dynentcacheentry &dec = dynentcache[dynenthash(x, y)];
-        if(dec.x != x || dec.y != y || dec.frame != dynentframe || dec.dynents.find(d) >= 0)
+        std::vector<physent> ents(num);
+        for(physent &e : ents)
         {
-            continue;
+            e.o = vec(randomint(size), randomint(size), size/2);
+            e.radius = 4.1f;
+        }
+        dynentgrid grid;
+        grid.setsize(dynentcellshift(size), size);
+        for(physent &e : ents)
+        {
+            grid.update(&e);
         }
-        dec.dynents.add(d);
+        double updatetime = 0,
+               querytime = 0,
+               scantime = 0;
+        int gridpairs = 0,
+            scanpairs = 0;
+        for(int i = 0; i < frames; ++i)
+        {
+            for(physent &e : ents)
+            {
+                e.o.x = std::clamp(e.o.x + randomint(9) - 4, 0.0f, size - 1.0f);
+                e.o.y = std::clamp(e.o.y + randomint(9) - 4, 0.0f, size - 1.0f);
+            }
+            double start = getpreciseclockmillis();
+            for(physent &e : ents)
+            {
+                grid.update(&e);
+            }
+            double updated = getpreciseclockmillis();
+            for(physent &e : ents)
+            {
+                ushort x1, y1, x2, y2;
+                grid.calcrange(e.o.x, e.o.y, e.radius, x1, y1, x2, y2);
+                for(int y = y1; y <= y2; ++y)
+                {
+                    for(int x = x1; x <= x2; ++x)
+                    {
+                        for(int slot : grid.cell(x, y))
+                        {
+                            if(grid.reject(slot, e.o.x, e.o.y, e.radius))
+                            {
+                                continue;
+                            }
+                            physent *o = grid.ent(slot);
+                            if(o != &e && !e.o.reject(o->o, e.radius + o->radius))
+                            {
+                                gridpairs++;
+                            }
+                        }
+                    }
+                }
+            }
+            double queried = getpreciseclockmillis();
+            for(physent &e : ents)
+            {
+                for(physent &o : ents)
+                {
+                    if(&o != &e && !e.o.reject(o.o, e.radius + o.radius))
+                    {
+                        scanpairs++;
+                    }
+                }
+            }
+            double scanned = getpreciseclockmillis();
+            updatetime += updated - start;
+            querytime += queried - updated;
+            scantime += scanned - queried;
+        }
+        conoutf("dynentbench: %d dynents: grid update %.3f ms, grid query %.3f ms, full scan %.3f ms per frame (%d grid / %d scan pairs)",
+                num, updatetime/frames, querytime/frames, scantime/frames, gridpairs/frames, scanpairs/frames);
     }
 }
 
 template<class E, class O>
-static bool plcollide(physent *d, const vec &dir, physent *o)
+static bool plcollide(CollisionContext &ctx, physent *d, const vec &dir, physent *o)
 {
     E entvol(d);
     O obvol(o);
@@ -283,17 +592,17 @@ static bool plcollide(physent *d, const vec &dir, physent *o)
     if(mpr::collide(entvol, obvol, nullptr, nullptr, &cp))
     {
         vec wn = cp.sub(obvol.center());
-        collidewall = obvol.contactface(wn, dir.iszero() ? wn.neg() : dir);
-        if(!collidewall.iszero())
+        ctx.wall = obvol.contactface(wn, dir.iszero() ? wn.neg() : dir);
+        if(!ctx.wall.iszero())
         {
             return true;
         }
-        collideinside++;
+        ctx.inside++;
     }
     return false;
 }
 
-static bool plcollide(physent *d, const vec &dir, physent *o)
+static bool plcollide(CollisionContext &ctx, physent *d, const vec &dir, physent *o)
 {
     switch(d->collidetype)
     {
@@ -301,22 +610,22 @@ static bool plcollide(physent *d, const vec &dir, physent *o)
         {
             if(o->collidetype == Collide_Ellipse)
             {
-                return ellipsecollide(d, dir, o->o, vec(0, 0, 0), o->yaw, o->xradius, o->yradius, o->aboveeye, o->eyeheight);
+                return ellipsecollide(ctx, d, dir, o->o, vec(0, 0, 0), o->yaw, o->xradius, o->yradius, o->aboveeye, o->eyeheight);
             }
             else
             {
-                return ellipseboxcollide(d, dir, o->o, vec(0, 0, 0), o->yaw, o->xradius, o->yradius, o->aboveeye, o->eyeheight);
+                return ellipseboxcollide(ctx, d, dir, o->o, vec(0, 0, 0), o->yaw, o->xradius, o->yradius, o->aboveeye, o->eyeheight);
             }
         }
         case Collide_OrientedBoundingBox:
         {
             if(o->collidetype == Collide_Ellipse)
             {
-                return plcollide<mpr::EntOBB, mpr::EntCylinder>(d, dir, o);
+                return plcollide<mpr::EntOBB, mpr::EntCylinder>(ctx, d, dir, o);
             }
             else
             {
-                return plcollide<mpr::EntOBB, mpr::EntOBB>(d, dir, o);
+                return plcollide<mpr::EntOBB, mpr::EntOBB>(ctx, d, dir, o);
             }
         }
         default:
@@ -326,68 +635,98 @@ static bool plcollide(physent *d, const vec &dir, physent *o)
     }
 }
 
-bool plcollide(physent *d, const vec &dir, bool insideplayercol)    // collide with player
+bool plcollide(CollisionContext &ctx, physent *d, const vec &dir, bool insideplayercol)    // collide with player
 {
     if(d->type==physent::PhysEnt_Camera)
     {
         return false;
     }
-    int lastinside = collideinside;
+    const dynentgrid &grid = ctx.broadphase ? *ctx.broadphase : dynentbroadphase;
+    if(!grid.numents())
+    {
+        return false;
+    }
+    int lastinside = ctx.inside;
     physent *insideplayer = nullptr;
-    LOOPDYNENTCACHE(x, y, d->o, d->radius)
+    ushort x1, y1, x2, y2;
+    grid.calcrange(d->o.x, d->o.y, d->radius, x1, y1, x2, y2);
+    for(int y = y1; y <= y2; ++y)
     {
-        const vector<physent *> &dynents = checkdynentcache(x, y);
-        for(int i = 0; i < dynents.length(); i++)
+        for(int x = x1; x <= x2; ++x)
         {
-            physent *o = dynents[i];
-            if(o==d || d->o.reject(o->o, d->radius+o->radius))
-            {
-                continue;
-            }
-            if(plcollide(d, dir, o))
+            const std::vector<int> &cell = grid.cell(x, y);
+            for(int slot : cell)
             {
-                collideplayer = o;
-                return true;
-            }
-            if(collideinside > lastinside)
-            {
-                lastinside = collideinside;
-                insideplayer = o;
+                if(grid.reject(slot, d->o.x, d->o.y, d->radius))
+                {
+                    continue;
+                }
+                physent *o = grid.ent(slot);
+                if(o==d || d->o.reject(o->o, d->radius+o->radius))
+                {
+                    continue;
+                }
+                if(plcollide(ctx, d, dir, o))
+                {
+                    ctx.player = o;
+                    return true;
+                }
+                if(ctx.inside > lastinside)
+                {
+                    lastinside = ctx.inside;
+                    insideplayer = o;
+                }
             }
         }
     }
     if(insideplayer && insideplayercol)
     {
-        collideplayer = insideplayer;
+        ctx.player = insideplayer;
         return true;
     }
     return false;
 }
 
-#undef LOOPDYNENTCACHE
-//==============================================================================
+//finds the wall hit by an entity touching mdlvol at the contact point cp
+template<class M>
+static bool mmcontact(CollisionContext &ctx, const vec &dir, const M &mdlvol, vec cp)
+{
+    vec wn = cp.sub(mdlvol.center());
+    ctx.wall = mdlvol.contactface(wn, dir.iszero() ? wn.neg() : dir);
+    if(!ctx.wall.iszero())
+    {
+        return true;
+    }
+    ctx.inside++;
+    return false;
+}
 
 template<class E, class M>
-static bool mmcollide(physent *d, const vec &dir, const extentity &e, const vec &center, const vec &radius, int yaw, int pitch, int roll)
+static bool mmcollide(CollisionContext &ctx, physent *d, const vec &dir, const extentity &e, const vec &center, const vec &radius, int yaw, int pitch, int roll)
 {
     E entvol(d);
     M mdlvol(e.o, center, radius, yaw, pitch, roll);
     vec cp;
     if(mpr::collide(entvol, mdlvol, nullptr, nullptr, &cp))
     {
-        vec wn = cp.sub(mdlvol.center());
-        collidewall = mdlvol.contactface(wn, dir.iszero() ? wn.neg() : dir);
-        if(!collidewall.iszero())
-        {
-            return true;
-        }
-        collideinside++;
+        return mmcontact(ctx, dir, mdlvol, cp);
+    }
+    return false;
+}
+
+//as above, but taking the collision result for the model from its lane of a batch already collided with
+template<class M>
+static bool mmcollide(CollisionContext &ctx, const vec &dir, const mpr::ModelBatch &batch, int lane, const extentity &e, const vec &center, const vec &radius, int yaw, int pitch, int roll)
+{
+    if(batch.hit(lane))
+    {
+        return mmcontact(ctx, dir, M(e.o, center, radius, yaw, pitch, roll), batch.contactpoint(lane));
     }
     return false;
 }
 
 template<class E>
-static bool fuzzycollidebox(physent *d, const vec &dir, float cutoff, const vec &o, const vec &center, const vec &radius, int yaw, int pitch, int roll)
+static bool fuzzycollidebox(CollisionContext &ctx, physent *d, const vec &dir, float cutoff, const vec &o, const vec &center, const vec &radius, int yaw, int pitch, int roll)
 {
     mpr::ModelOBB mdlvol(o, center, radius, yaw, pitch, roll);
     vec bbradius = mdlvol.orient.abstransposedtransform(radius);
@@ -397,7 +736,7 @@ static bool fuzzycollidebox(physent *d, const vec &dir, float cutoff, const vec
         return false;
     }
     E entvol(d);
-    collidewall = vec(0, 0, 0);
+    ctx.wall = vec(0, 0, 0);
     float bestdist = -1e10f;
     for(int i = 0; i < 6; ++i)
     {
@@ -453,7 +792,7 @@ static bool fuzzycollidebox(physent *d, const vec &dir, float cutoff, const vec
         {
             continue;
         }
-        collidewall = vec(0, 0, 0);
+        ctx.wall = vec(0, 0, 0);
         bestdist = dist;
         if(!dir.iszero())
         {
@@ -470,18 +809,18 @@ static bool fuzzycollidebox(physent *d, const vec &dir, float cutoff, const vec
                 continue;
             }
         }
-        collidewall = w;
+        ctx.wall = w;
     }
-    if(collidewall.iszero())
+    if(ctx.wall.iszero())
     {
-        collideinside++;
+        ctx.inside++;
         return false;
     }
     return true;
 }
 
 template<class E>
-static bool fuzzycollideellipse(physent *d, const vec &dir, float cutoff, const vec &o, const vec &center, const vec &radius, int yaw, int pitch, int roll)
+static bool fuzzycollideellipse(CollisionContext &ctx, physent *d, const vec &dir, float cutoff, const vec &o, const vec &center, const vec &radius, int yaw, int pitch, int roll)
 {
     mpr::ModelEllipse mdlvol(o, center, radius, yaw, pitch, roll);
     vec bbradius = mdlvol.orient.abstransposedtransform(radius);
@@ -494,7 +833,7 @@ static bool fuzzycollideellipse(physent *d, const vec &dir, float cutoff, const
         return false;
     }
     E entvol(d);
-    collidewall = vec(0, 0, 0);
+    ctx.wall = vec(0, 0, 0);
     float bestdist = -1e10f;
     for(int i = 0; i < 3; ++i)
     {
@@ -539,7 +878,7 @@ static bool fuzzycollideellipse(physent *d, const vec &dir, float cutoff, const
         {
             continue;
         }
-        collidewall = vec(0, 0, 0);
+        ctx.wall = vec(0, 0, 0);
         bestdist = dist;
         if(!dir.iszero())
         {
@@ -555,11 +894,11 @@ static bool fuzzycollideellipse(physent *d, const vec &dir, float cutoff, const
                 continue;
             }
         }
-        collidewall = w;
+        ctx.wall = w;
     }
-    if(collidewall.iszero())
+    if(ctx.wall.iszero())
     {
-        collideinside++;
+        ctx.inside++;
         return false;
     }
     return true;
@@ -571,44 +910,115 @@ static bool fuzzycollideellipse(physent *d, const vec &dir, float cutoff, const
 // 2: Collide_OrientedBoundingBox
 VAR(testtricol, 0, 0, 2);
 
-bool mmcollide(physent *d, const vec &dir, float cutoff, octaentities &oc) // collide with a mapmodel
+/* loadcollidemodel: returns the model used for collisions with the given mapmodel,
+ * loading it if needed
+ *
+ * inside worker tasks this is lookup only: models which loadcollidemodels() could
+ * not resolve on the main thread (missing or failed to load) are treated as absent
+ */
+static model *loadcollidemodel(int index)
+{
+    mapmodelinfo &mmi = mapmodels[index];
+    model *m = mmi.collide;
+    if(!m && !inworkertask())
+    {
+        if(!mmi.m && !loadmodel(nullptr, index))
+        {
+            return nullptr;
+        }
+        if(mmi.m->collidemodel)
+        {
+            m = loadmodel(mmi.m->collidemodel);
+        }
+        if(!m)
+        {
+            m = mmi.m;
+        }
+        mmi.collide = m;
+    }
+    return m;
+}
+
+//finds the collision volume of mapmodel entity e, returning false if d cannot touch it
+static bool mapmodelvolume(const physent *d, const extentity &e, model *&m, int &mcol, vec &center, vec &radius, float &scale)
+{
+    if(e.flags&EntFlag_NoCollide || !(static_cast<int>(mapmodels.size()) > e.attr1))
+    {
+        return false;
+    }
+    m = loadcollidemodel(e.attr1);
+    if(!m)
+    {
+        return false;
+    }
+    mapmodelinfo &mmi = mapmodels[e.attr1];
+    mcol = mmi.m->collide;
+    if(!mcol)
+    {
+        return false;
+    }
+    float rejectradius = m->collisionbox(center, radius);
+    scale = e.attr5 > 0 ? e.attr5/100.0f : 1;
+    center.mul(scale);
+    return !d->o.reject(vec(e.o).add(center), d->radius + rejectradius*scale);
+}
+
+//collide oriented box entities against several mapmodels at once rather than one at a time
+VAR(batchmapmodels, 0, 1, 1);
+
+/* batchmapmodelcollide: collides d against each mapmodel of oc that mmcollide() would
+ * test with mpr, filling the context's model batches in the order mmcollide()
+ * visits them
+ */
+static void batchmapmodelcollide(CollisionContext &ctx, physent *d, octaentities &oc)
 {
     const vector<extentity *> &ents = entities::getents();
+    ctx.mmboxes->clear();
+    ctx.mmellipses->clear();
     for(int i = 0; i < oc.mapmodels.length(); i++)
     {
-        extentity &e = *ents[oc.mapmodels[i]];
-        if(e.flags&EntFlag_NoCollide || !(static_cast<int>(mapmodels.size()) > e.attr1))
+        const extentity &e = *ents[oc.mapmodels[i]];
+        model *m;
+        int mcol;
+        vec center, radius;
+        float scale;
+        if(!mapmodelvolume(d, e, m, mcol, center, radius, scale) || mcol == Collide_TRI)
         {
             continue;
         }
-        mapmodelinfo &mmi = mapmodels[e.attr1];
-        model *m = mmi.collide;
-        if(!m)
+        radius.mul(scale);
+        if(mcol == Collide_Ellipse)
         {
-            if(!mmi.m && !loadmodel(nullptr, e.attr1))
-            {
-                continue;
-            }
-            if(mmi.m->collidemodel)
-            {
-                m = loadmodel(mmi.m->collidemodel);
-            }
-            if(!m)
-            {
-                m = mmi.m;
-            }
-            mmi.collide = m;
+            ctx.mmellipses->add(mpr::ModelEllipse(e.o, center, radius, e.attr2, e.attr3, e.attr4));
         }
-        int mcol = mmi.m->collide;
-        if(!mcol)
+        else
         {
-            continue;
+            ctx.mmboxes->add(mpr::ModelOBB(e.o, center, radius, e.attr2, e.attr3, e.attr4));
         }
+    }
+    mpr::EntOBB entvol(d);
+    ctx.mmboxes->collide(entvol);
+    ctx.mmellipses->collide(entvol);
+}
+
+bool mmcollide(CollisionContext &ctx, physent *d, const vec &dir, float cutoff, octaentities &oc) // collide with a mapmodel
+{
+    const vector<extentity *> &ents = entities::getents();
+    bool batched = batchmapmodels && !testtricol && d->collidetype == Collide_OrientedBoundingBox && oc.mapmodels.length() > 1;
+    if(batched)
+    {
+        batchmapmodelcollide(ctx, d, oc);
+    }
+    int boxlane = 0,
+        ellipselane = 0;
+    for(int i = 0; i < oc.mapmodels.length(); i++)
+    {
+        extentity &e = *ents[oc.mapmodels[i]];
+        model *m;
+        int mcol;
         vec center, radius;
-        float rejectradius = m->collisionbox(center, radius),
-              scale = e.attr5 > 0 ? e.attr5/100.0f : 1;
-        center.mul(scale);
-        if(d->o.reject(vec(e.o).add(center), d->radius + rejectradius*scale))
+        float scale;
+        if(!mapmodelvolume(d, e, m, mcol, center, radius, scale))
         {
             continue;
         }
@@ -617,7 +1027,8 @@ bool mmcollide(physent *d, const vec &dir, float cutoff, octaentities &oc) // co
             roll  = e.attr4;
         if(mcol == Collide_TRI || testtricol)
         {
-            if(!m->bih && !m->setBIH())
+            //BIHs are only built on the main thread, see loadcollidemodels()
+            if(!m->bih && (inworkertask() || !m->setBIH()))
             {
                 continue;
             }
@@ -625,7 +1036,7 @@ bool mmcollide(physent *d, const vec &dir, float cutoff, octaentities &oc) // co
             {
                 case Collide_Ellipse:
                 {
-                    if(m->bih->ellipsecollide(d, dir, cutoff, e.o, yaw, pitch, roll, scale))
+                    if(m->bih->ellipsecollide(ctx, d, dir, cutoff, e.o, yaw, pitch, roll, scale))
                     {
                         return true;
                     }
@@ -633,7 +1044,7 @@ bool mmcollide(physent *d, const vec &dir, float cutoff, octaentities &oc) // co
                 }
                 case Collide_OrientedBoundingBox:
                 {
-                    if(m->bih->boxcollide(d, dir, cutoff, e.o, yaw, pitch, roll, scale))
+                    if(m->bih->boxcollide(ctx, d, dir, cutoff, e.o, yaw, pitch, roll, scale))
                     {
                         return true;
                     }
@@ -656,24 +1067,24 @@ bool mmcollide(physent *d, const vec &dir, float cutoff, octaentities &oc) // co
                     {
                         if(pitch || roll)
                         {
-                            if(fuzzycollideellipse<mpr::EntCapsule>(d, dir, cutoff, e.o, center, radius, yaw, pitch, roll))
+                            if(fuzzycollideellipse<mpr::EntCapsule>(ctx, d, dir, cutoff, e.o, center, radius, yaw, pitch, roll))
                             {
                                 return true;
                             }
                         }
-                        else if(ellipsecollide(d, dir, e.o, center, yaw, radius.x, radius.y, radius.z, radius.z))
+                        else if(ellipsecollide(ctx, d, dir, e.o, center, yaw, radius.x, radius.y, radius.z, radius.z))
                         {
                             return true;
                         }
                     }
                     else if(pitch || roll)
                     {
-                        if(fuzzycollidebox<mpr::EntCapsule>(d, dir, cutoff, e.o, center, radius, yaw, pitch, roll))
+                        if(fuzzycollidebox<mpr::EntCapsule>(ctx, d, dir, cutoff, e.o, center, radius, yaw, pitch, roll))
                         {
                             return true;
                         }
                     }
-                    else if(ellipseboxcollide(d, dir, e.o, center, yaw, radius.x, radius.y, radius.z, radius.z))
+                    else if(ellipseboxcollide(ctx, d, dir, e.o, center, yaw, radius.x, radius.y, radius.z, radius.z))
                     {
                         return true;
                     }
@@ -683,12 +1094,14 @@ bool mmcollide(physent *d, const vec &dir, float cutoff, octaentities &oc) // co
                 {
                     if(mcol == Collide_Ellipse)
                     {
-                        if(mmcollide<mpr::EntOBB, mpr::ModelEllipse>(d, dir, e, center, radius, yaw, pitch, roll))
+                        if(batched ? mmcollide<mpr::ModelEllipse>(ctx, dir, *ctx.mmellipses, ellipselane++, e, center, radius, yaw, pitch, roll)
+                                   : mmcollide<mpr::EntOBB, mpr::ModelEllipse>(ctx, d, dir, e, center, radius, yaw, pitch, roll))
                         {
                             return true;
                         }
                     }
-                    else if(mmcollide<mpr::EntOBB, mpr::ModelOBB>(d, dir, e, center, radius, yaw, pitch, roll))
+                    else if(batched ? mmcollide<mpr::ModelOBB>(ctx, dir, *ctx.mmboxes, boxlane++, e, center, radius, yaw, pitch, roll)
+                                    : mmcollide<mpr::EntOBB, mpr::ModelOBB>(ctx, d, dir, e, center, radius, yaw, pitch, roll))
                     {
                         return true;
                     }
@@ -704,7 +1117,7 @@ bool mmcollide(physent *d, const vec &dir, float cutoff, octaentities &oc) // co
     return false;
 }
 
-static bool checkside(physent &d, int side, const vec &dir, const int visible, const float cutoff, float distval, float dotval, float margin, vec normal, vec &collidewall, float &bestdist)
+static bool checkside(physent &d, int side, const vec &dir, const int visible, const float cutoff, float distval, float dotval, float margin, vec normal, vec &wall, float &bestdist)
 {
     if(visible&(1<<side))
     {
@@ -728,14 +1141,14 @@ static bool checkside(physent &d, int side, const vec &dir, const int visible, c
                 return true;
             }
         }
-        collidewall = normal;
+        wall = normal;
         bestdist = dist;
     }
     return true;
 }
 
 template<class E>
-static bool fuzzycollidesolid(physent *d, const vec &dir, float cutoff, const cube &c, const ivec &co, int size) // collide with solid cube geometry
+static bool fuzzycollidesolid(CollisionContext &ctx, physent *d, const vec &dir, float cutoff, const cube &c, const ivec &co, int size) // collide with solid cube geometry
 {
     int crad = size/2;
     if(std::fabs(d->o.x - co.x - crad) > d->radius + crad || std::fabs(d->o.y - co.y - crad) > d->radius + crad ||
@@ -743,29 +1156,235 @@ static bool fuzzycollidesolid(physent *d, const vec &dir, float cutoff, const cu
     {
         return false;
     }
-    collidewall = vec(0, 0, 0);
+    ctx.wall = vec(0, 0, 0);
     float bestdist = -1e10f;
     int visible = !(c.visible&0x80) || d->type==physent::PhysEnt_Player ? c.visible : 0xFF;
 
     //if any of these checks are false (NAND of all of these checks)
-    if(!( checkside(*d, Orient_Left, dir, visible, cutoff, co.x - (d->o.x + d->radius), -dir.x, -d->radius, vec(-1, 0, 0), collidewall, bestdist)
-       && checkside(*d, Orient_Right, dir, visible, cutoff, d->o.x - d->radius - (co.x + size), dir.x, -d->radius, vec(1, 0, 0), collidewall, bestdist)
-       && checkside(*d, Orient_Back, dir, visible, cutoff, co.y - (d->o.y + d->radius), -dir.y, -d->radius, vec(0, -1, 0), collidewall, bestdist)
-       && checkside(*d, Orient_Front, dir, visible, cutoff, d->o.y - d->radius - (co.y + size), dir.y, -d->radius, vec(0, 1, 0), collidewall, bestdist)
-       && checkside(*d, Orient_Bottom, dir, visible, cutoff, co.z - (d->o.z + d->aboveeye), -dir.z, d->zmargin-(d->eyeheight+d->aboveeye)/4.0f, vec(0, 0, -1), collidewall, bestdist)
-       && checkside(*d, Orient_Top, dir, visible, cutoff, d->o.z - d->eyeheight - (co.z + size), dir.z, d->zmargin-(d->eyeheight+d->aboveeye)/3.0f, vec(0, 0, 1), collidewall, bestdist))
+    if(!( checkside(*d, Orient_Left, dir, visible, cutoff, co.x - (d->o.x + d->radius), -dir.x, -d->radius, vec(-1, 0, 0), ctx.wall, bestdist)
+       && checkside(*d, Orient_Right, dir, visible, cutoff, d->o.x - d->radius - (co.x + size), dir.x, -d->radius, vec(1, 0, 0), ctx.wall, bestdist)
+       && checkside(*d, Orient_Back, dir, visible, cutoff, co.y - (d->o.y + d->radius), -dir.y, -d->radius, vec(0, -1, 0), ctx.wall, bestdist)
+       && checkside(*d, Orient_Front, dir, visible, cutoff, d->o.y - d->radius - (co.y + size), dir.y, -d->radius, vec(0, 1, 0), ctx.wall, bestdist)
+       && checkside(*d, Orient_Bottom, dir, visible, cutoff, co.z - (d->o.z + d->aboveeye), -dir.z, d->zmargin-(d->eyeheight+d->aboveeye)/4.0f, vec(0, 0, -1), ctx.wall, bestdist)
+       && checkside(*d, Orient_Top, dir, visible, cutoff, d->o.z - d->eyeheight - (co.z + size), dir.z, d->zmargin-(d->eyeheight+d->aboveeye)/3.0f, vec(0, 0, 1), ctx.wall, bestdist))
        )
     {
         return false;
     }
-    if(collidewall.iszero())
+    if(ctx.wall.iszero())
     {
-        collideinside++;
+        ctx.inside++;
         return false;
     }
     return true;
 }
 
+/* plane support batching
+ *
+ * the deformed cube collision tests need the support point of the entity volume
+ * against each of a cube's (up to 12) clip planes, and that point's distance
+ * from the plane. These are independent of one another, so they are evaluated
+ * four planes at a time into a planesupport before the (inherently sequential)
+ * best plane search runs over them.
+ *
+ * each lane performs the same operations in the same order as the scalar
+ * mpr::EntCapsule and mpr::EntOBB support functions, so with strict floating
+ * point the batched values are exactly those the scalar path produces; with
+ * -ffast-math the compiler may reassociate either side, and the two can then
+ * differ in the last bits (clipplanebench reports any query this changes)
+ */
+VAR(batchclipplanes, 0, 1, 1);
+
+namespace
+{
+#ifdef PHYSICS_SSE
+    typedef __m128 float4;
+
+    inline float4 loadfloat4(const float *f) { return _mm_loadu_ps(f); }
+    inline void storefloat4(float *f, float4 a) { _mm_storeu_ps(f, a); }
+    inline float4 splatfloat4(float f) { return _mm_set1_ps(f); }
+    inline float4 addfloat4(float4 a, float4 b) { return _mm_add_ps(a, b); }
+    inline float4 mulfloat4(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+    inline float4 divfloat4(float4 a, float4 b) { return _mm_div_ps(a, b); }
+    inline float4 sqrtfloat4(float4 a) { return _mm_sqrt_ps(a); }
+    //picks a where x > 0, and b elsewhere
+    inline float4 selectpositive(float4 x, float4 a, float4 b)
+    {
+        float4 mask = _mm_cmpgt_ps(x, _mm_setzero_ps());
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+#else
+    struct float4
+    {
+        float v[4];
+    };
+
+    inline float4 loadfloat4(const float *f)
+    {
+        float4 r;
+        std::memcpy(r.v, f, sizeof(r.v));
+        return r;
+    }
+
+    inline void storefloat4(float *f, float4 a)
+    {
+        std::memcpy(f, a.v, sizeof(a.v));
+    }
+
+    inline float4 splatfloat4(float f)
+    {
+        return {{f, f, f, f}};
+    }
+
+    inline float4 addfloat4(float4 a, float4 b)
+    {
+        return {{a.v[0]+b.v[0], a.v[1]+b.v[1], a.v[2]+b.v[2], a.v[3]+b.v[3]}};
+    }
+
+    inline float4 mulfloat4(float4 a, float4 b)
+    {
+        return {{a.v[0]*b.v[0], a.v[1]*b.v[1], a.v[2]*b.v[2], a.v[3]*b.v[3]}};
+    }
+
+    inline float4 divfloat4(float4 a, float4 b)
+    {
+        return {{a.v[0]/b.v[0], a.v[1]/b.v[1], a.v[2]/b.v[2], a.v[3]/b.v[3]}};
+    }
+
+    inline float4 sqrtfloat4(float4 a)
+    {
+        return {{std::sqrt(a.v[0]), std::sqrt(a.v[1]), std::sqrt(a.v[2]), std::sqrt(a.v[3])}};
+    }
+
+    inline float4 selectpositive(float4 x, float4 a, float4 b)
+    {
+        return {{x.v[0] > 0 ? a.v[0] : b.v[0], x.v[1] > 0 ? a.v[1] : b.v[1], x.v[2] > 0 ? a.v[2] : b.v[2], x.v[3] > 0 ? a.v[3] : b.v[3]}};
+    }
+#endif
+
+    //dot product of three lanes of vectors, in vec::dot's order
+    inline float4 dotfloat4(float4 ax, float4 ay, float4 az, float4 bx, float4 by, float4 bz)
+    {
+        return addfloat4(addfloat4(mulfloat4(ax, bx), mulfloat4(ay, by)), mulfloat4(az, bz));
+    }
+
+    constexpr int maxclipplanesides = 12;
+
+    //the planes of a clipplanes, stored by component and padded to a multiple of four
+    struct planesupport
+    {
+        alignas(16) float nx[maxclipplanesides], ny[maxclipplanesides], nz[maxclipplanesides], offset[maxclipplanesides];
+        alignas(16) float x[maxclipplanesides], y[maxclipplanesides], z[maxclipplanesides], dist[maxclipplanesides];
+        int size;
+
+        //stores the negated plane normals, which are the directions the support points are taken in
+        void load(const clipplanes &p)
+        {
+            size = p.size;
+            for(int i = 0; i < maxclipplanesides; ++i)
+            {
+                const plane &w = p.p[i < p.size ? i : 0];
+                nx[i] = -w.x;
+                ny[i] = -w.y;
+                nz[i] = -w.z;
+                offset[i] = w.offset;
+            }
+        }
+
+        vec supportpoint(int i) const
+        {
+            return vec(x[i], y[i], z[i]);
+        }
+
+        //distance from the plane of pw = (px, py, pz), in plane::dist's order
+        void storedist(int i, float4 px, float4 py, float4 pz)
+        {
+            float4 wx = mulfloat4(loadfloat4(&nx[i]), splatfloat4(-1)),
+                   wy = mulfloat4(loadfloat4(&ny[i]), splatfloat4(-1)),
+                   wz = mulfloat4(loadfloat4(&nz[i]), splatfloat4(-1));
+            storefloat4(&x[i], px);
+            storefloat4(&y[i], py);
+            storefloat4(&z[i], pz);
+            storefloat4(&dist[i], addfloat4(dotfloat4(wx, wy, wz, px, py, pz), loadfloat4(&offset[i])));
+        }
+
+        //mirrors mpr::EntCapsule::supportpoint
+        void calc(const clipplanes &p, const mpr::EntCapsule &entvol)
+        {
+            load(p);
+            const physent *d = entvol.ent;
+            float4 ox = splatfloat4(d->o.x),
+                   oy = splatfloat4(d->o.y),
+                   radius = splatfloat4(d->radius),
+                   top = splatfloat4(d->o.z + (d->aboveeye - d->radius)),
+                   bottom = splatfloat4(d->o.z - (d->eyeheight - d->radius));
+            for(int i = 0; i < size; i += 4)
+            {
+                float4 dx = loadfloat4(&nx[i]),
+                       dy = loadfloat4(&ny[i]),
+                       dz = loadfloat4(&nz[i]),
+                       scale = divfloat4(radius, sqrtfloat4(dotfloat4(dx, dy, dz, dx, dy, dz)));
+                storedist(i, addfloat4(ox, mulfloat4(dx, scale)),
+                             addfloat4(oy, mulfloat4(dy, scale)),
+                             addfloat4(selectpositive(dz, top, bottom), mulfloat4(dz, scale)));
+            }
+        }
+
+        //mirrors mpr::EntOBB::supportpoint
+        void calc(const clipplanes &p, const mpr::EntOBB &entvol)
+        {
+            load(p);
+            const physent *d = entvol.ent;
+            const matrix3 &m = entvol.getorient();
+            float4 ax = splatfloat4(m.a.x), ay = splatfloat4(m.a.y), az = splatfloat4(m.a.z),
+                   bx = splatfloat4(m.b.x), by = splatfloat4(m.b.y), bz = splatfloat4(m.b.z),
+                   cx = splatfloat4(m.c.x), cy = splatfloat4(m.c.y), cz = splatfloat4(m.c.z),
+                   xradius = splatfloat4(d->xradius), negxradius = splatfloat4(-d->xradius),
+                   yradius = splatfloat4(d->yradius), negyradius = splatfloat4(-d->yradius),
+                   aboveeye = splatfloat4(d->aboveeye), negeyeheight = splatfloat4(-d->eyeheight),
+                   ox = splatfloat4(d->o.x),
+                   oy = splatfloat4(d->o.y),
+                   oz = splatfloat4(d->o.z);
+            for(int i = 0; i < size; i += 4)
+            {
+                float4 dx = loadfloat4(&nx[i]),
+                       dy = loadfloat4(&ny[i]),
+                       dz = loadfloat4(&nz[i]),
+                       //orient.transform(n)
+                       lx = addfloat4(addfloat4(mulfloat4(ax, dx), mulfloat4(bx, dy)), mulfloat4(cx, dz)),
+                       ly = addfloat4(addfloat4(mulfloat4(ay, dx), mulfloat4(by, dy)), mulfloat4(cy, dz)),
+                       lz = addfloat4(addfloat4(mulfloat4(az, dx), mulfloat4(bz, dy)), mulfloat4(cz, dz)),
+                       //localsupportpoint(ln)
+                       sx = selectpositive(lx, xradius, negxradius),
+                       sy = selectpositive(ly, yradius, negyradius),
+                       sz = selectpositive(lz, aboveeye, negeyeheight);
+                //orient.transposedtransform(ls).add(o)
+                storedist(i, addfloat4(dotfloat4(ax, ay, az, sx, sy, sz), ox),
+                             addfloat4(dotfloat4(bx, by, bz, sx, sy, sz), oy),
+                             addfloat4(dotfloat4(cx, cy, cz, sx, sy, sz), oz));
+            }
+        }
+    };
+}
+
+/* planesupportpoint: gets the support point of entvol against the i'th plane and its distance
+ *
+ * reads the batched values if they were computed, and evaluates the plane on its
+ * own otherwise
+ */
+template<class E>
+static vec planesupportpoint(const planesupport *batch, const E &entvol, const plane &w, int i, float &dist)
+{
+    if(batch)
+    {
+        dist = batch->dist[i];
+        return batch->supportpoint(i);
+    }
+    vec pw = entvol.supportpoint(vec(w).neg());
+    dist = w.dist(pw);
+    return pw;
+}
+
 template<class E>
 static bool clampcollide(const clipplanes &p, const E &entvol, const plane &w, const vec &pw)
 {
@@ -806,25 +1425,25 @@ static bool clampcollide(const clipplanes &p, const E &entvol, const plane &w, c
 }
 
 template<class E>
-static bool fuzzycollideplanes(physent *d, const vec &dir, float cutoff, const cube &c, const ivec &co, int size) // collide with deformed cube geometry
+static bool fuzzycollideplanes(CollisionContext &ctx, physent *d, const vec &dir, float cutoff, const cube &c, const ivec &co, int size) // collide with deformed cube geometry
 {
-    clipplanes &p = getclipbounds(c, co, size, *d);
+    clipplanes &p = getclipbounds(ctx, c, co, size, *d);
 
     if(std::fabs(d->o.x - p.o.x) > p.r.x + d->radius || std::fabs(d->o.y - p.o.y) > p.r.y + d->radius ||
        d->o.z + d->aboveeye < p.o.z - p.r.z || d->o.z - d->eyeheight > p.o.z + p.r.z)
     {
         return false;
     }
-    collidewall = vec(0, 0, 0);
+    ctx.wall = vec(0, 0, 0);
     float bestdist = -1e10f;
     int visible = forceclipplanes(c, co, size, p);
 
-    if(!( checkside(*d, Orient_Left, dir, visible, cutoff,   p.o.x - p.r.x - (d->o.x + d->radius),   -dir.x, -d->radius, vec(-1, 0, 0), collidewall, bestdist)
-       && checkside(*d, Orient_Right, dir, visible, cutoff,  d->o.x - d->radius - (p.o.x + p.r.x),    dir.x, -d->radius, vec(1, 0, 0), collidewall, bestdist)
-       && checkside(*d, Orient_Back, dir, visible, cutoff,   p.o.y - p.r.y - (d->o.y + d->radius),   -dir.y, -d->radius, vec(0, -1, 0), collidewall, bestdist)
-       && checkside(*d, Orient_Front, dir, visible, cutoff,  d->o.y - d->radius - (p.o.y + p.r.y),    dir.y, -d->radius, vec(0, 1, 0), collidewall, bestdist)
-       && checkside(*d, Orient_Bottom, dir, visible, cutoff, p.o.z - p.r.z - (d->o.z + d->aboveeye), -dir.z,  d->zmargin-(d->eyeheight+d->aboveeye)/4.0f, vec(0, 0, -1), collidewall, bestdist)
-       && checkside(*d, Orient_Top, dir, visible, cutoff,    d->o.z - d->eyeheight - (p.o.z + p.r.z), dir.z,  d->zmargin-(d->eyeheight+d->aboveeye)/3.0f, vec(0, 0, 1), collidewall, bestdist))
+    if(!( checkside(*d, Orient_Left, dir, visible, cutoff,   p.o.x - p.r.x - (d->o.x + d->radius),   -dir.x, -d->radius, vec(-1, 0, 0), ctx.wall, bestdist)
+       && checkside(*d, Orient_Right, dir, visible, cutoff,  d->o.x - d->radius - (p.o.x + p.r.x),    dir.x, -d->radius, vec(1, 0, 0), ctx.wall, bestdist)
+       && checkside(*d, Orient_Back, dir, visible, cutoff,   p.o.y - p.r.y - (d->o.y + d->radius),   -dir.y, -d->radius, vec(0, -1, 0), ctx.wall, bestdist)
+       && checkside(*d, Orient_Front, dir, visible, cutoff,  d->o.y - d->radius - (p.o.y + p.r.y),    dir.y, -d->radius, vec(0, 1, 0), ctx.wall, bestdist)
+       && checkside(*d, Orient_Bottom, dir, visible, cutoff, p.o.z - p.r.z - (d->o.z + d->aboveeye), -dir.z,  d->zmargin-(d->eyeheight+d->aboveeye)/4.0f, vec(0, 0, -1), ctx.wall, bestdist)
+       && checkside(*d, Orient_Top, dir, visible, cutoff,    d->o.z - d->eyeheight - (p.o.z + p.r.z), dir.z,  d->zmargin-(d->eyeheight+d->aboveeye)/3.0f, vec(0, 0, 1), ctx.wall, bestdist))
        )
     {
         return false;
@@ -832,11 +1451,17 @@ static bool fuzzycollideplanes(physent *d, const vec &dir, float cutoff, const c
 
     E entvol(d);
     int bestplane = -1;
+    bool batched = batchclipplanes != 0;
+    planesupport batch;
+    if(batched)
+    {
+        batch.calc(p, entvol);
+    }
     for(int i = 0; i < p.size; ++i)
     {
         const plane &w = p.p[i];
-        vec pw = entvol.supportpoint(vec(w).neg());
-        float dist = w.dist(pw);
+        float dist;
+        vec pw = planesupportpoint(batched ? &batch : nullptr, entvol, w, i, dist);
         if(dist >= 0)
         {
             return false;
@@ -871,18 +1496,18 @@ static bool fuzzycollideplanes(physent *d, const vec &dir, float cutoff, const c
 
     if(bestplane >= 0)
     {
-        collidewall = p.p[bestplane];
+        ctx.wall = p.p[bestplane];
     }
-    else if(collidewall.iszero())
+    else if(ctx.wall.iszero())
     {
-        collideinside++;
+        ctx.inside++;
         return false;
     }
     return true;
 }
 
 template<class E>
-static bool cubecollidesolid(physent *d, const vec &dir, float cutoff, const cube &c, const ivec &co, int size) // collide with solid cube geometry
+static bool cubecollidesolid(CollisionContext &ctx, physent *d, const vec &dir, float cutoff, const cube &c, const ivec &co, int size) // collide with solid cube geometry
 {
     int crad = size/2;
     if(std::fabs(d->o.x - co.x - crad) > d->radius + crad || std::fabs(d->o.y - co.y - crad) > d->radius + crad ||
@@ -896,33 +1521,33 @@ static bool cubecollidesolid(physent *d, const vec &dir, float cutoff, const cub
     {
         return false;
     }
-    collidewall = vec(0, 0, 0);
+    ctx.wall = vec(0, 0, 0);
     float bestdist = -1e10f;
     int visible = !(c.visible&0x80) || d->type==physent::PhysEnt_Player ? c.visible : 0xFF;
 
-    if(!( checkside(*d, Orient_Left, dir, visible, cutoff, co.x - entvol.right(), -dir.x, -d->radius, vec(-1, 0, 0), collidewall, bestdist)
-       && checkside(*d, Orient_Right, dir, visible, cutoff, entvol.left() - (co.x + size), dir.x, -d->radius, vec(1, 0, 0), collidewall, bestdist)
-       && checkside(*d, Orient_Back, dir, visible, cutoff, co.y - entvol.front(), -dir.y, -d->radius, vec(0, -1, 0), collidewall, bestdist)
-       && checkside(*d, Orient_Front, dir, visible, cutoff, entvol.back() - (co.y + size), dir.y, -d->radius, vec(0, 1, 0), collidewall, bestdist)
-       && checkside(*d, Orient_Bottom, dir, visible, cutoff, co.z - entvol.top(), -dir.z, d->zmargin-(d->eyeheight+d->aboveeye)/4.0f, vec(0, 0, -1), collidewall, bestdist)
-       && checkside(*d, Orient_Top, dir, visible, cutoff, entvol.bottom() - (co.z + size), dir.z, d->zmargin-(d->eyeheight+d->aboveeye)/3.0f, vec(0, 0, 1), collidewall, bestdist))
+    if(!( checkside(*d, Orient_Left, dir, visible, cutoff, co.x - entvol.right(), -dir.x, -d->radius, vec(-1, 0, 0), ctx.wall, bestdist)
+       && checkside(*d, Orient_Right, dir, visible, cutoff, entvol.left() - (co.x + size), dir.x, -d->radius, vec(1, 0, 0), ctx.wall, bestdist)
+       && checkside(*d, Orient_Back, dir, visible, cutoff, co.y - entvol.front(), -dir.y, -d->radius, vec(0, -1, 0), ctx.wall, bestdist)
+       && checkside(*d, Orient_Front, dir, visible, cutoff, entvol.back() - (co.y + size), dir.y, -d->radius, vec(0, 1, 0), ctx.wall, bestdist)
+       && checkside(*d, Orient_Bottom, dir, visible, cutoff, co.z - entvol.top(), -dir.z, d->zmargin-(d->eyeheight+d->aboveeye)/4.0f, vec(0, 0, -1), ctx.wall, bestdist)
+       && checkside(*d, Orient_Top, dir, visible, cutoff, entvol.bottom() - (co.z + size), dir.z, d->zmargin-(d->eyeheight+d->aboveeye)/3.0f, vec(0, 0, 1), ctx.wall, bestdist))
       )
     {
         return false;
     }
 
-    if(collidewall.iszero())
+    if(ctx.wall.iszero())
     {
-        collideinside++;
+        ctx.inside++;
         return false;
     }
     return true;
 }
 
 template<class E>
-static bool cubecollideplanes(physent *d, const vec &dir, float cutoff, const cube &c, const ivec &co, int size) // collide with deformed cube geometry
+static bool cubecollideplanes(CollisionContext &ctx, physent *d, const vec &dir, float cutoff, const cube &c, const ivec &co, int size) // collide with deformed cube geometry
 {
-    clipplanes &p = getclipbounds(c, co, size, *d);
+    clipplanes &p = getclipbounds(ctx, c, co, size, *d);
     if(std::fabs(d->o.x - p.o.x) > p.r.x + d->radius || std::fabs(d->o.y - p.o.y) > p.r.y + d->radius ||
        d->o.z + d->aboveeye < p.o.z - p.r.z || d->o.z - d->eyeheight > p.o.z + p.r.z)
     {
@@ -934,26 +1559,32 @@ static bool cubecollideplanes(physent *d, const vec &dir, float cutoff, const cu
     {
         return false;
     }
-    collidewall = vec(0, 0, 0);
+    ctx.wall = vec(0, 0, 0);
     float bestdist = -1e10f;
     int visible = forceclipplanes(c, co, size, p);
-    if(!( checkside(*d, Orient_Left, dir, visible, cutoff, p.o.x - p.r.x - entvol.right(),  -dir.x, -d->radius, vec(-1, 0, 0), collidewall, bestdist)
-       && checkside(*d, Orient_Right, dir, visible, cutoff, entvol.left() - (p.o.x + p.r.x), dir.x, -d->radius, vec(1, 0, 0), collidewall, bestdist)
-       && checkside(*d, Orient_Back, dir, visible, cutoff, p.o.y - p.r.y - entvol.front(),  -dir.y, -d->radius, vec(0, -1, 0), collidewall, bestdist)
-       && checkside(*d, Orient_Front, dir, visible, cutoff, entvol.back() - (p.o.y + p.r.y), dir.y, -d->radius, vec(0, 1, 0), collidewall, bestdist)
-       && checkside(*d, Orient_Bottom, dir, visible, cutoff, p.o.z - p.r.z - entvol.top(),  -dir.z,  d->zmargin-(d->eyeheight+d->aboveeye)/4.0f, vec(0, 0, -1), collidewall, bestdist)
-       && checkside(*d, Orient_Top, dir, visible, cutoff, entvol.bottom() - (p.o.z + p.r.z), dir.z,  d->zmargin-(d->eyeheight+d->aboveeye)/3.0f, vec(0, 0, 1), collidewall, bestdist))
+    if(!( checkside(*d, Orient_Left, dir, visible, cutoff, p.o.x - p.r.x - entvol.right(),  -dir.x, -d->radius, vec(-1, 0, 0), ctx.wall, bestdist)
+       && checkside(*d, Orient_Right, dir, visible, cutoff, entvol.left() - (p.o.x + p.r.x), dir.x, -d->radius, vec(1, 0, 0), ctx.wall, bestdist)
+       && checkside(*d, Orient_Back, dir, visible, cutoff, p.o.y - p.r.y - entvol.front(),  -dir.y, -d->radius, vec(0, -1, 0), ctx.wall, bestdist)
+       && checkside(*d, Orient_Front, dir, visible, cutoff, entvol.back() - (p.o.y + p.r.y), dir.y, -d->radius, vec(0, 1, 0), ctx.wall, bestdist)
+       && checkside(*d, Orient_Bottom, dir, visible, cutoff, p.o.z - p.r.z - entvol.top(),  -dir.z,  d->zmargin-(d->eyeheight+d->aboveeye)/4.0f, vec(0, 0, -1), ctx.wall, bestdist)
+       && checkside(*d, Orient_Top, dir, visible, cutoff, entvol.bottom() - (p.o.z + p.r.z), dir.z,  d->zmargin-(d->eyeheight+d->aboveeye)/3.0f, vec(0, 0, 1), ctx.wall, bestdist))
       )
     {
         return false;
     }
 
     int bestplane = -1;
+    bool batched = batchclipplanes != 0;
+    planesupport batch;
+    if(batched)
+    {
+        batch.calc(p, entvol);
+    }
     for(int i = 0; i < p.size; ++i)
     {
         const plane &w = p.p[i];
-        vec pw = entvol.supportpoint(vec(w).neg());
-        float dist = w.dist(pw);
+        float dist;
+        vec pw = planesupportpoint(batched ? &batch : nullptr, entvol, w, i, dist);
         if(dist <= bestdist)
         {
             continue;
@@ -983,17 +1614,17 @@ static bool cubecollideplanes(physent *d, const vec &dir, float cutoff, const cu
 
     if(bestplane >= 0)
     {
-        collidewall = p.p[bestplane];
+        ctx.wall = p.p[bestplane];
     }
-    else if(collidewall.iszero())
+    else if(ctx.wall.iszero())
     {
-        collideinside++;
+        ctx.inside++;
         return false;
     }
     return true;
 }
 
-static bool cubecollide(physent *d, const vec &dir, float cutoff, const cube &c, const ivec &co, int size, bool solid)
+static bool cubecollide(CollisionContext &ctx, physent *d, const vec &dir, float cutoff, const cube &c, const ivec &co, int size, bool solid)
 {
     switch(d->collidetype)
     {
@@ -1001,22 +1632,22 @@ static bool cubecollide(physent *d, const vec &dir, float cutoff, const cube &c,
         {
             if(c.issolid() || solid)
             {
-                return cubecollidesolid<mpr::EntOBB>(d, dir, cutoff, c, co, size);
+                return cubecollidesolid<mpr::EntOBB>(ctx, d, dir, cutoff, c, co, size);
             }
             else
             {
-                return cubecollideplanes<mpr::EntOBB>(d, dir, cutoff, c, co, size);
+                return cubecollideplanes<mpr::EntOBB>(ctx, d, dir, cutoff, c, co, size);
             }
         }
         case Collide_Ellipse:
         {
             if(c.issolid() || solid)
             {
-                return fuzzycollidesolid<mpr::EntCapsule>(d, dir, cutoff, c, co, size);
+                return fuzzycollidesolid<mpr::EntCapsule>(ctx, d, dir, cutoff, c, co, size);
             }
             else
             {
-                return fuzzycollideplanes<mpr::EntCapsule>(d, dir, cutoff, c, co, size);
+                return fuzzycollideplanes<mpr::EntCapsule>(ctx, d, dir, cutoff, c, co, size);
             }
         }
         default:
@@ -1026,13 +1657,13 @@ static bool cubecollide(physent *d, const vec &dir, float cutoff, const cube &c,
     }
 }
 
-static bool octacollide(physent *d, const vec &dir, float cutoff, const ivec &bo, const ivec &bs, const cube *c, const ivec &cor, int size) // collide with octants
+static bool octacollide(CollisionContext &ctx, physent *d, const vec &dir, float cutoff, const ivec &bo, const ivec &bs, const cube *c, const ivec &cor, int size) // collide with octants
 {
     LOOP_OCTA_BOX(cor, size, bo, bs)
     {
         if(c[i].ext && c[i].ext->ents)
         {
-            if(mmcollide(d, dir, cutoff, *c[i].ext->ents))
+            if(mmcollide(ctx, d, dir, cutoff, *c[i].ext->ents))
             {
                 return true;
             }
@@ -1040,7 +1671,7 @@ static bool octacollide(physent *d, const vec &dir, float cutoff, const ivec &bo
         ivec o(i, cor, size);
         if(c[i].children)
         {
-            if(octacollide(d, dir, cutoff, bo, bs, c[i].children, o, size>>1))
+            if(octacollide(ctx, d, dir, cutoff, bo, bs, c[i].children, o, size>>1))
             {
                 return true;
             }
@@ -1067,7 +1698,7 @@ static bool octacollide(physent *d, const vec &dir, float cutoff, const ivec &bo
             {
                 continue;
             }
-            if(cubecollide(d, dir, cutoff, c[i], o, size, solid))
+            if(cubecollide(ctx, d, dir, cutoff, c[i], o, size, solid))
             {
                 return true;
             }
@@ -1076,16 +1707,75 @@ static bool octacollide(physent *d, const vec &dir, float cutoff, const ivec &bo
     return false;
 }
 
-bool cubeworld::octacollide(physent *d, const vec &dir, float cutoff, const ivec &bo, const ivec &bs)
+//octacollide() over the compact octree, which only touches the cubes of leaves that can be collided with
+static bool compactcollide(CollisionContext &ctx, physent *d, const vec &dir, float cutoff, const ivec &bo, const ivec &bs, const compactoctree &t, int c, const ivec &cor, int size)
 {
+    LOOP_OCTA_BOX(cor, size, bo, bs)
+    {
+        const compactnode &n = t.nodes[c+i];
+        if(n.flags&CompactNode_Ents)
+        {
+            if(mmcollide(ctx, d, dir, cutoff, *t.cubes[c+i]->ext->ents))
+            {
+                return true;
+            }
+        }
+        ivec o(i, cor, size);
+        if(n.children >= 0)
+        {
+            if(compactcollide(ctx, d, dir, cutoff, bo, bs, t, n.children, o, size>>1))
+            {
+                return true;
+            }
+        }
+        else
+        {
+            bool solid = false;
+            switch(n.material&MatFlag_Clip)
+            {
+                case Mat_NoClip:
+                {
+                    continue;
+                }
+                case Mat_Clip:
+                {
+                    if(IS_CLIPPED(n.material&MatFlag_Volume) || d->type==physent::PhysEnt_Player)
+                    {
+                        solid = true;
+                    }
+                    break;
+                }
+            }
+            if(!solid && n.flags&CompactNode_Empty)
+            {
+                continue;
+            }
+            if(cubecollide(ctx, d, dir, cutoff, *t.cubes[c+i], o, size, solid))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+//collides a physent with the world's geometry and mapmodels within the box bo..bs
+bool octacollide(CollisionContext &ctx, physent *d, const vec &dir, float cutoff, const ivec &bo, const ivec &bs)
+{
+    //starting at the root only visits octants overlapping the box, as the descent below does
+    const compactoctree *compact = getcompactocta();
+    if(compact)
+    {
+        return compactcollide(ctx, d, dir, cutoff, bo, bs, *compact, 0, ivec(0, 0, 0), worldsize>>1);
+    }
     int diff = (bo.x^bs.x) | (bo.y^bs.y) | (bo.z^bs.z),
         scale = worldscale-1;
     if(diff&~((1<<scale)-1) || static_cast<uint>(bo.x|bo.y|bo.z|bs.x|bs.y|bs.z) >= static_cast<uint>(worldsize))
     {
-       return ::octacollide(d, dir, cutoff, bo, bs, worldroot, ivec(0, 0, 0), worldsize>>1);
+       return ::octacollide(ctx, d, dir, cutoff, bo, bs, worldroot, ivec(0, 0, 0), worldsize>>1);
     }
     const cube *c = &worldroot[OCTA_STEP(bo.x, bo.y, bo.z, scale)];
-    if(c->ext && c->ext->ents && mmcollide(d, dir, cutoff, *c->ext->ents))
+    if(c->ext && c->ext->ents && mmcollide(ctx, d, dir, cutoff, *c->ext->ents))
     {
         return true;
     }
@@ -1093,7 +1783,7 @@ bool cubeworld::octacollide(physent *d, const vec &dir, float cutoff, const ivec
     while(c->children && !(diff&(1<<scale)))
     {
         c = &c->children[OCTA_STEP(bo.x, bo.y, bo.z, scale)];
-        if(c->ext && c->ext->ents && mmcollide(d, dir, cutoff, *c->ext->ents))
+        if(c->ext && c->ext->ents && mmcollide(ctx, d, dir, cutoff, *c->ext->ents))
         {
             return true;
         }
@@ -1101,7 +1791,7 @@ bool cubeworld::octacollide(physent *d, const vec &dir, float cutoff, const ivec
     }
     if(c->children)
     {
-        return ::octacollide(d, dir, cutoff, bo, bs, c->children, ivec(bo).mask(~((2<<scale)-1)), 1<<scale);
+        return ::octacollide(ctx, d, dir, cutoff, bo, bs, c->children, ivec(bo).mask(~((2<<scale)-1)), 1<<scale);
     }
     bool solid = false;
     switch(c->material&MatFlag_Clip)
@@ -1125,20 +1815,126 @@ bool cubeworld::octacollide(physent *d, const vec &dir, float cutoff, const ivec
     }
     int csize = 2<<scale,
         cmask = ~(csize-1);
-    return cubecollide(d, dir, cutoff, *c, ivec(bo).mask(cmask), csize, solid);
+    return cubecollide(ctx, d, dir, cutoff, *c, ivec(bo).mask(cmask), csize, solid);
+}
+
+bool cubeworld::octacollide(physent *d, const vec &dir, float cutoff, const ivec &bo, const ivec &bs)
+{
+    return ::octacollide(maincollision, d, dir, cutoff, bo, bs);
 }
 
 // all collision happens here
-bool collide(physent *d, const vec &dir, float cutoff, bool playercol, bool insideplayercol)
+bool collide(CollisionContext &ctx, physent *d, const vec &dir, float cutoff, bool playercol, bool insideplayercol)
 {
-    collideinside = 0;
-    collideplayer = nullptr;
-    collidewall = vec(0, 0, 0);
+    ctx.inside = 0;
+    ctx.player = nullptr;
+    ctx.wall = vec(0, 0, 0);
     ivec bo(static_cast<int>(d->o.x-d->radius), static_cast<int>(d->o.y-d->radius), static_cast<int>(d->o.z-d->eyeheight)),
          bs(static_cast<int>(d->o.x+d->radius), static_cast<int>(d->o.y+d->radius), static_cast<int>(d->o.z+d->aboveeye));
     bo.sub(1);
     bs.add(1);  // guard space for rounding errors
-    return rootworld.octacollide(d, dir, cutoff, bo, bs) || (playercol && plcollide(d, dir, insideplayercol)); // collide with world
+    return octacollide(ctx, d, dir, cutoff, bo, bs) || (playercol && plcollide(ctx, d, dir, insideplayercol)); // collide with world
+}
+
+// info about collisions, as left by the last collide() made through the main context
+int collideinside; // whether an internal collision happened
+physent *collideplayer; // whether the collection hit a player
+vec collidewall; // just the normal vectors.
+
+static void publishcollision()
+{
+    collideinside = maincollision.inside;
+    collideplayer = maincollision.player;
+    collidewall = maincollision.wall;
+}
+
+//world collision queries made through the main context, kept for replay by clipplanebench
+namespace
+{
+    struct recordedcollide
+    {
+        physent d;
+        vec dir;
+        float cutoff;
+    };
+    std::vector<recordedcollide> recordedcollides;
+    constexpr size_t maxrecordedcollides = 1<<16;
+}
+
+VARF(recordcollide, 0, 0, 1, { if(recordcollide) recordedcollides.clear(); });
+
+bool collide(physent *d, const vec &dir, float cutoff, bool playercol, bool insideplayercol)
+{
+    if(recordcollide && recordedcollides.size() < maxrecordedcollides)
+    {
+        recordedcollides.push_back({*d, dir, cutoff});
+    }
+    bool collided = collide(maincollision, d, dir, cutoff, playercol, insideplayercol);
+    publishcollision();
+    return collided;
+}
+
+/* clipplanebench: replays the collide() queries recorded with `recordcollide 1`
+ * with the scalar and the batched clip plane tests, and reports the time taken
+ * and any queries whose results differ between the two
+ *
+ * only world geometry is collided against, since the other entities present
+ * when the queries were recorded may have since moved
+ */
+void clipplanebench()
+{
+    if(recordedcollides.empty())
+    {
+        conoutf("clipplanebench: no collisions recorded, move around with recordcollide 1 first");
+        return;
+    }
+    constexpr int passes = 20;
+    struct collideresult
+    {
+        bool collided;
+        int inside;
+        vec wall;
+    };
+    std::vector<collideresult> results[2];
+    double times[2];
+    int oldbatch = batchclipplanes;
+    for(int batch = 0; batch < 2; ++batch)
+    {
+        batchclipplanes = batch;
+        CollisionContext ctx;
+        std::vector<collideresult> &result = results[batch];
+        for(recordedcollide &r : recordedcollides) //warm the clip plane cache
+        {
+            collide(ctx, &r.d, r.dir, r.cutoff, false);
+        }
+        double start = getpreciseclockmillis();
+        for(int i = 0; i < passes; ++i)
+        {
+            for(recordedcollide &r : recordedcollides)
+            {
+                ctx.inside = 0;
+                bool collided = collide(ctx, &r.d, r.dir, r.cutoff, false);
+                if(!i)
+                {
+                    result.push_back({collided, ctx.inside, ctx.wall});
+                }
+            }
+        }
+        times[batch] = (getpreciseclockmillis() - start)/passes;
+    }
+    batchclipplanes = oldbatch;
+    int mismatches = 0;
+    for(size_t i = 0; i < recordedcollides.size(); ++i)
+    {
+        const collideresult &a = results[0][i],
+                            &b = results[1][i];
+        if(a.collided != b.collided || a.inside != b.inside || a.wall != b.wall)
+        {
+            mismatches++;
+        }
+    }
+    conoutf("clipplanebench: %d queries: scalar %.3f ms, batched %.3f ms (%.2fx), %d mismatches",
+            static_cast<int>(recordedcollides.size()), times[0], times[1], times[1] > 0 ? times[0]/times[1] : 0, mismatches);
 }
 
 void recalcdir(physent *d, const vec &oldvel, vec &dir)
@@ -1208,7 +2004,7 @@ void avoidcollision(physent *d, const vec &dir, physent *obstacle, float space)
     }
 }
 
-bool movecamera(physent *pl, const vec &dir, float dist, float stepdist)
+bool movecamera(CollisionContext &ctx, physent *pl, const vec &dir, float dist, float stepdist)
 {
     int steps = static_cast<int>(ceil(dist/stepdist));
     if(steps <= 0)
@@ -1221,7 +2017,7 @@ bool movecamera(physent *pl, const vec &dir, float dist, float stepdist)
     {
         vec oldpos(pl->o);
         pl->o.add(d);
-        if(collide(pl, vec(0, 0, 0), 0, false))
+        if(collide(ctx, pl, vec(0, 0, 0), 0, false))
         {
             pl->o = oldpos;
             return false;
@@ -1230,6 +2026,316 @@ bool movecamera(physent *pl, const vec &dir, float dist, float stepdist)
     return true;
 }
 
+bool movecamera(physent *pl, const vec &dir, float dist, float stepdist)
+{
+    bool moved = movecamera(maincollision, pl, dir, dist, stepdist);
+    publishcollision();
+    return moved;
+}
+
+//moves an entity by its velocity over dt seconds, sliding along whatever it runs into
+static void movedynent(CollisionContext &ctx, physent *d, float dt)
+{
+    vec dir = vec(d->vel).add(d->falling).mul(dt);
+    int steps = static_cast<int>(std::ceil(dir.magnitude()));
+    if(steps <= 0)
+    {
+        return;
+    }
+    dir.mul(1.0f/steps);
+    for(int i = 0; i < steps; ++i)
+    {
+        vec oldpos(d->o);
+        d->o.add(dir);
+        if(!collide(ctx, d, dir))
+        {
+            continue;
+        }
+        d->o = oldpos;
+        slideagainst(d, dir, ctx.wall, false, false);
+        d->o.add(dir);
+        if(collide(ctx, d, dir))
+        {
+            d->o = oldpos;
+            return;
+        }
+    }
+}
+
+/* loadcollidemodels: resolves the collision models of every mapmodel, which would
+ * otherwise be loaded on first contact
+ *
+ * runs on the main thread before entities are handed to the workers, which only
+ * look up what is resolved here
+ */
+static void loadcollidemodels()
+{
+    for(uint i = 0; i < mapmodels.size(); ++i)
+    {
+        model *m = loadcollidemodel(i);
+        if(!m)
+        {
+            continue;
+        }
+        if((mapmodels[i].m->collide == Collide_TRI || testtricol) && !m->bih)
+        {
+            m->setBIH();
+        }
+        //the collision box is computed on first use, so compute it here rather than on the workers
+        vec center, radius;
+        m->collisionbox(center, radius);
+    }
+}
+
+static void movedynents(dynentgrid &grid, physent **ents, int num, float dt)
+{
+    loadcollidemodels();
+    //entities are filed under the whole area they may cross, so that the grid
+    //stays valid while they move; those confined to one region are grouped
+    int regionshift = std::max(grid.shift(), 8) - grid.shift();
+    std::unordered_map<int, int> regionindex;
+    std::vector<std::vector<physent *>> regions;
+    std::vector<physent *> crossing;
+    for(int i = 0; i < num; ++i)
+    {
+        physent *d = ents[i];
+        float margin = vec(d->vel).add(d->falling).magnitude()*dt + 1;
+        grid.update(d, margin);
+        ushort x1, y1, x2, y2;
+        grid.calcrange(d->o.x, d->o.y, d->radius + margin, x1, y1, x2, y2);
+        if(x1>>regionshift != x2>>regionshift || y1>>regionshift != y2>>regionshift)
+        {
+            crossing.push_back(d);
+            continue;
+        }
+        int key = ((y1>>regionshift)<<16) | (x1>>regionshift);
+        auto itr = regionindex.find(key);
+        if(itr == regionindex.end())
+        {
+            itr = regionindex.emplace(key, regions.size()).first;
+            regions.emplace_back();
+        }
+        regions[itr->second].push_back(d);
+    }
+    //entities in different regions cannot touch each other, and those crossing
+    //regions stay put until the regions are done
+    int numregions = regions.size(),
+        numtasks = std::min(numworkerthreads(), numregions);
+    while(static_cast<int>(movecollisions.size()) < std::max(numtasks, 1))
+    {
+        movecollisions.push_back(std::make_unique<CollisionContext>());
+    }
+    for(std::unique_ptr<CollisionContext> &ctx : movecollisions)
+    {
+        ctx->broadphase = &grid;
+    }
+    taskgroup tasks;
+    for(int i = 0; i < numtasks; ++i)
+    {
+        int start = (numregions*i)/numtasks,
+            end = (numregions*(i+1))/numtasks;
+        tasks.run([&regions, start, end, dt, &ctx = *movecollisions[i]]()
+        {
+            for(int j = start; j < end; ++j)
+            {
+                for(physent *d : regions[j])
+                {
+                    movedynent(ctx, d, dt);
+                }
+            }
+        });
+    }
+    tasks.wait();
+    for(const std::vector<physent *> &region : regions)
+    {
+        for(physent *d : region)
+        {
+            grid.update(d);
+        }
+    }
+    CollisionContext &ctx = *movecollisions[0];
+    for(physent *d : crossing)
+    {
+        movedynent(ctx, d, dt);
+        grid.update(d);
+    }
+}
+
+/* movedynents: moves a batch of entities by their velocities over dt seconds
+ *
+ * the world is split into square regions, and entities which stay within one
+ * region for the whole step are moved on the worker pool, one task per group of
+ * regions, each region's entities in the order given. Entities whose movement
+ * may take them across a region boundary are then moved one at a time on the
+ * calling thread, so contacts between regions are resolved in a fixed order and
+ * the outcome does not depend on the number of threads
+ *
+ * the entities are refiled in the dynent broadphase as they move
+ */
+void movedynents(physent **ents, int num, float dt)
+{
+    dynentbroadphase.setsize(dynentcellshift(worldsize), worldsize);
+    movedynents(dynentbroadphase, ents, num, dt);
+}
+
+/* movedynentsbench: moves numbots bots scattered across the map for 60 ticks
+ * with 1, 2, 4 and 8 threads, reporting the time per tick and whether the bots
+ * ended up where they did with one thread
+ */
+void movedynentsbench(int *numbots)
+{
+    if(!worldsize)
+    {
+        return;
+    }
+    constexpr int ticks = 60;
+    constexpr float dt = 1/60.0f;
+    int num = std::clamp(*numbots > 0 ? *numbots : 1024, 1, 1<<16);
+    std::vector<physent> start(num);
+    for(physent &d : start)
+    {
+        d.type = physent::PhysEnt_Player;
+        d.o = vec(randomint(worldsize), randomint(worldsize), randomint(worldsize));
+        d.vel = vec(randomint(201) - 100, randomint(201) - 100, 0);
+        d.falling = vec(0, 0, -50);
+    }
+    std::vector<physent> reference;
+    int oldthreads = workerthreads;
+    double basetime = 0;
+    for(int threads = 1; threads <= 8; threads *= 2)
+    {
+        setworkerthreads(threads);
+        std::vector<physent> bots(start);
+        std::vector<physent *> ents(num);
+        for(int i = 0; i < num; ++i)
+        {
+            ents[i] = &bots[i];
+        }
+        dynentgrid grid;
+        grid.setsize(dynentcellshift(worldsize), worldsize);
+        grid.sync(ents);
+        double begin = getpreciseclockmillis();
+        for(int i = 0; i < ticks; ++i)
+        {
+            movedynents(grid, ents.data(), num, dt);
+        }
+        double elapsed = (getpreciseclockmillis() - begin)/ticks;
+        int mismatches = 0;
+        if(threads == 1)
+        {
+            basetime = elapsed;
+            reference = bots;
+        }
+        else
+        {
+            for(int i = 0; i < num; ++i)
+            {
+                if(bots[i].o != reference[i].o)
+                {
+                    mismatches++;
+                }
+            }
+        }
+        conoutf("movedynentsbench: %d bots, %d threads: %.3f ms per tick (%.2fx), %d mismatches", num, threads, elapsed, elapsed > 0 ? basetime/elapsed : 0, mismatches);
+    }
+    setworkerthreads(oldthreads);
+}
+
+/* mapmodelbench: collides oriented box entities against a dense cluster of
+ * nummodels mapmodel volumes (half boxes, half ellipses), one model at a time
+ * and batched, and reports the model tests per second of each and how many
+ * results differ between the two
+ */
+void mapmodelbench(int *nummodels)
+{
+    constexpr int queries = 2000;
+    int num = *nummodels > 0 ? *nummodels : 64;
+    float extent = 16*std::cbrt(static_cast<float>(num)); //keeps the cluster about equally dense for any size
+    std::vector<mpr::ModelOBB> boxes;
+    std::vector<mpr::ModelEllipse> ellipses;
+    mpr::ModelBatch boxbatch(false),
+                    ellipsebatch(true);
+    for(int i = 0; i < num; ++i)
+    {
+        vec o(randomint(static_cast<int>(extent)), randomint(static_cast<int>(extent)), randomint(static_cast<int>(extent))),
+            radius(4 + randomint(12), 4 + randomint(12), 4 + randomint(12));
+        int yaw = randomint(360),
+            pitch = randomint(4) ? 0 : randomint(90) - 45,
+            roll = randomint(4) ? 0 : randomint(90) - 45;
+        if(i&1)
+        {
+            ellipses.emplace_back(o, vec(0, 0, 0), radius, yaw, pitch, roll);
+            ellipsebatch.add(ellipses.back());
+        }
+        else
+        {
+            boxes.emplace_back(o, vec(0, 0, 0), radius, yaw, pitch, roll);
+            boxbatch.add(boxes.back());
+        }
+    }
+    std::vector<physent> ents(queries);
+    for(physent &d : ents)
+    {
+        d.o = vec(randomint(static_cast<int>(extent)), randomint(static_cast<int>(extent)), randomint(static_cast<int>(extent)));
+        d.yaw = randomint(360);
+        d.xradius = d.yradius = d.radius = 4.1f;
+        d.eyeheight = 14;
+        d.aboveeye = 1;
+    }
+    std::vector<uchar> hits;
+    std::vector<vec> contacts;
+    double start = getpreciseclockmillis();
+    for(physent &d : ents)
+    {
+        mpr::EntOBB entvol(&d);
+        for(const mpr::ModelOBB &m : boxes)
+        {
+            vec cp(0, 0, 0);
+            hits.push_back(mpr::collide(entvol, m, nullptr, nullptr, &cp) ? 1 : 0);
+            contacts.push_back(cp);
+        }
+        for(const mpr::ModelEllipse &m : ellipses)
+        {
+            vec cp(0, 0, 0);
+            hits.push_back(mpr::collide(entvol, m, nullptr, nullptr, &cp) ? 1 : 0);
+            contacts.push_back(cp);
+        }
+    }
+    double scalartime = getpreciseclockmillis() - start;
+    std::vector<uchar> batchhits;
+    std::vector<vec> batchcontacts;
+    start = getpreciseclockmillis();
+    for(physent &d : ents)
+    {
+        mpr::EntOBB entvol(&d);
+        boxbatch.collide(entvol);
+        ellipsebatch.collide(entvol);
+        for(const mpr::ModelBatch *batch : {&boxbatch, &ellipsebatch})
+        {
+            for(int i = 0; i < batch->size(); ++i)
+            {
+                batchhits.push_back(batch->hit(i) ? 1 : 0);
+                batchcontacts.push_back(batch->contactpoint(i));
+            }
+        }
+    }
+    double batchtime = getpreciseclockmillis() - start;
+    int numhits = 0,
+        mismatches = 0;
+    for(size_t i = 0; i < hits.size(); ++i)
+    {
+        numhits += hits[i];
+        if(hits[i] != batchhits[i] || (hits[i] && contacts[i] != batchcontacts[i]))
+        {
+            mismatches++;
+        }
+    }
+    double tests = static_cast<double>(queries)*num;
+    conoutf("mapmodelbench: %d models, %d entities, %d hits: single %.0f, batched %.0f model tests per second (%.2fx), %d mismatches",
+            num, queries, numhits, scalartime > 0 ? tests*1000/scalartime : 0, batchtime > 0 ? tests*1000/batchtime : 0,
+            batchtime > 0 ? scalartime/batchtime : 0, mismatches);
+}
+
 bool droptofloor(vec &o, float radius, float height)
 {
     static struct dropent : physent
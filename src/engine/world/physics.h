@@ -1,24 +1,67 @@
 #ifndef PHYSICS_H_
 #define PHYSICS_H_
 
+struct clipplanes;
+struct clipplanecache;
+class dynentgrid;
+
+namespace mpr
+{
+    class ModelBatch;
+}
+
+/* CollisionContext: the state of one thread's collision queries
+ *
+ * collide() reports its results through the context it is given, and each
+ * context keeps its own cache of clip planes, so any number of threads may run
+ * collision queries at once as long as each uses its own context and neither
+ * the world nor the dynent broadphase is modified meanwhile
+ *
+ * the collidewall/collideinside/collideplayer globals mirror the engine's own
+ * main thread context, for callers of the context-less functions
+ */
+struct CollisionContext
+{
+    int inside;      // whether an internal collision happened
+    physent *player; // the player collided with, if any
+    vec wall;        // the normal of the surface collided with
+
+    clipplanecache *clipcache;
+    const dynentgrid *broadphase; // the dynents to collide with, or null for the engine's own
+    mpr::ModelBatch *mmboxes, *mmellipses; // mapmodels batched for collision with oriented box entities
+
+    CollisionContext();
+    ~CollisionContext();
+    CollisionContext(const CollisionContext &) = delete;
+    CollisionContext &operator=(const CollisionContext &) = delete;
+
+    clipplanes &getclipbounds(const cube &c, const ivec &o, int size, int offset);
+};
+
 extern vec collidewall;
 extern int collideinside;
 extern physent *collideplayer;
 
 extern void avoidcollision(physent *d, const vec &dir, physent *obstacle, float space);
 extern bool movecamera(physent *pl, const vec &dir, float dist, float stepdist);
+extern bool movecamera(CollisionContext &ctx, physent *pl, const vec &dir, float dist, float stepdist);
 extern void dropenttofloor(entity *e);
 extern bool droptofloor(vec &o, float radius, float height);
 
-struct clipplanes;
-
 extern bool collide(physent *d, const vec &dir = vec(0, 0, 0), float cutoff = 0.0f, bool playercol = true, bool insideplayercol = false);
+extern bool collide(CollisionContext &ctx, physent *d, const vec &dir = vec(0, 0, 0), float cutoff = 0.0f, bool playercol = true, bool insideplayercol = false);
+extern bool octacollide(CollisionContext &ctx, physent *d, const vec &dir, float cutoff, const ivec &bo, const ivec &bs);
 extern void modifyorient(float yaw, float pitch);
 
 extern void vecfromyawpitch(float yaw, float pitch, int move, int strafe, vec &m);
 extern void updatephysstate(physent *d);
 extern void cleardynentcache();
 extern void updatedynentcache(physent *d);
+extern void dynentbench();
+extern void movedynents(physent **ents, int num, float dt);
+extern void movedynentsbench(int *numbots);
+extern void clipplanebench();
+extern void mapmodelbench(int *nummodels);
 extern bool entinmap(dynent *d, bool avoidplayers = false);
 extern void findplayerspawn(dynent *d, int forceent = -1, int tag = 0);
 
@@ -13,20 +13,34 @@
  */
 #include "../libprimis-headers/cube.h"
 #include "../../shared/geomexts.h"
+#include "../../shared/threads.h"
 
 #include "bih.h"
 #include "entities.h"
+#include "octacompact.h"
 #include "octaworld.h"
 #include "physics.h"
 #include "raycube.h"
 #include "world/world.h"
 
+#include "interface/console.h"
+#include "interface/control.h"
+
+#include "model/model.h"
+
+#include "render/rendergl.h"
+#include "render/rendermodel.h"
+
 //internally relevant functionality
 namespace
 {
+    //clip plane cache of the calling thread while it runs a batch of rays, shared world cache otherwise
+    thread_local clipplanecache *rayclipcache = nullptr;
+
     clipplanes &getclipplanes(const cube &c, const ivec &o, int size)
     {
-        clipplanes &p = rootworld.getclipbounds(c, o, size, c.visible&0x80 ? 2 : 0);
+        int offset = c.visible&0x80 ? 2 : 0;
+        clipplanes &p = rayclipcache ? rayclipcache->getclipbounds(c, o, size, offset) : rootworld.getclipbounds(c, o, size, offset);
         if(p.visible&0x80)
         {
             genclipplanes(c, o, size, p, false, false);
@@ -133,8 +147,8 @@ namespace
         return true;
     }
 
-    float hitentdist;
-    int hitent, hitorient;
+    thread_local float hitentdist;
+    thread_local int hitent, hitorient;
 
     float disttoent(octaentities *oc, const vec &o, const vec &ray, float radius, int mode, extentity *t)
     {
@@ -261,7 +275,7 @@ bool insideworld(const ivec &o)
            static_cast<uint>(o.z) < static_cast<uint>(worldsize);
 }
 
-vec hitsurface;
+thread_local vec hitsurface;
 
 //==================INITRAYCUBE CHECKINSIDEWORLD DOWNOCTREE FINDCLOSEST UPOCTREE
 #define INITRAYCUBE \
@@ -271,6 +285,9 @@ vec hitsurface;
         invray(ray.x ? 1/ray.x : 1e16f, ray.y ? 1/ray.y : 1e16f, ray.z ? 1/ray.z : 1e16f); \
     cube *levels[20]; \
     levels[worldscale] = worldroot; \
+    const compactoctree *compact = getcompactocta(); \
+    int clevels[20]; \
+    clevels[worldscale] = 0; \
     int lshift = worldscale, \
         elvl = mode&Ray_BB ? worldscale : 0; \
     ivec lsizemask(invray.x>0 ? 1 : 0, invray.y>0 ? 1 : 0, invray.z>0 ? 1 : 0); \
@@ -303,28 +320,59 @@ vec hitsurface;
         dist += disttoworld; \
     }
 
+#define RAYENTS(ents, disttoent, earlyexit) \
+        { \
+            float edist = disttoent(ents, o, ray, dent, mode, t); \
+            if(edist < dent) \
+            { \
+                earlyexit return std::min(edist, dist); \
+                elvl = lshift; \
+                dent = std::min(dent, edist); \
+            } \
+        }
+
+//the compact octree, when present, is descended without touching any cube but the leaf
 #define DOWNOCTREE(disttoent, earlyexit) \
-        cube *lc = levels[lshift]; \
-        for(;;) \
+        cube *lc; \
+        if(compact) \
         { \
-            lshift--; \
-            lc += OCTA_STEP(x, y, z, lshift); \
-            if(lc->ext && lc->ext->ents && lshift < elvl) \
+            int ln = clevels[lshift]; \
+            for(;;) \
             { \
-                float edist = disttoent(lc->ext->ents, o, ray, dent, mode, t); \
-                if(edist < dent) \
+                lshift--; \
+                ln += OCTA_STEP(x, y, z, lshift); \
+                const compactnode &n = compact->nodes[ln]; \
+                if(n.flags&CompactNode_Ents && lshift < elvl) \
                 { \
-                    earlyexit return std::min(edist, dist); \
-                    elvl = lshift; \
-                    dent = std::min(dent, edist); \
+                    RAYENTS(compact->cubes[ln]->ext->ents, disttoent, earlyexit); \
                 } \
+                if(n.children < 0) \
+                { \
+                    break; \
+                } \
+                ln = n.children; \
+                clevels[lshift] = ln; \
             } \
-            if(lc->children==nullptr) \
+            lc = compact->cubes[ln]; \
+        } \
+        else \
+        { \
+            lc = levels[lshift]; \
+            for(;;) \
             { \
-                break; \
+                lshift--; \
+                lc += OCTA_STEP(x, y, z, lshift); \
+                if(lc->ext && lc->ext->ents && lshift < elvl) \
+                { \
+                    RAYENTS(lc->ext->ents, disttoent, earlyexit); \
+                } \
+                if(lc->children==nullptr) \
+                { \
+                    break; \
+                } \
+                lc = lc->children; \
+                levels[lshift] = lc; \
             } \
-            lc = lc->children; \
-            levels[lshift] = lc; \
         }
 
 #define FINDCLOSEST(xclosest, yclosest, zclosest) \
@@ -477,6 +525,7 @@ float cubeworld::shadowray(const vec &o, const vec &ray, float radius, int mode,
 #undef CHECKINSIDEWORLD
 #undef UPOCTREE
 #undef DOWNOCTREE
+#undef RAYENTS
 #undef INTERSECTBOX
 #undef INTERSECTPLANES
 //==============================================================================
@@ -499,6 +548,94 @@ float rayent(const vec &o, const vec &ray, float radius, int mode, int size, int
     return dist;
 }
 
+/* preloadraymodels: loads the mapmodels (and their BIHs) rays may test
+ *
+ * must run on the main thread before rays are handed to the pool; the workers
+ * only look models up, skipping any which are missing or failed to load here
+ */
+static void preloadraymodels()
+{
+    const vector<extentity *> &ents = entities::getents();
+    for(int i = 0; i < ents.length(); i++)
+    {
+        const extentity &e = *ents[i];
+        if(e.type != EngineEnt_Mapmodel)
+        {
+            continue;
+        }
+        model *m = loadmapmodel(e.attr1);
+        if(m)
+        {
+            m->preloadBIH();
+        }
+    }
+}
+
+/* castrays: runs cast(i) for every ray index in [0, numrays) across the worker pool
+ *
+ * rays are split into contiguous runs, each of which is cast with a private
+ * clip plane cache, so runs may be cast on any thread
+ */
+static void castrays(int numrays, const std::function<void(int)> &cast)
+{
+    constexpr int minrun = 256;
+    int numruns = std::clamp(numrays/minrun, 1, 4*numworkerthreads());
+    taskgroup tasks;
+    for(int i = 0; i < numruns; ++i)
+    {
+        int start = (numrays*i)/numruns,
+            end = (numrays*(i+1))/numruns;
+        tasks.run([&cast, start, end]()
+        {
+            clipplanecache *cache = new clipplanecache(),
+                           *oldcache = rayclipcache;
+            rayclipcache = cache;
+            for(int j = start; j < end; ++j)
+            {
+                cast(j);
+            }
+            rayclipcache = oldcache;
+            delete cache;
+        });
+    }
+    tasks.wait();
+}
+
+/* raycubes: batched form of cubeworld::raycube()
+ *
+ * casts every ray from o[i] along ray[i] with the same radius, mode and size,
+ * writing the result of each to dists[i], and if surfaces is not null its hit
+ * surface normal to surfaces[i] (zero if the ray did not set one). The rays are
+ * spread across the worker pool; safe as long as the world is not modified
+ * while it runs. Ignores the entity to skip that raycube() can be given.
+ */
+void raycubes(int numrays, const vec *o, const vec *ray, float *dists, float radius, int mode, int size, vec *surfaces)
+{
+    if((mode&Ray_Poly) == Ray_Poly)
+    {
+        preloadraymodels();
+    }
+    castrays(numrays, [&](int i)
+    {
+        hitsurface = vec(0, 0, 0);
+        dists[i] = rootworld.raycube(o[i], ray[i], radius, mode, size);
+        if(surfaces)
+        {
+            surfaces[i] = hitsurface;
+        }
+    });
+}
+
+//batched form of cubeworld::shadowray(), see raycubes()
+void shadowrays(int numrays, const vec *o, const vec *ray, float *dists, float radius, int mode)
+{
+    preloadraymodels();
+    castrays(numrays, [&](int i)
+    {
+        dists[i] = rootworld.shadowray(o[i], ray[i], radius, mode);
+    });
+}
+
 float raycubepos(const vec &o, const vec &ray, vec &hitpos, float radius, int mode, int size)
 {
     hitpos = ray;
@@ -536,3 +673,48 @@ float rayfloor(const vec &o, vec &floor, int mode, float radius)
     floor = hitsurface;
     return dist;
 }
+
+/* raycubebench: casts numrays rays in all directions from the camera with
+ * raycubes() on 1, 2, 4 and 8 threads, reporting the throughput of each and
+ * whether the results match those of the single threaded run
+ */
+void raycubebench(int *numrays)
+{
+    int num = std::clamp(*numrays > 0 ? *numrays : 1<<20, 1, 1<<24);
+    std::vector<vec> origins(num, camera1->o),
+                     rays(num);
+    //spiral of directions evenly covering the sphere
+    for(int i = 0; i < num; ++i)
+    {
+        float z = 1 - (2*i + 1)/static_cast<float>(num),
+              r = std::sqrt(std::max(1 - z*z, 0.0f)),
+              angle = i*2.39996323f;
+        rays[i] = vec(r*std::cos(angle), r*std::sin(angle), z);
+    }
+    std::vector<float> reference(num),
+                       dists(num);
+    int oldthreads = workerthreads;
+    double basetime = 0;
+    for(int threads = 1; threads <= 8; threads *= 2)
+    {
+        setworkerthreads(threads);
+        std::vector<float> &out = threads == 1 ? reference : dists;
+        double start = getpreciseclockmillis();
+        raycubes(num, origins.data(), rays.data(), out.data(), 0, Ray_ClipMat|Ray_Poly);
+        double elapsed = getpreciseclockmillis() - start;
+        if(threads == 1)
+        {
+            basetime = elapsed;
+        }
+        int mismatches = 0;
+        for(int i = 0; i < num; ++i)
+        {
+            if(out[i] != reference[i])
+            {
+                mismatches++;
+            }
+        }
+        conoutf("raycubebench: %d threads: %.2f ms (%.2f Mrays/s, %.2fx), %d mismatches", threads, elapsed, elapsed > 0 ? num/(elapsed*1000) : 0, elapsed > 0 ? basetime/elapsed : 0, mismatches);
+    }
+    setworkerthreads(oldthreads);
+}
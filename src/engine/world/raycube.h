@@ -1,12 +1,16 @@
 #ifndef RAYCUBE_H_
 #define RAYCUBE_H_
 
-extern vec hitsurface;
+extern thread_local vec hitsurface;
 
 extern float raycubepos(const vec &o, const vec &ray, vec &hit, float radius = 0, int mode = Ray_ClipMat, int size = 0);
 extern float rayent(const vec &o, const vec &ray, float radius, int mode, int size, int &orient, int &ent);
 extern float rayfloor  (const vec &o, vec &floor, int mode = 0, float radius = 0);
 
+extern void raycubes(int numrays, const vec *o, const vec *ray, float *dists, float radius = 0, int mode = Ray_ClipMat, int size = 0, vec *surfaces = nullptr);
+extern void shadowrays(int numrays, const vec *o, const vec *ray, float *dists, float radius, int mode);
+extern void raycubebench(int *numrays);
+
 extern bool insideworld(const vec &o);
 extern bool insideworld(const ivec &o);
 
@@ -7,6 +7,7 @@
 #include "bih.h"
 #include "entities.h"
 #include "light.h"
+#include "octacompact.h"
 #include "octaedit.h"
 #include "octaworld.h"
 #include "raycube.h"
@@ -427,6 +428,7 @@ bool cubeworld::modifyoctaent(int flags, int id, extentity &e)
     {
         return false;
     }
+    clearcompactocta();
     ivec o, r;
     if(!getentboundingbox(e, o, r))
     {
@@ -663,7 +665,9 @@ bool cubeworld::emptymap(int scale, bool force, bool usecfg)    // main empty wo
     setvar("mapsize", 1<<worldscale, true, false);
     setvar("emptymap", 1, true, false);
     texmru.clear();
+    clearcompactocta();
     freeocta(worldroot);
+    trimcubepool();
     worldroot = newcubes(faceempty);
     for(int i = 0; i < 4; ++i)
     {
@@ -703,6 +707,7 @@ bool cubeworld::enlargemap(bool force)
     {
         return false;
     }
+    clearcompactocta();
     worldscale++;
     worldsize *= 2;
     cube *c = newcubes(faceempty);
@@ -762,6 +767,7 @@ void cubeworld::shrinkmap()
     {
         return;
     }
+    clearcompactocta();
     int octant = -1;
     for(int i = 0; i < 8; ++i)
     {
@@ -4,8 +4,17 @@
 #include "../../shared/geomexts.h"
 #include "../../shared/glexts.h"
 #include "../../shared/stream.h"
+#include "../../shared/threads.h"
+
+#include <filesystem>
+#include <thread>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
 
 #include "light.h"
+#include "octacompact.h"
 #include "octaedit.h"
 #include "octaworld.h"
 #include "raycube.h"
@@ -13,6 +22,7 @@
 #include "world.h"
 
 #include "interface/console.h"
+#include "interface/control.h"
 #include "interface/cs.h"
 #include "interface/menus.h"
 
@@ -133,15 +143,18 @@ bool cubeworld::loadmapheader(stream *f, const char *ogzname, mapheader &hdr, oc
     return true;
 }
 
-string ogzname, bakname, cfgname, picname;
+string ogzname, tmapname, bakname, cfgname, picname;
 
 VARP(savebak, 0, 2, 2);
+VARP(savemapraw, 0, 0, 1); //save maps uncompressed as .tmap files, which are memory mapped rather than inflated on load
+VARP(savemapasync, 0, 0, 1); //compress and write saved maps on a background thread
 
 void setmapfilenames(const char *fname, const char *cname = nullptr)
 {
     string name;
     validmapname(name, fname);
     formatstring(ogzname, "media/map/%s.ogz", name);
+    formatstring(tmapname, "media/map/%s.tmap", name);
     formatstring(picname, "media/map/%s.png", name);
     if(savebak==1)
     {
@@ -158,6 +171,7 @@ void setmapfilenames(const char *fname, const char *cname = nullptr)
     validmapname(name, cname ? cname : fname);
     formatstring(cfgname, "media/map/%s.cfg", name);
     path(ogzname);
+    path(tmapname);
     path(bakname);
     path(cfgname);
     path(picname);
@@ -190,6 +204,7 @@ enum
 };
 
 static int savemapprogress = 0;
+static std::vector<uint> *savesubtrees = nullptr; //when set, savec records the offset of each cube in the top two levels here
 
 void cubeworld::savec(cube *c, const ivec &o, int size, stream *f)
 {
@@ -200,6 +215,10 @@ void cubeworld::savec(cube *c, const ivec &o, int size, stream *f)
     for(int i = 0; i < 8; ++i) //loop through children (there's always eight in an octree)
     {
         ivec co(i, o, size);
+        if(savesubtrees && size >= worldsize>>2)
+        {
+            savesubtrees->push_back(f->tell());
+        }
         if(c[i].children) //recursively note existence of children & call this fxn again
         {
             f->putchar(OctaSave_Children);
@@ -375,9 +394,42 @@ void cubeworld::savec(cube *c, const ivec &o, int size, stream *f)
     }
 }
 
-cube *loadchildren(stream *f, const ivec &co, int size, bool &failed);
+/* mapreader: decodes map data straight from memory
+ *
+ * the octree makes up the bulk of a map and is read a byte or two at a time, so
+ * it is decoded from a buffer with inline accessors rather than through the
+ * stream interface
+ */
+struct mapreader
+{
+    const uchar *buf, *end;
+
+    mapreader(const uchar *buf, size_t len) : buf(buf), end(buf + len) {}
+
+    int getchar()
+    {
+        return buf < end ? *buf++ : -1;
+    }
+
+    size_t read(void *dst, size_t len)
+    {
+        len = std::min(len, static_cast<size_t>(end - buf));
+        std::memcpy(dst, buf, len);
+        buf += len;
+        return len;
+    }
 
-void loadc(stream *f, cube &c, const ivec &co, int size, bool &failed)
+    template<class T>
+    T get()
+    {
+        T n;
+        return read(&n, sizeof(n)) == sizeof(n) ? lilswap(n) : 0;
+    }
+};
+
+cube *loadchildren(mapreader &f, const ivec &co, int size, bool &failed);
+
+void loadc(mapreader &f, cube &c, const ivec &co, int size, bool &failed)
 {
     static constexpr uint layerdup (1<<7); //if numverts is larger than this, get additional precision
 
@@ -387,7 +439,7 @@ void loadc(stream *f, cube &c, const ivec &co, int size, bool &failed)
         uchar verts, numverts;
     };
 
-    int octsav = f->getchar();
+    int octsav = f.getchar();
     switch(octsav&0x7)
     {
         case OctaSave_Children:
@@ -406,7 +458,7 @@ void loadc(stream *f, cube &c, const ivec &co, int size, bool &failed)
         }
         case OctaSave_Normal:
         {
-            f->read(c.edges, 12);
+            f.read(c.edges, 12);
             break;
         }
         default:
@@ -417,21 +469,21 @@ void loadc(stream *f, cube &c, const ivec &co, int size, bool &failed)
     }
     for(int i = 0; i < 6; ++i)
     {
-        c.texture[i] = f->get<ushort>();
+        c.texture[i] = f.get<ushort>();
     }
     if(octsav&0x40)
     {
-        c.material = f->get<ushort>();
+        c.material = f.get<ushort>();
     }
     if(octsav&0x80)
     {
-        c.merged = f->getchar();
+        c.merged = f.getchar();
     }
     if(octsav&0x20)
     {
         int surfmask, totalverts;
-        surfmask = f->getchar();
-        totalverts = std::max(f->getchar(), 0);
+        surfmask = f.getchar();
+        totalverts = std::max(f.getchar(), 0);
         newcubeext(c, totalverts, false);
         std::memset(c.ext->surfaces, 0, sizeof(c.ext->surfaces));
         std::memset(c.ext->verts(), 0, totalverts*sizeof(vertinfo));
@@ -444,13 +496,13 @@ void loadc(stream *f, cube &c, const ivec &co, int size, bool &failed)
                 if(mapversion <= 0)
                 {
                     polysurfacecompat psurf;
-                    f->read(&psurf, sizeof(polysurfacecompat));
+                    f.read(&psurf, sizeof(polysurfacecompat));
                     surf.verts = psurf.verts;
                     surf.numverts = psurf.numverts;
                 }
                 else
                 {
-                    f->read(&surf, sizeof(surf));
+                    f.read(&surf, sizeof(surf));
                 }
                 int vertmask = surf.verts, numverts = surf.totalverts();
                 if(!numverts)
@@ -493,10 +545,10 @@ void loadc(stream *f, cube &c, const ivec &co, int size, bool &failed)
                 {
                     if(hasxyz && vertmask&0x01)
                     {
-                        ushort c1 = f->get<ushort>(),
-                               r1 = f->get<ushort>(),
-                               c2 = f->get<ushort>(),
-                               r2 = f->get<ushort>();
+                        ushort c1 = f.get<ushort>(),
+                               r1 = f.get<ushort>(),
+                               c2 = f.get<ushort>(),
+                               r2 = f.get<ushort>();
                         ivec xyz;
                         xyz[vc] = c1;
                         xyz[vr] = r1;
@@ -520,13 +572,13 @@ void loadc(stream *f, cube &c, const ivec &co, int size, bool &failed)
                     {
                         for(int k = 0; k < 4; ++k)
                         {
-                            f->get<ushort>();
+                            f.get<ushort>();
                         }
                         if(surf.numverts & layerdup)
                         {
                             for(int k = 0; k < 4; ++k)
                             {
-                                f->get<ushort>();
+                                f.get<ushort>();
                             }
                         }
                         hasuv = false;
@@ -534,7 +586,7 @@ void loadc(stream *f, cube &c, const ivec &co, int size, bool &failed)
                 }
                 if(hasnorm && vertmask&0x08)
                 {
-                    ushort norm = f->get<ushort>();
+                    ushort norm = f.get<ushort>();
                     for(int k = 0; k < layerverts; ++k)
                     {
                         verts[k].norm = norm;
@@ -549,18 +601,18 @@ void loadc(stream *f, cube &c, const ivec &co, int size, bool &failed)
                         if(hasxyz)
                         {
                             ivec xyz;
-                            xyz[vc] = f->get<ushort>(); xyz[vr] = f->get<ushort>();
+                            xyz[vc] = f.get<ushort>(); xyz[vr] = f.get<ushort>();
                             xyz[dim] = n[dim] ? -(bias + n[vc]*xyz[vc] + n[vr]*xyz[vr])/n[dim] : vo[dim];
                             v.setxyz(xyz);
                         }
                         if(hasuv)
                         {
-                            f->get<ushort>();
-                            f->get<ushort>();
+                            f.get<ushort>();
+                            f.get<ushort>();
                         }
                         if(hasnorm)
                         {
-                            v.norm = f->get<ushort>();
+                            v.norm = f.get<ushort>();
                         }
                     }
                 }
@@ -568,8 +620,8 @@ void loadc(stream *f, cube &c, const ivec &co, int size, bool &failed)
                 {
                     for(int k = 0; k < layerverts; ++k)
                     {
-                        f->get<ushort>();
-                        f->get<ushort>();
+                        f.get<ushort>();
+                        f.get<ushort>();
                     }
                 }
             }
@@ -577,7 +629,7 @@ void loadc(stream *f, cube &c, const ivec &co, int size, bool &failed)
     }
 }
 
-cube *loadchildren(stream *f, const ivec &co, int size, bool &failed)
+cube *loadchildren(mapreader &f, const ivec &co, int size, bool &failed)
 {
     cube *c = newcubes();
     for(int i = 0; i < 8; ++i)
@@ -591,6 +643,213 @@ cube *loadchildren(stream *f, const ivec &co, int size, bool &failed)
     return c;
 }
 
+/* mapdata: the uncompressed contents of a map file
+ *
+ * .tmap files are memory mapped and used in place; .ogz files are inflated into
+ * memory in large blocks up front
+ */
+struct mapdata
+{
+    mappedfile raw;
+    std::vector<uchar> inflated;
+    const uchar *buf = nullptr;
+    size_t len = 0;
+    uint crc = 0;
+};
+
+static size_t mapoctreeoffset = 0; //offset of the octree within the current map's uncompressed contents
+static std::vector<uint> mapsubtrees;  //subtree index of the current map
+
+static bool readogz(const char *filename, mapdata &m)
+{
+    static constexpr size_t blocksize = 1<<16;
+
+    stream *f = opengzfile(filename, "rb");
+    if(!f)
+    {
+        return false;
+    }
+    size_t len = 0;
+    for(;;)
+    {
+        m.inflated.resize(len + blocksize);
+        size_t n = f->read(&m.inflated[len], blocksize);
+        len += n;
+        if(n < blocksize)
+        {
+            break;
+        }
+    }
+    m.inflated.resize(len);
+    m.crc = f->getcrc();
+    delete f;
+    m.buf = m.inflated.data();
+    m.len = len;
+    return true;
+}
+
+static bool readtmap(const char *filename, mapdata &m)
+{
+    if(!m.raw.open(filename))
+    {
+        return false;
+    }
+    m.buf = m.raw.data();
+    m.len = m.raw.size();
+    //same checksum gzstream computes over the inflated contents of an .ogz
+    m.crc = crc32(crc32(0, nullptr, 0), m.buf, m.len);
+    return true;
+}
+
+//returns when a map file on disk was last written, or false if it is not on disk
+static bool mapfiletime(const char *filename, std::filesystem::file_time_type &time)
+{
+    const char *found = findfile(filename, "e");
+    if(!found)
+    {
+        return false;
+    }
+    std::error_code err;
+    time = std::filesystem::last_write_time(found, err);
+    return !err;
+}
+
+/* readmapdata: reads the current map, returning the name of the file read
+ *
+ * if both a .tmap and an .ogz of the map are on disk, the newer one is read, so
+ * changing savemapraw between saves never loads a stale copy; otherwise the
+ * format savemapraw prefers is tried first, falling back to the other
+ */
+static const char *readmapdata(mapdata &m)
+{
+    std::filesystem::file_time_type tmaptime, ogztime;
+    if(mapfiletime(tmapname, tmaptime) && mapfiletime(ogzname, ogztime))
+    {
+        bool raw = tmaptime > ogztime;
+        conoutf(Console_Warn, "both %s and %s exist, loading the newer %s", tmapname, ogzname, raw ? tmapname : ogzname);
+        if(raw ? readtmap(tmapname, m) : readogz(ogzname, m))
+        {
+            return raw ? tmapname : ogzname;
+        }
+    }
+    if(savemapraw)
+    {
+        if(readtmap(tmapname, m))
+        {
+            return tmapname;
+        }
+        return readogz(ogzname, m) ? ogzname : nullptr;
+    }
+    if(readogz(ogzname, m))
+    {
+        return ogzname;
+    }
+    return readtmap(tmapname, m) ? tmapname : nullptr;
+}
+
+/* subtree index
+ *
+ * maps store the offset (from the start of the octree) of every cube in the top
+ * two levels of the octree in the extras block of the header, which older
+ * loaders skip. Offsets are listed in save order: each of the eight root cubes,
+ * followed directly by its eight children if it has any
+ */
+static const char subtreemagic[4] = {'S', 'U', 'B', 'T'};
+
+static void readsubtreeindex(const char *buf, int len, std::vector<uint> &offsets)
+{
+    if(len < 8 || std::memcmp(buf, subtreemagic, 4))
+    {
+        return;
+    }
+    uint num;
+    std::memcpy(&num, &buf[4], sizeof(num));
+    num = lilswap(num);
+    if(num > static_cast<uint>(len - 8)/sizeof(uint))
+    {
+        return;
+    }
+    offsets.resize(num);
+    std::memcpy(offsets.data(), &buf[8], num*sizeof(uint));
+    for(uint &offset : offsets)
+    {
+        offset = lilswap(offset);
+    }
+}
+
+//checks that the index describes exactly the top two levels of the octree in buf
+static bool validsubtreeindex(const uchar *buf, size_t len, const std::vector<uint> &offsets)
+{
+    size_t next = 0;
+    for(int i = 0; i < 8; ++i)
+    {
+        if(next >= offsets.size() || offsets[next] >= len)
+        {
+            return false;
+        }
+        if(buf[offsets[next++]] == OctaSave_Children)
+        {
+            for(int j = 0; j < 8; ++j, ++next)
+            {
+                if(next >= offsets.size() || offsets[next] >= len)
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    return next == offsets.size();
+}
+
+/* loadsubtrees: decodes an octree using its subtree index
+ *
+ * the children of each root cube are decoded as separate tasks on the worker
+ * pool, each starting at its own offset; root cubes without children are
+ * decoded on the calling thread
+ */
+static cube *loadsubtrees(const uchar *buf, size_t len, const std::vector<uint> &offsets, int size, bool &failed)
+{
+    cube *root = newcubes();
+    std::vector<uchar> subtreefailed(offsets.size(), 0);
+    size_t next = 0;
+    taskgroup tasks;
+    for(int i = 0; i < 8; ++i)
+    {
+        ivec o(i, ivec(0, 0, 0), size);
+        uint offset = offsets[next++];
+        if(buf[offset] != OctaSave_Children)
+        {
+            mapreader f(buf + offset, len - offset);
+            loadc(f, root[i], o, size, failed);
+            continue;
+        }
+        root[i].children = newcubes();
+        for(int j = 0; j < 8; ++j, ++next)
+        {
+            cube &c = root[i].children[j];
+            uchar &cfailed = subtreefailed[next];
+            uint coffset = offsets[next];
+            ivec co(j, o, size>>1);
+            tasks.run([buf, len, coffset, &c, co, size, &cfailed]()
+            {
+                mapreader f(buf + coffset, len - coffset);
+                bool subfailed = false;
+                loadc(f, c, co, size>>1, subfailed);
+                cfailed = subfailed;
+            });
+        }
+    }
+    tasks.wait();
+    for(uchar subfailed : subtreefailed)
+    {
+        if(subfailed)
+        {
+            failed = true;
+        }
+    }
+    return root;
+}
+
 VAR(debugvars, 0, 0, 1);
 
 void savevslot(stream *f, VSlot &vs, int prev)
@@ -829,21 +1088,101 @@ void loadvslots(stream *f, int numvslots)
     delete[] prev;
 }
 
+/* background map saving
+ *
+ * with savemapasync set, save_world only serializes the map into memory, which
+ * snapshots the octree, vslots and entities as they are at the time of the
+ * save; compression and disk writes then happen on a background thread, whose
+ * result is reported by checkmapsave()
+ *
+ * the background thread only ever touches the snapshot and the already opened
+ * file stream, and compresses serially so as not to compete with the frame for
+ * the worker pool
+ */
+enum
+{
+    MapSave_Idle = 0,
+    MapSave_Writing,
+    MapSave_Done,
+    MapSave_Failed
+};
+
+static std::thread mapsavethread;
+static std::atomic<int> mapsavestate(MapSave_Idle);
+static double mapsavetime = 0;
+static string mapsavename = "";
+
+static struct mapsavecleanup
+{
+    ~mapsavecleanup()
+    {
+        if(mapsavethread.joinable())
+        {
+            mapsavethread.join();
+        }
+    }
+} savecleanup;
+
+//writes the serialized map to f and closes it
+static bool writemapdata(stream *f, const std::vector<uchar> &mapbuf, const std::vector<uchar> &octree)
+{
+    bool written = f->write(mapbuf.data(), mapbuf.size()) == mapbuf.size() &&
+                   f->write(octree.data(), octree.size()) == octree.size();
+    delete f;
+    return written;
+}
+
+/* checkmapsave: reports the result of a finished background save
+ *
+ * returns true while a save is still being written; if wait is set, first
+ * blocks until any save in progress has finished. Meant to be polled once a
+ * frame, and called before anything touches the map files
+ */
+bool checkmapsave(bool wait)
+{
+    if(!mapsavethread.joinable())
+    {
+        return false;
+    }
+    if(!wait && mapsavestate.load(std::memory_order_acquire) == MapSave_Writing)
+    {
+        return true;
+    }
+    mapsavethread.join();
+    if(mapsavestate == MapSave_Done)
+    {
+        conoutf("wrote map file %s (%.1f seconds in background)", mapsavename, mapsavetime/1000);
+    }
+    else
+    {
+        conoutf(Console_Warn, "could not write map to %s", mapsavename);
+    }
+    mapsavestate = MapSave_Idle;
+    return false;
+}
+
+static void mapsaving()
+{
+    intret(checkmapsave() ? 1 : 0);
+}
+
 bool cubeworld::save_world(const char *mname, const char *gameident)
 {
+    checkmapsave(true);
     if(!*mname)
     {
         mname = clientmap;
     }
     setmapfilenames(*mname ? mname : "untitled");
+    const char *mapfile = savemapraw ? tmapname : ogzname;
     if(savebak)
     {
-        backup(ogzname, bakname);
+        backup(mapfile, bakname);
     }
-    stream *f = opengzfile(ogzname, "wb");
-    if(!f)
+    stream *file = savemapraw ? openrawfile(mapfile, "wb") : (savemapasync ? opengzfile(mapfile, "wb") : openparallelgzfile(mapfile));
+    if(!file)
     {
-        conoutf(Console_Warn, "could not write map to %s", ogzname);
+        conoutf(Console_Warn, "could not write map to %s", mapfile);
         return false;
     }
     int numvslots = vslots.length();
@@ -854,7 +1193,19 @@ bool cubeworld::save_world(const char *mname, const char *gameident)
     }
 
     savemapprogress = 0;
+    renderprogress(0, "saving octree...");
+    //the octree is serialized first, so the subtree index can be written ahead of it
+    std::vector<uchar> octree;
+    std::vector<uint> subtrees;
+    stream *octreef = openvecfile(octree);
+    savesubtrees = &subtrees;
+    savec(worldroot, ivec(0, 0, 0), worldsize>>1, octreef);
+    savesubtrees = nullptr;
+    delete octreef;
+    mapsubtrees = subtrees;
     renderprogress(0, "saving map...");
+    std::vector<uchar> mapbuf;
+    stream *f = openvecfile(mapbuf);
 
     mapheader hdr;
     std::memcpy(hdr.magic, "TMAP", 4);
@@ -930,11 +1281,15 @@ bool cubeworld::save_world(const char *mname, const char *gameident)
     }
     f->putchar(static_cast<int>(std::strlen(gameident)));
     f->write(gameident, static_cast<int>(std::strlen(gameident)+1));
-    //=== padding for compatibility (extent properties no longer a feature)
-    f->put<ushort>(0);
-    f->put<ushort>(0);
-    f->write(0, 0);
-    //=== end of padding
+    f->put<ushort>(0); //no extra entity info
+    //extras: the subtree index
+    f->put<ushort>(8 + subtrees.size()*sizeof(uint));
+    f->write(subtreemagic, 4);
+    f->put<uint>(subtrees.size());
+    for(uint offset : subtrees)
+    {
+        f->put<uint>(offset);
+    }
     f->put<ushort>(texmru.size());
     for(uint i = 0; i < texmru.size(); i++)
     {
@@ -949,10 +1304,28 @@ bool cubeworld::save_world(const char *mname, const char *gameident)
         }
     }
     savevslots(f, numvslots);
-    renderprogress(0, "saving octree...");
-    savec(worldroot, ivec(0, 0, 0), worldsize>>1, f);
+    mapoctreeoffset = f->tell();
     delete f;
-    conoutf("wrote map file %s", ogzname);
+    if(savemapasync)
+    {
+        copystring(mapsavename, mapfile);
+        mapsavestate = MapSave_Writing;
+        mapsavethread = std::thread([file, mapbuf = std::move(mapbuf), octree = std::move(octree)]()
+        {
+            double start = getpreciseclockmillis();
+            bool written = writemapdata(file, mapbuf, octree);
+            mapsavetime = getpreciseclockmillis() - start;
+            mapsavestate.store(written ? MapSave_Done : MapSave_Failed, std::memory_order_release);
+        });
+        conoutf("saving map file %s in the background", mapfile);
+        return true;
+    }
+    if(!writemapdata(file, mapbuf, octree))
+    {
+        conoutf(Console_Warn, "could not write map to %s", mapfile);
+        return false;
+    }
+    conoutf("wrote map file %s", mapfile);
     return true;
 }
 
@@ -969,17 +1342,20 @@ void cubeworld::clearmapcrc()
 bool cubeworld::load_world(const char *mname, const char *gameident, const char *gameinfo, const char *cname)
 {
     int loadingstart = SDL_GetTicks();
+    checkmapsave(true);
     setmapfilenames(mname, cname);
-    stream *f = opengzfile(ogzname, "rb");
-    if(!f)
+    mapdata data;
+    const char *mapfile = readmapdata(data);
+    if(!mapfile)
     {
         conoutf(Console_Error, "could not read map %s", ogzname);
         return false;
     }
+    stream *f = openmemfile(data.buf, data.len);
     mapheader hdr;
     octaheader ohdr;
     std::memset(&ohdr, 0, sizeof(ohdr));
-    if(!loadmapheader(f, ogzname, hdr, ohdr))
+    if(!loadmapheader(f, mapfile, hdr, ohdr))
     {
         delete f;
         return false;
@@ -989,8 +1365,10 @@ bool cubeworld::load_world(const char *mname, const char *gameident, const char
     renderbackground("loading...", mapshot, mname, gameinfo);
     setvar("mapversion", hdr.version, true, false);
     renderprogress(0, "clearing world...");
+    clearcompactocta();
     freeocta(worldroot);
     worldroot = nullptr;
+    trimcubepool();
     int worldscale = 0;
     while(1<<worldscale < hdr.worldsize)
     {
@@ -1105,6 +1483,8 @@ bool cubeworld::load_world(const char *mname, const char *gameident, const char
         extrasize = f->get<ushort>();
     vector<char> extras;
     f->read(extras.pad(extrasize), extrasize);
+    std::vector<uint> subtrees;
+    readsubtreeindex(extras.getbuf(), extras.length(), subtrees);
     texmru.clear();
     ushort nummru = f->get<ushort>();
     for(int i = 0; i < nummru; ++i)
@@ -1149,7 +1529,20 @@ bool cubeworld::load_world(const char *mname, const char *gameident, const char
     loadvslots(f, hdr.numvslots);
     renderprogress(0, "loading octree...");
     bool failed = false;
-    worldroot = loadchildren(f, ivec(0, 0, 0), hdr.worldsize>>1, failed);
+    mapoctreeoffset = f->tell();
+    delete f;
+    const uchar *octreebuf = data.buf + mapoctreeoffset;
+    size_t octreelen = data.len - mapoctreeoffset;
+    mapsubtrees = subtrees;
+    if(validsubtreeindex(octreebuf, octreelen, subtrees))
+    {
+        worldroot = loadsubtrees(octreebuf, octreelen, subtrees, hdr.worldsize>>1, failed);
+    }
+    else
+    {
+        mapreader octree(octreebuf, octreelen);
+        worldroot = loadchildren(octree, ivec(0, 0, 0), hdr.worldsize>>1, failed);
+    }
     if(failed)
     {
         conoutf(Console_Error, "garbage in map");
@@ -1157,9 +1550,8 @@ bool cubeworld::load_world(const char *mname, const char *gameident, const char
     renderprogress(0, "validating...");
     validatec(worldroot, hdr.worldsize>>1);
 
-    mapcrc = f->getcrc();
-    delete f;
-    conoutf("read map %s (%.1f seconds)", ogzname, (SDL_GetTicks()-loadingstart)/1000.0f);
+    mapcrc = data.crc;
+    conoutf("read map %s (%.1f seconds)", mapfile, (SDL_GetTicks()-loadingstart)/1000.0f);
     clearmainmenu();
 
     identflags |= Idf_Overridden;
@@ -1175,7 +1567,94 @@ bool cubeworld::load_world(const char *mname, const char *gameident, const char
     return true;
 }
 
+//resident set size of the process in MB, or 0 where it cannot be read
+static double residentmb()
+{
+#ifdef __linux__
+    FILE *f = std::fopen("/proc/self/statm", "r");
+    if(!f)
+    {
+        return 0;
+    }
+    long size = 0,
+         resident = 0;
+    int read = std::fscanf(f, "%ld %ld", &size, &resident);
+    std::fclose(f);
+    return read == 2 ? resident*(sysconf(_SC_PAGESIZE)/(1024.0*1024.0)) : 0;
+#else
+    return 0;
+#endif
+}
+
+/* loadmapbench: times reading and decoding the current map's octree from each
+ * map format present on disk
+ *
+ * both files are expected to hold the current map, as written by savemap with
+ * savemapraw set to 0 and to 1; the octree is decoded into both heap allocated
+ * and pooled cubes, timing the decode and teardown and the growth in resident
+ * memory for each
+ */
+void loadmapbench()
+{
+    if(!mapoctreeoffset)
+    {
+        conoutf(Console_Error, "loadmapbench: no map loaded");
+        return;
+    }
+    for(int raw = 0; raw < 2; ++raw)
+    {
+        const char *filename = raw ? tmapname : ogzname;
+        mapdata data;
+        double start = getpreciseclockmillis();
+        if(!(raw ? readtmap(filename, data) : readogz(filename, data)))
+        {
+            conoutf("loadmapbench: could not read %s", filename);
+            continue;
+        }
+        double readtime = getpreciseclockmillis() - start;
+        if(data.len < mapoctreeoffset)
+        {
+            conoutf(Console_Error, "loadmapbench: %s does not match the current map", filename);
+            continue;
+        }
+        const uchar *octreebuf = data.buf + mapoctreeoffset;
+        size_t octreelen = data.len - mapoctreeoffset;
+        conoutf("loadmapbench: %s: %.2f ms read, %.2f MB", filename, readtime, data.len/(1024.0f*1024.0f));
+        bool failed = false;
+        double decodetime = 0;
+        //the copy decoded here is freed before the pool is switched back, so the world's cubes are unaffected
+        for(int pooled = 0; pooled < 2; ++pooled)
+        {
+            setcubepool(pooled);
+            mapreader octree(octreebuf, octreelen);
+            double rss = residentmb();
+            start = getpreciseclockmillis();
+            cube *root = loadchildren(octree, ivec(0, 0, 0), worldsize>>1, failed);
+            decodetime = getpreciseclockmillis() - start;
+            double loadedrss = residentmb();
+            start = getpreciseclockmillis();
+            freeocta(root);
+            double teardowntime = getpreciseclockmillis() - start;
+            setcubepool(true);
+            conoutf("loadmapbench: %s: %.2f ms octree (%s), %.2f ms teardown, %+.2f MB resident%s", filename, decodetime, pooled ? "pooled" : "heap", teardowntime, loadedrss - rss, failed ? " (garbage in map)" : "");
+        }
+        trimcubepool();
+        if(!validsubtreeindex(octreebuf, octreelen, mapsubtrees))
+        {
+            conoutf("loadmapbench: %s has no subtree index", filename);
+            continue;
+        }
+        start = getpreciseclockmillis();
+        cube *root = loadsubtrees(octreebuf, octreelen, mapsubtrees, worldsize>>1, failed);
+        double subtreetime = getpreciseclockmillis() - start;
+        freeocta(root);
+        conoutf("loadmapbench: %s: %.2f ms octree from subtree index (%d threads, %.2fx)", filename, subtreetime, numworkerthreads(), subtreetime > 0 ? decodetime/subtreetime : 0);
+    }
+}
+
 void initworldiocmds()
 {
     addcommand("mapcfgname", reinterpret_cast<identfun>(mapcfgname), "", Id_Command);
+    addcommand("loadmapbench", reinterpret_cast<identfun>(loadmapbench), "", Id_Command);
+    addcommand("mapsaving", reinterpret_cast<identfun>(mapsaving), "", Id_Command);
 }
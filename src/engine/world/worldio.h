@@ -3,5 +3,6 @@
 
 extern uint getmapcrc();
 extern void clearmapcrc();
+extern bool checkmapsave(bool wait = false);
 
 #endif
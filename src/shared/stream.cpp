@@ -7,6 +7,7 @@
  */
 #include "../libprimis-headers/cube.h"
 #include "stream.h"
+#include "threads.h"
 
 #include "../engine/interface/console.h"
 
@@ -400,6 +401,8 @@ done:
 #include <shlobj.h>
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <dirent.h>
@@ -662,7 +665,7 @@ const char *addpackagedir(const char *dir)
 
 const char *findfile(const char *filename, const char *mode)
 {
-    static string s;
+    static thread_local string s; //textures are looked up from the worker pool
     if(homedir[0])
     {
         formatstring(s, "%s%s", homedir, filename);
@@ -1526,6 +1529,222 @@ struct gzstream : stream
     }
 };
 
+/* pgzstream: write-only gzip stream which deflates blocks in parallel
+ *
+ * input is split into fixed size blocks which are compressed on the worker
+ * pool, each primed with the tail of the previous block as its dictionary;
+ * every block but the last ends on a sync flush, so the blocks concatenate into
+ * a single standard deflate stream which gzstream can read back
+ */
+struct pgzstream : stream
+{
+    static constexpr size_t blocksize = 128*1024,
+                            dictsize  = 32*1024; //deflate's maximum window
+
+    struct block
+    {
+        std::vector<uchar> in, out;
+        uint crc;
+    };
+
+    stream *file;
+    bool writing, autoclose;
+    int level;
+    uint crc;
+    offset total;
+    std::vector<block> blocks; //full blocks waiting to be compressed, followed by the one being filled
+    std::vector<uchar> dict;   //tail of the last block written out
+
+    pgzstream() : file(nullptr), writing(false), autoclose(false), level(Z_BEST_COMPRESSION), crc(0), total(0) {}
+
+    ~pgzstream()
+    {
+        close();
+    }
+
+    void newblock()
+    {
+        blocks.emplace_back();
+        blocks.back().in.reserve(blocksize);
+    }
+
+    bool open(stream *f, bool needclose, int complevel)
+    {
+        if(file)
+        {
+            return false;
+        }
+        file = f;
+        autoclose = needclose;
+        level = complevel;
+        writing = true;
+        crc = crc32(0, nullptr, 0);
+        uchar header[] = { gzstream::MAGIC1, gzstream::MAGIC2, Z_DEFLATED, 0, 0, 0, 0, 0, 0, gzstream::OS_UNIX };
+        file->write(header, sizeof(header));
+        newblock();
+        return true;
+    }
+
+    static bool compressblock(block &b, const uchar *dictbuf, size_t dictlen, int level, bool last)
+    {
+        z_stream zfile;
+        zfile.zalloc = nullptr;
+        zfile.zfree = nullptr;
+        zfile.opaque = nullptr;
+        if(deflateInit2(&zfile, level, Z_DEFLATED, -MAX_WBITS, std::min(MAX_MEM_LEVEL, 8), Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            return false;
+        }
+        if(dictlen)
+        {
+            deflateSetDictionary(&zfile, dictbuf, dictlen);
+        }
+        b.out.resize(deflateBound(&zfile, b.in.size()) + 16);
+        zfile.next_in = b.in.data();
+        zfile.avail_in = b.in.size();
+        size_t used = 0;
+        bool ok = false;
+        for(;;)
+        {
+            zfile.next_out = &b.out[used];
+            zfile.avail_out = b.out.size() - used;
+            int err = deflate(&zfile, last ? Z_FINISH : Z_SYNC_FLUSH);
+            used = b.out.size() - zfile.avail_out;
+            if(err == Z_STREAM_END || (err == Z_OK && !last && zfile.avail_out > 0))
+            {
+                ok = true;
+                break;
+            }
+            if(err != Z_OK && err != Z_BUF_ERROR)
+            {
+                break;
+            }
+            b.out.resize(2*b.out.size());
+        }
+        deflateEnd(&zfile);
+        b.out.resize(used);
+        b.crc = crc32(crc32(0, nullptr, 0), b.in.data(), b.in.size());
+        return ok;
+    }
+
+    //compresses the queued blocks on the worker pool and writes them out in order; the block being filled is included only if it is the last
+    bool flushblocks(bool last)
+    {
+        size_t num = last ? blocks.size() : blocks.size() - 1;
+        std::vector<uchar> failed(num, 0);
+        {
+            taskgroup tasks;
+            for(size_t i = 0; i < num; ++i)
+            {
+                const uchar *dictbuf = dict.data();
+                size_t dictlen = dict.size();
+                if(i > 0)
+                {
+                    dictlen = std::min(blocks[i-1].in.size(), dictsize);
+                    dictbuf = blocks[i-1].in.data() + blocks[i-1].in.size() - dictlen;
+                }
+                block &b = blocks[i];
+                uchar &bfailed = failed[i];
+                bool finish = last && i == num-1;
+                int complevel = level;
+                tasks.run([&b, dictbuf, dictlen, complevel, finish, &bfailed]()
+                {
+                    bfailed = !compressblock(b, dictbuf, dictlen, complevel, finish);
+                });
+            }
+            tasks.wait();
+        }
+        for(size_t i = 0; i < num; ++i)
+        {
+            const block &b = blocks[i];
+            if(failed[i] || file->write(b.out.data(), b.out.size()) != b.out.size())
+            {
+                writing = false;
+                return false;
+            }
+            crc = crc32_combine(crc, b.crc, b.in.size());
+        }
+        if(num > 0)
+        {
+            const std::vector<uchar> &tail = blocks[num-1].in;
+            size_t dictlen = std::min(tail.size(), dictsize);
+            dict.assign(tail.end() - dictlen, tail.end());
+            blocks.erase(blocks.begin(), blocks.begin() + num);
+        }
+        return true;
+    }
+
+    void finishwriting()
+    {
+        if(!writing || !flushblocks(true))
+        {
+            return;
+        }
+        uchar trailer[8] =
+        {
+            static_cast<uchar>(crc&0xFF), static_cast<uchar>((crc>>8)&0xFF), static_cast<uchar>((crc>>16)&0xFF), static_cast<uchar>((crc>>24)&0xFF),
+            static_cast<uchar>(total&0xFF), static_cast<uchar>((total>>8)&0xFF), static_cast<uchar>((total>>16)&0xFF), static_cast<uchar>((total>>24)&0xFF)
+        };
+        file->write(trailer, sizeof(trailer));
+    }
+
+    void close()
+    {
+        finishwriting();
+        writing = false;
+        blocks.clear();
+        if(autoclose && file)
+        {
+            delete file;
+        }
+        file = nullptr;
+    }
+
+    bool end()
+    {
+        return !writing;
+    }
+
+    offset tell()
+    {
+        return writing ? total : offset(-1);
+    }
+
+    uint getcrc()
+    {
+        return crc;
+    }
+
+    size_t write(const void *buf, size_t len)
+    {
+        if(!writing || !buf || !len)
+        {
+            return 0;
+        }
+        const uchar *src = static_cast<const uchar *>(buf);
+        size_t remaining = len;
+        while(remaining > 0)
+        {
+            std::vector<uchar> &in = blocks.back().in;
+            size_t n = std::min(remaining, blocksize - in.size());
+            in.insert(in.end(), src, src + n);
+            src += n;
+            remaining -= n;
+            total += n;
+            if(in.size() >= blocksize)
+            {
+                newblock();
+                //keep enough blocks queued to give every thread a couple
+                if(static_cast<int>(blocks.size()) > 2*numworkerthreads() && !flushblocks(false))
+                {
+                    break;
+                }
+            }
+        }
+        return len - remaining;
+    }
+};
+
 struct utf8stream : stream
 {
     enum Size
@@ -1810,6 +2029,211 @@ struct utf8stream : stream
     }
 };
 
+//read-only stream over a block of memory owned by the caller
+struct memstream : stream
+{
+    const uchar *buf;
+    size_t len, pos;
+
+    memstream(const void *buf, size_t len) : buf(static_cast<const uchar *>(buf)), len(len), pos(0) {}
+
+    void close()
+    {
+    }
+
+    bool end()
+    {
+        return pos >= len;
+    }
+
+    offset tell()
+    {
+        return pos;
+    }
+
+    offset size()
+    {
+        return len;
+    }
+
+    bool seek(offset off, int whence)
+    {
+        offset newpos = whence == SEEK_END ? len + off : (whence == SEEK_CUR ? pos + off : off);
+        if(newpos < 0 || newpos > static_cast<offset>(len))
+        {
+            return false;
+        }
+        pos = newpos;
+        return true;
+    }
+
+    size_t read(void *dst, size_t n)
+    {
+        n = std::min(n, len - pos);
+        std::memcpy(dst, &buf[pos], n);
+        pos += n;
+        return n;
+    }
+
+    int getchar()
+    {
+        return pos < len ? buf[pos++] : -1;
+    }
+};
+
+//write-only stream appending to a vector owned by the caller
+struct vecstream : stream
+{
+    std::vector<uchar> &buf;
+
+    vecstream(std::vector<uchar> &buf) : buf(buf) {}
+
+    void close()
+    {
+    }
+
+    bool end()
+    {
+        return true;
+    }
+
+    offset tell()
+    {
+        return buf.size();
+    }
+
+    offset size()
+    {
+        return buf.size();
+    }
+
+    size_t write(const void *src, size_t n)
+    {
+        const uchar *bytes = static_cast<const uchar *>(src);
+        buf.insert(buf.end(), bytes, bytes + n);
+        return n;
+    }
+
+    bool putchar(int c)
+    {
+        buf.push_back(c);
+        return true;
+    }
+};
+
+mappedfile::mappedfile() : buf(nullptr), len(0), mapped(false), zipview(false)
+{
+}
+
+mappedfile::~mappedfile()
+{
+    close();
+}
+
+/* open: maps the file with the given name
+ *
+ * files are looked up the same way as openfile(): zip packages take precedence
+ * over the filesystem
+ */
+bool mappedfile::open(const char *filename)
+{
+    close();
+    bool inzip = findzipfile(filename);
+    if(inzip)
+    {
+        size_t size = 0;
+        const uchar *view = openzipview(filename, size);
+        if(view)
+        {
+            buf = view;
+            len = size;
+            zipview = true;
+            return true;
+        }
+    }
+    const char *found = inzip ? nullptr : findfile(filename, "rb");
+    if(found)
+    {
+#ifdef WIN32
+        HANDLE file = CreateFileA(found, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(file != INVALID_HANDLE_VALUE)
+        {
+            LARGE_INTEGER filesize;
+            if(GetFileSizeEx(file, &filesize) && filesize.QuadPart > 0)
+            {
+                HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if(mapping)
+                {
+                    //the view keeps the mapping alive once its handle is closed
+                    void *addr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                    if(addr)
+                    {
+                        buf = static_cast<const uchar *>(addr);
+                        len = filesize.QuadPart;
+                        mapped = true;
+                    }
+                    CloseHandle(mapping);
+                }
+            }
+            CloseHandle(file);
+        }
+#else
+        int fd = ::open(found, O_RDONLY);
+        if(fd >= 0)
+        {
+            struct stat st;
+            if(fstat(fd, &st) >= 0 && st.st_size > 0)
+            {
+                void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(addr != MAP_FAILED)
+                {
+                    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+                    buf = static_cast<const uchar *>(addr);
+                    len = st.st_size;
+                    mapped = true;
+                }
+            }
+            ::close(fd);
+        }
+#endif
+    }
+    if(!mapped)
+    {
+        size_t size = 0;
+        char *contents = loadfile(filename, &size, false);
+        if(!contents)
+        {
+            return false;
+        }
+        buf = reinterpret_cast<const uchar *>(contents);
+        len = size;
+    }
+    return true;
+}
+
+void mappedfile::close()
+{
+    if(zipview)
+    {
+        closezipview(buf);
+    }
+    else if(mapped)
+    {
+#ifdef WIN32
+        UnmapViewOfFile(buf);
+#else
+        munmap(const_cast<uchar *>(buf), len);
+#endif
+    }
+    else
+    {
+        delete[] reinterpret_cast<const char *>(buf);
+    }
+    buf = nullptr;
+    len = 0;
+    mapped = zipview = false;
+}
+
 stream *openrawfile(const char *filename, const char *mode)
 {
     const char *found = findfile(filename, mode);
@@ -1848,6 +2272,16 @@ stream *opentempfile(const char *name, const char *mode)
     return file;
 }
 
+stream *openmemfile(const void *buf, size_t len)
+{
+    return new memstream(buf, len);
+}
+
+stream *openvecfile(std::vector<uchar> &buf)
+{
+    return new vecstream(buf);
+}
+
 stream *opengzfile(const char *filename, const char *mode, stream *file, int level)
 {
     stream *source = file ? file : openfile(filename, mode);
@@ -1868,6 +2302,22 @@ stream *opengzfile(const char *filename, const char *mode, stream *file, int lev
     return gz;
 }
 
+/* openparallelgzfile: opens a gzip file for writing, compressed on the worker pool
+ *
+ * getcrc() is only complete once the stream is closed
+ */
+stream *openparallelgzfile(const char *filename, stream *file, int level)
+{
+    stream *source = file ? file : openfile(filename, "wb");
+    if(!source)
+    {
+        return nullptr;
+    }
+    pgzstream *gz = new pgzstream;
+    gz->open(source, !file, level);
+    return gz;
+}
+
 stream *openutf8file(const char *filename, const char *mode, stream *file)
 {
     stream *source = file ? file : openfile(filename, mode);
@@ -27,6 +27,34 @@ enum
     CubeType_Unicode = 1 << 6
 };
 
+/* mappedfile: a read-only view of the entire contents of a file
+ *
+ * files on disk are memory mapped, so their contents are paged in as they are
+ * read rather than copied up front; files stored uncompressed in zip packages
+ * are viewed in place in the archive's mapping; any other files are read into
+ * memory instead
+ */
+class mappedfile
+{
+    public:
+        mappedfile();
+        ~mappedfile();
+
+        bool open(const char *filename);
+        void close();
+        const uchar *data() const { return buf; }
+        size_t size() const { return len; }
+        bool ismapped() const { return mapped || zipview; }
+
+        mappedfile(const mappedfile &) = delete;
+        mappedfile &operator=(const mappedfile &) = delete;
+
+    private:
+        const uchar *buf;
+        size_t len;
+        bool mapped, zipview;
+};
+
 extern const uchar cubectype[256];
 inline int iscubeprint(uchar c) { return cubectype[c] & CubeType_Print; }
 inline int iscubespace(uchar c) { return cubectype[c] & CubeType_Space; }
@@ -64,7 +92,12 @@ extern bool listdir(const char *dir, bool rel, const char *ext, vector<char *> &
 extern int listfiles(const char *dir, const char *ext, vector<char *> &files);
 extern int listzipfiles(const char *dir, const char *ext, vector<char *> &files);
 extern stream *opentempfile(const char *filename, const char *mode);
+extern stream *openmemfile(const void *buf, size_t len);
+extern stream *openvecfile(std::vector<uchar> &buf);
+extern stream *openparallelgzfile(const char *filename, stream *file = nullptr, int level = Z_BEST_COMPRESSION);
 extern bool findzipfile(const char *filename);
+extern const uchar *openzipview(const char *name, size_t &size);
+extern void closezipview(const uchar *view);
 extern const char *addpackagedir(const char *dir);
 extern const char *parentdir(const char *directory);
 extern bool fileexists(const char *path, const char *mode);
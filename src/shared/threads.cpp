@@ -0,0 +1,247 @@
+// worker pool used to spread engine work across multiple cores
+
+#include "../libprimis-headers/cube.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "threads.h"
+
+namespace
+{
+    struct queuedtask
+    {
+        std::function<void()> fun;
+        std::atomic<int> *pending;
+    };
+
+    //everything below is guarded by taskmutex
+    std::vector<std::thread> workers;
+    std::deque<queuedtask> tasks;
+    std::mutex taskmutex;
+    std::condition_variable taskcond, //workers: a task was queued or the pool is stopping
+                            waitcond; //waiters: a task was queued or a group finished
+    int numwaiting = 0;
+    bool stopworkers = false,
+         workersstarted = false;
+
+    thread_local bool intask = false;
+
+    //runs fun with intask set, restoring it afterwards since tasks may nest
+    void runtask(const std::function<void()> &fun)
+    {
+        bool wasintask = intask;
+        intask = true;
+        fun();
+        intask = wasintask;
+    }
+
+    void runqueued(queuedtask &task)
+    {
+        runtask(task.fun);
+        //the group may be destroyed as soon as pending reaches zero, so don't touch it afterwards
+        if(task.pending->fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            std::lock_guard<std::mutex> lock(taskmutex);
+            if(numwaiting)
+            {
+                waitcond.notify_all();
+            }
+        }
+    }
+
+    //pops and runs one task from the queue, returns false if there was none to run
+    bool runonetask()
+    {
+        queuedtask task;
+        {
+            std::lock_guard<std::mutex> lock(taskmutex);
+            if(tasks.empty())
+            {
+                return false;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        runqueued(task);
+        return true;
+    }
+
+    void workerloop()
+    {
+        for(;;)
+        {
+            queuedtask task;
+            {
+                std::unique_lock<std::mutex> lock(taskmutex);
+                taskcond.wait(lock, [](){return stopworkers || !tasks.empty();});
+                if(tasks.empty())
+                {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            runqueued(task);
+        }
+    }
+
+    void stopthreads()
+    {
+        std::vector<std::thread> stopping;
+        {
+            std::lock_guard<std::mutex> lock(taskmutex);
+            stopworkers = true;
+            stopping.swap(workers);
+        }
+        taskcond.notify_all();
+        //workers need the mutex to see stopworkers, so join them without holding it
+        for(std::thread &t : stopping)
+        {
+            t.join();
+        }
+        std::lock_guard<std::mutex> lock(taskmutex);
+        stopworkers = false;
+        workersstarted = false;
+    }
+
+    //the calling thread counts as one of the pool's threads, so only n-1 workers are spawned
+    //must be called with taskmutex held
+    void startthreads()
+    {
+        int numthreads = numworkerthreads();
+        for(int i = 1; i < numthreads; ++i)
+        {
+            workers.emplace_back(workerloop);
+        }
+        workersstarted = true;
+    }
+
+    struct workerpoolcleanup
+    {
+        ~workerpoolcleanup()
+        {
+            stopthreads();
+        }
+    } cleanup;
+}
+
+VARF(workerthreads, 0, 0, 64, setworkerthreads(workerthreads));
+
+/* numworkerthreads: returns the number of threads work may be spread across,
+ * including the calling thread
+ */
+int numworkerthreads()
+{
+    if(workerthreads)
+    {
+        return workerthreads;
+    }
+    return std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+}
+
+/* setworkerthreads: resizes the worker pool
+ *
+ * must not be called while any taskgroup has work outstanding; the new threads
+ * are started lazily on the next use of the pool
+ */
+void setworkerthreads(int numthreads)
+{
+    stopthreads();
+    workerthreads = std::clamp(numthreads, 0, 64);
+}
+
+taskgroup::taskgroup() : pending(0)
+{
+    std::lock_guard<std::mutex> lock(taskmutex);
+    if(!workersstarted)
+    {
+        startthreads();
+    }
+}
+
+taskgroup::~taskgroup()
+{
+    wait();
+}
+
+/* run: adds a task to this group
+ *
+ * if the pool has no workers, the task runs immediately on the calling thread
+ */
+void taskgroup::run(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(taskmutex);
+        if(!workers.empty())
+        {
+            pending.fetch_add(1, std::memory_order_acq_rel);
+            tasks.push_back({std::move(task), &pending});
+            //a waiter may be blocked with every worker busy, so let it pick up the new task too
+            if(numwaiting)
+            {
+                waitcond.notify_one();
+            }
+            taskcond.notify_one();
+            return;
+        }
+    }
+    runtask(task);
+}
+
+/* wait: blocks until every task added to this group has finished
+ *
+ * queued tasks (from any group) are run on the waiting thread in the meantime;
+ * once the queue is empty the thread sleeps until a task is queued or a group
+ * finishes
+ */
+void taskgroup::wait()
+{
+    while(pending.load(std::memory_order_acquire) > 0)
+    {
+        if(runonetask())
+        {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(taskmutex);
+        ++numwaiting;
+        waitcond.wait(lock, [this](){return pending.load(std::memory_order_acquire) <= 0 || !tasks.empty();});
+        --numwaiting;
+    }
+}
+
+/* inworkertask: returns true while the calling thread is running a task given to the pool
+ *
+ * tasks may run on any thread, including ones waiting on a group, so code which
+ * must only touch shared state (models, GL) when it is safe to do so should
+ * check this rather than which thread it is on
+ */
+bool inworkertask()
+{
+    return intask;
+}
+
+/* parallelfor: calls fun(i) for each i in [0, num), spread across the pool
+ *
+ * indices are handed out in contiguous chunks, one per thread
+ */
+void parallelfor(int num, const std::function<void(int)> &fun)
+{
+    taskgroup group;
+    int numchunks = std::min(numworkerthreads(), num);
+    for(int i = 0; i < numchunks; ++i)
+    {
+        int start = (num*i)/numchunks,
+            end = (num*(i+1))/numchunks;
+        group.run([&fun, start, end]()
+        {
+            for(int j = start; j < end; ++j)
+            {
+                fun(j);
+            }
+        });
+    }
+    group.wait();
+}
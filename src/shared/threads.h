@@ -0,0 +1,38 @@
+#ifndef THREADS_H_
+#define THREADS_H_
+
+#include <atomic>
+#include <functional>
+
+/* worker pool
+ *
+ * the engine keeps a single pool of worker threads, sized by the `workerthreads`
+ * variable (0 picks the number of hardware threads). Work is handed to the pool
+ * through a taskgroup; the thread which waits on a group helps run queued tasks
+ * while it waits, so tasks may themselves spawn and wait on further tasks
+ *
+ * with only one thread configured, tasks run inline when they are added, in
+ * exactly the order a serial implementation would run them
+ */
+
+class taskgroup
+{
+    public:
+        taskgroup();
+        ~taskgroup();
+
+        void run(std::function<void()> task);
+        void wait();
+
+    private:
+        std::atomic<int> pending;
+};
+
+extern int workerthreads;
+
+extern int numworkerthreads();
+extern void setworkerthreads(int numthreads);
+extern bool inworkertask();
+extern void parallelfor(int num, const std::function<void(int)> &fun);
+
+#endif
@@ -1,4 +1,7 @@
 #include "../libprimis-headers/cube.h"
+
+#include <atomic>
+
 #include "stream.h"
 
 #include "../engine/interface/console.h"
@@ -52,82 +55,52 @@ struct zipfile
     }
 };
 
-struct zipstream;
-
 struct ziparchive
 {
     char *name;
-    FILE *data;
+    mappedfile data;
     hashnameset<zipfile> files;
-    int openfiles;
-    zipstream *owner;
+    std::atomic<int> openfiles; //open streams and views, which keep the archive from being removed
 
-    ziparchive() : name(nullptr), data(nullptr), files(512), openfiles(0), owner(nullptr)
+    ziparchive() : name(nullptr), files(512), openfiles(0)
     {
     }
     ~ziparchive()
     {
         delete[] name;
-        if(data)
-        {
-            std::fclose(data);
-            data = nullptr;
-        }
     }
 };
 
-static bool findzipdirectory(FILE *f, zipdirectoryheader &hdr)
+static bool findzipdirectory(const uchar *data, size_t len, zipdirectoryheader &hdr)
 {
-    if(fseek(f, 0, SEEK_END) < 0)
+    if(len < Zip_DirectorySize)
     {
         return false;
     }
-    long offset = ftell(f);
-    if(offset < 0)
-    {
-        return false;
-    }
-    uchar buf[1024],
-          *src = nullptr;
-    long end = std::max(offset - 0xFFFFL - Zip_DirectorySize, 0L);
-    size_t len = 0;
     const uint signature = static_cast<uint>(Zip_DirectorySignature);
-    while(offset > end)
+    //the directory record is followed by a comment of at most 0xFFFF bytes
+    const uchar *start = len > 0xFFFF + Zip_DirectorySize ? &data[len - 0xFFFF - Zip_DirectorySize] : data,
+                *src = nullptr;
+    for(const uchar *search = &data[len - Zip_DirectorySize]; search >= start; search--)
     {
-        size_t carry = std::min(len, static_cast<size_t>(Zip_DirectorySize-1)), next = std::min(sizeof(buf) - carry, static_cast<size_t>(offset - end));
-        offset -= next;
-        std::memmove(&buf[next], buf, carry);
-        if(next + carry < Zip_DirectorySize || fseek(f, offset, SEEK_SET) < 0 || std::fread(buf, 1, next, f) != next)
-        {
-            return false;
-        }
-        len = next + carry;
-        uchar *search = &buf[next-1];
-        for(; search >= buf; search--)
-        {
-            if(*(uint *)search == signature)
-            {
-                break;
-            }
-        }
-        if(search >= buf)
+        if(*(const uint *)search == signature)
         {
             src = search;
             break;
         }
     }
-    if(!src || &buf[len] - src < Zip_DirectorySize)
+    if(!src)
     {
         return false;
     }
-    hdr.signature = *(uint *)src; src += 4; //src is incremented by the size of the field (int is 4 bytes)
-    hdr.disknumber = *(ushort *)src; src += 2;
-    hdr.directorydisk = *(ushort *)src; src += 2;
-    hdr.diskentries = *(ushort *)src; src += 2;
-    hdr.entries = *(ushort *)src; src += 2;
-    hdr.size = *(uint *)src; src += 4;
-    hdr.offset = *(uint *)src; src += 4;
-    hdr.commentlength = *(ushort *)src; src += 2;
+    hdr.signature = *(const uint *)src; src += 4; //src is incremented by the size of the field (int is 4 bytes)
+    hdr.disknumber = *(const ushort *)src; src += 2;
+    hdr.directorydisk = *(const ushort *)src; src += 2;
+    hdr.diskentries = *(const ushort *)src; src += 2;
+    hdr.entries = *(const ushort *)src; src += 2;
+    hdr.size = *(const uint *)src; src += 4;
+    hdr.offset = *(const uint *)src; src += 4;
+    hdr.commentlength = *(const ushort *)src; src += 2;
     if(hdr.signature != Zip_DirectorySignature || hdr.disknumber != hdr.directorydisk || hdr.diskentries != hdr.entries)
     {
         return false;
@@ -137,39 +110,70 @@ static bool findzipdirectory(FILE *f, zipdirectoryheader &hdr)
 
 VAR(debugzip, 0, 0, 1);
 
-static bool readzipdirectory(const char *archname, FILE *f, int entries, int offset, uint size, std::vector<zipfile> &files)
+static bool readlocalfileheader(const uchar *data, size_t len, ziplocalfileheader &h, uint offset)
 {
-    uchar *buf = new uchar[size],
-          *src = buf;
-    if(!buf || fseek(f, offset, SEEK_SET) < 0 || std::fread(buf, 1, size, f) != size)
+    if(offset > len || len - offset < Zip_LocalFileSize)
     {
-        delete[] buf;
         return false;
     }
+    const uchar *src = &data[offset];
+    h.signature = *(const uint *)src; src += 4; //src is incremented by the size of the field (int is 4 bytes e.g)
+    h.version = *(const ushort *)src; src += 2;
+    h.flags = *(const ushort *)src; src += 2;
+    h.compression = *(const ushort *)src; src += 2;
+    h.modtime = *(const ushort *)src; src += 2;
+    h.moddate = *(const ushort *)src; src += 2;
+    h.crc32 = *(const uint *)src; src += 4;
+    h.compressedsize = *(const uint *)src; src += 4;
+    h.uncompressedsize = *(const uint *)src; src += 4;
+    h.namelength = *(const ushort *)src; src += 2;
+    h.extralength = *(const ushort *)src; src += 2;
+    if(h.signature != Zip_LocalFileSignature)
+    {
+        return false;
+    }
+    // h.uncompressedsize or h.compressedsize may be zero - so don't validate
+    return true;
+}
+
+/* readzipdirectory: indexes the files listed in the central directory
+ *
+ * the local header of every file is read up front, so each entry records where
+ * its data starts and opening a file never has to touch the archive's headers
+ */
+static bool readzipdirectory(const char *archname, const uchar *data, size_t len, int entries, uint offset, uint size, std::vector<zipfile> &files)
+{
+    if(offset > len || len - offset < size)
+    {
+        return false;
+    }
+    const uchar *src = &data[offset],
+                *end = &data[offset + size];
+    files.reserve(entries); //entries are built in place, as zipfile owns its name
     for(int i = 0; i < entries; ++i)
     {
-        if(src + Zip_FileSize > &buf[size])
+        if(src + Zip_FileSize > end)
         {
             break;
         }
         zipfileheader hdr;
-        hdr.signature   = *(uint *)src; src += 4; //src is incremented by the size of the field (int is 4 bytes)
-        hdr.version     = *(ushort *)src; src += 2;
-        hdr.needversion = *(ushort *)src; src += 2;
-        hdr.flags       = *(ushort *)src; src += 2;
-        hdr.compression = *(ushort *)src; src += 2;
-        hdr.modtime     = *(ushort *)src; src += 2;
-        hdr.moddate     = *(ushort *)src; src += 2;
-        hdr.crc32            = *(uint *)src; src += 4;
-        hdr.compressedsize   = *(uint *)src; src += 4;
-        hdr.uncompressedsize = *(uint *)src; src += 4;
-        hdr.namelength       = *(ushort *)src; src += 2;
-        hdr.extralength      = *(ushort *)src; src += 2;
-        hdr.commentlength    = *(ushort *)src; src += 2;
-        hdr.disknumber       = *(ushort *)src; src += 2;
-        hdr.internalattribs  = *(ushort *)src; src += 2;
-        hdr.externalattribs  = *(uint *)src; src += 4;
-        hdr.offset           = *(uint *)src; src += 4;
+        hdr.signature   = *(const uint *)src; src += 4; //src is incremented by the size of the field (int is 4 bytes)
+        hdr.version     = *(const ushort *)src; src += 2;
+        hdr.needversion = *(const ushort *)src; src += 2;
+        hdr.flags       = *(const ushort *)src; src += 2;
+        hdr.compression = *(const ushort *)src; src += 2;
+        hdr.modtime     = *(const ushort *)src; src += 2;
+        hdr.moddate     = *(const ushort *)src; src += 2;
+        hdr.crc32            = *(const uint *)src; src += 4;
+        hdr.compressedsize   = *(const uint *)src; src += 4;
+        hdr.uncompressedsize = *(const uint *)src; src += 4;
+        hdr.namelength       = *(const ushort *)src; src += 2;
+        hdr.extralength      = *(const ushort *)src; src += 2;
+        hdr.commentlength    = *(const ushort *)src; src += 2;
+        hdr.disknumber       = *(const ushort *)src; src += 2;
+        hdr.internalattribs  = *(const ushort *)src; src += 2;
+        hdr.externalattribs  = *(const uint *)src; src += 4;
+        hdr.offset           = *(const uint *)src; src += 4;
         if(hdr.signature != Zip_FileSignature)
         {
             break;
@@ -179,21 +183,35 @@ static bool readzipdirectory(const char *archname, FILE *f, int entries, int off
             src += hdr.namelength + hdr.extralength + hdr.commentlength;
             continue;
         }
-        if(src + hdr.namelength > &buf[size])
+        if(src + hdr.namelength > end)
         {
             break;
         }
+        ziplocalfileheader local;
+        if(!readlocalfileheader(data, len, local, hdr.offset))
+        {
+            src += hdr.namelength + hdr.extralength + hdr.commentlength;
+            continue;
+        }
+        uint fileoffset = hdr.offset + Zip_LocalFileSize + local.namelength + local.extralength,
+             storedsize = hdr.compression ? hdr.compressedsize : hdr.uncompressedsize;
+        if(fileoffset > len || len - fileoffset < storedsize)
+        {
+            src += hdr.namelength + hdr.extralength + hdr.commentlength;
+            continue;
+        }
         string pname;
         int namelen = std::min(static_cast<int>(hdr.namelength), static_cast<int>(sizeof(pname)-1));
         std::memcpy(pname, src, namelen);
         pname[namelen] = '\0';
         path(pname);
         char *name = newstring(pname);
-        zipfile f;
+        files.emplace_back();
+        zipfile &f = files.back();
         f.name = name;
         f.header = hdr.offset;
+        f.offset = fileoffset;
         f.size = hdr.uncompressedsize;
-        files.push_back(f);
         f.compressedsize = hdr.compression ? hdr.compressedsize : 0;
         if(debugzip)
         {
@@ -201,37 +219,9 @@ static bool readzipdirectory(const char *archname, FILE *f, int entries, int off
         }
         src += hdr.namelength + hdr.extralength + hdr.commentlength;
     }
-    delete[] buf;
     return files.size() > 0;
 }
 
-static bool readlocalfileheader(FILE *f, ziplocalfileheader &h, uint offset)
-{
-    uchar buf[Zip_LocalFileSize];
-    if(fseek(f, offset, SEEK_SET) < 0 || std::fread(buf, 1, Zip_LocalFileSize, f) != Zip_LocalFileSize)
-    {
-        return false;
-    }
-    uchar *src = buf;
-    h.signature = *(uint *)src; src += 4; //src is incremented by the size of the field (int is 4 bytes e.g)
-    h.version = *(ushort *)src; src += 2;
-    h.flags = *(ushort *)src; src += 2;
-    h.compression = *(ushort *)src; src += 2;
-    h.modtime = *(ushort *)src; src += 2;
-    h.moddate = *(ushort *)src; src += 2;
-    h.crc32 = *(uint *)src; src += 4;
-    h.compressedsize = *(uint *)src; src += 4;
-    h.uncompressedsize = *(uint *)src; src += 4;
-    h.namelength = *(ushort *)src; src += 2;
-    h.extralength = *(ushort *)src; src += 2;
-    if(h.signature != Zip_LocalFileSignature)
-    {
-        return false;
-    }
-    // h.uncompressedsize or h.compressedsize may be zero - so don't validate
-    return true;
-}
-
 static std::vector<ziparchive *> archives;
 
 ziparchive *findzip(const char *name)
@@ -343,23 +333,22 @@ bool addzip(const char *name, const char *mount = nullptr, const char *strip = n
         return true;
     }
 
-    FILE *f = fopen(findfile(pname, "rb"), "rb");
-    if(!f)
+    ziparchive *arch = new ziparchive;
+    if(!arch->data.open(pname))
     {
         conoutf(Console_Error, "could not open file %s", pname);
+        delete arch;
         return false;
     }
     zipdirectoryheader h;
     std::vector<zipfile> files;
-    if(!findzipdirectory(f, h) || !readzipdirectory(pname, f, h.entries, h.offset, h.size, files))
+    if(!findzipdirectory(arch->data.data(), arch->data.size(), h) || !readzipdirectory(pname, arch->data.data(), arch->data.size(), h.entries, h.offset, h.size, files))
     {
         conoutf(Console_Error, "could not read directory in zip %s", pname);
-        std::fclose(f);
+        delete arch;
         return false;
     }
-    ziparchive *arch = new ziparchive;
     arch->name = newstring(pname);
-    arch->data = f;
     mountzip(*arch, files, mount, strip);
     archives.push_back(arch);
     conoutf("added zip %s", pname);
@@ -393,19 +382,22 @@ bool removezip(const char *name)
     return true;
 }
 
+/* zipstream: reads a file out of a mapped zip archive
+ *
+ * every stream keeps its own cursor into the archive's memory, so any number of
+ * streams may read from the same archive at once without contending for it;
+ * deflated files are inflated straight from the mapping
+ */
 struct zipstream : stream
 {
-    enum
-    {
-        Buffer_Size  = 16384
-    };
     ziparchive *arch;
     zipfile *info;
+    const uchar *data;
     z_stream zfile;
-    uchar *buf;
-    uint reading;
+    uint reading; //read position of stored files, ~0U once reading has stopped
     bool ended;
-    zipstream() : arch(nullptr), info(nullptr), buf(nullptr), reading(~0U), ended(false)
+
+    zipstream() : arch(nullptr), info(nullptr), data(nullptr), reading(~0U), ended(false)
     {
         zfile.zalloc = nullptr;
         zfile.zfree = nullptr;
@@ -417,43 +409,15 @@ struct zipstream : stream
     {
         close();
     }
-    void readbuf(uint size = Buffer_Size)
+
+    void rewind()
     {
-        if(!zfile.avail_in)
-        {
-            zfile.next_in = (Bytef *)buf;
-        }
-        size = std::min(size, static_cast<uint>(&buf[Buffer_Size] - &zfile.next_in[zfile.avail_in]));
-        if(arch->owner != this)
-        {
-            arch->owner = nullptr;
-            if(fseek(arch->data, reading, SEEK_SET) >= 0)
-            {
-                arch->owner = this;
-            }
-            else
-            {
-                return;
-            }
-        }
-        uint remaining = info->offset + info->compressedsize - reading,
-             n = arch->owner == this ? std::fread(zfile.next_in + zfile.avail_in, 1, std::min(size, remaining), arch->data) : 0U;
-        zfile.avail_in += n;
-        reading += n;
+        zfile.next_in = const_cast<Bytef *>(data);
+        zfile.avail_in = info->compressedsize;
     }
 
     bool open(ziparchive *a, zipfile *f)
     {
-        if(f->offset == ~0U)
-        {
-            ziplocalfileheader h;
-            a->owner = nullptr;
-            if(!readlocalfileheader(a->data, h, f->header))
-            {
-                return false;
-            }
-            f->offset = f->header + Zip_LocalFileSize + h.namelength + h.extralength;
-        }
         if(f->compressedsize && inflateInit2(&zfile, -MAX_WBITS) != Z_OK)
         {
             return false;
@@ -461,11 +425,12 @@ struct zipstream : stream
         a->openfiles++;
         arch = a;
         info = f;
-        reading = f->offset;
+        data = &a->data.data()[f->offset];
+        reading = 0;
         ended = false;
         if(f->compressedsize)
         {
-            buf = new uchar[Buffer_Size];
+            rewind();
         }
         return true;
     }
@@ -478,7 +443,7 @@ struct zipstream : stream
         }
         if(debugzip)
         {
-            conoutf(Console_Debug, info->compressedsize ? "%s: zfile.total_out %u, info->size %u" : "%s: reading %u, info->size %u", info->name, info->compressedsize ? static_cast<uint>(zfile.total_out) : reading - info->offset, info->size);
+            conoutf(Console_Debug, info->compressedsize ? "%s: zfile.total_out %u, info->size %u" : "%s: reading %u, info->size %u", info->name, info->compressedsize ? static_cast<uint>(zfile.total_out) : reading, info->size);
         }
         if(info->compressedsize)
         {
@@ -490,11 +455,8 @@ struct zipstream : stream
     void close()
     {
         stopreading();
-        delete[] buf;
-        buf = nullptr;
         if(arch)
         {
-            arch->owner = nullptr;
             arch->openfiles--;
             arch = nullptr;
         }
@@ -510,7 +472,7 @@ struct zipstream : stream
     }
     offset tell()
     {
-        return reading != ~0U ? (info->compressedsize ? zfile.total_out : reading - info->offset) : offset(-1);
+        return reading != ~0U ? (info->compressedsize ? zfile.total_out : reading) : offset(-1);
     }
     bool seek(offset pos, int whence)
     {
@@ -518,41 +480,6 @@ struct zipstream : stream
         {
             return false;
         }
-        if(!info->compressedsize)
-        {
-            switch(whence)
-            {
-                case SEEK_END:
-                {
-                    pos += info->offset + info->size;
-                    break;
-                }
-                case SEEK_CUR:
-                {
-                    pos += reading;
-                    break;
-                }
-                case SEEK_SET:
-                {
-                    pos += info->offset;
-                    break;
-                }
-                default:
-                {
-                    return false;
-                }
-            }
-            pos = std::clamp(pos, offset(info->offset), offset(info->offset + info->size));
-            arch->owner = nullptr;
-            if(fseek(arch->data, static_cast<int>(pos), SEEK_SET) < 0)
-            {
-                return false;
-            }
-            arch->owner = this;
-            reading = pos;
-            ended = false;
-            return true;
-        }
         switch(whence)
         {
             case SEEK_END:
@@ -562,7 +489,7 @@ struct zipstream : stream
             }
             case SEEK_CUR:
             {
-                pos += zfile.total_out;
+                pos += tell();
                 break;
             }
             case SEEK_SET:
@@ -574,14 +501,18 @@ struct zipstream : stream
                 return false;
             }
         }
+        if(!info->compressedsize)
+        {
+            reading = std::clamp(pos, offset(0), offset(info->size));
+            ended = false;
+            return true;
+        }
         if(pos >= (offset)info->size)
         {
-            reading = info->offset + info->compressedsize;
             zfile.next_in += zfile.avail_in;
             zfile.avail_in = 0;
             zfile.total_in = info->compressedsize;
             zfile.total_out = info->size;
-            arch->owner = nullptr;
             ended = false;
             return true;
         }
@@ -595,19 +526,8 @@ struct zipstream : stream
         }
         else
         {
-            if(zfile.next_in && zfile.total_in <= static_cast<uint>(zfile.next_in - buf))
-            {
-                zfile.avail_in += zfile.total_in;
-                zfile.next_in -= zfile.total_in;
-            }
-            else
-            {
-                arch->owner = nullptr;
-                zfile.avail_in = 0;
-                zfile.next_in = nullptr;
-                reading = info->offset;
-            }
             inflateReset(&zfile);
+            rewind();
         }
         uchar skip[512];
         while(pos > 0)
@@ -631,17 +551,8 @@ struct zipstream : stream
         }
         if(!info->compressedsize)
         {
-            if(arch->owner != this)
-            {
-                arch->owner = nullptr;
-                if(fseek(arch->data, reading, SEEK_SET) < 0)
-                {
-                    stopreading();
-                    return 0;
-                }
-                arch->owner = this;
-            }
-            size_t n = std::fread(buf, 1, std::min(len, static_cast<size_t>(info->size + info->offset - reading)), arch->data);
+            size_t n = std::min(len, static_cast<size_t>(info->size - reading));
+            std::memcpy(buf, &data[reading], n);
             reading += n;
             if(n < len)
             {
@@ -653,10 +564,6 @@ struct zipstream : stream
         zfile.avail_out = len;
         while(zfile.avail_out > 0)
         {
-            if(!zfile.avail_in)
-            {
-                readbuf(Buffer_Size);
-            }
             int err = inflate(&zfile, Z_NO_FLUSH);
             if(err != Z_OK)
             {
@@ -719,6 +626,45 @@ bool findzipfile(const char *name)
     return false;
 }
 
+/* openzipview: returns the contents of a file stored uncompressed in a zip
+ *
+ * the pointer refers directly to the mapped archive, which cannot be removed
+ * until the view is released with closezipview(); returns nullptr if the file
+ * is not in any zip, or if it is compressed
+ */
+const uchar *openzipview(const char *name, size_t &size)
+{
+    for(int i = archives.size(); --i >=0;) //note reverse iteration
+    {
+        ziparchive *arch = archives[i];
+        const zipfile *f = arch->files.access(name);
+        if(!f)
+        {
+            continue;
+        }
+        if(f->compressedsize)
+        {
+            return nullptr;
+        }
+        arch->openfiles++;
+        size = f->size;
+        return &arch->data.data()[f->offset];
+    }
+    return nullptr;
+}
+
+void closezipview(const uchar *view)
+{
+    for(ziparchive *arch : archives)
+    {
+        if(view >= arch->data.data() && view < &arch->data.data()[arch->data.size()])
+        {
+            arch->openfiles--;
+            return;
+        }
+    }
+}
+
 int listzipfiles(const char *dir, const char *ext, vector<char *> &files)
 {
     size_t extsize = ext ? std::strlen(ext)+1 : 0,